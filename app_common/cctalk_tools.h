@@ -11,19 +11,27 @@ License: BSD-3-Clause
 #include <QVector>
 #include <QPair>
 #include <QSerialPortInfo>
+#include <QCoreApplication>
+#include <memory>
 
 #include "cctalk/bill_validator_device.h"
 #include "cctalk/coin_acceptor_device.h"
+#include "cctalk/cctalk_bus.h"
+#include "cctalk/cctalk_bus_discovery.h"
+#include "cctalk/cctalk_log.h"
+#include "cctalk/cctalk_simulator.h"
+#include "cctalk/cctalk_wire_capture.h"
 #include "app_settings.h"
 
 
 
 
 /// Set up cctalk devices - coin acceptor and bill validator. This
-/// reads the config file to get the device settings.
+/// reads the config file to get the device settings. Devices found by bus
+/// discovery (if any) are used for the settings that are not configured.
 /// \return Error string or empty string if no error.
 inline QString setUpCctalkDevices(qtcc::BillValidatorDevice* bill_validator, qtcc::CoinAcceptorDevice* coin_acceptor,
-		const std::function<void(QString message)>& message_logger)
+		const std::function<void(QString message)>& message_logger, const qtcc::CcBusMap& discovered_buses = qtcc::CcBusMap())
 {
 	QStringList port_devices;
 	{
@@ -37,21 +45,41 @@ inline QString setUpCctalkDevices(qtcc::BillValidatorDevice* bill_validator, qtc
 		port_devices << QStringLiteral("/dev/ttyUSB0");
 	}
 
+	// Discovered devices replace the guesses below.
+	auto find_discovered = [&discovered_buses](qtcc::CcCategory category) {
+		for (const auto& devices : discovered_buses) {
+			for (const qtcc::CcDiscoveredDevice& device : devices) {
+				if (device.category == category) {
+					return device;
+				}
+			}
+		}
+		qtcc::CcDiscoveredDevice device;
+		device.address = ccCategoryGetDefaultAddress(category);
+		return device;
+	};
+	const qtcc::CcDiscoveredDevice discovered_bill = find_discovered(qtcc::CcCategory::BillValidator);
+	const qtcc::CcDiscoveredDevice discovered_coin = find_discovered(qtcc::CcCategory::CoinAcceptor);
+
 	// Note: If using multiple devices, all ccTalk options must be the same if the
 	// device name is the same; except for cctalk_address, which must be
 	// non-zero and must be different.
 
-	auto bill_device = AppSettings::getValue<QString>(QStringLiteral("bill_validator/serial_device_name"), port_devices.value(0));
+	auto bill_device = AppSettings::getValue<QString>(QStringLiteral("bill_validator/serial_device_name"),
+			discovered_bill.port_device.isEmpty() ? port_devices.value(0) : discovered_bill.port_device);
 	auto bill_cctalk_address = AppSettings::getValue<quint8>(QStringLiteral("bill_validator/cctalk_address"),
-			ccCategoryGetDefaultAddress(qtcc::CcCategory::BillValidator));
+			discovered_bill.address);
 	bool bill_des_encrypted = AppSettings::getValue<bool>(QStringLiteral("bill_validator/cctalk_des_encrypted"), false);
 	bool bill_checksum_16bit = AppSettings::getValue<bool>(QStringLiteral("bill_validator/cctalk_checksum_16bit"), false);
+	auto bill_baud_rate = AppSettings::getValue<qint32>(QStringLiteral("bill_validator/cctalk_baud_rate"), 0);
 
-	auto coin_device = AppSettings::getValue<QString>(QStringLiteral("coin_acceptor/serial_device_name"), port_devices.value(1));
+	auto coin_device = AppSettings::getValue<QString>(QStringLiteral("coin_acceptor/serial_device_name"),
+			discovered_coin.port_device.isEmpty() ? port_devices.value(1) : discovered_coin.port_device);
 	auto coin_cctalk_address = AppSettings::getValue<quint8>(QStringLiteral("coin_acceptor/cctalk_address"),
-			ccCategoryGetDefaultAddress(qtcc::CcCategory::CoinAcceptor));
+			discovered_coin.address);
 	bool coin_des_encrypted = AppSettings::getValue<bool>(QStringLiteral("coin_acceptor/cctalk_des_encrypted"), false);
 	bool coin_checksum_16bit = AppSettings::getValue<bool>(QStringLiteral("coin_acceptor/cctalk_checksum_16bit"), false);
+	auto coin_baud_rate = AppSettings::getValue<qint32>(QStringLiteral("coin_acceptor/cctalk_baud_rate"), 0);
 
 	if (!bill_device.isEmpty() && bill_device == coin_device) {
 		if (bill_cctalk_address == 0x00 || coin_cctalk_address == 0x00) {
@@ -63,9 +91,65 @@ inline QString setUpCctalkDevices(qtcc::BillValidatorDevice* bill_validator, qtc
 		if (bill_checksum_16bit != coin_checksum_16bit || bill_des_encrypted != coin_des_encrypted) {
 			return QObject::tr("! ccTalk or serial options are different for devices in a multi-device serial network, cannot continue.");
 		}
-		if (bill_checksum_16bit || coin_checksum_16bit) {
-			return QObject::tr("! 16-bit checksum enabled for at least one ccTalk device in a multi-device serial network, cannot continue.");
+	}
+
+	// Non-blocking serial workers don't tie up a thread while waiting for responses.
+	const auto worker_mode = AppSettings::getValue<bool>(QStringLiteral("cctalk/serial_worker_async"), false)
+			? qtcc::SerialWorkerMode::Async : qtcc::SerialWorkerMode::Blocking;
+	// The Linux-native transport lowers the latency of USB serial adapters.
+	auto transport_kind = AppSettings::getValue<bool>(QStringLiteral("cctalk/serial_transport_native"), false)
+			? qtcc::SerialTransportKind::LinuxNative : qtcc::SerialTransportKind::QtSerialPort;
+	if (!qtcc::SerialTransport::isSupported(transport_kind)) {
+		message_logger(QObject::tr("! Native serial transport is not supported on this platform, using QSerialPort."));
+	}
+
+	// Simulated devices answer on the configured port names, no hardware needed.
+	if (AppSettings::getValue<bool>(QStringLiteral("cctalk/simulator"), false)) {
+		transport_kind = qtcc::SerialTransportKind::Simulator;
+
+		qtcc::CcSimulatorOptions options;
+		options.emulate_line_speed = !AppSettings::getValue<bool>(QStringLiteral("cctalk/simulator_infinite_baud"), false);
+		const int credit_count = AppSettings::getValue<int>(QStringLiteral("cctalk/simulator_credit_count"), 5);
+
+		auto bill_port = qtcc::CcSimulator::addPort(bill_device, options);
+		auto coin_port = (coin_device == bill_device ? bill_port : qtcc::CcSimulator::addPort(coin_device, options));
+		if (bill_validator) {
+			qtcc::CcSimulatedDeviceInfo info;
+			info.category = qtcc::CcCategory::BillValidator;
+			info.address = bill_cctalk_address;
+			info.checksum_16bit = bill_checksum_16bit;
+			bill_port->addDevice(info)->scheduleCredits(5000, 1, credit_count, 2000);
 		}
+		if (coin_acceptor) {
+			qtcc::CcSimulatedDeviceInfo info;
+			info.category = qtcc::CcCategory::CoinAcceptor;
+			info.address = coin_cctalk_address;
+			info.checksum_16bit = coin_checksum_16bit;
+			coin_port->addDevice(info)->scheduleCredits(5000, 1, credit_count, 300);
+		}
+		message_logger(QObject::tr("* Using simulated devices."));
+	}
+	const bool custom_bus = worker_mode != qtcc::SerialWorkerMode::Blocking || transport_kind != qtcc::SerialTransportKind::QtSerialPort;
+
+	// Devices on the same serial line share a single bus (port and worker thread).
+	if (bill_validator && coin_acceptor && !bill_device.isEmpty() && bill_device == coin_device) {
+		auto bus = std::make_shared<qtcc::CctalkBus>(worker_mode, nullptr, transport_kind);
+		bill_validator->getLinkController().setBus(bus);
+		coin_acceptor->getLinkController().setBus(bus);
+	} else if (custom_bus) {
+		if (bill_validator) {
+			bill_validator->getLinkController().setBus(std::make_shared<qtcc::CctalkBus>(worker_mode, nullptr, transport_kind));
+		}
+		if (coin_acceptor) {
+			coin_acceptor->getLinkController().setBus(std::make_shared<qtcc::CctalkBus>(worker_mode, nullptr, transport_kind));
+		}
+	}
+
+	// Cached identification data speeds up re-initialization of known devices.
+	std::shared_ptr<qtcc::CcIdentificationCache> identification_cache;
+	if (AppSettings::getValue<bool>(QStringLiteral("cctalk/identification_cache"), false)) {
+		identification_cache = std::make_shared<qtcc::CcIdentificationCache>(
+				AppSettings::getUserSettingsDirectory() + QStringLiteral("/identification_cache.ini"));
 	}
 
 	bool show_full_response = AppSettings::getValue<bool>("cctalk/show_full_response", false);
@@ -74,6 +158,41 @@ inline QString setUpCctalkDevices(qtcc::BillValidatorDevice* bill_validator, qtc
 	bool show_cctalk_request = AppSettings::getValue<bool>("cctalk/show_cctalk_request", true);
 	bool show_cctalk_response = AppSettings::getValue<bool>("cctalk/show_cctalk_response", true);
 
+	// Requests, responses and event tables are recorded without formatting and rendered
+	// in batches in the GUI thread.
+	std::shared_ptr<qtcc::CcLogPipeline> log_pipeline;
+	if (AppSettings::getValue<bool>(QStringLiteral("cctalk/structured_log"), false)) {
+		log_pipeline = std::make_shared<qtcc::CcLogPipeline>();
+		log_pipeline->setFilter(qtcc::CcLogLevel::Debug, quint32(qtcc::CcLogCategory::EventTable)
+				| (show_cctalk_request ? quint32(qtcc::CcLogCategory::Request) : 0)
+				| (show_cctalk_response ? quint32(qtcc::CcLogCategory::Response) : 0));
+		std::weak_ptr<qtcc::CcLogPipeline> weak_pipeline = log_pipeline;
+		log_pipeline->setDataAvailableCallback([weak_pipeline, message_logger]() {
+			QMetaObject::invokeMethod(QCoreApplication::instance(), [weak_pipeline, message_logger]() {
+				if (auto pipeline = weak_pipeline.lock()) {
+					const QVector<qtcc::CcLogRecord> records = pipeline->drain();
+					for (const auto& record : records) {
+						message_logger(qtcc::CcLogPipeline::formatRecord(record));
+					}
+				}
+			}, Qt::QueuedConnection);
+		});
+	}
+
+	// Binary capture of the serial traffic, for cctalk_replay. Shared by both devices.
+	std::shared_ptr<qtcc::CcWireCapture> wire_capture;
+	const QString wire_capture_file = AppSettings::getValue<QString>(QStringLiteral("cctalk/wire_capture_file"), QString());
+	if (!wire_capture_file.isEmpty()) {
+		wire_capture = std::make_shared<qtcc::CcWireCapture>();
+		QString capture_error;
+		if (wire_capture->open(wire_capture_file, capture_error)) {
+			message_logger(QObject::tr("* Recording the serial traffic to %1").arg(wire_capture_file));
+		} else {
+			message_logger(capture_error);
+			wire_capture.reset();
+		}
+	}
+
 	// Bill validator
 	if (bill_validator) {
 		if (bill_device.isEmpty()) {
@@ -83,6 +202,14 @@ inline QString setUpCctalkDevices(qtcc::BillValidatorDevice* bill_validator, qtc
 		bill_validator->getLinkController().setCcTalkOptions(bill_device, bill_cctalk_address, bill_checksum_16bit, bill_des_encrypted);
 		bill_validator->getLinkController().setLoggingOptions(show_full_response, show_serial_request, show_serial_response,
 				show_cctalk_request, show_cctalk_response);
+		bill_validator->getLinkController().setLogPipeline(log_pipeline);
+		if (wire_capture) {
+			bill_validator->getLinkController().getBus()->setWireCapture(wire_capture);
+		}
+
+		// Negotiated using SwitchBaudRate during initialization, if supported by the device.
+		bill_validator->setPreferredBaudRate(bill_baud_rate);
+		bill_validator->setIdentificationCache(identification_cache);
 
 		bill_validator->setBillValidationFunction([]([[maybe_unused]] quint8 bill_id, [[maybe_unused]] const qtcc::CcIdentifier& identifier) {
 			return true;  // accept all supported bills
@@ -100,6 +227,12 @@ inline QString setUpCctalkDevices(qtcc::BillValidatorDevice* bill_validator, qtc
 		coin_acceptor->getLinkController().setCcTalkOptions(coin_device, coin_cctalk_address, coin_checksum_16bit, coin_des_encrypted);
 		coin_acceptor->getLinkController().setLoggingOptions(show_full_response, show_serial_request, show_serial_response,
 				show_cctalk_request, show_cctalk_response);
+		coin_acceptor->getLinkController().setLogPipeline(log_pipeline);
+		if (wire_capture) {
+			coin_acceptor->getLinkController().getBus()->setWireCapture(wire_capture);
+		}
+		coin_acceptor->setPreferredBaudRate(coin_baud_rate);
+		coin_acceptor->setIdentificationCache(identification_cache);
 
 		QObject::connect(coin_acceptor, &qtcc::CctalkDevice::logMessage, message_logger);
 	}
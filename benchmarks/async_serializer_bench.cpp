@@ -0,0 +1,105 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <cstdio>
+#include <functional>
+#include <memory>
+
+#include "cctalk/helpers/async_serializer.h"
+#include "legacy_async_serializer.h"
+
+
+/**
+\file
+AsyncSerializer stepping benchmark: steps per second of the current AsyncSerializer
+versus the original implementation (LegacyAsyncSerializer).
+
+"sync" steps call continueSequence() before returning (e.g. skipped initialization steps),
+"async" steps call it from a queued callback, like a ccTalk reply.
+*/
+
+
+namespace {
+
+
+	/// Run \c sequence_count sequences of \c step_count steps one after another, then call \c done.
+	template<typename Serializer>
+	void runSequences(int sequence_count, int step_count, bool async_steps, const std::function<void()>& done)
+	{
+		if (sequence_count == 0) {
+			done();
+			return;
+		}
+
+		auto serializer = new Serializer(  // auto-deleted
+			[=]([[maybe_unused]] Serializer* finished_serializer) {
+				// Start the next sequence from the event loop, to avoid recursion.
+				QMetaObject::invokeMethod(QCoreApplication::instance(), [=]() {
+					runSequences<Serializer>(sequence_count - 1, step_count, async_steps, done);
+				}, Qt::QueuedConnection);
+			}
+		);
+
+		for (int i = 0; i < step_count; ++i) {
+			serializer->add([=](Serializer* running_serializer) {
+				if (async_steps) {
+					QMetaObject::invokeMethod(QCoreApplication::instance(), [=]() {
+						running_serializer->continueSequence(true);
+					}, Qt::QueuedConnection);
+				} else {
+					running_serializer->continueSequence(true);
+				}
+			});
+		}
+
+		serializer->start();
+	}
+
+
+
+	/// Run a benchmark and print its result, then call \c done.
+	template<typename Serializer>
+	void runBenchmark(const char* name, bool async_steps, const std::function<void()>& done)
+	{
+		const int sequence_count = 1000;
+		const int step_count = 200;
+
+		auto timer = std::make_shared<QElapsedTimer>();
+		timer->start();
+
+		runSequences<Serializer>(sequence_count, step_count, async_steps, [=]() {
+			const double sec = double(timer->nsecsElapsed()) / 1e9;
+			const double steps = double(sequence_count) * step_count;
+			std::printf("%-10s %-6s %12.0f steps/s %10.1f ns/step\n", name, async_steps ? "async" : "sync",
+					steps / sec, sec * 1e9 / steps);
+			done();
+		});
+	}
+
+
+}
+
+
+
+int main(int argc, char* argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	QMetaObject::invokeMethod(&app, [&]() {
+		runBenchmark<LegacyAsyncSerializer>("legacy", false, [&]() {
+			runBenchmark<AsyncSerializer>("current", false, [&]() {
+				runBenchmark<LegacyAsyncSerializer>("legacy", true, [&]() {
+					runBenchmark<AsyncSerializer>("current", true, [&]() {
+						app.quit();
+					});
+				});
+			});
+		});
+	}, Qt::QueuedConnection);
+
+	return QCoreApplication::exec();
+}
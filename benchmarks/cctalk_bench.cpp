@@ -0,0 +1,875 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTimer>
+#include <QVector>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "cctalk/bill_validator_device.h"
+#include "cctalk/cctalk_bus.h"
+#include "cctalk/cctalk_device.h"
+#include "cctalk/cctalk_device_manager.h"
+#include "cctalk/cctalk_frame.h"
+#include "cctalk/cctalk_link_controller.h"
+#include "cctalk/cctalk_simulator.h"
+#include "cctalk/coin_acceptor_device.h"
+#include "cctalk/helpers/async_serializer.h"
+
+
+/**
+\file
+ccTalk protocol stack benchmark, running against the in-process simulator
+(SerialTransportKind::Simulator), so no hardware is needed.
+
+Measured:
+- per-frame cost of building and verifying a frame, per checksum mode and frame size;
+- frame throughput through ccRequest() -> serial worker -> onResponseReceive() -> callback;
+- latency percentiles of one poll iteration (event request + event log processing);
+- time from initialize() to NormalRejecting state, per device category;
+- heap allocations per poll iteration (all threads);
+- polling throughput with several devices per bus and several buses per process.
+
+Each result is printed to stdout as one JSON object per line ("JSON Lines"), with
+a "benchmark" key naming the measurement. Progress messages go to stderr.
+
+Before the benchmarks, building and parsing frames is checked not to allocate (see
+checkFrameAllocations()), and neither is the framing layer along warmed-up poll round trips,
+in both worker modes (see checkPollAllocations()). If any of them allocates, the program exits
+with status 1.
+"Infinite baud" results measure the library overhead; "9600" results include the
+emulated line transmission time and device latency.
+*/
+
+
+namespace {
+
+	/// Number of heap allocations since the program start (all threads)
+	std::atomic<quint64> s_allocation_count = {0};
+
+	/// Number of heap allocations made by the framing layer (in a CcFramingScope, all threads)
+	std::atomic<quint64> s_framing_allocation_count = {0};
+
+}
+
+
+void* operator new(std::size_t size)
+{
+	s_allocation_count.fetch_add(1, std::memory_order_relaxed);
+	if (qtcc::CcFramingScope::isActive()) {
+		s_framing_allocation_count.fetch_add(1, std::memory_order_relaxed);
+	}
+	if (void* ptr = std::malloc(size > 0 ? size : 1)) {
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, [[maybe_unused]] std::size_t size) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, [[maybe_unused]] std::size_t size) noexcept
+{
+	std::free(ptr);
+}
+
+
+
+namespace {
+
+
+	/// Maximum time for a device to reach NormalRejecting state
+	constexpr int max_initialization_msec = 30000;
+
+	/// Poll round trips before counting the allocations (lazily allocated buffers, hash tables, timers)
+	constexpr int allocation_check_warmup_count = 100;
+
+
+	/// Benchmark sizes, reduced with --quick
+	struct BenchOptions {
+		int codec_count = 1000000;  ///< Frames per build / verify run
+		int allocation_poll_count = 2000;  ///< Poll round trips per allocation check
+		int frame_count = 20000;  ///< Frames per throughput run
+		int pipeline_depth = 16;  ///< Requests in flight in the pipelined throughput run
+		int poll_count = 5000;  ///< Poll iterations per latency run (infinite baud)
+		int slow_poll_count = 500;  ///< Poll iterations per latency run (9600 baud)
+		int init_count = 5;  ///< Initializations per category
+		int scaling_msec = 2000;  ///< Measurement window of the scaling runs
+	};
+
+
+	/// Device with the polling internals exposed
+	template<typename Base>
+	class BenchDevice : public Base {
+		public:
+			using Base::stopTimer;
+			using Base::requestBufferedCreditEvents;
+			using Base::processCreditEventLog;
+	};
+
+
+	/// Print a result line
+	void printResult(const QString& benchmark, QJsonObject result)
+	{
+		result.insert(QStringLiteral("benchmark"), benchmark);
+		std::printf("%s\n", QJsonDocument(result).toJson(QJsonDocument::Compact).constData());
+		std::fflush(stdout);
+	}
+
+
+	/// Print a progress message
+	void printProgress(const QString& msg)
+	{
+		std::fprintf(stderr, "%s\n", qPrintable(msg));
+	}
+
+
+	/// Get the latency percentiles (in microseconds) of \c samples_nsec
+	QJsonObject getPercentiles(QVector<qint64> samples_nsec)
+	{
+		QJsonObject result;
+		if (samples_nsec.isEmpty()) {
+			return result;
+		}
+		std::sort(samples_nsec.begin(), samples_nsec.end());
+		auto percentile = [&](double p) {
+			const int index = std::min(int(p * samples_nsec.size()), samples_nsec.size() - 1);
+			return double(samples_nsec.at(index)) / 1000.;
+		};
+		result.insert(QStringLiteral("p50_usec"), percentile(0.50));
+		result.insert(QStringLiteral("p90_usec"), percentile(0.90));
+		result.insert(QStringLiteral("p99_usec"), percentile(0.99));
+		result.insert(QStringLiteral("max_usec"), double(samples_nsec.last()) / 1000.);
+		return result;
+	}
+
+
+	/// Register a simulated port named \c port_name with \c device_count devices of \c category
+	/// at consecutive addresses, starting from the category default.
+	std::shared_ptr<qtcc::CcSimulatedPort> addSimulatedPort(const QString& port_name, qtcc::CcCategory category,
+			int device_count, bool infinite_baud, quint8 polling_interval_msec = 100)
+	{
+		qtcc::CcSimulatorOptions options;
+		options.emulate_line_speed = !infinite_baud;
+		options.random_seed = 1;
+		auto port = qtcc::CcSimulator::addPort(port_name, options);
+
+		for (int i = 0; i < device_count; ++i) {
+			qtcc::CcSimulatedDeviceInfo info;
+			info.category = category;
+			info.address = quint8(qtcc::ccCategoryGetDefaultAddress(category) + i);
+			info.polling_interval_msec = polling_interval_msec;
+			port->addDevice(info);
+		}
+		return port;
+	}
+
+
+	/// Payload of \c size bytes for the frame benchmarks
+	QByteArray makePayload(int size)
+	{
+		QByteArray payload(size, Qt::Uninitialized);
+		for (int i = 0; i < size; ++i) {
+			payload[i] = char(i * 7 + 1);
+		}
+		return payload;
+	}
+
+
+	/// Get the name of a checksum policy for the results
+	template<typename Checksum>
+	QString getChecksumName()
+	{
+		return std::is_same_v<Checksum, qtcc::CcChecksum16> ? QStringLiteral("crc16") : QStringLiteral("checksum8");
+	}
+
+
+	/// Get the name of a device category for the results
+	QString getCategoryName(qtcc::CcCategory category)
+	{
+		return category == qtcc::CcCategory::BillValidator ? QStringLiteral("bill_validator") : QStringLiteral("coin_acceptor");
+	}
+
+
+
+	/// Build, verify and parse frames of both checksum modes, counting the heap allocations.
+	/// \return false if anything was allocated.
+	bool checkFrameAllocations()
+	{
+		// Prepared in advance, the QByteArray allocates.
+		const QByteArray payload = makePayload(qtcc::CcFrame::max_data_size);
+
+		int valid_count = 0;
+		const quint64 allocations_before = s_allocation_count.load();
+		for (int size : {0, 2, qtcc::CcFrame::max_data_size}) {
+			const qtcc::CcByteView data = qtcc::CcByteView(payload).mid(0, size);
+
+			const qtcc::CcFrame frame8 = qtcc::ccBuildFrame<qtcc::CcChecksum8>(2, 1, 254, data);
+			const qtcc::CcFrame frame16 = qtcc::ccBuildFrame<qtcc::CcChecksum16>(2, 1, 254, data);
+
+			// Parse a copy, the way the received frames are parsed
+			for (const qtcc::CcFrame* built : {&frame8, &frame16}) {
+				qtcc::CcFrame received;
+				received.assign(built->getBytes());
+				const bool verified = (built == &frame8 ? received.verify<qtcc::CcChecksum8>() : received.verify<qtcc::CcChecksum16>());
+				if (verified && received.hasValidSize() && received.getHeader() == 254
+						&& received.getDestinationAddress() == 2 && received.getData().size() == size
+						&& std::equal(data.begin(), data.end(), received.getData().begin())) {
+					++valid_count;
+				}
+			}
+		}
+		const quint64 allocations = s_allocation_count.load() - allocations_before;
+
+		QJsonObject result;
+		result.insert(QStringLiteral("allocations"), double(allocations));
+		result.insert(QStringLiteral("valid_frames"), valid_count);
+		result.insert(QStringLiteral("passed"), allocations == 0 && valid_count == 6);
+		printResult(QStringLiteral("frame_allocation_check"), result);
+
+		if (allocations != 0) {
+			printProgress(QStringLiteral("Building or parsing a frame allocated %1 times").arg(allocations));
+		}
+		if (valid_count != 6) {
+			printProgress(QStringLiteral("Building or parsing a frame gave invalid results"));
+		}
+		return allocations == 0 && valid_count == 6;
+	}
+
+
+
+	/// Per-frame cost of building and verifying a frame with \c data_size payload bytes
+	template<typename Checksum>
+	void benchFrameCodec(const BenchOptions& bench_options, int data_size)
+	{
+		printProgress(QStringLiteral("Frame build / verify, %1, %2 data bytes").arg(getChecksumName<Checksum>()).arg(data_size));
+
+		const QByteArray payload = makePayload(data_size);
+		const qtcc::CcByteView data(payload);
+		const int count = bench_options.codec_count;
+
+		// The header changes, so that the compiler can't hoist the checksum out of the loop.
+		quint64 sink = 0;
+		QElapsedTimer timer;
+		timer.start();
+		for (int i = 0; i < count; ++i) {
+			const qtcc::CcFrame frame = qtcc::ccBuildFrame<Checksum>(2, 1, quint8(i), data);
+			sink += quint8(frame.data()[frame.size() - 1]);
+		}
+		const qint64 build_nsec = timer.nsecsElapsed();
+
+		std::vector<qtcc::CcFrame> frames;
+		frames.reserve(256);
+		for (int header = 0; header < 256; ++header) {
+			frames.push_back(qtcc::ccBuildFrame<Checksum>(2, 1, quint8(header), data));
+		}
+		int valid_count = 0;
+		timer.start();
+		for (int i = 0; i < count; ++i) {
+			valid_count += int(qtcc::ccVerifyFrame<Checksum>(frames[std::size_t(i & 0xff)]));
+		}
+		const qint64 verify_nsec = timer.nsecsElapsed();
+
+		QJsonObject result;
+		result.insert(QStringLiteral("checksum"), getChecksumName<Checksum>());
+		result.insert(QStringLiteral("data_size"), data_size);
+		result.insert(QStringLiteral("frame_size"), qtcc::cc_frame_overhead_size + data_size);
+		result.insert(QStringLiteral("frames"), count);
+		result.insert(QStringLiteral("build_nsec_per_frame"), double(build_nsec) / count);
+		result.insert(QStringLiteral("verify_nsec_per_frame"), double(verify_nsec) / count);
+		result.insert(QStringLiteral("verify_failures"), count - valid_count);
+		result.insert(QStringLiteral("sink"), double(sink & 0xff));  // keeps the build loop
+		printResult(QStringLiteral("frame_codec"), result);
+	}
+
+
+
+	/// Sends \c command requests with at most \c depth of them in flight.
+	/// Owned by the pending request callbacks.
+	class FrameSender : public std::enable_shared_from_this<FrameSender> {
+		public:
+			FrameSender(qtcc::CctalkLinkController* controller, qtcc::CcHeader command, int count, int depth,
+					std::function<void(int error_count)> done)
+				: controller_(controller), command_(command), remaining_(count), depth_(depth), done_(std::move(done))
+			{ }
+
+			/// Send requests until \c depth of them are in flight
+			void sendNext()
+			{
+				while (remaining_ > 0 && in_flight_ < depth_) {
+					--remaining_;
+					const quint64 request_id = controller_->ccRequest(command_, QByteArray());
+					if (request_id == 0) {  // the callback is not called
+						++errors_;
+						continue;
+					}
+					++in_flight_;
+					auto self = shared_from_this();
+					controller_->executeOnReturn(request_id, [self]([[maybe_unused]] quint64 returned_request_id,
+							const QString& error_msg, [[maybe_unused]] const QByteArray& command_data) {
+						self->onReturn(error_msg);
+					});
+				}
+				if (remaining_ == 0 && in_flight_ == 0 && done_) {
+					auto done = std::move(done_);
+					done_ = nullptr;
+					done(errors_);
+				}
+			}
+
+		private:
+			void onReturn(const QString& error_msg)
+			{
+				--in_flight_;
+				if (!error_msg.isEmpty()) {
+					++errors_;
+				}
+				sendNext();
+			}
+
+			qtcc::CctalkLinkController* controller_ = nullptr;
+			qtcc::CcHeader command_ = qtcc::CcHeader::SimplePoll;
+			int remaining_ = 0;  ///< Not sent yet
+			int in_flight_ = 0;
+			int depth_ = 1;
+			int errors_ = 0;
+			std::function<void(int error_count)> done_;
+	};
+
+
+
+	/// Frame throughput through the link controller and the serial worker
+	void benchFrameThroughput(const BenchOptions& bench_options, qtcc::SerialWorkerMode mode, int depth,
+			const std::function<void()>& done)
+	{
+		const QString port_name = QStringLiteral("bench_frames");
+		addSimulatedPort(port_name, qtcc::CcCategory::CoinAcceptor, 1, true);
+
+		auto controller = std::make_shared<qtcc::CctalkLinkController>();
+		controller->setBus(std::make_shared<qtcc::CctalkBus>(mode, nullptr, qtcc::SerialTransportKind::Simulator));
+		controller->setCcTalkOptions(port_name, qtcc::ccCategoryGetDefaultAddress(qtcc::CcCategory::CoinAcceptor), false, false);
+		controller->setLoggingOptions(false, false, false, false, false);
+
+		const QString mode_name = (mode == qtcc::SerialWorkerMode::Async ? QStringLiteral("async") : QStringLiteral("blocking"));
+		printProgress(QStringLiteral("Frame throughput, %1 mode, %2 in flight").arg(mode_name).arg(depth));
+
+		controller->openPort([=](const QString& open_error_msg) {
+			if (!open_error_msg.isEmpty()) {
+				printProgress(open_error_msg);
+				done();
+				return;
+			}
+			const quint64 allocations_before = s_allocation_count.load();
+			auto timer = std::make_shared<QElapsedTimer>();
+			timer->start();
+
+			auto sender = std::make_shared<FrameSender>(controller.get(), qtcc::CcHeader::SimplePoll, bench_options.frame_count, depth,
+					[=](int error_count) {
+				const double sec = double(timer->nsecsElapsed()) / 1e9;
+				const quint64 allocations = s_allocation_count.load() - allocations_before;
+
+				QJsonObject result;
+				result.insert(QStringLiteral("mode"), mode_name);
+				result.insert(QStringLiteral("in_flight"), depth);
+				result.insert(QStringLiteral("frames"), bench_options.frame_count);
+				result.insert(QStringLiteral("errors"), error_count);
+				result.insert(QStringLiteral("frames_per_sec"), double(bench_options.frame_count) / sec);
+				result.insert(QStringLiteral("usec_per_frame"), sec * 1e6 / bench_options.frame_count);
+				result.insert(QStringLiteral("allocations_per_frame"), double(allocations) / bench_options.frame_count);
+				printResult(QStringLiteral("frame_throughput"), result);
+
+				// Don't destroy the controller from its own callback.
+				QMetaObject::invokeMethod(QCoreApplication::instance(), [=]() {
+					controller->closePort();
+					qtcc::CcSimulator::removePort(port_name);
+					done();
+				}, Qt::QueuedConnection);
+			});
+			sender->sendNext();
+		});
+	}
+
+
+
+	/// Run warmed-up poll round trips (ccRequest() -> serial worker -> CcFrameAssembler ->
+	/// onResponseReceive() -> callback) against a simulated coin acceptor, counting the heap
+	/// allocations made by the framing layer. The rest of the round trip (queued signals,
+	/// timers, request tables) is reported, but allowed to allocate.
+	/// \c done is called with false if the framing layer allocated or a poll failed.
+	void checkPollAllocations(const BenchOptions& bench_options, qtcc::SerialWorkerMode mode,
+			const std::function<void(bool passed)>& done)
+	{
+		const QString port_name = QStringLiteral("bench_allocations");
+		addSimulatedPort(port_name, qtcc::CcCategory::CoinAcceptor, 1, true);
+
+		auto controller = std::make_shared<qtcc::CctalkLinkController>();
+		controller->setBus(std::make_shared<qtcc::CctalkBus>(mode, nullptr, qtcc::SerialTransportKind::Simulator));
+		controller->setCcTalkOptions(port_name, qtcc::ccCategoryGetDefaultAddress(qtcc::CcCategory::CoinAcceptor), false, false);
+		controller->setLoggingOptions(false, false, false, false, false);
+
+		const QString mode_name = (mode == qtcc::SerialWorkerMode::Async ? QStringLiteral("async") : QStringLiteral("blocking"));
+		printProgress(QStringLiteral("Poll allocation check, %1 mode").arg(mode_name));
+
+		auto finish = [=](bool passed) {
+			// Don't destroy the controller from its own callback.
+			QMetaObject::invokeMethod(QCoreApplication::instance(), [=]() {
+				controller->closePort();
+				qtcc::CcSimulator::removePort(port_name);
+				done(passed);
+			}, Qt::QueuedConnection);
+		};
+
+		controller->openPort([=](const QString& open_error_msg) {
+			if (!open_error_msg.isEmpty()) {
+				printProgress(open_error_msg);
+				finish(false);
+				return;
+			}
+
+			auto measure = [=]() {
+				const int poll_count = bench_options.allocation_poll_count;
+				const quint64 framing_allocations_before = s_framing_allocation_count.load();
+				const quint64 allocations_before = s_allocation_count.load();
+
+				auto sender = std::make_shared<FrameSender>(controller.get(), qtcc::CcHeader::ReadBufferedCredit, poll_count, 1,
+						[=](int error_count) {
+					const quint64 framing_allocations = s_framing_allocation_count.load() - framing_allocations_before;
+					const quint64 allocations = s_allocation_count.load() - allocations_before;
+					const bool passed = (framing_allocations == 0 && error_count == 0);
+
+					QJsonObject result;
+					result.insert(QStringLiteral("mode"), mode_name);
+					result.insert(QStringLiteral("polls"), poll_count);
+					result.insert(QStringLiteral("errors"), error_count);
+					result.insert(QStringLiteral("framing_allocations"), double(framing_allocations));
+					result.insert(QStringLiteral("allocations_per_poll"), double(allocations) / poll_count);
+					result.insert(QStringLiteral("passed"), passed);
+					printResult(QStringLiteral("poll_allocation_check"), result);
+
+					if (framing_allocations != 0) {
+						printProgress(QStringLiteral("The framing layer allocated %1 times in %2 polls").arg(framing_allocations).arg(poll_count));
+					}
+					if (error_count != 0) {
+						printProgress(QStringLiteral("%1 of %2 polls failed").arg(error_count).arg(poll_count));
+					}
+					finish(passed);
+				});
+				sender->sendNext();
+			};
+
+			auto warmup = std::make_shared<FrameSender>(controller.get(), qtcc::CcHeader::ReadBufferedCredit,
+					allocation_check_warmup_count, 1, [=]([[maybe_unused]] int error_count) {
+				QMetaObject::invokeMethod(QCoreApplication::instance(), measure, Qt::QueuedConnection);
+			});
+			warmup->sendNext();
+		});
+	}
+
+
+
+	/// Open the port of \c device and initialize it. \c done is called with the time from
+	/// initialize() to NormalRejecting state in nanoseconds, or -1 on error.
+	void startDevice(qtcc::CctalkDevice* device, const std::function<void(qint64 init_nsec)>& done)
+	{
+		device->getLinkController().openPort([=](const QString& open_error_msg) {
+			if (!open_error_msg.isEmpty()) {
+				printProgress(open_error_msg);
+				done(-1);
+				return;
+			}
+
+			auto timer = std::make_shared<QElapsedTimer>();
+			auto connection = std::make_shared<QMetaObject::Connection>();
+			auto deadline = std::make_shared<QTimer>();
+
+			auto finish = [=](qint64 init_nsec) {
+				QObject::disconnect(*connection);
+				deadline->stop();
+				deadline->disconnect();  // break the reference cycle
+				done(init_nsec);
+			};
+
+			*connection = QObject::connect(device, &qtcc::CctalkDevice::deviceStateChanged,
+					[=]([[maybe_unused]] qtcc::CcDeviceState old_state, qtcc::CcDeviceState new_state) {
+				if (new_state == qtcc::CcDeviceState::NormalRejecting) {
+					finish(timer->nsecsElapsed());
+				} else if (new_state == qtcc::CcDeviceState::InitializationFailed) {
+					printProgress(QStringLiteral("Device initialization failed"));
+					finish(-1);
+				}
+			});
+
+			deadline->setSingleShot(true);
+			QObject::connect(deadline.get(), &QTimer::timeout, [=]() {
+				printProgress(QStringLiteral("Device initialization timed out"));
+				finish(-1);
+			});
+			deadline->start(max_initialization_msec);
+
+			timer->start();
+			device->initialize([](const QString& init_error_msg) {
+				if (!init_error_msg.isEmpty()) {
+					printProgress(init_error_msg);
+				}
+			});
+		});
+	}
+
+
+
+	/// Shut down \c device, close its port and delete it, then call \c done.
+	void stopDevice(qtcc::CctalkDevice* device, const std::function<void()>& done)
+	{
+		const bool sent = device->shutdown([=]([[maybe_unused]] const QString& error_msg) {
+			QMetaObject::invokeMethod(QCoreApplication::instance(), [=]() {
+				device->getLinkController().closePort();
+				device->deleteLater();
+				done();
+			}, Qt::QueuedConnection);
+		});
+		if (!sent) {
+			device->getLinkController().closePort();
+			device->deleteLater();
+			done();
+		}
+	}
+
+
+
+	/// Create a device of \c category on a private simulator bus
+	template<typename Base>
+	BenchDevice<Base>* createDevice(const QString& port_name, qtcc::CcCategory category, qtcc::SerialWorkerMode mode)
+	{
+		auto device = new BenchDevice<Base>();
+		device->getLinkController().setBus(std::make_shared<qtcc::CctalkBus>(mode, nullptr, qtcc::SerialTransportKind::Simulator));
+		device->getLinkController().setCcTalkOptions(port_name, qtcc::ccCategoryGetDefaultAddress(category), false, false);
+		device->getLinkController().setLoggingOptions(false, false, false, false, false);
+		return device;
+	}
+
+
+
+	/// Run \c count poll iterations one after another, collecting the latency of each one.
+	template<typename Device>
+	void runPolls(Device* device, int count, std::shared_ptr<QVector<qint64>> samples_nsec, const std::function<void()>& done)
+	{
+		if (count == 0) {
+			done();
+			return;
+		}
+		auto timer = std::make_shared<QElapsedTimer>();
+		timer->start();
+		device->requestBufferedCreditEvents([=](const QString& error_msg, quint8 event_counter, const QVector<qtcc::CcEventData>& event_data) {
+			device->processCreditEventLog(false, error_msg, event_counter, event_data, [=]() {
+				samples_nsec->append(timer->nsecsElapsed());
+				// Continue from the event loop, to avoid recursion.
+				QMetaObject::invokeMethod(QCoreApplication::instance(), [=]() {
+					runPolls(device, count - 1, samples_nsec, done);
+				}, Qt::QueuedConnection);
+			});
+		});
+	}
+
+
+
+	/// Poll iteration latency and allocations. The device poll timer is stopped, and the
+	/// iterations are run back-to-back.
+	template<typename Base>
+	void benchPollLatency(const BenchOptions& bench_options, qtcc::CcCategory category, bool infinite_baud,
+			const std::function<void()>& done)
+	{
+		const QString port_name = QStringLiteral("bench_poll");
+		addSimulatedPort(port_name, category, 1, infinite_baud);
+		auto device = createDevice<Base>(port_name, category, qtcc::SerialWorkerMode::Async);
+
+		const QString line_name = infinite_baud ? QStringLiteral("infinite") : QStringLiteral("9600");
+		const int poll_count = infinite_baud ? bench_options.poll_count : bench_options.slow_poll_count;
+		printProgress(QStringLiteral("Poll latency, %1, %2 baud").arg(getCategoryName(category), line_name));
+
+		startDevice(device, [=](qint64 init_nsec) {
+			if (init_nsec < 0) {
+				stopDevice(device, done);
+				return;
+			}
+			device->stopTimer();
+
+			auto samples_nsec = std::make_shared<QVector<qint64>>();
+			samples_nsec->reserve(poll_count);
+			const quint64 allocations_before = s_allocation_count.load();
+
+			runPolls(device, poll_count, samples_nsec, [=]() {
+				const quint64 allocations = s_allocation_count.load() - allocations_before;
+
+				QJsonObject result = getPercentiles(*samples_nsec);
+				result.insert(QStringLiteral("category"), getCategoryName(category));
+				result.insert(QStringLiteral("baud"), line_name);
+				result.insert(QStringLiteral("polls"), poll_count);
+				result.insert(QStringLiteral("allocations_per_poll"), double(allocations) / poll_count);
+				printResult(QStringLiteral("poll_latency"), result);
+
+				stopDevice(device, [=]() {
+					qtcc::CcSimulator::removePort(port_name);
+					done();
+				});
+			});
+		});
+	}
+
+
+
+	/// Run \c count initializations of a device on \c port_name, collecting the times.
+	template<typename Base>
+	void runInitializations(const QString& port_name, qtcc::CcCategory category, int count,
+			std::shared_ptr<QVector<qint64>> samples_nsec, const std::function<void()>& done)
+	{
+		if (count == 0) {
+			done();
+			return;
+		}
+		auto device = createDevice<Base>(port_name, category, qtcc::SerialWorkerMode::Async);
+		startDevice(device, [=](qint64 init_nsec) {
+			if (init_nsec >= 0) {
+				samples_nsec->append(init_nsec);
+			}
+			stopDevice(device, [=]() {
+				runInitializations<Base>(port_name, category, count - 1, samples_nsec, done);
+			});
+		});
+	}
+
+
+
+	/// Time from initialize() to NormalRejecting state. This includes the identification
+	/// requests, the self-check and the first poll timer interval.
+	template<typename Base>
+	void benchInitialization(const BenchOptions& bench_options, qtcc::CcCategory category, bool infinite_baud,
+			const std::function<void()>& done)
+	{
+		const QString port_name = QStringLiteral("bench_init");
+		auto port = addSimulatedPort(port_name, category, 1, infinite_baud);
+
+		const QString line_name = infinite_baud ? QStringLiteral("infinite") : QStringLiteral("9600");
+		printProgress(QStringLiteral("Initialization, %1, %2 baud").arg(getCategoryName(category), line_name));
+
+		auto samples_nsec = std::make_shared<QVector<qint64>>();
+		runInitializations<Base>(port_name, category, bench_options.init_count, samples_nsec, [=]() {
+			QJsonObject result = getPercentiles(*samples_nsec);
+			result.insert(QStringLiteral("category"), getCategoryName(category));
+			result.insert(QStringLiteral("baud"), line_name);
+			result.insert(QStringLiteral("runs"), bench_options.init_count);
+			result.insert(QStringLiteral("failures"), bench_options.init_count - samples_nsec->size());
+			result.insert(QStringLiteral("requests_per_init"), double(port->getRequestCount()) / std::max(bench_options.init_count, 1));
+			printResult(QStringLiteral("initialization"), result);
+
+			qtcc::CcSimulator::removePort(port_name);
+			done();
+		});
+	}
+
+
+
+	/// Polling throughput of \c bus_count buses with \c devices_per_bus coin acceptors each,
+	/// managed by CctalkDeviceManager. The devices ask to be polled every millisecond, so the
+	/// result is limited by the library and the emulated line.
+	void benchScaling(const BenchOptions& bench_options, int bus_count, int devices_per_bus, bool infinite_baud,
+			const std::function<void()>& done)
+	{
+		const QString line_name = infinite_baud ? QStringLiteral("infinite") : QStringLiteral("9600");
+		printProgress(QStringLiteral("Scaling, %1 bus(es) x %2 device(s), %3 baud").arg(bus_count).arg(devices_per_bus).arg(line_name));
+
+		auto manager = std::make_shared<qtcc::CctalkDeviceManager>(std::min(bus_count, 4), qtcc::SerialTransportKind::Simulator);
+		auto ports = std::make_shared<QVector<std::shared_ptr<qtcc::CcSimulatedPort>>>();
+		QStringList port_names;
+
+		for (int bus = 0; bus < bus_count; ++bus) {
+			const QString port_name = QStringLiteral("bench_scaling%1").arg(bus);
+			port_names << port_name;
+			ports->append(addSimulatedPort(port_name, qtcc::CcCategory::CoinAcceptor, devices_per_bus, infinite_baud, 1));
+			for (int i = 0; i < devices_per_bus; ++i) {
+				auto device = manager->createDevice<qtcc::CoinAcceptorDevice>(port_name,
+						quint8(qtcc::ccCategoryGetDefaultAddress(qtcc::CcCategory::CoinAcceptor) + i));
+				device->getLinkController().setLoggingOptions(false, false, false, false, false);
+			}
+		}
+
+		manager->initializeAll([=](const QVector<QString>& errors) {
+			const int failures = int(std::count_if(errors.begin(), errors.end(), [](const QString& e) { return !e.isEmpty(); }));
+
+			// Let the devices switch to NormalRejecting and settle before measuring.
+			QTimer::singleShot(500, [=]() {
+				quint64 requests_before = 0;
+				for (const auto& port : *ports) {
+					requests_before += port->getRequestCount();
+				}
+				const quint64 allocations_before = s_allocation_count.load();
+				auto timer = std::make_shared<QElapsedTimer>();
+				timer->start();
+
+				QTimer::singleShot(bench_options.scaling_msec, [=]() {
+					const double sec = double(timer->nsecsElapsed()) / 1e9;
+					quint64 requests = 0;
+					for (const auto& port : *ports) {
+						requests += port->getRequestCount();
+					}
+					requests -= requests_before;
+					const quint64 allocations = s_allocation_count.load() - allocations_before;
+					const int device_count = bus_count * devices_per_bus;
+
+					QJsonObject result;
+					result.insert(QStringLiteral("buses"), bus_count);
+					result.insert(QStringLiteral("devices_per_bus"), devices_per_bus);
+					result.insert(QStringLiteral("baud"), line_name);
+					result.insert(QStringLiteral("failures"), failures);
+					result.insert(QStringLiteral("requests_per_sec"), double(requests) / sec);
+					result.insert(QStringLiteral("requests_per_sec_per_device"), double(requests) / sec / device_count);
+					result.insert(QStringLiteral("allocations_per_request"), requests > 0 ? double(allocations) / double(requests) : 0.);
+					printResult(QStringLiteral("scaling"), result);
+
+					manager->shutdownAll([=]([[maybe_unused]] const QVector<QString>& shutdown_errors) {
+						// Don't destroy the manager from its own callback.
+						QMetaObject::invokeMethod(QCoreApplication::instance(), [=]() {
+							for (const QString& name : port_names) {
+								qtcc::CcSimulator::removePort(name);
+							}
+							done();
+						}, Qt::QueuedConnection);
+					});
+				});
+			});
+		});
+	}
+
+
+}
+
+
+
+int main(int argc, char* argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription(QStringLiteral("Benchmark the ccTalk protocol stack against the device simulator. "
+			"The results are printed to stdout in JSON Lines format."));
+	parser.addHelpOption();
+	QCommandLineOption quick_option(QStringLiteral("quick"), QStringLiteral("Run shorter benchmarks (less accurate)."));
+	parser.addOption(quick_option);
+	parser.process(app);
+
+	BenchOptions bench_options;
+	if (parser.isSet(quick_option)) {
+		bench_options.codec_count = 100000;
+		bench_options.allocation_poll_count = 500;
+		bench_options.frame_count = 2000;
+		bench_options.poll_count = 500;
+		bench_options.slow_poll_count = 50;
+		bench_options.init_count = 2;
+		bench_options.scaling_msec = 500;
+	}
+
+	if (!checkFrameAllocations()) {
+		return 1;
+	}
+
+	// Short (SimplePoll-sized) and the longest frames
+	for (int data_size : {0, qtcc::CcFrame::max_data_size}) {
+		benchFrameCodec<qtcc::CcChecksum8>(bench_options, data_size);
+		benchFrameCodec<qtcc::CcChecksum16>(bench_options, data_size);
+	}
+
+	// Set if an allocation check fails
+	int exit_status = 0;
+
+	// Each benchmark is a step; the next one starts when its done callback is called.
+	auto aser = new AsyncSerializer([&app, &exit_status]([[maybe_unused]] AsyncSerializer* serializer) {  // auto-deleted
+		app.exit(exit_status);
+	});
+	auto add_step = [&](const std::function<void(const std::function<void()>& done)>& bench) {
+		aser->add([=](AsyncSerializer* serializer) {
+			bench([=]() {
+				serializer->continueSequence(true);
+			});
+		});
+	};
+
+	for (auto mode : {qtcc::SerialWorkerMode::Async, qtcc::SerialWorkerMode::Blocking}) {
+		add_step([=, &exit_status](const auto& done) {
+			checkPollAllocations(bench_options, mode, [=, &exit_status](bool passed) {
+				if (!passed) {
+					exit_status = 1;
+				}
+				done();
+			});
+		});
+	}
+
+	for (auto mode : {qtcc::SerialWorkerMode::Async, qtcc::SerialWorkerMode::Blocking}) {
+		for (int depth : {1, bench_options.pipeline_depth}) {
+			add_step([=](const auto& done) { benchFrameThroughput(bench_options, mode, depth, done); });
+		}
+	}
+
+	for (bool infinite_baud : {true, false}) {
+		add_step([=](const auto& done) {
+			benchPollLatency<qtcc::CoinAcceptorDevice>(bench_options, qtcc::CcCategory::CoinAcceptor, infinite_baud, done);
+		});
+		add_step([=](const auto& done) {
+			benchPollLatency<qtcc::BillValidatorDevice>(bench_options, qtcc::CcCategory::BillValidator, infinite_baud, done);
+		});
+	}
+
+	for (bool infinite_baud : {true, false}) {
+		add_step([=](const auto& done) {
+			benchInitialization<qtcc::CoinAcceptorDevice>(bench_options, qtcc::CcCategory::CoinAcceptor, infinite_baud, done);
+		});
+		add_step([=](const auto& done) {
+			benchInitialization<qtcc::BillValidatorDevice>(bench_options, qtcc::CcCategory::BillValidator, infinite_baud, done);
+		});
+	}
+
+	for (bool infinite_baud : {true, false}) {
+		for (int devices_per_bus : {1, 2, 4, 8}) {
+			add_step([=](const auto& done) { benchScaling(bench_options, 1, devices_per_bus, infinite_baud, done); });
+		}
+		for (int bus_count : {2, 4, 8}) {
+			add_step([=](const auto& done) { benchScaling(bench_options, bus_count, 1, infinite_baud, done); });
+		}
+	}
+
+	QMetaObject::invokeMethod(&app, [aser]() {
+		aser->start();
+	}, Qt::QueuedConnection);
+
+	return QCoreApplication::exec();
+}
@@ -0,0 +1,87 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef LEGACY_ASYNC_SERIALIZER_H
+#define LEGACY_ASYNC_SERIALIZER_H
+
+#include <QObject>
+#include <QVector>
+#include <QTimer>
+
+#include <functional>
+#include <utility>
+
+
+
+/// The original AsyncSerializer stepping (a string-based timer connection per step,
+/// executors copied out of a QVector), kept for comparison in the benchmark.
+class LegacyAsyncSerializer : public QObject {
+	Q_OBJECT
+	public:
+
+		using FinishHandler = std::function<void(LegacyAsyncSerializer* serializer)>;
+		using ExecutorFunc = std::function<void(LegacyAsyncSerializer* serializer)>;
+
+
+		explicit LegacyAsyncSerializer(FinishHandler finish_handler)
+				: finish_handler_(std::move(finish_handler))
+		{
+			timer_.setSingleShot(true);
+		}
+
+
+		void add(const ExecutorFunc& func)
+		{
+			executors_ << func;
+		}
+
+
+		bool start()
+		{
+			current_func_index_ = -1;
+			executeNextFunc();
+			return true;
+		}
+
+
+		void continueSequence(bool queue_next)
+		{
+			if (queue_next && (current_func_index_ + 1 < executors_.size())) {
+				QObject::connect(&timer_, SIGNAL(timeout()), this, SLOT(executeNextFunc()), Qt::QueuedConnection);
+				timer_.start(0);
+			} else {
+				current_func_index_ = -1;
+				executors_.clear();
+				finish_handler_(this);
+				delete this;
+			}
+		}
+
+
+	protected slots:
+
+		void executeNextFunc()
+		{
+			++current_func_index_;
+			QTimer::disconnect(&timer_, nullptr, nullptr, nullptr);
+			ExecutorFunc func = executors_.value(current_func_index_);
+			if (func) {
+				func(this);
+			}
+		}
+
+
+	private:
+
+		QTimer timer_;
+		FinishHandler finish_handler_;
+		QVector<ExecutorFunc> executors_;
+		int current_func_index_ = 0;
+
+};
+
+
+
+#endif
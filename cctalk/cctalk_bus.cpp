@@ -0,0 +1,330 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <utility>
+
+#include "cctalk_bus.h"
+#include "cctalk_link_controller.h"
+#include "helpers/debug.h"
+#include "serial_worker.h"
+
+
+namespace qtcc {
+
+
+
+
+CctalkBus::CctalkBus(SerialWorkerMode mode, QThread* io_thread, SerialTransportKind transport_kind)
+		: io_thread_(io_thread ? io_thread : &worker_thread_)
+{
+	// Frames are passed to and from the worker thread by value.
+	qRegisterMetaType<qtcc::CcFrame>("qtcc::CcFrame");
+
+	serial_worker_.reset(new SerialWorker(mode, transport_kind));
+
+	// With a private thread, the worker is deleted by serial_worker_ after the thread is stopped.
+	serial_worker_->moveToThread(io_thread_);
+
+	// Connect our proxy signals to their slots.
+	connect(this, &CctalkBus::openPortInWorker, serial_worker_.data(), &SerialWorker::openPort, Qt::QueuedConnection);
+	connect(this, &CctalkBus::closePortInWorker, serial_worker_.data(), &SerialWorker::closePort, Qt::QueuedConnection);
+
+	// Handle their signals
+	connect(serial_worker_.data(), &SerialWorker::portOpen, this, &CctalkBus::onPortOpen, Qt::QueuedConnection);
+	connect(serial_worker_.data(), &SerialWorker::portError, this, &CctalkBus::onPortError, Qt::QueuedConnection);
+	connect(serial_worker_.data(), &SerialWorker::responseReceived, this, &CctalkBus::onResponseReceive, Qt::QueuedConnection);
+	connect(serial_worker_.data(), &SerialWorker::requestTimeout, this, &CctalkBus::onRequestTimeout, Qt::QueuedConnection);
+	connect(serial_worker_.data(), &SerialWorker::responseTimeout, this, &CctalkBus::onResponseTimeout, Qt::QueuedConnection);
+	connect(serial_worker_.data(), &SerialWorker::logMessage, this, &CctalkBus::onLogMessage, Qt::QueuedConnection);
+
+	// Start the thread (calls run(), enters event loop).
+	if (io_thread_ == &worker_thread_) {
+		worker_thread_.start();
+	}
+}
+
+
+
+CctalkBus::~CctalkBus()
+{
+	if (io_thread_ == &worker_thread_) {
+		worker_thread_.quit();
+		worker_thread_.wait();
+	} else {
+		// The shared thread keeps running, delete the worker (and its port) there.
+		serial_worker_.take()->deleteLater();
+	}
+}
+
+
+
+void CctalkBus::setLoggingOptions(bool show_full_response, bool show_serial_request, bool show_serial_response)
+{
+	serial_worker_->setLoggingOptions(show_full_response, show_serial_request, show_serial_response);
+}
+
+
+
+void CctalkBus::setWireCapture(std::shared_ptr<CcWireCapture> capture)
+{
+	// The worker uses it from its own thread.
+	SerialWorker* worker = serial_worker_.data();
+	QMetaObject::invokeMethod(worker, [worker, capture]() {
+		worker->setWireCapture(capture);
+	}, Qt::QueuedConnection);
+}
+
+
+
+void CctalkBus::attach(CctalkLinkController* controller)
+{
+	DBG_ASSERT_RETURN_NONE(controller);
+	if (!controllers_.contains(controller)) {
+		controllers_.append(controller);
+	}
+}
+
+
+
+void CctalkBus::detach(CctalkLinkController* controller)
+{
+	closePort(controller);
+	controllers_.removeAll(controller);
+
+	for (auto iter = request_owners_.begin(); iter != request_owners_.end(); ) {
+		if (iter.value() == controller) {
+			iter = request_owners_.erase(iter);
+		} else {
+			++iter;
+		}
+	}
+}
+
+
+
+int CctalkBus::getAttachedCount() const
+{
+	return controllers_.size();
+}
+
+
+
+void CctalkBus::openPort(CctalkLinkController* controller, const QString& port_device,
+		const std::function<void(const QString& error_msg)>& finish_callback)
+{
+	DBG_ASSERT(controllers_.contains(controller));
+
+	if ((port_open_ || port_opening_) && port_device != port_device_) {
+		finish_callback(tr("! Serial port %1 is already used by this bus, cannot open %2.").arg(port_device_).arg(port_device));
+		return;
+	}
+
+	port_users_.insert(controller);
+
+	if (port_open_) {
+		finish_callback(QString());
+		return;
+	}
+
+	open_callbacks_ << finish_callback;
+
+	if (!port_opening_) {
+		port_opening_ = true;
+		if (port_device != port_device_) {
+			baud_rate_ = cc_default_baud_rate;  // the remembered speed belongs to the old device
+		}
+		port_device_ = port_device;
+		emit openPortInWorker(port_device_, baud_rate_);  // Queued
+	}
+}
+
+
+
+void CctalkBus::closePort(CctalkLinkController* controller)
+{
+	if (!port_users_.remove(controller)) {
+		return;
+	}
+	if (port_users_.isEmpty() && (port_open_ || port_opening_)) {
+		port_open_ = false;
+		port_opening_ = false;
+		// Nobody is waiting for the queued requests anymore. They are never reported back,
+		// so forget their owners too.
+		const QVector<quint64> dropped_ids = serial_worker_->clearQueue();
+		for (quint64 request_id : dropped_ids) {
+			request_owners_.remove(request_id);
+		}
+		emit closePortInWorker();
+	}
+}
+
+
+
+QString CctalkBus::getPortDevice() const
+{
+	return port_device_;
+}
+
+
+
+void CctalkBus::setBaudRate(qint32 baud_rate)
+{
+	DBG_ASSERT_RETURN_NONE(baud_rate > 0);
+	if (baud_rate != baud_rate_) {
+		// The measured response times belong to the old speed.
+		for (CctalkLinkController* controller : qAsConst(controllers_)) {
+			controller->onBusBaudRateChange();
+		}
+	}
+	baud_rate_ = baud_rate;
+
+	if (port_open_ || port_opening_) {
+		// Go ahead of anything queued, so that all the following requests use the new speed.
+		SerialWorkerRequest request;
+		request.priority = CcRequestPriority::RealTime;
+		request.baud_rate = baud_rate;
+		serial_worker_->enqueueRequest(std::move(request));
+	}
+}
+
+
+
+qint32 CctalkBus::getBaudRate() const
+{
+	return baud_rate_;
+}
+
+
+
+SerialWorkerMode CctalkBus::getWorkerMode() const
+{
+	return serial_worker_->getMode();
+}
+
+
+
+quint64 CctalkBus::sendRequest(CctalkLinkController* controller, const CcFrame& request_frame,
+		bool request_needs_response, int write_timeout_msec, int response_timeout_msec, CcRequestPriority priority,
+		const SerialWorkerRetry& retry)
+{
+	DBG_ASSERT(controllers_.contains(controller));
+
+	const quint64 request_id = allocateRequestId();
+
+	if (request_needs_response) {
+		request_owners_.insert(request_id, controller);
+	}
+
+	// The request is placed directly into the worker transmit queue. Requests from all the
+	// attached controllers are sent in priority order, FIFO within the same priority.
+	SerialWorkerRequest request;
+	request.request_id = request_id;
+	request.request_frame = request_frame;
+	request.request_needs_response = request_needs_response;
+	request.write_timeout_msec = write_timeout_msec;
+	request.response_timeout_msec = response_timeout_msec;
+	request.priority = priority;
+	request.retry = retry;
+	request.checksum_16bit = controller->getChecksum16bit();
+	request.statistics = controller->getStatistics();  // recorded by the worker
+	request.rtt_estimator = controller->getRttEstimator();  // fed by the worker
+	serial_worker_->enqueueRequest(std::move(request));
+
+	return request_id;
+}
+
+
+
+quint64 CctalkBus::allocateRequestId()
+{
+	quint64 request_id = ++req_num_;
+	if (request_id == 0) {
+		request_id = ++req_num_;
+	}
+	return request_id;
+}
+
+
+
+void CctalkBus::onPortOpen()
+{
+	const bool was_opening = port_opening_;
+	port_opening_ = false;
+	port_open_ = was_opening;  // a close may have been requested in the meantime
+
+	auto callbacks = std::move(open_callbacks_);
+	open_callbacks_.clear();
+	for (const auto& callback : callbacks) {
+		callback(QString());
+	}
+
+	const auto controllers = controllers_;  // the callbacks may detach
+	for (CctalkLinkController* controller : controllers) {
+		controller->onBusPortOpen();
+	}
+}
+
+
+
+void CctalkBus::onPortError(const QString& error_msg)
+{
+	port_opening_ = false;
+
+	auto callbacks = std::move(open_callbacks_);
+	open_callbacks_.clear();
+	for (const auto& callback : callbacks) {
+		callback(error_msg);
+	}
+
+	const auto controllers = controllers_;  // the callbacks may detach
+	for (CctalkLinkController* controller : controllers) {
+		controller->onBusPortError(error_msg);
+	}
+}
+
+
+
+void CctalkBus::onResponseReceive(quint64 request_id, const qtcc::CcFrame& response_frame)
+{
+	CctalkLinkController* controller = request_owners_.take(request_id);
+	if (controller) {
+		controller->onResponseReceive(request_id, response_frame);
+	}
+}
+
+
+
+void CctalkBus::onRequestTimeout(quint64 request_id)
+{
+	CctalkLinkController* controller = request_owners_.take(request_id);
+	if (controller) {
+		controller->onRequestTimeout(request_id);
+	}
+}
+
+
+
+void CctalkBus::onResponseTimeout(quint64 request_id)
+{
+	CctalkLinkController* controller = request_owners_.take(request_id);
+	if (controller) {
+		controller->onResponseTimeout(request_id);
+	}
+}
+
+
+
+void CctalkBus::onLogMessage(const QString& msg)
+{
+	emit logMessage(msg);
+
+	if (!controllers_.isEmpty()) {
+		controllers_.first()->onBusLogMessage(msg);
+	}
+}
+
+
+
+}
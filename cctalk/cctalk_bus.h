@@ -0,0 +1,195 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_BUS_H
+#define CCTALK_BUS_H
+
+#include <QObject>
+#include <QThread>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QByteArray>
+#include <QScopedPointer>
+#include <functional>
+
+#include "cctalk_enums.h"
+#include "cctalk_frame.h"
+#include "serial_worker.h"
+
+
+namespace qtcc {
+
+
+
+class CctalkLinkController;
+
+
+/**
+\file
+
+A physical ccTalk line (serial port) may have several devices on it (multi-drop bus),
+each with its own address. CctalkBus owns the single serial port worker and its thread
+for such a line, and any number of CctalkLinkController objects may attach to it.
+
+The bus assigns bus-wide unique request IDs, places the requests into the worker's transmit
+queue (highest priority first, then in the order they were issued; since each device waits for
+a reply before issuing the next request, this interleaves the traffic of all attached devices),
+and routes the replies, timeouts and port errors back to the controller that issued the request.
+
+CctalkBus and all its attached controllers must live in the same thread.
+
+By default, the bus creates its own worker thread. With SerialWorkerMode::Async, the worker
+never blocks, so the buses of several serial lines may share a single I/O thread (passed to
+the constructor and owned by the caller; it must outlive the buses).
+
+The bus remembers the line speed of its port (9600 baud by default, or as negotiated
+by the device using SwitchBaudRate command) and reopens the port at that speed.
+*/
+
+
+/// Serial line shared by one or more ccTalk link controllers.
+class CctalkBus : public QObject {
+	Q_OBJECT
+	public:
+
+		/// Constructor. If \c io_thread is nullptr, launches a private worker thread.
+		/// Otherwise, the worker is moved to \c io_thread, which must be running and
+		/// must outlive the bus. Sharing a thread only makes sense in asynchronous mode,
+		/// since a blocking worker would stall the other workers in the thread.
+		/// \c transport_kind selects the serial port implementation.
+		explicit CctalkBus(SerialWorkerMode mode = SerialWorkerMode::Blocking, QThread* io_thread = nullptr,
+				SerialTransportKind transport_kind = SerialTransportKind::QtSerialPort);
+
+		/// Destructor
+		~CctalkBus() override;
+
+
+		/// Set logging options for the serial worker (though logMessage() signal).
+		/// Call before opening the port.
+		void setLoggingOptions(bool show_full_response, bool show_serial_request, bool show_serial_response);
+
+		/// Capture the traffic of this bus into \c capture (possibly shared with other buses).
+		/// Null disables capturing. May be called at any time.
+		void setWireCapture(std::shared_ptr<CcWireCapture> capture);
+
+
+		/// Attach a link controller to this bus. This is called by CctalkLinkController::setBus().
+		void attach(CctalkLinkController* controller);
+
+		/// Detach a link controller from this bus. Its port reference (if any) is released
+		/// and its pending requests are forgotten.
+		void detach(CctalkLinkController* controller);
+
+		/// Get the number of attached controllers.
+		[[nodiscard]] int getAttachedCount() const;
+
+
+		/// Open the serial port on behalf of \c controller. If the port is already open,
+		/// \c finish_callback is called immediately. All controllers sharing the bus must
+		/// use the same port device.
+		void openPort(CctalkLinkController* controller, const QString& port_device,
+				const std::function<void(const QString& error_msg)>& finish_callback);
+
+		/// Release the port reference of \c controller. The port is closed when the
+		/// last controller releases it.
+		void closePort(CctalkLinkController* controller);
+
+		/// Get the port device the bus was opened with.
+		[[nodiscard]] QString getPortDevice() const;
+
+		/// Change the line speed. If the port is open, the change is performed by the worker
+		/// before any request queued after this call is sent. The speed is remembered
+		/// for reopening the port, until a different port device is opened.
+		/// The response time estimates of the attached controllers are reset.
+		void setBaudRate(qint32 baud_rate);
+
+		/// Get the current (or next, if the port is closed) line speed.
+		[[nodiscard]] qint32 getBaudRate() const;
+
+		/// Get the serial worker I/O mode.
+		[[nodiscard]] SerialWorkerMode getWorkerMode() const;
+
+
+		/// Queue request data for sending on behalf of \c controller.
+		/// The worker retransmits the request after malformed or missing replies according to \c retry.
+		/// \return bus-wide unique request ID.
+		quint64 sendRequest(CctalkLinkController* controller, const CcFrame& request_frame,
+				bool request_needs_response, int write_timeout_msec, int response_timeout_msec,
+				CcRequestPriority priority = CcRequestPriority::Normal, const SerialWorkerRetry& retry = SerialWorkerRetry());
+
+		/// Get a new bus-wide unique request ID without sending anything. Used for the requests
+		/// that a controller finishes by itself (coalesced or cached ones).
+		quint64 allocateRequestId();
+
+
+	signals:
+
+		/// Mirrored from SerialWorker. Port-level log messages are forwarded to the
+		/// first attached controller as well.
+		void logMessage(const QString& msg);
+
+
+	// SerialWorker caller signals. There are emitted internally to call SerialWorker slots.
+	// For each slot in SerialWorker there should be a signal here.
+
+	// Private signals
+	signals:
+
+		/// Proxy signal to call a slot in the worker thread.
+		void openPortInWorker(const QString& port_name, qint32 baud_rate);
+
+		/// Proxy signal to call a slot in the worker thread.
+		void closePortInWorker();
+
+
+	protected slots:
+
+		/// Handle SerialWorker::portOpen()
+		void onPortOpen();
+
+		/// Handle SerialWorker::portError()
+		void onPortError(const QString& error_msg);
+
+		/// Route SerialWorker::responseReceived() to the requesting controller
+		void onResponseReceive(quint64 request_id, const qtcc::CcFrame& response_frame);
+
+		/// Route SerialWorker::requestTimeout() to the requesting controller
+		void onRequestTimeout(quint64 request_id);
+
+		/// Route SerialWorker::responseTimeout() to the requesting controller
+		void onResponseTimeout(quint64 request_id);
+
+		/// Forward SerialWorker::logMessage()
+		void onLogMessage(const QString& msg);
+
+
+	private:
+
+		QScopedPointer<SerialWorker> serial_worker_;  ///< Serial port worker, lives in io_thread_.
+		QThread worker_thread_;  ///< Private worker thread, unused if an external I/O thread is given
+		QThread* io_thread_ = nullptr;  ///< The thread that SerialWorker lives in
+
+		QString port_device_;  ///< Serial port device, e.g. /dev/ttyUSB0
+		qint32 baud_rate_ = cc_default_baud_rate;  ///< Line speed of port_device_
+		bool port_open_ = false;  ///< True if the worker reported the port to be open
+		bool port_opening_ = false;  ///< True while the open request is being processed by the worker
+		QVector<std::function<void(const QString& error_msg)>> open_callbacks_;  ///< Callbacks waiting for port open result
+
+		QVector<CctalkLinkController*> controllers_;  ///< Attached controllers, in attachment order
+		QSet<CctalkLinkController*> port_users_;  ///< Controllers that have requested the port to be open
+
+		quint64 req_num_ = 0;  ///< Request number. This is used to identify which response came from which request.
+		QHash<quint64, CctalkLinkController*> request_owners_;  ///< Request ID -> requesting controller
+
+};
+
+
+
+}
+
+
+#endif
@@ -0,0 +1,414 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSerialPortInfo>
+#include <QSettings>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "cctalk_bus_discovery.h"
+#include "cctalk_bus.h"
+#include "cctalk_link_controller.h"
+#include "helpers/async_parallel_group.h"
+#include "helpers/async_serializer.h"
+#include "helpers/debug.h"
+
+
+namespace qtcc {
+
+
+namespace {
+
+	/// Cache file format version
+	constexpr int cache_format_version = 1;
+
+}
+
+
+
+CcBusDiscovery::CcBusDiscovery(SerialWorkerMode worker_mode, SerialTransportKind transport_kind)
+		: worker_mode_(worker_mode), transport_kind_(transport_kind), candidate_addresses_(getDefaultCandidateAddresses())
+{ }
+
+
+
+void CcBusDiscovery::setCacheFile(const QString& file_name)
+{
+	cache_file_ = file_name;
+}
+
+
+
+void CcBusDiscovery::setEmptyPortCacheLifetime(int msec)
+{
+	empty_port_cache_msec_ = std::max(msec, 0);
+}
+
+
+
+void CcBusDiscovery::clearCache()
+{
+	if (!cache_file_.isEmpty()) {
+		QFile::remove(cache_file_);
+	}
+}
+
+
+
+void CcBusDiscovery::setProbeTimeout(int msec)
+{
+	DBG_ASSERT_RETURN_NONE(msec > 0);
+	probe_timeout_msec_ = msec;
+}
+
+
+
+void CcBusDiscovery::setCandidateAddresses(const QVector<quint8>& addresses)
+{
+	candidate_addresses_ = addresses;
+}
+
+
+
+void CcBusDiscovery::setChecksum16bit(bool checksum_16bit)
+{
+	checksum_16bit_ = checksum_16bit;
+}
+
+
+
+void CcBusDiscovery::discover(const QStringList& port_devices, const FinishFunc& finish_callback)
+{
+	const QStringList ports = port_devices.isEmpty() ? getAvailablePorts() : port_devices;
+	const CachedPortMap cached_ports = loadCache();
+
+	auto elapsed = std::make_shared<QElapsedTimer>();
+	elapsed->start();
+	auto bus_map = std::make_shared<CcBusMap>();
+	auto probed_ports = std::make_shared<CachedPortMap>();  // New cache entries of the probed ports
+	auto failed_ports = std::make_shared<QStringList>();  // Ports that could not be probed
+
+	auto group = new AsyncParallelGroup(  // auto-deleted
+		// Finish callback
+		[=]([[maybe_unused]] AsyncParallelGroup* finished_group) {
+			bus_map_ = *bus_map;
+
+			// Update the probed ports, keep the others (possibly written by another discovery meanwhile).
+			if (!cache_file_.isEmpty()) {
+				CachedPortMap updated_cache = loadCache();
+				for (const QString& port_device : qAsConst(*failed_ports)) {
+					updated_cache.remove(port_device);
+				}
+				for (auto iter = probed_ports->cbegin(); iter != probed_ports->cend(); ++iter) {
+					updated_cache.insert(iter.key(), iter.value());
+				}
+				storeCache(updated_cache);
+			}
+
+			int device_count = 0;
+			for (const auto& devices : qAsConst(bus_map_)) {
+				device_count += devices.size();
+			}
+			emit logMessage(tr("* Discovered %1 devices on %2 of %3 serial ports in %4 ms.")
+					.arg(device_count).arg(bus_map_.size()).arg(ports.size()).arg(elapsed->elapsed()));
+			finish_callback(bus_map_);
+		}
+	);
+
+	for (const QString& port_device : ports) {
+		group->add([=](AsyncParallelGroup* running_group, int branch_index) {
+			auto full_probe = [=]() {
+				probePort(port_device, candidate_addresses_, true, [=](const QString& error_msg, const QVector<CcDiscoveredDevice>& devices) {
+					if (!error_msg.isEmpty()) {
+						emit logMessage(tr("! Could not probe serial port %1: %2").arg(port_device, error_msg));
+						failed_ports->append(port_device);
+					} else {
+						if (!devices.isEmpty()) {
+							bus_map->insert(port_device, devices);
+						}
+						CachedPort entry;
+						entry.devices = devices;
+						entry.probe_time_msec = QDateTime::currentMSecsSinceEpoch();
+						probed_ports->insert(port_device, entry);
+					}
+					running_group->finishBranch(branch_index, error_msg);
+				});
+			};
+
+			if (!cached_ports.contains(port_device)) {
+				full_probe();
+				return;
+			}
+			const CachedPort cached_port = cached_ports.value(port_device);
+
+			// Nothing was found on this port recently, don't probe it again yet.
+			if (cached_port.devices.isEmpty()) {
+				const qint64 age_msec = QDateTime::currentMSecsSinceEpoch() - cached_port.probe_time_msec;
+				if (age_msec >= 0 && age_msec < empty_port_cache_msec_) {
+					running_group->finishBranch(branch_index);
+				} else {
+					full_probe();
+				}
+				return;
+			}
+
+			// Verify the cached devices with SimplePoll. If anything changed, probe the whole port.
+			QVector<quint8> cached_addresses;
+			for (const auto& device : cached_port.devices) {
+				cached_addresses << device.address;
+			}
+			probePort(port_device, cached_addresses, false, [=](const QString& error_msg, const QVector<CcDiscoveredDevice>& devices) {
+				const bool verified = error_msg.isEmpty() && devices.size() == cached_port.devices.size()
+						&& std::equal(devices.cbegin(), devices.cend(), cached_port.devices.cbegin(),
+								[](const CcDiscoveredDevice& found, const CcDiscoveredDevice& cached) {
+					return found.address == cached.address;
+				});
+				if (!verified) {
+					emit logMessage(tr("* Cached devices on serial port %1 changed, probing all addresses.").arg(port_device));
+					full_probe();
+					return;
+				}
+				bus_map->insert(port_device, cached_port.devices);
+				CachedPort entry = cached_port;
+				entry.probe_time_msec = QDateTime::currentMSecsSinceEpoch();
+				probed_ports->insert(port_device, entry);
+				running_group->finishBranch(branch_index);
+			});
+		});
+	}
+
+	group->start();
+}
+
+
+
+CcBusMap CcBusDiscovery::getBusMap() const
+{
+	return bus_map_;
+}
+
+
+
+QStringList CcBusDiscovery::getAvailablePorts()
+{
+	QStringList port_devices;
+	const QList<QSerialPortInfo> ports = QSerialPortInfo::availablePorts();
+	for (const QSerialPortInfo& info : ports) {
+		port_devices << info.systemLocation();
+	}
+	return port_devices;
+}
+
+
+
+QVector<quint8> CcBusDiscovery::getDefaultCandidateAddresses()
+{
+	QVector<quint8> addresses;
+	for (int category = int(CcCategory::CoinAcceptor); category <= int(CcCategory::Debug); ++category) {
+		const quint8 address = ccCategoryGetDefaultAddress(CcCategory(category));
+		if (address != 0 && !addresses.contains(address)) {
+			addresses << address;
+		}
+	}
+	std::sort(addresses.begin(), addresses.end());
+	return addresses;
+}
+
+
+
+void CcBusDiscovery::probePort(const QString& port_device, const QVector<quint8>& addresses, bool get_categories,
+		const PortFinishFunc& finish_callback)
+{
+	if (addresses.isEmpty()) {
+		finish_callback(QString(), QVector<CcDiscoveredDevice>());
+		return;
+	}
+
+	// One controller per address, all of them on the same bus. The requests are queued
+	// on the bus, so the probes of a port are sent back to back without waiting for us.
+	struct ProbeState {
+		std::vector<CctalkLinkController*> controllers;  ///< Deleted when finished
+		QVector<bool> replied;  ///< Per-controller SimplePoll result
+		QVector<CcCategory> categories;  ///< Per-controller category
+		QString error;  ///< Port error
+	};
+	auto state = std::make_shared<ProbeState>();
+	auto bus = std::make_shared<CctalkBus>(worker_mode_, nullptr, transport_kind_);
+	for (quint8 address : addresses) {
+		auto* controller = new CctalkLinkController();
+		controller->setBus(bus);
+		controller->setCcTalkOptions(port_device, address, checksum_16bit_, false);
+		// A missing device is the common case here, don't wait for it more than once.
+		controller->setRetryPolicy(CcRetryPolicy::createDisabled());
+		controller->setAdaptiveTimeoutsEnabled(false);
+		state->controllers.push_back(controller);
+	}
+	state->replied.fill(false, addresses.size());
+	state->categories.fill(CcCategory::Unknown, addresses.size());
+
+	auto aser = new AsyncSerializer(  // auto-deleted
+		// Finish handler
+		[=]([[maybe_unused]] AsyncSerializer* serializer) {
+			QVector<CcDiscoveredDevice> devices;
+			for (int i = 0; i < addresses.size(); ++i) {
+				if (state->replied.at(i)) {
+					CcDiscoveredDevice device;
+					device.port_device = port_device;
+					device.address = addresses.at(i);
+					device.category = state->categories.at(i);
+					devices << device;
+				}
+			}
+			for (CctalkLinkController* controller : state->controllers) {
+				controller->closePort();
+				controller->deleteLater();  // we may be inside its callback
+			}
+			state->controllers.clear();
+			finish_callback(state->error, devices);
+		}
+	);
+
+	// Open the port
+	aser->add([=](AsyncSerializer* serializer) {
+		state->controllers.front()->openPort([=](const QString& error_msg) {
+			state->error = error_msg;
+			if (error_msg.isEmpty()) {
+				// The port is open, so the others are registered right away.
+				for (std::size_t i = 1; i < state->controllers.size(); ++i) {
+					state->controllers.at(i)->openPort([]([[maybe_unused]] const QString& open_error_msg) { });
+				}
+			}
+			serializer->continueSequence(error_msg.isEmpty());
+		});
+	});
+
+	// SimplePoll each address
+	aser->add([=](AsyncSerializer* serializer) {
+		auto join = AsyncJoin::create(int(state->controllers.size()), [=]([[maybe_unused]] const QVector<QString>& errors) {
+			serializer->continueSequence(state->replied.contains(true));
+		});
+		for (int i = 0; i < int(state->controllers.size()); ++i) {
+			CctalkLinkController* controller = state->controllers.at(std::size_t(i));
+			auto arrive = AsyncJoin::getArrivalCallback(join, i);
+			quint64 sent_request_id = controller->ccRequest(CcHeader::SimplePoll, QByteArray(), probe_timeout_msec_);
+			if (sent_request_id == 0) {
+				arrive(tr("! Could not send request."));
+				continue;
+			}
+			controller->executeOnReturn(sent_request_id, [=]([[maybe_unused]] quint64 request_id, const QString& error_msg,
+					const QByteArray& command_data) {
+				state->replied[i] = error_msg.isEmpty() && command_data.isEmpty();  // ACK
+				arrive(error_msg);
+			});
+		}
+	});
+
+	// Get the category of the devices that replied
+	aser->add([=](AsyncSerializer* serializer) {
+		if (!get_categories) {
+			serializer->continueSequence(true);
+			return;
+		}
+		auto join = AsyncJoin::create(int(state->controllers.size()), [=]([[maybe_unused]] const QVector<QString>& errors) {
+			serializer->continueSequence(true);
+		});
+		for (int i = 0; i < int(state->controllers.size()); ++i) {
+			CctalkLinkController* controller = state->controllers.at(std::size_t(i));
+			auto arrive = AsyncJoin::getArrivalCallback(join, i);
+			if (!state->replied.at(i)) {
+				arrive(QString());
+				continue;
+			}
+			quint64 sent_request_id = controller->ccRequest(CcHeader::GetEquipmentCategory, QByteArray(), probe_timeout_msec_);
+			if (sent_request_id == 0) {
+				arrive(tr("! Could not send request."));
+				continue;
+			}
+			controller->executeOnReturn(sent_request_id, [=]([[maybe_unused]] quint64 request_id, const QString& error_msg,
+					const QByteArray& command_data) {
+				if (error_msg.isEmpty()) {
+					state->categories[i] = ccCategoryFromReportedName(QString::fromUtf8(command_data));
+				}
+				// The device replied to SimplePoll, so keep it even if the category is unknown.
+				arrive(error_msg);
+			});
+		}
+	});
+
+	aser->start();
+}
+
+
+
+CcBusDiscovery::CachedPortMap CcBusDiscovery::loadCache() const
+{
+	CachedPortMap cached_ports;
+	if (cache_file_.isEmpty()) {
+		return cached_ports;
+	}
+	QSettings settings(cache_file_, QSettings::IniFormat);
+	if (settings.value(QStringLiteral("format_version")).toInt() != cache_format_version) {
+		return cached_ports;
+	}
+
+	const int port_count = settings.beginReadArray(QStringLiteral("ports"));
+	for (int port_index = 0; port_index < port_count; ++port_index) {
+		settings.setArrayIndex(port_index);
+		const QString port_device = settings.value(QStringLiteral("port_device")).toString();
+		CachedPort& cached_port = cached_ports[port_device];
+		cached_port.probe_time_msec = settings.value(QStringLiteral("probe_time")).toLongLong();
+
+		const int device_count = settings.beginReadArray(QStringLiteral("devices"));
+		for (int device_index = 0; device_index < device_count; ++device_index) {
+			settings.setArrayIndex(device_index);
+			CcDiscoveredDevice device;
+			device.port_device = port_device;
+			device.address = quint8(settings.value(QStringLiteral("address")).toUInt());
+			device.category = CcCategory(settings.value(QStringLiteral("category")).toInt());
+			cached_port.devices << device;
+		}
+		settings.endArray();
+	}
+	settings.endArray();
+	return cached_ports;
+}
+
+
+
+void CcBusDiscovery::storeCache(const CachedPortMap& cached_ports) const
+{
+	if (cache_file_.isEmpty()) {
+		return;
+	}
+	QSettings settings(cache_file_, QSettings::IniFormat);
+	settings.clear();
+	settings.setValue(QStringLiteral("format_version"), cache_format_version);
+
+	settings.beginWriteArray(QStringLiteral("ports"), cached_ports.size());
+	int port_index = 0;
+	for (auto iter = cached_ports.cbegin(); iter != cached_ports.cend(); ++iter, ++port_index) {
+		settings.setArrayIndex(port_index);
+		settings.setValue(QStringLiteral("port_device"), iter.key());
+		settings.setValue(QStringLiteral("probe_time"), iter->probe_time_msec);
+
+		const QVector<CcDiscoveredDevice>& devices = iter->devices;
+		settings.beginWriteArray(QStringLiteral("devices"), devices.size());
+		for (int device_index = 0; device_index < devices.size(); ++device_index) {
+			settings.setArrayIndex(device_index);
+			settings.setValue(QStringLiteral("address"), devices.at(device_index).address);
+			settings.setValue(QStringLiteral("category"), int(devices.at(device_index).category));
+		}
+		settings.endArray();
+	}
+	settings.endArray();
+}
+
+
+
+}
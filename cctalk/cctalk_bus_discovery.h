@@ -0,0 +1,164 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_BUS_DISCOVERY_H
+#define CCTALK_BUS_DISCOVERY_H
+
+#include <QObject>
+#include <QMap>
+#include <QVector>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+#include "cctalk_enums.h"
+#include "serial_worker.h"
+#include "serial_transport.h"
+
+
+namespace qtcc {
+
+
+/**
+\file
+
+Bus discovery: find the ccTalk devices attached to the serial ports.
+
+Each port is probed with SimplePoll at the candidate addresses (the default addresses
+of all the device categories, unless changed) under a short timeout, and the devices that
+reply are asked for their category with GetEquipmentCategory. All ports are probed in
+parallel, so the discovery takes about as long as probing a single port.
+
+AddressPoll is not used: its replies are raw address bytes sent with address-dependent
+delays, not ccTalk frames, so they cannot be received through the frame-based link.
+
+The result can be kept in a cache file. On the next run the cached devices are verified
+with a single SimplePoll each (their categories are taken from the cache), and a port is
+fully probed again only if the verification fails. Ports where nothing was found are cached
+for a short time (see setEmptyPortCacheLifetime()) and skipped until then, so that restarting
+the application doesn't wait for a full probe of each empty port. Each discovery updates the
+cache entries of the ports it probed and keeps the others.
+The probes are not retried, the timeout of each one is fixed (see setProbeTimeout()).
+*/
+
+
+
+/// A device found by CcBusDiscovery
+struct CcDiscoveredDevice {
+	QString port_device;  ///< Serial port
+	quint8 address = 0;  ///< ccTalk address
+	CcCategory category = CcCategory::Unknown;  ///< Reported equipment category
+};
+
+
+/// Port device -> devices found on it (in address order). Ports without devices are not listed.
+using CcBusMap = QMap<QString, QVector<CcDiscoveredDevice>>;
+
+
+
+/// ccTalk bus discovery
+class CcBusDiscovery : public QObject {
+	Q_OBJECT
+	public:
+
+		/// Finish callback
+		using FinishFunc = std::function<void(const CcBusMap& bus_map)>;
+
+
+		/// Constructor
+		explicit CcBusDiscovery(SerialWorkerMode worker_mode = SerialWorkerMode::Blocking,
+				SerialTransportKind transport_kind = SerialTransportKind::QtSerialPort);
+
+
+		/// Set the file to keep the result of the last discovery in between runs. Empty (default)
+		/// disables the cache.
+		void setCacheFile(const QString& file_name);
+
+		/// Set how long a port where nothing was found is remembered as empty (not probed).
+		/// 0 disables caching the empty ports. The default is 5 minutes.
+		void setEmptyPortCacheLifetime(int msec);
+
+		/// Remove the cached result, so that the next discovery probes all the ports
+		void clearCache();
+
+		/// Set the response timeout of each probe request. The default is 100 ms.
+		void setProbeTimeout(int msec);
+
+		/// Set the addresses to probe. The default is the default address of each category.
+		void setCandidateAddresses(const QVector<quint8>& addresses);
+
+		/// Use 16-bit CRC checksums for the probe requests
+		void setChecksum16bit(bool checksum_16bit);
+
+
+		/// Probe \c port_devices (all available serial ports if empty) in parallel.
+		/// The callback is called once all the ports are probed. Discovery errors (e.g.
+		/// a port that cannot be opened) are logged, such ports have no devices.
+		void discover(const QStringList& port_devices, const FinishFunc& finish_callback);
+
+		/// Get the result of the last discovery
+		[[nodiscard]] CcBusMap getBusMap() const;
+
+
+		/// Get the system locations of all available serial ports
+		[[nodiscard]] static QStringList getAvailablePorts();
+
+		/// Get the default addresses of all the device categories
+		[[nodiscard]] static QVector<quint8> getDefaultCandidateAddresses();
+
+
+	signals:
+
+		/// Emitted whenever a message should be logged.
+		void logMessage(QString msg);
+
+
+	private:
+
+		/// Probe function finish callback
+		using PortFinishFunc = std::function<void(const QString& error_msg, const QVector<CcDiscoveredDevice>& devices)>;
+
+		/// Cache entry of a port
+		struct CachedPort {
+			QVector<CcDiscoveredDevice> devices;  ///< Devices found on the port, in address order
+			qint64 probe_time_msec = 0;  ///< When the port was probed (msec since epoch)
+		};
+
+		/// Port device -> cache entry
+		using CachedPortMap = QMap<QString, CachedPort>;
+
+
+		/// Probe \c addresses on a single port. Devices that don't reply are skipped.
+		/// If \c get_categories is false, GetEquipmentCategory is not sent and the categories
+		/// are left unknown.
+		void probePort(const QString& port_device, const QVector<quint8>& addresses, bool get_categories,
+				const PortFinishFunc& finish_callback);
+
+		/// Load all the cache entries. Returns an empty map if the cache is disabled or invalid.
+		[[nodiscard]] CachedPortMap loadCache() const;
+
+		/// Store the cache entries in the cache file, replacing its contents
+		void storeCache(const CachedPortMap& cached_ports) const;
+
+
+		const SerialWorkerMode worker_mode_;  ///< Worker mode of the probing buses
+		const SerialTransportKind transport_kind_;  ///< Transport of the probing buses
+
+		QString cache_file_;  ///< Cache file, empty if disabled
+		int empty_port_cache_msec_ = 5 * 60 * 1000;  ///< Lifetime of the empty port cache entries
+		int probe_timeout_msec_ = 100;  ///< Probe request response timeout
+		QVector<quint8> candidate_addresses_;  ///< Addresses to probe
+		bool checksum_16bit_ = false;  ///< Probe checksum type
+
+		CcBusMap bus_map_;  ///< Result of the last discovery
+
+};
+
+
+
+}
+
+
+#endif
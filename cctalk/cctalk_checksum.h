@@ -0,0 +1,150 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_CHECKSUM_H
+#define CCTALK_CHECKSUM_H
+
+#include <QtGlobal>
+#include <array>
+#include <cstddef>
+
+
+namespace qtcc {
+
+
+/**
+\file
+
+ccTalk frame checksum policies.
+
+A ccTalk frame is [destination] [data size] [source] [header] [data ...] [checksum].
+
+With the simple 8-bit checksum, the checksum byte is chosen so that the sum of all the
+frame bytes is 0 (mod 256).
+
+With the 16-bit CRC checksum, the source address is not transmitted. CRC-CCITT
+(polynomial 0x1021, initial value 0, no reflection) is calculated over all the other bytes
+(destination, data size, header, data), its LSB is placed in the source address field and
+its MSB in the checksum field.
+
+Each policy provides seal() (fill in the checksum of a frame built with the checksum fields
+present) and verify(), both working on the raw frame bytes. The frame builder and validator
+(see CcFrame) are templated on the policy, so no per-byte branching on the checksum type
+is needed at runtime.
+*/
+
+
+
+/// Offset of the source address (or CRC LSB) field
+constexpr int cc_frame_source_offset = 2;
+
+/// Size of the frame without the data
+constexpr int cc_frame_overhead_size = 5;
+
+
+
+/// Generate the CRC-CCITT (polynomial 0x1021) lookup table
+constexpr std::array<quint16, 256> ccCrc16MakeTable()
+{
+	std::array<quint16, 256> table = {};
+	for (std::size_t i = 0; i < table.size(); ++i) {
+		auto crc = static_cast<quint16>(i << 8);
+		for (int bit = 0; bit < 8; ++bit) {
+			crc = static_cast<quint16>((crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1));
+		}
+		table[i] = crc;
+	}
+	return table;
+}
+
+
+
+/// CRC-CCITT lookup table, generated at compile time
+constexpr std::array<quint16, 256> cc_crc16_table = ccCrc16MakeTable();
+
+static_assert(cc_crc16_table[1] == 0x1021 && cc_crc16_table[255] == 0x1ef0, "Invalid CRC-CCITT table");
+
+
+
+/// Add a byte to a running CRC-CCITT value
+constexpr quint16 ccCrc16Update(quint16 crc, quint8 byte)
+{
+	return static_cast<quint16>((crc << 8) ^ cc_crc16_table[((crc >> 8) ^ byte) & 0xff]);
+}
+
+
+
+/// Simple 8-bit checksum policy
+struct CcChecksum8 {
+
+	/// The source address field carries the source address
+	static constexpr bool has_source_address = true;
+
+	/// Set the checksum field (the last byte) of a complete frame.
+	static void seal(char* frame, int size)
+	{
+		quint8 checksum = 0;
+		for (int i = 0; i < size - 1; ++i) {
+			checksum = static_cast<quint8>(checksum + quint8(frame[i]));
+		}
+		frame[size - 1] = char(static_cast<quint8>(256 - checksum));
+	}
+
+	/// Verify a complete frame. The sum of all bytes must be 0.
+	[[nodiscard]] static bool verify(const char* frame, int size)
+	{
+		quint8 checksum = 0;
+		for (int i = 0; i < size; ++i) {
+			checksum = static_cast<quint8>(checksum + quint8(frame[i]));
+		}
+		return checksum == 0;
+	}
+
+};
+
+
+
+/// 16-bit CRC-CCITT checksum policy
+struct CcChecksum16 {
+
+	/// The source address field carries the CRC LSB
+	static constexpr bool has_source_address = false;
+
+	/// Calculate the CRC of a complete frame, skipping the checksum fields.
+	[[nodiscard]] static quint16 calculate(const char* frame, int size)
+	{
+		quint16 crc = 0;
+		for (int i = 0; i < size - 1; ++i) {
+			if (i != cc_frame_source_offset) {
+				crc = ccCrc16Update(crc, quint8(frame[i]));
+			}
+		}
+		return crc;
+	}
+
+	/// Set the CRC fields (the source address field and the last byte) of a complete frame.
+	static void seal(char* frame, int size)
+	{
+		const quint16 crc = calculate(frame, size);
+		frame[cc_frame_source_offset] = char(crc & 0xff);
+		frame[size - 1] = char(crc >> 8);
+	}
+
+	/// Verify a complete frame.
+	[[nodiscard]] static bool verify(const char* frame, int size)
+	{
+		const quint16 received_crc = static_cast<quint16>(quint8(frame[cc_frame_source_offset])
+				| (quint8(frame[size - 1]) << 8));
+		return calculate(frame, size) == received_crc;
+	}
+
+};
+
+
+
+}
+
+
+#endif
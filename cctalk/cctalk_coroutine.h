@@ -0,0 +1,397 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_COROUTINE_H
+#define CCTALK_COROUTINE_H
+
+#ifdef QTCC_COROUTINES
+
+#include <QByteArray>
+#include <QString>
+#include <QObject>
+#include <QPointer>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "cctalk_enums.h"
+#include "cctalk_link_controller.h"
+#include "helpers/debug.h"
+
+
+namespace qtcc {
+
+
+/**
+\file
+
+C++20 coroutine support (enabled with the QTCC_COROUTINES CMake option).
+
+CctalkLinkController::ccRequestAwait() returns an awaitable request, and CcTask is
+a coroutine type, so that a command sequence can be written as straight-line code
+instead of nested ccRequest() / executeOnReturn() callbacks:
+\code
+CcTask<QString> readProductInfo(CctalkLinkController& link)
+{
+	QStringList infos;
+	for (CcHeader header : {CcHeader::GetManufacturer, CcHeader::GetProductCode, CcHeader::GetBuildCode}) {
+		CcReply reply = co_await link.ccRequestAwait(header);
+		if (!reply.isOk()) {
+			co_return QString();
+		}
+		infos << QString::fromLatin1(reply.command_data);
+	}
+	co_return infos.join(QStringLiteral("\n"));
+}
+
+readProductInfo(link).start([](QString info) { ... });
+\endcode
+
+The whole sequence uses a single coroutine frame; the awaiting state lives in the frame,
+and the reply callback only captures two pointers (no allocation). The coroutine is resumed
+from the reply callback, in the controller thread. A suspended coroutine is resumed exactly
+once for each request, also on timeouts and port errors (see executeOnReturn()).
+CctalkDevice::requestManufacturingInfo() is written this way if QTCC_COROUTINES is enabled.
+
+Destroying a suspended coroutine (e.g. destroying a CcTask that awaits a request) removes
+its reply callback (see CctalkLinkController::cancelOnReturn()). If the controller is destroyed
+while a coroutine awaits its request, the coroutine is not resumed anymore, and its frame is
+not freed.
+*/
+
+
+
+/// Result of an awaited ccTalk request
+struct CcReply {
+	quint64 request_id = 0;  ///< Request ID. 0 if the request could not be sent.
+	QString error_msg;  ///< Error message, empty on success
+	QByteArray command_data;  ///< Reply data
+
+	/// Check if the request succeeded
+	[[nodiscard]] bool isOk() const
+	{
+		return error_msg.isEmpty();
+	}
+};
+
+
+
+/// Awaitable ccTalk request, returned by CctalkLinkController::ccRequestAwait().
+/// The request is sent when awaited.
+class CcRequestAwaitable {
+	public:
+
+		/// Constructor
+		CcRequestAwaitable(CctalkLinkController* controller, CcHeader command, QByteArray data, int response_timeout_msec)
+				: controller_(controller), command_(command), data_(std::move(data)), response_timeout_msec_(response_timeout_msec)
+		{ }
+
+		/// Non-copyable
+		CcRequestAwaitable(const CcRequestAwaitable& other) = delete;
+
+		/// Non-copyable
+		CcRequestAwaitable& operator=(const CcRequestAwaitable& other) = delete;
+
+		/// Destructor. If the coroutine frame is destroyed while waiting for the reply,
+		/// the reply callback is removed, so that the destroyed frame is not resumed.
+		~CcRequestAwaitable()
+		{
+			if (waiting_ && controller_) {
+				controller_->cancelOnReturn(reply_.request_id);
+			}
+		}
+
+
+		/// Awaitable interface
+		[[nodiscard]] bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		/// Awaitable interface. Sends the request; doesn't suspend if it could not be sent.
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			reply_.request_id = controller_->ccRequest(command_, data_, response_timeout_msec_);
+			if (reply_.request_id == 0) {
+				reply_.error_msg = QObject::tr("! ccTalk request (%1) could not be sent.").arg(ccHeaderGetDisplayableName(command_));
+				return false;
+			}
+			waiting_ = true;
+			controller_->executeOnReturnView(reply_.request_id, [this, handle]([[maybe_unused]] quint64 request_id,
+					const QString& error_msg, CcByteView command_data) {
+				waiting_ = false;
+				reply_.error_msg = error_msg;
+				reply_.command_data = command_data.toByteArray();
+				handle.resume();
+			});
+			return true;
+		}
+
+		/// Awaitable interface
+		CcReply await_resume()
+		{
+			return std::move(reply_);
+		}
+
+
+	private:
+
+		QPointer<CctalkLinkController> controller_;  ///< Controller to send the request with. Null if it was destroyed.
+		CcHeader command_;  ///< Request command
+		QByteArray data_;  ///< Request data
+		int response_timeout_msec_ = 0;  ///< Response timeout
+		CcReply reply_;  ///< Result
+		bool waiting_ = false;  ///< The request was sent and the reply callback is registered
+
+};
+
+
+
+template<typename T = void>
+class CcTask;
+
+
+namespace detail {
+
+	/// CcTask promise, common part
+	struct CcTaskPromiseBase {
+		std::coroutine_handle<> continuation;  ///< Coroutine awaiting this task, if any
+		bool detached = false;  ///< Started with CcTask::start(), destroys itself when finished
+
+		/// Resumes the awaiting coroutine, or calls the finish callback of a detached task.
+		template<typename Promise>
+		struct FinalAwaiter {
+			[[nodiscard]] bool await_ready() const noexcept
+			{
+				return false;
+			}
+
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+			{
+				Promise& promise = handle.promise();
+				if (promise.continuation) {
+					return promise.continuation;
+				}
+				if (promise.detached) {
+					promise.callFinishCallback();
+					handle.destroy();
+				}
+				return std::noop_coroutine();
+			}
+
+			void await_resume() const noexcept
+			{ }
+		};
+
+		/// Tasks are lazy, they start when awaited or started.
+		std::suspend_always initial_suspend() const noexcept
+		{
+			return {};
+		}
+
+		/// The library doesn't use exceptions
+		void unhandled_exception() const noexcept
+		{
+			std::terminate();
+		}
+	};
+
+
+	/// CcTask promise for tasks returning a value
+	template<typename T>
+	struct CcTaskPromise : CcTaskPromiseBase {
+		std::optional<T> value;  ///< co_return value
+		std::function<void(T value)> finish_callback;  ///< Detached task callback
+
+		CcTask<T> get_return_object() noexcept;
+
+		FinalAwaiter<CcTaskPromise> final_suspend() const noexcept
+		{
+			return {};
+		}
+
+		void return_value(T arg_value)
+		{
+			value = std::move(arg_value);
+		}
+
+		void callFinishCallback()
+		{
+			if (finish_callback) {
+				finish_callback(std::move(*value));
+			}
+		}
+
+		T takeResult()
+		{
+			return std::move(*value);
+		}
+	};
+
+
+	/// CcTask promise for tasks without a value
+	template<>
+	struct CcTaskPromise<void> : CcTaskPromiseBase {
+		std::function<void()> finish_callback;  ///< Detached task callback
+
+		CcTask<void> get_return_object() noexcept;
+
+		FinalAwaiter<CcTaskPromise> final_suspend() const noexcept
+		{
+			return {};
+		}
+
+		void return_void() const noexcept
+		{ }
+
+		void callFinishCallback()
+		{
+			if (finish_callback) {
+				finish_callback();
+			}
+		}
+
+		void takeResult() const noexcept
+		{ }
+	};
+
+}
+
+
+
+/// Lazily started coroutine task. A task can be either co_awaited by another
+/// coroutine, or started with start() (detached, with an optional finish callback).
+template<typename T>
+class [[nodiscard]] CcTask {
+	public:
+
+		/// Coroutine interface
+		using promise_type = detail::CcTaskPromise<T>;
+
+		/// Finish callback type for start()
+		using FinishFunc = decltype(promise_type::finish_callback);
+
+
+		/// Constructor, used by the promise
+		explicit CcTask(std::coroutine_handle<promise_type> handle) noexcept
+				: handle_(handle)
+		{ }
+
+		/// Move constructor
+		CcTask(CcTask&& other) noexcept
+				: handle_(std::exchange(other.handle_, nullptr))
+		{ }
+
+		/// Move assignment
+		CcTask& operator=(CcTask&& other) noexcept
+		{
+			if (this != &other) {
+				destroy();
+				handle_ = std::exchange(other.handle_, nullptr);
+			}
+			return *this;
+		}
+
+		/// Non-copyable
+		CcTask(const CcTask& other) = delete;
+
+		/// Non-copyable
+		CcTask& operator=(const CcTask& other) = delete;
+
+		/// Destructor. Destroys the coroutine if it wasn't started with start().
+		~CcTask()
+		{
+			destroy();
+		}
+
+
+		/// Start the task without awaiting it. The coroutine frame is destroyed
+		/// when the task finishes, after calling \c finish_callback.
+		void start(FinishFunc finish_callback = FinishFunc())
+		{
+			auto handle = std::exchange(handle_, nullptr);
+			if (!handle) {
+				return;
+			}
+			handle.promise().detached = true;
+			handle.promise().finish_callback = std::move(finish_callback);
+			handle.resume();
+		}
+
+
+		/// Awaitable interface
+		[[nodiscard]] bool await_ready() const noexcept
+		{
+			return !handle_ || handle_.done();
+		}
+
+		/// Awaitable interface. Starts the task; it resumes the awaiting coroutine when finished.
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+		{
+			handle_.promise().continuation = awaiting;
+			return handle_;
+		}
+
+		/// Awaitable interface. Awaiting a task that was started with start() or moved
+		/// from is an error; it gives a default-constructed result.
+		T await_resume()
+		{
+			DBG_ASSERT(handle_);
+			if (!handle_) {
+				if constexpr (std::is_void_v<T>) {
+					return;
+				} else {
+					return T();
+				}
+			}
+			return handle_.promise().takeResult();
+		}
+
+
+	private:
+
+		/// Destroy the coroutine, if owned
+		void destroy()
+		{
+			if (handle_) {
+				handle_.destroy();
+				handle_ = nullptr;
+			}
+		}
+
+
+		std::coroutine_handle<promise_type> handle_;  ///< Coroutine, null if detached or moved from
+
+};
+
+
+
+namespace detail {
+
+	template<typename T>
+	CcTask<T> CcTaskPromise<T>::get_return_object() noexcept
+	{
+		return CcTask<T>(std::coroutine_handle<CcTaskPromise<T>>::from_promise(*this));
+	}
+
+
+	inline CcTask<void> CcTaskPromise<void>::get_return_object() noexcept
+	{
+		return CcTask<void>(std::coroutine_handle<CcTaskPromise<void>>::from_promise(*this));
+	}
+
+}
+
+
+
+}
+
+
+#endif  // QTCC_COROUTINES
+
+#endif
@@ -0,0 +1,82 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <algorithm>
+#include <utility>
+
+#include "cctalk_credit_event_channel.h"
+
+
+namespace qtcc {
+
+
+
+CcCreditEventChannel::CcCreditEventChannel(int capacity, Mode mode)
+		: mode_(mode), ring_(std::size_t(std::max(capacity, 2)), mode == Mode::MultiProducer)
+{ }
+
+
+
+void CcCreditEventChannel::setDataAvailableCallback(DataAvailableFunc callback)
+{
+	ring_.setDataAvailableCallback(std::move(callback));
+}
+
+
+
+bool CcCreditEventChannel::push(CcCreditEvent event)
+{
+	// A dropped event still consumes its sequence number, leaving a gap for the consumer to see.
+	event.host_sequence = last_sequence_.fetch_add(1, std::memory_order_relaxed) + 1;
+	return ring_.push(event);
+}
+
+
+
+int CcCreditEventChannel::drain(CcCreditEvent* events, int max_count)
+{
+	return ring_.drain(events, max_count);
+}
+
+
+
+QVector<CcCreditEvent> CcCreditEventChannel::drain(int max_count)
+{
+	QVector<CcCreditEvent> events;
+	ring_.drainInto(events, max_count);
+	return events;
+}
+
+
+
+quint64 CcCreditEventChannel::getDroppedCount() const
+{
+	return ring_.getDroppedCount();
+}
+
+
+
+quint64 CcCreditEventChannel::getLastSequence() const
+{
+	return last_sequence_.load(std::memory_order_relaxed);
+}
+
+
+
+int CcCreditEventChannel::getCapacity() const
+{
+	return int(ring_.getCapacity());
+}
+
+
+
+CcCreditEventChannel::Mode CcCreditEventChannel::getMode() const
+{
+	return mode_;
+}
+
+
+
+}
@@ -0,0 +1,125 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_CREDIT_EVENT_CHANNEL_H
+#define CCTALK_CREDIT_EVENT_CHANNEL_H
+
+#include <QtGlobal>
+#include <QVector>
+#include <atomic>
+#include <type_traits>
+
+#include "cctalk_enums.h"
+#include "helpers/lockfree_ring.h"
+
+
+namespace qtcc {
+
+
+/**
+\file
+
+Lock-free credit event channel.
+
+An alternative to the creditAccepted() signal for accounting consumers: each accepted
+coin / bill is pushed as a compact, trivially copyable record into a bounded ring buffer,
+which the consumer drains in batches from its own thread. Every record carries a host-side
+sequence number; if the consumer falls behind and the ring overflows, the dropped records
+leave gaps in the sequence (and are counted in getDroppedCount()), so a lagging consumer
+knows exactly how many credits it missed.
+
+A channel may be set on a single device (SingleProducer), or shared by a fleet of
+devices polled from different threads (MultiProducer).
+*/
+
+
+
+/// Accepted credit record
+struct CcCreditEvent {
+	quint64 host_sequence = 0;  ///< Channel-wide sequence number, starting at 1. Gaps mean dropped records.
+	qint64 timestamp_msec = 0;  ///< Detection (poll) time, UTC milliseconds since epoch
+	quint64 value = 0;  ///< Value in minor units: divide by 10^decimal_places to get the country currency value
+	quint8 decimal_places = 0;  ///< See value
+	CcCategory category = CcCategory::Unknown;  ///< Device category (coin acceptor or bill validator)
+	quint8 device_address = 0;  ///< ccTalk address of the device
+	quint8 device_event_counter = 0;  ///< Device event counter of this event (1 - 255)
+	quint8 position = 0;  ///< Coin position / bill type
+	quint8 sorter_path = 0;  ///< Coin sorter path. 0 for bills.
+};
+
+static_assert(std::is_trivially_copyable_v<CcCreditEvent>, "CcCreditEvent must be trivially copyable");
+
+
+
+/// Lock-free bounded channel of credit events
+class CcCreditEventChannel {
+	public:
+
+		/// Producer mode
+		enum class Mode {
+			SingleProducer,  ///< One producer thread (a single device, or devices in the same thread)
+			MultiProducer,  ///< Any number of producer threads
+		};
+
+
+		/// Called by a producer when the channel becomes non-empty, see NotifyingRing
+		using DataAvailableFunc = NotifyingRing<CcCreditEvent>::DataAvailableFunc;
+
+
+		/// Constructor. The capacity is rounded up to a power of two.
+		explicit CcCreditEventChannel(int capacity = 1024, Mode mode = Mode::SingleProducer);
+
+		/// Non-copyable
+		CcCreditEventChannel(const CcCreditEventChannel& other) = delete;
+
+		/// Non-copyable
+		CcCreditEventChannel& operator=(const CcCreditEventChannel& other) = delete;
+
+
+		/// Set the data-available callback. Set it before the producers start.
+		void setDataAvailableCallback(DataAvailableFunc callback);
+
+
+		/// Producer function. Assigns the host sequence number and queues the event.
+		/// \return false if the channel was full and the event was dropped.
+		bool push(CcCreditEvent event);
+
+
+		/// Consumer function. Move up to \c max_count events into \c events.
+		/// \return the number of events drained.
+		int drain(CcCreditEvent* events, int max_count);
+
+		/// Consumer function. Drain up to \c max_count events (all of them if \c max_count is 0).
+		/// With multiple producers, records pushed concurrently may be slightly out of sequence order.
+		[[nodiscard]] QVector<CcCreditEvent> drain(int max_count = 0);
+
+
+		/// Get the number of events dropped due to a full channel
+		[[nodiscard]] quint64 getDroppedCount() const;
+
+		/// Get the last assigned host sequence number (including dropped events)
+		[[nodiscard]] quint64 getLastSequence() const;
+
+		/// Get the channel capacity
+		[[nodiscard]] int getCapacity() const;
+
+		/// Get the producer mode
+		[[nodiscard]] Mode getMode() const;
+
+
+	private:
+
+		const Mode mode_;  ///< Producer mode
+		NotifyingRing<CcCreditEvent> ring_;  ///< Events
+		std::atomic<quint64> last_sequence_ = {0};  ///< Last assigned sequence number
+
+};
+
+
+
+}
+
+
+#endif
@@ -5,9 +5,12 @@ License: BSD-3-Clause
 
 #include <memory>
 #include <QStringList>
+#include <algorithm>
 #include <utility>
 
 #include "cctalk_device.h"
+#include "cctalk_bus.h"
+#include "cctalk_coroutine.h"
 #include "helpers/debug.h"
 #include "helpers/async_serializer.h"
 
@@ -15,8 +18,100 @@ License: BSD-3-Clause
 namespace qtcc {
 
 
+#ifdef QTCC_COROUTINES
+namespace {
+
+	/// Result of manufacturingInfoTask()
+	struct CcManufacturingInfo {
+		QString error_msg;  ///< Error message of the first failed request, empty on success
+		CcCategory category = CcCategory::Unknown;  ///< Equipment category
+		QStringList infos;  ///< Formatted information lines
+	};
+
+
+	/// Request the manufacturing information, stopping at the first error.
+	CcTask<CcManufacturingInfo> manufacturingInfoTask(CctalkLinkController& link)
+	{
+		CcManufacturingInfo result;
+
+		// Category
+		CcReply reply = co_await link.ccRequestAwait(CcHeader::GetEquipmentCategory);
+		if (!reply.isOk()) {
+			result.error_msg = reply.error_msg;
+			co_return result;
+		}
+		const QString category = QString::fromUtf8(reply.command_data);
+		result.infos << QObject::tr("*** Equipment category: %1").arg(category);
+		result.category = ccCategoryFromReportedName(category);
+
+		// Product code
+		reply = co_await link.ccRequestAwait(CcHeader::GetProductCode);
+		if (!reply.isOk()) {
+			result.error_msg = reply.error_msg;
+			co_return result;
+		}
+		result.infos << QObject::tr("*** Product code: %1").arg(QString::fromLatin1(reply.command_data));
+
+		// Build code
+		reply = co_await link.ccRequestAwait(CcHeader::GetBuildCode);
+		if (!reply.isOk()) {
+			result.error_msg = reply.error_msg;
+			co_return result;
+		}
+		result.infos << QObject::tr("*** Build code: %1").arg(QString::fromLatin1(reply.command_data));
+
+		// Manufacturer
+		reply = co_await link.ccRequestAwait(CcHeader::GetManufacturer);
+		if (!reply.isOk()) {
+			result.error_msg = reply.error_msg;
+			co_return result;
+		}
+		result.infos << QObject::tr("*** Manufacturer: %1").arg(QString::fromLatin1(reply.command_data));
+
+		// S/N
+		reply = co_await link.ccRequestAwait(CcHeader::GetSerialNumber);
+		if (!reply.isOk()) {
+			result.error_msg = reply.error_msg;
+			co_return result;
+		}
+		result.infos << QObject::tr("*** Serial number: %1").arg(QString::fromLatin1(reply.command_data.toHex()));
+
+		// Software revision
+		reply = co_await link.ccRequestAwait(CcHeader::GetSoftwareRevision);
+		if (!reply.isOk()) {
+			result.error_msg = reply.error_msg;
+			co_return result;
+		}
+		result.infos << QObject::tr("*** Software Revision: %1").arg(QString::fromLatin1(reply.command_data));
+
+		// ccTalk command set revision
+		reply = co_await link.ccRequestAwait(CcHeader::GetCommsRevision);
+		if (!reply.isOk()) {
+			result.error_msg = reply.error_msg;
+			co_return result;
+		}
+		const QByteArray& revision = reply.command_data;
+		if (revision.size() == 3) {
+			result.infos << QObject::tr("*** ccTalk product release: %1, ccTalk version %2.%3").arg(int(revision.at(0)))
+					.arg(int(revision.at(1))).arg(int(revision.at(2)));
+		} else {
+			result.infos << QObject::tr("*** ccTalk comms revision (encoded): %1").arg(QString::fromLatin1(revision.toHex()));
+		}
+
+		co_return result;
+	}
+
+}
+#endif
+
+
 CctalkDevice::CctalkDevice()
 {
+	// Signal arguments are passed by value to receivers in other threads.
+	qRegisterMetaType<qtcc::CcDeviceState>("qtcc::CcDeviceState");
+	qRegisterMetaType<qtcc::CcIdentifier>("qtcc::CcIdentifier");
+	qRegisterMetaType<qtcc::CcLostCreditsRecord>("qtcc::CcLostCreditsRecord");
+
 	// Set up log message passthrough from link controller to us.
 	connect(&link_controller_, &CctalkLinkController::logMessage, this, &CctalkDevice::logMessage);
 
@@ -26,8 +121,11 @@ CctalkDevice::CctalkDevice()
 		emit logMessage(error_msg);
 	});
 
-	// The polling interval may change with the state.
-	event_timer_.setInterval(not_alive_polling_interval_msec_);
+	// The polling interval may change with the state. The next iteration is
+	// scheduled when the previous one finishes.
+	setPollingInterval(not_alive_polling_interval_msec_);
+	event_timer_.setSingleShot(true);
+	event_timer_.setTimerType(Qt::PreciseTimer);
 
 	connect(&event_timer_, &QTimer::timeout, this, &CctalkDevice::timerIteration);
 }
@@ -41,6 +139,20 @@ CctalkLinkController& CctalkDevice::getLinkController()
 
 
 
+void CctalkDevice::moveToDeviceThread(QThread* thread)
+{
+	DBG_ASSERT_RETURN_NONE(thread);
+	DBG_ASSERT_RETURN_NONE(QThread::currentThread() == this->thread());
+
+	// Posted events (e.g. queued replies) and active timers move with the objects.
+	// The members are not our children, move them explicitly.
+	moveToThread(thread);
+	event_timer_.moveToThread(thread);
+	link_controller_.moveToControllerThread(thread);
+}
+
+
+
 void CctalkDevice::setBillValidationFunction(BillValidatorFunc validator)
 {
 	bill_validator_func_ = std::move(validator);
@@ -48,6 +160,63 @@ void CctalkDevice::setBillValidationFunction(BillValidatorFunc validator)
 
 
 
+void CctalkDevice::setPreferredBaudRate(qint32 baud_rate)
+{
+	preferred_baud_rate_ = baud_rate;
+}
+
+
+
+qint32 CctalkDevice::getPreferredBaudRate() const
+{
+	return preferred_baud_rate_;
+}
+
+
+
+void CctalkDevice::setIdentificationCache(std::shared_ptr<CcIdentificationCache> cache)
+{
+	identification_cache_ = std::move(cache);
+}
+
+
+
+std::shared_ptr<CcIdentificationCache> CctalkDevice::getIdentificationCache() const
+{
+	return identification_cache_;
+}
+
+
+
+void CctalkDevice::setCreditEventChannel(std::shared_ptr<CcCreditEventChannel> channel)
+{
+	credit_event_channel_ = std::move(channel);
+}
+
+
+
+std::shared_ptr<CcCreditEventChannel> CctalkDevice::getCreditEventChannel() const
+{
+	return credit_event_channel_;
+}
+
+
+
+void CctalkDevice::setMinimumPollingInterval(int msec)
+{
+	minimum_polling_interval_msec_ = std::max(msec, 0);
+	setPollingInterval(polling_interval_msec_);
+}
+
+
+
+int CctalkDevice::getMinimumPollingInterval() const
+{
+	return minimum_polling_interval_msec_;
+}
+
+
+
 bool CctalkDevice::initialize(const std::function<void(const QString& error_msg)>& finish_callback)
 {
 	if (getDeviceState() != CcDeviceState::ShutDown) {
@@ -75,10 +244,14 @@ void CctalkDevice::startTimer()
 {
 	emit logMessage(tr("Starting poll timer."));
 
-	event_timer_.start();
+	event_timer_enabled_ = true;
+	poll_scheduler_.reset();
 
-	// The timer will kick in only after a timeout, so do the first iteration manually.
-	QTimer::singleShot(0, this, SLOT(timerIteration()));
+	// Do the first iteration right away. If an iteration is running, the next one
+	// is scheduled when it finishes.
+	if (!timer_iteration_task_running_) {
+		event_timer_.start(0);
+	}
 }
 
 
@@ -87,11 +260,41 @@ void CctalkDevice::stopTimer()
 {
 	emit logMessage(tr("Stopping poll timer."));
 
+	event_timer_enabled_ = false;
 	event_timer_.stop();
 }
 
 
 
+void CctalkDevice::setPollingInterval(int msec)
+{
+	polling_interval_msec_ = (msec > 0 ? msec : default_normal_polling_interval_msec_);
+	poll_scheduler_.setIdleInterval(std::max(polling_interval_msec_, minimum_polling_interval_msec_));
+}
+
+
+
+void CctalkDevice::finishTimerIteration()
+{
+	timer_iteration_task_running_ = false;
+
+	const bool activity_detected = poll_activity_detected_;
+	poll_activity_detected_ = false;
+	const int delay_msec = poll_scheduler_.iterationFinished(activity_detected);
+
+	// Report the start of a series of overruns only, a slow device would flood the log otherwise.
+	if (poll_scheduler_.getConsecutiveOverrunCount() == 1) {
+		emit logMessage(tr("! Poll iteration took %1ms, longer than the polling interval (%2ms).")
+				.arg(poll_scheduler_.getLastIterationTime()).arg(poll_scheduler_.getIdleInterval()));
+	}
+
+	if (event_timer_enabled_) {
+		event_timer_.start(delay_msec);
+	}
+}
+
+
+
 void CctalkDevice::timerIteration()
 {
 	if (timer_iteration_task_running_) {
@@ -99,14 +302,15 @@ void CctalkDevice::timerIteration()
 	}
 // 	emit logMessage(tr("Polling..."));
 
-	// This is set to false in finish callbacks.
+	// This is set to false in finish callbacks (finishTimerIteration()).
 	timer_iteration_task_running_ = true;
+	poll_scheduler_.iterationStarted();
 
 
 	// The device is not initialized, do nothing and wait for request for state change to Initialized.
 	if (getDeviceState() == CcDeviceState::ShutDown) {
 		// Nothing
-		timer_iteration_task_running_ = false;
+		finishTimerIteration();
 		return;
 	}
 
@@ -116,10 +320,10 @@ void CctalkDevice::timerIteration()
 		requestCheckAlive([=]([[maybe_unused]] const QString& error_msg, bool alive) {
 			if (alive) {
 				requestSwitchDeviceState(CcDeviceState::Initialized, [=]([[maybe_unused]] const QString& local_error_msg) {
-					timer_iteration_task_running_ = false;
+					finishTimerIteration();
 				});
 			} else {
-				timer_iteration_task_running_ = false;
+				finishTimerIteration();
 			}
 		});
 		return;
@@ -133,12 +337,12 @@ void CctalkDevice::timerIteration()
 			if (fault_code == CcFaultCode::Ok) {
 				// The device is OK, resume normal rejecting mode.
 				requestSwitchDeviceState(CcDeviceState::NormalRejecting, [=]([[maybe_unused]] const QString& local_error_msg) {
-					timer_iteration_task_running_ = false;
+					finishTimerIteration();
 				});
 			} else {
 				// The device is not ok, resume diagnostics polling mode.
 				requestSwitchDeviceState(CcDeviceState::DiagnosticsPolling, [=]([[maybe_unused]] const QString& local_error_msg) {
-					timer_iteration_task_running_ = false;
+					finishTimerIteration();
 				});
 			}
 		});
@@ -147,9 +351,9 @@ void CctalkDevice::timerIteration()
 
 	// The device initialization failed, something wrong with it. Abort.
 	if (getDeviceState() == CcDeviceState::InitializationFailed) {
-		timer_iteration_task_running_ = false;
 		// Nothing we can do, cannot work with this device.
 		stopTimer();
+		finishTimerIteration();
 		return;
 	}
 
@@ -157,7 +361,7 @@ void CctalkDevice::timerIteration()
 	if (getDeviceState() == CcDeviceState::NormalAccepting) {
 		requestBufferedCreditEvents([=](const QString& error_msg, quint8 event_counter, const QVector<CcEventData>& event_data) {
 			processCreditEventLog(true, error_msg, event_counter, event_data, [=]() {
-				timer_iteration_task_running_ = false;
+				finishTimerIteration();
 			});
 		});
 		return;
@@ -167,7 +371,7 @@ void CctalkDevice::timerIteration()
 	if (getDeviceState() == CcDeviceState::NormalRejecting) {
 		requestBufferedCreditEvents([=](const QString& error_msg, quint8 event_counter, const QVector<CcEventData>& event_data) {
 			processCreditEventLog(false, error_msg, event_counter, event_data, [=]() {
-				timer_iteration_task_running_ = false;
+				finishTimerIteration();
 			});
 		});
 		return;
@@ -180,10 +384,10 @@ void CctalkDevice::timerIteration()
 			if (fault_code == CcFaultCode::Ok) {
 				// The error has been resolved, switch to rejecting mode.
 				requestSwitchDeviceState(CcDeviceState::NormalRejecting, [=]([[maybe_unused]] const QString& state_error_msg) {
-					timer_iteration_task_running_ = false;
+					finishTimerIteration();
 				});
 			} else {  // the fault is still there
-				timer_iteration_task_running_ = false;
+				finishTimerIteration();
 			}
 		});
 		return;
@@ -194,7 +398,7 @@ void CctalkDevice::timerIteration()
 	// NormalRejecting state will be enabled and the event table will be read, if everything's ok.
 	if (getDeviceState() == CcDeviceState::UnexpectedDown) {
 		requestSwitchDeviceState(CcDeviceState::Initialized, [=]([[maybe_unused]] const QString& error_msg) {
-			timer_iteration_task_running_ = false;
+			finishTimerIteration();
 		});
 		return;
 	}
@@ -204,7 +408,7 @@ void CctalkDevice::timerIteration()
 	// Assume it needs initialization.
 	if (getDeviceState() == CcDeviceState::ExternalReset) {
 		requestSwitchDeviceState(CcDeviceState::Initialized, [=]([[maybe_unused]] const QString& error_msg) {
-			timer_iteration_task_running_ = false;
+			finishTimerIteration();
 		});
 		return;
 	}
@@ -227,28 +431,28 @@ bool CctalkDevice::requestSwitchDeviceState(CcDeviceState state, const std::func
 		case CcDeviceState::ShutDown:
 		{
 			bool success = switchStateShutDown(finish_callback);
-			event_timer_.setInterval(normal_polling_interval_msec_);
+			setPollingInterval(normal_polling_interval_msec_);
 			stopTimer();
 			return success;
 		}
 
 		case CcDeviceState::UninitializedDown:
 			setDeviceState(state);
-			event_timer_.setInterval(not_alive_polling_interval_msec_);
+			setPollingInterval(not_alive_polling_interval_msec_);
 			finish_callback(QString());
 			return true;
 
 		case CcDeviceState::Initialized:
 		{
 			bool success = switchStateInitialized(finish_callback);
-			event_timer_.setInterval(normal_polling_interval_msec_);
+			setPollingInterval(normal_polling_interval_msec_);
 			startTimer();
 			return success;
 		}
 
 		case CcDeviceState::InitializationFailed:
 			setDeviceState(state);
-			event_timer_.setInterval(not_alive_polling_interval_msec_);
+			setPollingInterval(not_alive_polling_interval_msec_);
 			finish_callback(QString());
 			return true;
 
@@ -261,14 +465,14 @@ bool CctalkDevice::requestSwitchDeviceState(CcDeviceState state, const std::func
 		case CcDeviceState::DiagnosticsPolling:
 		{
 			bool success = switchStateDiagnosticsPolling(finish_callback);
-			event_timer_.setInterval(normal_polling_interval_msec_);
+			setPollingInterval(normal_polling_interval_msec_);
 			return success;
 		}
 
 		case CcDeviceState::UnexpectedDown:
 		case CcDeviceState::ExternalReset:
 			setDeviceState(state);
-			event_timer_.setInterval(not_alive_polling_interval_msec_);
+			setPollingInterval(not_alive_polling_interval_msec_);
 			finish_callback(QString());
 			return true;
 	}
@@ -286,6 +490,9 @@ bool CctalkDevice::switchStateInitialized(const std::function<void(const QString
 
 	auto shared_error = std::make_shared<QString>();
 	auto shared_alive = std::make_shared<bool>();
+	auto shared_cache = identification_cache_;  // the cache may be replaced while initializing
+	auto shared_cache_key = std::make_shared<QString>();
+	auto shared_cache_hit = std::make_shared<bool>(false);
 
 	auto aser = new AsyncSerializer(  // auto-deleted
 		// Finish callback
@@ -312,8 +519,45 @@ bool CctalkDevice::switchStateInitialized(const std::function<void(const QString
 		});
 	});
 
+	// Switch to a faster line speed, if requested. Failures are not fatal.
+	aser->add([=](AsyncSerializer* serializer) {
+		requestNegotiateBaudRate([=]([[maybe_unused]] qint32 baud_rate) {
+			serializer->continueSequence(true);
+		});
+	});
+
+	// Validate the cached identification data, if any. Errors are not fatal here,
+	// the full identification below reports them.
+	aser->add([=](AsyncSerializer* serializer) {
+		if (!shared_cache) {
+			serializer->continueSequence(true);
+			return;
+		}
+		requestIdentificationCacheKey([=](const QString& error_msg, const QString& key) {
+			CcIdentificationCacheEntry entry;
+			if (error_msg.isEmpty()) {
+				*shared_cache_key = key;
+				*shared_cache_hit = shared_cache->lookup(key, entry);
+			}
+			if (*shared_cache_hit) {
+				emit logMessage(tr("* Using cached identification data (key %1), skipping full identification.").arg(key));
+				emit logMessage(tr("* Manufacturing information:\n%1").arg(entry.manufacturing_info));
+				device_category_ = entry.category;
+				manufacturing_info_ = entry.manufacturing_info;
+				identifiers_ = entry.identifiers;
+			} else if (error_msg.isEmpty()) {
+				emit logMessage(tr("* No cached identification data for key %1, performing full identification.").arg(key));
+			}
+			serializer->continueSequence(true);
+		});
+	});
+
 	// Get device manufacturing info
 	aser->add([=](AsyncSerializer* serializer) {
+		if (*shared_cache_hit) {
+			serializer->continueSequence(true);
+			return;
+		}
 		requestManufacturingInfo([=](const QString& error_msg, CcCategory category, const QString& info) {
 			if (!error_msg.isEmpty()) {
 				*shared_error = error_msg;
@@ -348,6 +592,10 @@ bool CctalkDevice::switchStateInitialized(const std::function<void(const QString
 	// Get bill / coin identifiers
 // 	if (req_identifiers_on_init_) {
 		aser->add([=](AsyncSerializer* serializer) {
+			if (*shared_cache_hit) {
+				serializer->continueSequence(true);
+				return;
+			}
 			requestIdentifiers([=](const QString& error_msg, const QMap<quint8, CcIdentifier>& identifiers) {
 				if (!error_msg.isEmpty()) {
 					*shared_error = error_msg;
@@ -359,6 +607,18 @@ bool CctalkDevice::switchStateInitialized(const std::function<void(const QString
 		});
 // 	}
 
+	// Store the fresh identification data in the cache
+	aser->add([=](AsyncSerializer* serializer) {
+		if (shared_cache && !*shared_cache_hit && !shared_cache_key->isEmpty()) {
+			CcIdentificationCacheEntry entry;
+			entry.category = device_category_;
+			entry.manufacturing_info = manufacturing_info_;
+			entry.identifiers = identifiers_;
+			shared_cache->store(*shared_cache_key, entry);
+		}
+		serializer->continueSequence(true);
+	});
+
 	// Modify bill validator operating mode - enable escrow and stacker
 	aser->add([=](AsyncSerializer* serializer) {
 		if (device_category_ == CcCategory::BillValidator) {
@@ -477,6 +737,15 @@ void CctalkDevice::requestCheckAlive(const std::function<void(const QString& err
 	link_controller_.executeOnReturn(sent_request_id, [=](quint64 request_id, const QString& error_msg, const QByteArray& command_data) mutable {
 		if (!error_msg.isEmpty()) {
 			emit logMessage(tr("! Error checking for device alive status (simple poll): %1").arg(error_msg));
+
+			// The device may be back at the default speed (e.g. after a power cycle).
+			auto bus = link_controller_.getBus();
+			if (bus && bus->getBaudRate() != cc_default_baud_rate) {
+				emit logMessage(tr("* Falling back to %1 baud.").arg(cc_default_baud_rate));
+				bus->setBaudRate(cc_default_baud_rate);
+				requestCheckAlive(finish_callback);
+				return;
+			}
 			finish_callback(error_msg, false);
 			return;
 		}
@@ -493,6 +762,177 @@ void CctalkDevice::requestCheckAlive(const std::function<void(const QString& err
 
 
 
+void CctalkDevice::requestMaximumBaudRate(const std::function<void(const QString& error_msg, qint32 baud_rate)>& finish_callback)
+{
+	QByteArray command_arg;
+	command_arg.append(char(CcBaudRateOperation::RequestMaximum));
+
+	quint64 sent_request_id = link_controller_.ccRequest(CcHeader::SwitchBaudRate, command_arg);
+	link_controller_.executeOnReturn(sent_request_id, [=](quint64 request_id, const QString& error_msg, const QByteArray& command_data) mutable {
+		if (!error_msg.isEmpty()) {
+			emit logMessage(tr("! Error getting maximum baud rate: %1").arg(error_msg));
+			finish_callback(error_msg, 0);
+			return;
+		}
+		// Decode the data
+		const qint32 baud_rate = command_data.size() == 1 ? ccBaudRateGetValue(CcBaudRate(command_data.at(0))) : 0;
+		if (baud_rate == 0) {
+			QString error = tr("! Invalid baud rate data received.");
+			emit ccResponseDataDecodeError(request_id, error);  // auto-logged
+			finish_callback(error, 0);
+			return;
+		}
+		emit logMessage(tr("* Maximum supported baud rate: %1").arg(baud_rate));
+		finish_callback(QString(), baud_rate);
+	});
+}
+
+
+
+void CctalkDevice::requestSwitchBaudRate(CcBaudRate baud_rate_code, const std::function<void(const QString& error_msg)>& finish_callback)
+{
+	QByteArray command_arg;
+	command_arg.append(char(CcBaudRateOperation::Switch)).append(char(baud_rate_code));
+
+	quint64 sent_request_id = link_controller_.ccRequest(CcHeader::SwitchBaudRate, command_arg);
+	link_controller_.executeOnReturn(sent_request_id, [=](quint64 request_id, const QString& error_msg, const QByteArray& command_data) mutable {
+		if (!error_msg.isEmpty()) {
+			emit logMessage(tr("! Error switching baud rate: %1").arg(error_msg));
+			finish_callback(error_msg);
+			return;
+		}
+		if (!command_data.isEmpty()) {
+			QString error = tr("! Non-empty data received while waiting for ACK.");
+			emit ccResponseDataDecodeError(request_id, error);  // auto-logged
+			finish_callback(error);
+			return;
+		}
+		emit logMessage(tr("* Device accepted baud rate %1").arg(ccBaudRateGetValue(baud_rate_code)));
+		finish_callback(QString());
+	});
+}
+
+
+
+void CctalkDevice::requestNegotiateBaudRate(const std::function<void(qint32 baud_rate)>& finish_callback)
+{
+	auto bus = link_controller_.getBus();
+	DBG_ASSERT(bus);
+	const qint32 current_baud_rate = bus ? bus->getBaudRate() : cc_default_baud_rate;
+
+	if (!bus || preferred_baud_rate_ <= cc_default_baud_rate || preferred_baud_rate_ == current_baud_rate) {
+		finish_callback(current_baud_rate);
+		return;
+	}
+	if (bus->getAttachedCount() > 1) {
+		emit logMessage(tr("* The line is shared with other devices, keeping %1 baud.").arg(current_baud_rate));
+		finish_callback(current_baud_rate);
+		return;
+	}
+
+	requestMaximumBaudRate([=](const QString& error_msg, qint32 max_baud_rate) {
+		if (!error_msg.isEmpty()) {
+			emit logMessage(tr("* Baud rate switching is not supported by the device, keeping %1 baud.").arg(current_baud_rate));
+			finish_callback(current_baud_rate);
+			return;
+		}
+
+		// Pick the fastest standard rate that both sides agree on.
+		const qint32 max_usable_baud_rate = std::min(preferred_baud_rate_, max_baud_rate);
+		CcBaudRate baud_rate_code = CcBaudRate::Baud9600;
+		for (int code = int(CcBaudRate::Baud115200); code > int(CcBaudRate::Baud9600); --code) {
+			if (ccBaudRateGetValue(CcBaudRate(code)) <= max_usable_baud_rate) {
+				baud_rate_code = CcBaudRate(code);
+				break;
+			}
+		}
+		const qint32 baud_rate = ccBaudRateGetValue(baud_rate_code);
+		if (baud_rate == current_baud_rate) {
+			finish_callback(current_baud_rate);
+			return;
+		}
+
+		requestSwitchBaudRate(baud_rate_code, [=](const QString& switch_error_msg) {
+			if (!switch_error_msg.isEmpty()) {
+				finish_callback(current_baud_rate);  // the device stays at the old rate
+				return;
+			}
+
+			// The device has replied at the old rate and is switching now. Follow it, then
+			// make sure we can talk to each other. If not, requestCheckAlive() falls back to 9600.
+			bus->setBaudRate(baud_rate);
+			requestCheckAlive([=]([[maybe_unused]] const QString& alive_error_msg, bool alive) {
+				const qint32 result_baud_rate = bus->getBaudRate();
+				if (alive && result_baud_rate == baud_rate) {
+					emit logMessage(tr("* Line speed switched to %1 baud.").arg(baud_rate));
+				} else {
+					emit logMessage(tr("! Device doesn't respond at %1 baud, using %2 baud.").arg(baud_rate).arg(result_baud_rate));
+				}
+				finish_callback(result_baud_rate);
+			});
+		});
+	});
+}
+
+
+
+void CctalkDevice::requestIdentificationCacheKey(const std::function<void(const QString& error_msg, const QString& key)>& finish_callback)
+{
+	auto shared_error = std::make_shared<QString>();
+	auto replies = std::make_shared<QVector<QByteArray>>();
+
+	auto aser = new AsyncSerializer(  // auto-deleted
+		// Finish callback
+		[=]([[maybe_unused]] AsyncSerializer* serializer) {
+			if (!shared_error->isEmpty()) {
+				emit logMessage(tr("! Error getting identification cache key: %1").arg(*shared_error));
+				finish_callback(*shared_error, QString());
+				return;
+			}
+			finish_callback(QString(), CcIdentificationCache::createKey(replies->value(0), replies->value(1), replies->value(2)));
+		}
+	);
+
+	for (CcHeader header : {CcHeader::GetSerialNumber, CcHeader::GetBuildCode, CcHeader::GetSoftwareRevision}) {
+		aser->add([=](AsyncSerializer* serializer) {
+			quint64 sent_request_id = link_controller_.ccRequest(header, QByteArray());
+			link_controller_.executeOnReturn(sent_request_id, [=]([[maybe_unused]] quint64 request_id, const QString& error_msg, const QByteArray& command_data) mutable {
+				if (!error_msg.isEmpty()) {
+					*shared_error = error_msg;
+				} else {
+					replies->append(command_data);
+				}
+				serializer->continueSequence(error_msg.isEmpty());
+			});
+		});
+	}
+
+	aser->start();
+}
+
+
+
+#ifdef QTCC_COROUTINES
+
+void CctalkDevice::requestManufacturingInfo(const std::function<void(const QString& error_msg, CcCategory category, const QString& info)>& finish_callback)
+{
+	// The task frame is freed when it finishes.
+	manufacturingInfoTask(link_controller_).start([this, finish_callback](CcManufacturingInfo result) {
+		QString info = result.infos.join(QStringLiteral("\n"));
+
+		// Log the info
+		if (!result.error_msg.isEmpty()) {
+			emit logMessage(tr("! Error getting full general information: %1").arg(result.error_msg));
+		}
+		if (!info.isEmpty()) {
+			emit logMessage(tr("* Manufacturing information:\n%1").arg(info));
+		}
+		finish_callback(result.error_msg, result.category, info);
+	});
+}
+
+#else
+
 void CctalkDevice::requestManufacturingInfo(const std::function<void(const QString& error_msg, CcCategory category, const QString& info)>& finish_callback)
 {
 	auto shared_error = std::make_shared<QString>();
@@ -627,6 +1067,8 @@ void CctalkDevice::requestManufacturingInfo(const std::function<void(const QStri
 	aser->start();
 }
 
+#endif
+
 
 
 void CctalkDevice::requestPollingInterval(const std::function<void(const QString& error_msg, quint64 msec)>& finish_callback)
@@ -988,30 +1430,34 @@ void CctalkDevice::requestBufferedCreditEvents(const std::function<void(const QS
 	// [result B]: If A is 0, B is error code, see CcCoinAcceptorEventCode / CcBillValidatorErrorCode.
 	// If A is credit, B is sorter path (0 unsupported, 1-8 path number).
 
-	QString coin_bill = (device_category_ == CcCategory::CoinAcceptor ? tr("Coin") : tr("Bill"));
+	// Only translated if a message needs it, this runs on each poll.
+	auto coin_bill = [this]() {
+		return (device_category_ == CcCategory::CoinAcceptor ? tr("Coin") : tr("Bill"));
+	};
 	CcHeader command = (device_category_ == CcCategory::CoinAcceptor ? CcHeader::ReadBufferedCredit : CcHeader::ReadBufferedBillEvents);
 
 	quint64 sent_request_id = link_controller_.ccRequest(command, QByteArray());
-	link_controller_.executeOnReturn(sent_request_id,
-			[=](quint64 request_id, const QString& error_msg, const QByteArray& command_data) mutable {
+	// This is sent on each poll, so parse the reply in place, without copying it.
+	link_controller_.executeOnReturnView(sent_request_id,
+			[=](quint64 request_id, const QString& error_msg, CcByteView command_data) mutable {
 
 		// TODO Handle command timeout
 
 		QVector<CcEventData> event_data;
 		if (!error_msg.isEmpty()) {
-			emit logMessage(tr("! Error getting %1 buffered credit / events: %2").arg(coin_bill).arg(error_msg));
+			emit logMessage(tr("! Error getting %1 buffered credit / events: %2").arg(coin_bill()).arg(error_msg));
 			finish_callback(error_msg, 0, event_data);
 			return;
 		}
 		if (command_data.isEmpty()) {
-			QString error = tr("! Invalid (empty) %1 buffered credit / event data received.").arg(coin_bill);
+			QString error = tr("! Invalid (empty) %1 buffered credit / event data received.").arg(coin_bill());
 			emit ccResponseDataDecodeError(request_id, error);  // auto-logged
 			finish_callback(error, 0, event_data);
 			return;
 		}
 		if (command_data.size() % 2 != 1) {
 			QString error = tr("! Invalid %1 buffered credit / event data size received, unexpected size: %2.")
-					.arg(coin_bill).arg(command_data.size());
+					.arg(coin_bill()).arg(command_data.size());
 			emit ccResponseDataDecodeError(request_id, error);  // auto-logged
 			finish_callback(error, 0, event_data);
 			return;
@@ -1020,9 +1466,24 @@ void CctalkDevice::requestBufferedCreditEvents(const std::function<void(const QS
 		auto event_counter = quint8(command_data[0]);
 
 		// Log the table, but only if changed.
-		if (!event_log_read_ || last_event_num_ != event_counter) {
+		const std::shared_ptr<CcLogPipeline>& log_pipeline = link_controller_.getLogPipeline();
+		if (log_pipeline && (!event_log_read_ || last_event_num_ != event_counter)) {
+			if (log_pipeline->isEnabled(CcLogLevel::Info, CcLogCategory::EventTable)) {
+				CcLogRecord record;
+				record.request_id = request_id;
+				record.event = CcLogEvent::EventTable;
+				record.level = CcLogLevel::Info;
+				record.category = CcLogCategory::EventTable;
+				record.device_category = device_category_;
+				record.address = link_controller_.getDeviceAddress();
+				record.host_event_number = last_event_num_;
+				record.setPayload(command_data);
+				log_pipeline->push(record);
+			}
+			event_log_read_ = true;
+		} else if (!event_log_read_ || last_event_num_ != event_counter) {
 			QStringList strs;
-			strs << tr("* %1 buffered credit / event table (newest to oldest):").arg(coin_bill);
+			strs << tr("* %1 buffered credit / event table (newest to oldest):").arg(coin_bill());
 			strs << tr("*** Host-side last processed event number: %1").arg(int(last_event_num_));
 			strs << tr("*** Device-side event counter: %1").arg(int(event_counter));
 			for (int i = 1; (i+1) < command_data.size(); i += 2) {
@@ -1075,6 +1536,9 @@ void CctalkDevice::processCreditEventLog(bool accepting, const QString& event_lo
 		return;
 	}
 
+	const QDateTime previous_poll_time = last_event_poll_time_;
+	last_event_poll_time_ = QDateTime::currentDateTimeUtc();
+
 	// When the device is first booted, the event log contains all zeroes.
 
 	if (last_event_num_ == 0 && event_counter == 0) {
@@ -1096,7 +1560,7 @@ void CctalkDevice::processCreditEventLog(bool accepting, const QString& event_lo
 
 	// If the event counters are equal, there are no new events.
 	if (last_event_num_ == event_counter) {
-		// nothing
+		link_controller_.getStatistics()->recordEventPoll(0);
 		finish_callback();
 		return;
 	}
@@ -1109,17 +1573,41 @@ void CctalkDevice::processCreditEventLog(bool accepting, const QString& event_lo
 		emit logMessage(tr("! Detected device that was up (and generating events) before the host startup; ignoring \"credit accepted\" events."));
 	}
 
+	const quint8 previous_event_num = last_event_num_;
 	int num_new_events = int(event_counter) - int(last_event_num_);
 	if (num_new_events < 0) {
 		num_new_events += 255;
 	}
 	last_event_num_ = event_counter;
 
+	// More events may be coming (e.g. a handful of coins), poll in burst mode.
+	poll_activity_detected_ = true;
+
 	if (num_new_events > event_data.size()) {
 		emit logMessage(tr("! Event counter difference %1 is greater than buffer size %2, possible loss of credit.")
 				.arg(num_new_events).arg(event_data.size()));
 	}
 
+	// Track how full the buffer was. The events buffered before our startup don't tell
+	// anything about our polling rate.
+	if (!processing_app_startup_events) {
+		const int buffer_size = event_data.isEmpty() ? cc_event_buffer_size : event_data.size();
+		link_controller_.getStatistics()->recordEventPoll(num_new_events);
+		poll_scheduler_.reportBufferPressure(std::min(num_new_events, buffer_size), buffer_size);
+
+		if (num_new_events > buffer_size) {
+			CcLostCreditsRecord record;
+			record.previous_event_counter = previous_event_num;
+			record.event_counter = event_counter;
+			record.new_event_count = num_new_events;
+			record.lost_event_count = num_new_events - buffer_size;
+			record.previous_poll_time = previous_poll_time;
+			record.detection_time = last_event_poll_time_;
+			link_controller_.getStatistics()->recordEventBufferOverflow(record.lost_event_count);
+			emit creditsPossiblyLost(record);
+		}
+	}
+
 	// Newest to oldest
 	QVector<CcEventData> new_event_data = event_data.mid(0, num_new_events);
 	emit logMessage(tr("* Found %1 new event(s); processing from oldest to newest.").arg(new_event_data.size()));
@@ -1132,6 +1620,8 @@ void CctalkDevice::processCreditEventLog(bool accepting, const QString& event_lo
 	for (int i = new_event_data.size() - 1; i >= 0; --i) {
 		CcEventData ev = new_event_data.at(i);
 		const bool processing_last_event = (i == 0);
+		// The counter wraps from 255 to 1
+		const auto ev_counter = quint8((int(event_counter) - 1 - i + 255 * 2) % 255 + 1);
 
 		if (ev.hasError()) {
 			// Coin Acceptor
@@ -1183,6 +1673,7 @@ void CctalkDevice::processCreditEventLog(bool accepting, const QString& event_lo
 				}
 				if (!processing_app_startup_events) {
 					emit creditAccepted(ev.coin_id, id);
+					publishCreditEvent(ev.coin_id, id, ev.coin_sorter_path, ev_counter);
 				}
 
 			// Bills
@@ -1228,6 +1719,7 @@ void CctalkDevice::processCreditEventLog(bool accepting, const QString& event_lo
 					}
 					if (!processing_app_startup_events) {
 						emit creditAccepted(ev.bill_id, id);
+						publishCreditEvent(ev.bill_id, id, 0, ev_counter);
 					}
 
 				} else {
@@ -1242,6 +1734,11 @@ void CctalkDevice::processCreditEventLog(bool accepting, const QString& event_lo
 	// First, determine if the fault code is actually fatal.
 	// If it is, return the bill. If not, accept it, provided the validator function likes it.
 
+	// Poll quickly until the routing result shows up in the event log.
+	if (bill_routing_pending) {
+		poll_activity_detected_ = true;
+	}
+
 	if (!bill_routing_pending && !self_check_requested) {
 		// Nothing more to do, continue processing the events.
 		finish_callback();
@@ -1326,6 +1823,29 @@ void CctalkDevice::processCreditEventLog(bool accepting, const QString& event_lo
 
 
 
+void CctalkDevice::publishCreditEvent(quint8 position, const CcIdentifier& identifier, quint8 sorter_path, quint8 device_event_counter)
+{
+	if (!credit_event_channel_) {
+		return;
+	}
+	quint64 divisor = 0;
+	CcCreditEvent event;
+	event.timestamp_msec = last_event_poll_time_.toMSecsSinceEpoch();
+	event.value = identifier.getValue(divisor);
+	event.decimal_places = quint8(divisor);
+	event.category = device_category_;
+	event.device_address = link_controller_.getDeviceAddress();
+	event.device_event_counter = device_event_counter;
+	event.position = position;
+	event.sorter_path = sorter_path;
+	if (!credit_event_channel_->push(event)) {
+		emit logMessage(tr("! Credit event channel is full, credit event dropped (%1 dropped in total).")
+				.arg(credit_event_channel_->getDroppedCount()));
+	}
+}
+
+
+
 void CctalkDevice::requestRouteBill(CcBillRouteCommandType route,
 		const std::function<void(const QString& error_msg, CcBillRouteStatus status)>& finish_callback)
 {
@@ -1435,6 +1955,14 @@ void CctalkDevice::setDeviceState(CcDeviceState state)
 
 
 
+void CctalkDevice::setStoredIdentification(CcCategory category, const QMap<quint8, CcIdentifier>& identifiers)
+{
+	device_category_ = category;
+	identifiers_ = identifiers;
+}
+
+
+
 CcCategory CctalkDevice::getStoredDeviceCategory() const
 {
 	return device_category_;
@@ -1456,6 +1984,13 @@ int CctalkDevice::getStoredPollingInterval() const
 
 
 
+quint64 CctalkDevice::getPollOverrunCount() const
+{
+	return poll_scheduler_.getOverrunCount();
+}
+
+
+
 QMap<quint8, CcIdentifier> CctalkDevice::getStoredIndentifiers() const
 {
 	return identifiers_;
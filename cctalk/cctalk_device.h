@@ -9,12 +9,19 @@ License: BSD-3-Clause
 #include <QMap>
 #include <QTimer>
 #include <QTime>
+#include <QDateTime>
+#include <QThread>
+#include <QMetaType>
+#include <atomic>
 #include <functional>
 #include <memory>
 
 #include "helpers/async_serializer.h"
+#include "cctalk_credit_event_channel.h"
 #include "cctalk_enums.h"
+#include "cctalk_identification_cache.h"
 #include "cctalk_link_controller.h"
+#include "cctalk_poll_scheduler.h"
 
 
 
@@ -41,6 +48,8 @@ enum class CcDeviceState {
 	/// - read device manufacturing info (category, serial, manufacturer, ...)
 	/// - read device recommended polling frequency
 	/// - initialize coin / bill IDs (including country scaling)
+	/// - (manufacturing info and IDs are taken from the identification cache instead, if it's
+	///   set and the device serial number, build code and software revision match)
 	/// - enable stacker and escrow for bill validators
 	/// - set inhibit status off on all bills (but not coins!).
 	/// If the device doesn't respond to SimplePoll, UninitializedDown state is entered.
@@ -101,6 +110,21 @@ inline QString ccDeviceStateGetDisplayableName(CcDeviceState status)
 
 
 
+/// Record of an event buffer overflow: more events happened between two polls than
+/// the device buffer holds, so the oldest ones (possibly credits) were lost.
+struct CcLostCreditsRecord {
+	quint8 previous_event_counter = 0;  ///< Event counter seen by the previous poll
+	quint8 event_counter = 0;  ///< Event counter seen by this poll
+	int new_event_count = 0;  ///< Number of events that happened between the polls
+	int lost_event_count = 0;  ///< Number of events that didn't fit into the buffer
+	QDateTime previous_poll_time;  ///< Time of the previous poll (UTC)
+	QDateTime detection_time;  ///< Time of this poll (UTC)
+};
+
+
+
+
+
 /// ccTalk device. This class contains high-level functions to manipulate
 /// ccTalk devices. The actual messaging protocol is implemented in the
 /// controller-thread-managing CctalkLinkController class.
@@ -118,11 +142,57 @@ class CctalkDevice : public QObject {
 		CctalkLinkController& getLinkController();
 
 
+		/// Move the device (its state machine, timers and link controller, including the bus)
+		/// to \c thread, e.g. a dedicated high-priority thread, so that polling and escrow
+		/// handling don't depend on the responsiveness of the GUI thread. This must be called
+		/// from the current device thread (preferably in ShutDown state). All the devices sharing
+		/// a bus must be moved to the same thread.
+		/// Afterwards, call the device functions from its thread only (e.g. using
+		/// QMetaObject::invokeMethod()); the signals reach receivers in other threads through
+		/// queued connections. getDeviceState() may be called from any thread.
+		void moveToDeviceThread(QThread* thread);
+
+
 		/// This function is called in NormalAccepting state when a bill is inserted and
 		/// should be checked for validity by us.
 		/// If the function returns true, the bill is accepted.
+		/// The function is called in the device thread (see moveToDeviceThread()).
 		void setBillValidationFunction(BillValidatorFunc validator);
 
+		/// Set the line speed to negotiate (using SwitchBaudRate command) during initialization,
+		/// e.g. 115200 for USB devices. If the device supports a lower maximum, that is used instead.
+		/// 0 (default) or 9600 disables the negotiation. The negotiation is skipped if the bus is
+		/// shared with other devices, since all the devices on a line must use the same speed.
+		void setPreferredBaudRate(qint32 baud_rate);
+
+		/// Get the line speed set with setPreferredBaudRate().
+		[[nodiscard]] qint32 getPreferredBaudRate() const;
+
+		/// Set the identification cache. If set, initialization reads the device serial number,
+		/// build code and software revision first, and uses the cached manufacturing info and
+		/// coin / bill identifiers if they match. Otherwise (or if \c cache is null, the default)
+		/// the full identification is performed, and its results are stored in the cache.
+		void setIdentificationCache(std::shared_ptr<CcIdentificationCache> cache);
+
+		/// Get the identification cache set with setIdentificationCache().
+		[[nodiscard]] std::shared_ptr<CcIdentificationCache> getIdentificationCache() const;
+
+		/// Set a lock-free channel to push accepted credits to, in addition to emitting
+		/// creditAccepted(). The channel may be shared by several devices (see CcCreditEventChannel::Mode).
+		/// Set it before initializing the device; null (default) disables it.
+		void setCreditEventChannel(std::shared_ptr<CcCreditEventChannel> channel);
+
+		/// Get the channel set with setCreditEventChannel()
+		[[nodiscard]] std::shared_ptr<CcCreditEventChannel> getCreditEventChannel() const;
+
+		/// Set the minimum idle polling interval, e.g. to share a bus with other devices
+		/// (see CctalkDeviceManager). Burst polling and event buffer pressure may still poll faster,
+		/// so that no credits are lost. 0 (default) means no limit.
+		void setMinimumPollingInterval(int msec);
+
+		/// Get the interval set with setMinimumPollingInterval()
+		[[nodiscard]] int getMinimumPollingInterval() const;
+
 
 		/// Request initializing the device from ShutDown state.
 		/// Starts event timer.
@@ -143,14 +213,25 @@ class CctalkDevice : public QObject {
 		/// Stop event-handling timer
 		void stopTimer();
 
+		/// Set the idle polling interval. 0 means the default interval.
+		void setPollingInterval(int msec);
+
+		/// Finish the current timer iteration and schedule the next one (if the timer is running),
+		/// counting from now.
+		void finishTimerIteration();
+
 
 	signals:
 
 		/// Emitted whenever device state is changed.
-		void deviceStateChanged(CcDeviceState old_state, CcDeviceState new_state);
+		void deviceStateChanged(qtcc::CcDeviceState old_state, qtcc::CcDeviceState new_state);
 
 		/// Emitted whenever a credit is accepted.
-		void creditAccepted(quint8 id, CcIdentifier identifier);
+		void creditAccepted(quint8 id, qtcc::CcIdentifier identifier);
+
+		/// Emitted when the event buffer has overflowed between two polls (credits possibly lost).
+		/// The overflows are counted in the link statistics as well.
+		void creditsPossiblyLost(const qtcc::CcLostCreditsRecord& record);
 
 		/// Emitted whenever cctalk message data cannot be decoded (logic error)
 		void ccResponseDataDecodeError(quint64 request_id, const QString& error_msg);
@@ -194,8 +275,26 @@ class CctalkDevice : public QObject {
 
 
 		/// Send SimplePoll and return for ACK.
+		/// If there is no reply and the line is not at the default speed (the device may have been
+		/// power-cycled, or it failed to switch the speed), the line is switched back to 9600 baud
+		/// and the check is repeated.
 		void requestCheckAlive(const std::function<void(const QString& error_msg, bool alive)>& finish_callback);
 
+		/// Request the maximum baud rate supported by the device.
+		void requestMaximumBaudRate(const std::function<void(const QString& error_msg, qint32 baud_rate)>& finish_callback);
+
+		/// Request the device to switch to a new baud rate. The device replies at the old rate.
+		void requestSwitchBaudRate(CcBaudRate baud_rate_code, const std::function<void(const QString& error_msg)>& finish_callback);
+
+		/// Negotiate the preferred baud rate: query the maximum supported rate, switch the device
+		/// and the host port, and verify the link with SimplePoll. If anything fails after the switch,
+		/// the line falls back to 9600 baud. Negotiation errors are not fatal; the callback
+		/// receives the resulting line speed.
+		void requestNegotiateBaudRate(const std::function<void(qint32 baud_rate)>& finish_callback);
+
+		/// Request the identification cache key (serial number, build code and software revision).
+		void requestIdentificationCacheKey(const std::function<void(const QString& error_msg, const QString& key)>& finish_callback);
+
 		/// Request manufacturing information info from the device.
 		/// This includes category, serial number, manufacturer, ...
 		void requestManufacturingInfo(const std::function<void(const QString& error_msg, CcCategory category, const QString& info)>& finish_callback);
@@ -230,6 +329,9 @@ class CctalkDevice : public QObject {
 		void processCreditEventLog(bool accepting, const QString& event_log_cmd_error_msg, quint8 event_counter,
 				const QVector<CcEventData>& event_data, const std::function<void()>& finish_callback);
 
+		/// Push an accepted credit to the credit event channel, if set.
+		void publishCreditEvent(quint8 position, const CcIdentifier& identifier, quint8 sorter_path, quint8 device_event_counter);
+
 		/// Route a bill that is held in escrow.
 		void requestRouteBill(CcBillRouteCommandType route,
 				const std::function<void(const QString& error_msg, CcBillRouteStatus status)>& finish_callback);
@@ -247,7 +349,8 @@ class CctalkDevice : public QObject {
 
 	public:
 
-		/// Get device status as set by the latest status-updating function
+		/// Get device status as set by the latest status-updating function.
+		/// This function is thread-safe.
 		[[nodiscard]] CcDeviceState getDeviceState() const;
 
 
@@ -256,6 +359,10 @@ class CctalkDevice : public QObject {
 		/// Set the device status. Emits deviceStateChanged() if changed.
 		void setDeviceState(CcDeviceState state);
 
+		/// Set the stored category and identifiers without querying the device (e.g. when
+		/// replaying captured traffic).
+		void setStoredIdentification(CcCategory category, const QMap<quint8, CcIdentifier>& identifiers);
+
 
 	public:
 
@@ -271,22 +378,35 @@ class CctalkDevice : public QObject {
 		/// Get requestIdentifiers() result
 		[[nodiscard]] QMap<quint8, CcIdentifier> getStoredIndentifiers() const;
 
+		/// Get the number of poll iterations that took longer than the polling interval
+		[[nodiscard]] quint64 getPollOverrunCount() const;
+
 
 	private:
 
 		CctalkLinkController link_controller_;  ///< Controller for serial worker thread with cctalk link management support.
 
 		int normal_polling_interval_msec_ = 0;  ///< Polling interval for normal and diagnostics modes.
+		int polling_interval_msec_ = 0;  ///< Idle polling interval set by setPollingInterval()
+		int minimum_polling_interval_msec_ = 0;  ///< See setMinimumPollingInterval()
 		const int default_normal_polling_interval_msec_ = 100;  ///< Default polling interval for normal and diagnostics modes.
 		const int not_alive_polling_interval_msec_ = 1000;  ///< Polling interval for modes when the device doesn't respond to alive check.
 
-		QTimer event_timer_;  ///< Polling timer
+		QTimer event_timer_;  ///< Polling timer (single-shot, restarted after each iteration)
+		bool event_timer_enabled_ = false;  ///< True between startTimer() and stopTimer()
 		bool timer_iteration_task_running_ = false;  ///< Avoids parallel executions of state change, since it's asynchronous
+		CcPollScheduler poll_scheduler_;  ///< Plans the next poll iteration
+		bool poll_activity_detected_ = false;  ///< Set by processCreditEventLog() if new events or an escrowed bill were found
 
-		CcDeviceState device_state_ = CcDeviceState::ShutDown;  ///< Current status
+		std::atomic<CcDeviceState> device_state_ = {CcDeviceState::ShutDown};  ///< Current status, may be read from other threads
 
 		BillValidatorFunc bill_validator_func_;  ///< Bill validator function, which tells us to accept or reject a certain bill.
 
+		qint32 preferred_baud_rate_ = 0;  ///< Line speed to negotiate during initialization. 0 means no negotiation.
+
+		std::shared_ptr<CcIdentificationCache> identification_cache_;  ///< Cache of manufacturing info and identifiers. May be null.
+		std::shared_ptr<CcCreditEventChannel> credit_event_channel_;  ///< Accepted credits are pushed here. May be null.
+
 // 		QTimer reset_timer_;  ///< Timer that waits for the device to get back up after SoftReset
 // 		QTime last_reset_time_;  ///< Last time the device was SoftReset
 
@@ -298,6 +418,7 @@ class CctalkDevice : public QObject {
 
 		bool event_log_read_ = false;  ///< True if the event log was read at least once.
 		quint8 last_event_num_ = 0;  ///< Last event number returned by ReadBufferedCredit command.
+		QDateTime last_event_poll_time_;  ///< Time of the last successful event poll (UTC)
 
 };
 
@@ -306,4 +427,8 @@ class CctalkDevice : public QObject {
 }
 
 
+Q_DECLARE_METATYPE(qtcc::CcDeviceState)
+Q_DECLARE_METATYPE(qtcc::CcLostCreditsRecord)
+
+
 #endif
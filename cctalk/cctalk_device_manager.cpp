@@ -0,0 +1,301 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <QElapsedTimer>
+#include <QPointer>
+#include <algorithm>
+#include <memory>
+
+#include "cctalk_device_manager.h"
+#include "helpers/async_parallel_group.h"
+#include "helpers/debug.h"
+
+
+namespace qtcc {
+
+
+
+CctalkDeviceManager::CctalkDeviceManager(int io_thread_count, SerialTransportKind transport_kind)
+		: transport_kind_(transport_kind)
+{
+	DBG_ASSERT(io_thread_count > 0);
+	for (int i = 0; i < std::max(io_thread_count, 1); ++i) {
+		auto thread = std::make_unique<QThread>();
+		thread->setObjectName(QStringLiteral("cctalk-io-%1").arg(i));
+		thread->start();
+		io_threads_.push_back(std::move(thread));
+	}
+
+	balance_timer_.setInterval(balance_interval_msec);
+	connect(&balance_timer_, &QTimer::timeout, this, &CctalkDeviceManager::balanceBusLoad);
+	balance_timer_.start();
+}
+
+
+
+CctalkDeviceManager::~CctalkDeviceManager()
+{
+	balance_timer_.stop();
+
+	// The devices detach from the buses, the buses delete their workers in the I/O threads.
+	devices_.clear();
+	owned_devices_.clear();
+	buses_.clear();
+
+	for (auto& thread : io_threads_) {
+		thread->quit();
+	}
+	for (auto& thread : io_threads_) {
+		thread->wait();
+	}
+}
+
+
+
+void CctalkDeviceManager::addDevice(CctalkDevice* device)
+{
+	DBG_ASSERT_RETURN_NONE(device);
+	if (!devices_.contains(device)) {
+		devices_.append(device);
+	}
+}
+
+
+
+void CctalkDeviceManager::removeDevice(CctalkDevice* device)
+{
+	devices_.removeAll(device);
+
+	auto iter = std::find_if(owned_devices_.begin(), owned_devices_.end(), [device](const auto& owned_device) {
+		return owned_device.get() == device;
+	});
+	if (iter != owned_devices_.end()) {
+		// The device may be in the middle of a callback.
+		iter->release()->deleteLater();
+		owned_devices_.erase(iter);
+	}
+
+	balanceBusLoad();
+}
+
+
+
+QVector<CctalkDevice*> CctalkDeviceManager::getDevices() const
+{
+	return devices_;
+}
+
+
+
+void CctalkDeviceManager::initializeAll(const FinishFunc& finish_callback)
+{
+	auto elapsed = std::make_shared<QElapsedTimer>();
+	elapsed->start();
+
+	auto group = new AsyncParallelGroup(  // auto-deleted
+		// Finish callback
+		[=](AsyncParallelGroup* finished_group) {
+			const QVector<QString> errors = finished_group->getErrors();
+			const auto failed_count = std::count_if(errors.cbegin(), errors.cend(), [](const QString& error_msg) {
+				return !error_msg.isEmpty();
+			});
+			emit logMessage(tr("* Initialized %1 of %2 devices in %3 ms.")
+					.arg(errors.size() - int(failed_count)).arg(errors.size()).arg(elapsed->elapsed()));
+			finish_callback(errors);
+		}
+	);
+
+	for (CctalkDevice* device : devices_) {
+		QPointer<CctalkDevice> device_ptr(device);
+		group->add([=](AsyncParallelGroup* running_group, int branch_index) {
+			if (!device_ptr) {
+				running_group->finishBranch(branch_index, tr("! Device was deleted."));
+				return;
+			}
+			initializeDevice(device_ptr, [=](const QString& error_msg) {
+				running_group->finishBranch(branch_index, error_msg);
+			});
+		});
+	}
+
+	group->start();
+}
+
+
+
+void CctalkDeviceManager::shutdownAll(const FinishFunc& finish_callback)
+{
+	auto group = new AsyncParallelGroup(  // auto-deleted
+		// Finish callback
+		[=](AsyncParallelGroup* finished_group) {
+			finish_callback(finished_group->getErrors());
+		}
+	);
+
+	for (CctalkDevice* device : devices_) {
+		QPointer<CctalkDevice> device_ptr(device);
+		group->add([=](AsyncParallelGroup* running_group, int branch_index) {
+			if (!device_ptr) {
+				running_group->finishBranch(branch_index, tr("! Device was deleted."));
+				return;
+			}
+			if (device_ptr->getDeviceState() == CcDeviceState::ShutDown) {
+				device_ptr->getLinkController().closePort();
+				running_group->finishBranch(branch_index);
+				return;
+			}
+			device_ptr->shutdown([=](const QString& error_msg) {
+				// Close the port once the device is "shut down"
+				if (device_ptr) {
+					device_ptr->getLinkController().closePort();
+				}
+				running_group->finishBranch(branch_index, error_msg);
+			});
+		});
+	}
+
+	group->start();
+}
+
+
+
+CcLinkStatisticsSnapshot CctalkDeviceManager::getStatistics() const
+{
+	CcLinkStatisticsSnapshot total;
+	for (CctalkDevice* device : devices_) {
+		total.merge(device->getLinkController().getStatistics()->getSnapshot());
+	}
+	return total;
+}
+
+
+
+int CctalkDeviceManager::getIoThreadCount() const
+{
+	return int(io_threads_.size());
+}
+
+
+
+void CctalkDeviceManager::balanceBusLoad()
+{
+	for (auto iter = buses_.constBegin(); iter != buses_.constEnd(); ++iter) {
+		const std::shared_ptr<CctalkBus>& bus = iter.value();
+
+		QVector<CctalkDevice*> bus_devices;
+		for (CctalkDevice* device : devices_) {
+			if (device->getLinkController().getBus() == bus) {
+				bus_devices.append(device);
+			}
+		}
+
+		// A single device may poll as fast as it wants.
+		if (bus_devices.size() <= 1) {
+			for (CctalkDevice* device : bus_devices) {
+				device->setMinimumPollingInterval(0);
+			}
+			continue;
+		}
+
+		// An event poll is 5 bytes of request (echoed back) and 16 bytes of reply for
+		// ReadBufferedCredit, 10 bits per byte, plus the device reply delay.
+		const quint64 estimated_poll_usec = quint64(26 * 10) * 1000 * 1000 / quint64(std::max(bus->getBaudRate(), 1)) + 10 * 1000;
+
+		quint64 bus_poll_usec = 0;
+		for (CctalkDevice* device : bus_devices) {
+			const CcLinkStatisticsSnapshot snapshot = device->getLinkController().getStatistics()->getSnapshot();
+			quint64 poll_usec = 0;
+			for (CcHeader command : {CcHeader::ReadBufferedCredit, CcHeader::ReadBufferedBillEvents}) {
+				if (snapshot.commands.contains(command)) {
+					poll_usec = std::max(poll_usec, snapshot.commands.value(command).round_trip_time.getMeanUsec());
+				}
+			}
+			bus_poll_usec += (poll_usec > 0 ? poll_usec : estimated_poll_usec);
+		}
+
+		// Each device polls once per interval, all of them together take bus_poll_usec.
+		const int min_interval_msec = int(double(bus_poll_usec) / max_bus_poll_load / 1000.0 + 0.5);
+		for (CctalkDevice* device : bus_devices) {
+			device->setMinimumPollingInterval(min_interval_msec);
+		}
+	}
+}
+
+
+
+void CctalkDeviceManager::initializeDevice(CctalkDevice* device, const std::function<void(const QString& error_msg)>& finish_callback)
+{
+	if (device->getDeviceState() != CcDeviceState::ShutDown) {
+		finish_callback(QString());  // already running
+		return;
+	}
+
+	QPointer<CctalkDevice> device_ptr(device);
+	device->getLinkController().openPort([=](const QString& error_msg) {
+		if (!error_msg.isEmpty() || !device_ptr) {
+			finish_callback(error_msg.isEmpty() ? tr("! Device was deleted.") : error_msg);
+			return;
+		}
+		const bool started = device_ptr->initialize([=](const QString& init_error_msg) {
+			if (!init_error_msg.isEmpty()) {
+				finish_callback(init_error_msg);
+				return;
+			}
+			// Initialization errors switch the device to another state instead of being reported here.
+			const CcDeviceState state = device_ptr ? device_ptr->getDeviceState() : CcDeviceState::ShutDown;
+			if (state == CcDeviceState::ShutDown || state == CcDeviceState::UninitializedDown
+					|| state == CcDeviceState::InitializationFailed) {
+				finish_callback(tr("! Device initialization failed, the device is in %1 state.")
+						.arg(ccDeviceStateGetDisplayableName(state)));
+				return;
+			}
+			finish_callback(QString());
+		});
+		if (!started) {
+			finish_callback(tr("! Could not start device initialization."));
+		}
+	});
+}
+
+
+
+void CctalkDeviceManager::setupOwnedDevice(CctalkDevice* device, const QString& port_device, quint8 device_addr, bool checksum_16bit)
+{
+	DBG_ASSERT_RETURN_NONE(device);
+	owned_devices_.emplace_back(device);
+
+	device->getLinkController().setBus(getPortBus(port_device));
+	device->getLinkController().setCcTalkOptions(port_device, device_addr, checksum_16bit, false);
+	addDevice(device);
+
+	balanceBusLoad();
+}
+
+
+
+std::shared_ptr<CctalkBus> CctalkDeviceManager::getPortBus(const QString& port_device)
+{
+	if (auto bus = buses_.value(port_device)) {
+		return bus;
+	}
+
+	// Put the port on the thread that serves the fewest ports.
+	QVector<int> thread_ports(int(io_threads_.size()), 0);
+	for (int thread_index : qAsConst(bus_threads_)) {
+		++thread_ports[thread_index];
+	}
+	const int thread_index = int(std::min_element(thread_ports.cbegin(), thread_ports.cend()) - thread_ports.cbegin());
+
+	// The async worker doesn't block its thread while waiting for replies,
+	// so a thread can serve several ports.
+	auto bus = std::make_shared<CctalkBus>(SerialWorkerMode::Async, io_threads_.at(std::size_t(thread_index)).get(), transport_kind_);
+	buses_.insert(port_device, bus);
+	bus_threads_.insert(port_device, thread_index);
+	return bus;
+}
+
+
+
+}
@@ -0,0 +1,153 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_DEVICE_MANAGER_H
+#define CCTALK_DEVICE_MANAGER_H
+
+#include <QObject>
+#include <QVector>
+#include <QMap>
+#include <QString>
+#include <QThread>
+#include <QTimer>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "cctalk_device.h"
+#include "cctalk_bus.h"
+#include "cctalk_link_statistics.h"
+
+
+namespace qtcc {
+
+
+
+/// Manages a group of ccTalk devices (e.g. all the devices of a cabinet).
+/// Devices on different ports are initialized and shut down in parallel,
+/// so startup takes about as long as the slowest port.
+///
+/// Devices created with createDevice() are owned by the manager. Their serial ports
+/// are served by a small pool of I/O threads (one non-blocking worker per port, the
+/// ports are distributed over the threads), so a fleet of devices doesn't need one
+/// thread per port. Devices sharing a port get a minimum polling interval so that
+/// their polls together don't take more than a part of the bus time.
+class CctalkDeviceManager : public QObject {
+	Q_OBJECT
+	public:
+
+		/// Finish callback. \c errors has one element per device (in getDevices() order),
+		/// empty if the operation succeeded for that device.
+		using FinishFunc = std::function<void(const QVector<QString>& errors)>;
+
+
+		/// Constructor. \c io_thread_count I/O threads are started for the ports
+		/// of the devices created with createDevice().
+		explicit CctalkDeviceManager(int io_thread_count = 2, SerialTransportKind transport_kind = SerialTransportKind::QtSerialPort);
+
+		/// Destructor. Owned devices are deleted, then their buses, then the I/O threads
+		/// are stopped.
+		~CctalkDeviceManager() override;
+
+		/// Non-copyable
+		CctalkDeviceManager(const CctalkDeviceManager& other) = delete;
+
+		/// Non-copyable
+		CctalkDeviceManager& operator=(const CctalkDeviceManager& other) = delete;
+
+
+		/// Create a device owned by the manager, on a bus of \c port_device (the
+		/// bus is shared with the other devices on the same port).
+		/// Logging options may be set on the returned device before initialization.
+		template<typename Device>
+		Device* createDevice(const QString& port_device, quint8 device_addr, bool checksum_16bit = false);
+
+		/// Add a device. The device is not owned by the manager and must outlive it
+		/// (or be removed first).
+		void addDevice(CctalkDevice* device);
+
+		/// Remove a device. Owned devices are deleted (later, with deleteLater()).
+		void removeDevice(CctalkDevice* device);
+
+		/// Get all devices, in order of addition
+		[[nodiscard]] QVector<CctalkDevice*> getDevices() const;
+
+
+		/// Open the ports and initialize all the devices in ShutDown state concurrently.
+		/// Devices that are already initialized are left as they are. A device that
+		/// ends up in InitializationFailed or UninitializedDown state is reported as an error.
+		void initializeAll(const FinishFunc& finish_callback);
+
+		/// Shut down all the devices concurrently and close their ports.
+		void shutdownAll(const FinishFunc& finish_callback);
+
+
+		/// Get the combined link statistics of all the devices
+		[[nodiscard]] CcLinkStatisticsSnapshot getStatistics() const;
+
+		/// Get the number of I/O threads
+		[[nodiscard]] int getIoThreadCount() const;
+
+		/// Recalculate the minimum polling intervals of the devices sharing a bus.
+		/// This is done periodically and when devices are added or removed.
+		void balanceBusLoad();
+
+
+	signals:
+
+		/// Emitted whenever a summary message should be logged.
+		void logMessage(QString msg);
+
+
+	private:
+
+		/// Open the port and initialize a single device
+		void initializeDevice(CctalkDevice* device, const std::function<void(const QString& error_msg)>& finish_callback);
+
+		/// Set up and take ownership of a device created by createDevice()
+		void setupOwnedDevice(CctalkDevice* device, const QString& port_device, quint8 device_addr, bool checksum_16bit);
+
+		/// Get the bus of a port, creating it on the least used I/O thread if needed
+		std::shared_ptr<CctalkBus> getPortBus(const QString& port_device);
+
+
+		/// Fraction of the bus time the polls of all the devices on it may take
+		static constexpr double max_bus_poll_load = 0.8;
+
+		/// How often the bus load is recalculated
+		static constexpr int balance_interval_msec = 5000;
+
+
+		const SerialTransportKind transport_kind_;  ///< Transport of the buses created by the manager
+
+		QVector<CctalkDevice*> devices_;  ///< Managed devices
+		std::vector<std::unique_ptr<CctalkDevice>> owned_devices_;  ///< Devices created with createDevice()
+
+		std::vector<std::unique_ptr<QThread>> io_threads_;  ///< I/O thread pool
+		QMap<QString, std::shared_ptr<CctalkBus>> buses_;  ///< Port device -> bus, for owned devices
+		QMap<QString, int> bus_threads_;  ///< Port device -> index in io_threads_
+
+		QTimer balance_timer_;  ///< Periodic balanceBusLoad() timer
+
+};
+
+
+
+template<typename Device>
+Device* CctalkDeviceManager::createDevice(const QString& port_device, quint8 device_addr, bool checksum_16bit)
+{
+	static_assert(std::is_base_of_v<CctalkDevice, Device>, "Device must be derived from CctalkDevice");
+	auto* device = new Device();
+	setupOwnedDevice(device, port_device, device_addr, checksum_16bit);
+	return device;
+}
+
+
+
+}
+
+
+#endif
@@ -9,6 +9,9 @@ License: BSD-3-Clause
 #include <QMap>
 #include <QString>
 #include <QObject>
+#include <QMetaType>
+#include <array>
+#include <cstddef>
 #include <utility>
 
 #include "helpers/debug.h"
@@ -17,6 +20,59 @@ License: BSD-3-Clause
 namespace qtcc {
 
 
+/*
+The mappings below are used on the hot path (event polling, request scheduling, statistics),
+so the ones keyed by a byte are constexpr 256-entry tables indexed by the byte value.
+The displayable names are kept untranslated in the tables (marked for translation with
+QT_TRANSLATE_NOOP) and translated when requested, so that a translator installed
+after the first call is still used.
+*/
+
+
+/// Dense table indexed by a byte value (e.g. a quint8-based enum)
+template<typename Value>
+using CcByteTable = std::array<Value, 256>;
+
+
+namespace detail {
+
+	/// Create a table with \c entries, the rest of the elements set to \c default_value
+	template<typename Key, typename Value, std::size_t N>
+	constexpr CcByteTable<Value> ccMakeByteTable(Value default_value, const std::pair<Key, Value> (&entries)[N])
+	{
+		CcByteTable<Value> table = {};
+		for (auto& value : table) {
+			value = default_value;
+		}
+		for (const auto& entry : entries) {
+			table[std::size_t(entry.first)] = entry.second;
+		}
+		return table;
+	}
+
+
+	/// Create a table by calling \c func (taking \c Key) for each byte value
+	template<typename Key, typename Func>
+	constexpr auto ccGenerateByteTable(Func func)
+	{
+		CcByteTable<decltype(func(Key()))> table = {};
+		for (std::size_t i = 0; i < table.size(); ++i) {
+			table[i] = func(Key(i));
+		}
+		return table;
+	}
+
+
+	/// Translate a name from a name table. Returns an empty string for nullptr.
+	inline QString ccTranslateName(const char* name)
+	{
+		return name ? QObject::tr(name) : QString();
+	}
+
+}
+
+
+
 /// ccTalk header bytes. Note: Core commands are mandatory, Core plus are optional
 /// (except when required for a certain type of device).
 /// See specification Appendix 13 for mandatory commands.
@@ -129,60 +185,214 @@ enum class CcHeader : quint8 {
 
 
 
+/// Untranslated names, see ccHeaderGetDisplayableName()
+inline constexpr CcByteTable<const char*> cc_header_names = detail::ccMakeByteTable<CcHeader, const char*>(nullptr, {
+	{CcHeader::Reply, QT_TRANSLATE_NOOP("QObject", "Reply")},
+	{CcHeader::ResetDevice, QT_TRANSLATE_NOOP("QObject", "ResetDevice")},
+	{CcHeader::Busy, QT_TRANSLATE_NOOP("QObject", "Busy")},
+
+	{CcHeader::SwitchBaudRate, QT_TRANSLATE_NOOP("QObject", "SwitchBaudRate")},
+
+	{CcHeader::GetFraudCounter, QT_TRANSLATE_NOOP("QObject", "GetFraudCounter")},
+	{CcHeader::GetRejectCounter, QT_TRANSLATE_NOOP("QObject", "GetRejectCounter")},
+	{CcHeader::GetAcceptCounter, QT_TRANSLATE_NOOP("QObject", "GetAcceptCounter")},
+	{CcHeader::GetInsertionCounter, QT_TRANSLATE_NOOP("QObject", "GetInsertionCounter")},
+
+	{CcHeader::ReadBufferedBillEvents, QT_TRANSLATE_NOOP("QObject", "ReadBufferedBillEvents")},
+	{CcHeader::RouteBill, QT_TRANSLATE_NOOP("QObject", "RouteBill")},
+	{CcHeader::ReadBufferedCredit, QT_TRANSLATE_NOOP("QObject", "ReadBufferedCredit")},
+
+	{CcHeader::PerformSelfCheck, QT_TRANSLATE_NOOP("QObject", "PerformSelfCheck")},
+
+	{CcHeader::GetInhibitStatus, QT_TRANSLATE_NOOP("QObject", "GetInhibitStatus")},
+	{CcHeader::SetInhibitStatus, QT_TRANSLATE_NOOP("QObject", "SetInhibitStatus")},
+	{CcHeader::GetMasterInhibitStatus, QT_TRANSLATE_NOOP("QObject", "GetMasterInhibitStatus")},
+	{CcHeader::SetMasterInhibitStatus, QT_TRANSLATE_NOOP("QObject", "SetMasterInhibitStatus")},
+	{CcHeader::SetBillOperatingMode, QT_TRANSLATE_NOOP("QObject", "SetBillOperatingMode")},
+
+	{CcHeader::GetCountryScalingFactor, QT_TRANSLATE_NOOP("QObject", "GetCountryScalingFactor")},
+	{CcHeader::GetVariableSet, QT_TRANSLATE_NOOP("QObject", "GetVariableSet")},
+	{CcHeader::GetBillId, QT_TRANSLATE_NOOP("QObject", "GetBillId")},
+	{CcHeader::GetCoinId, QT_TRANSLATE_NOOP("QObject", "GetCoinId")},
+
+	{CcHeader::GetBaseYear, QT_TRANSLATE_NOOP("QObject", "GetBaseYear")},
+	{CcHeader::GetCommsRevision, QT_TRANSLATE_NOOP("QObject", "GetCommsRevision")},
+	{CcHeader::GetBuildCode, QT_TRANSLATE_NOOP("QObject", "GetBuildCode")},
+	{CcHeader::GetSoftwareRevision, QT_TRANSLATE_NOOP("QObject", "GetSoftwareRevision")},
+	{CcHeader::GetSerialNumber, QT_TRANSLATE_NOOP("QObject", "GetSerialNumber")},
+	{CcHeader::GetProductCode, QT_TRANSLATE_NOOP("QObject", "GetProductCode")},
+	{CcHeader::GetEquipmentCategory, QT_TRANSLATE_NOOP("QObject", "GetEquipmentCategory")},
+	{CcHeader::GetManufacturer, QT_TRANSLATE_NOOP("QObject", "GetManufacturer")},
+
+	{CcHeader::GetStatus, QT_TRANSLATE_NOOP("QObject", "GetStatus")},
+
+	{CcHeader::GetPollingPriority, QT_TRANSLATE_NOOP("QObject", "GetPollingPriority")},
+	{CcHeader::AddressPoll, QT_TRANSLATE_NOOP("QObject", "AddressPoll")},
+	{CcHeader::SimplePoll, QT_TRANSLATE_NOOP("QObject", "SimplePoll")},
+
+	{CcHeader::FactorySetUpAndTest, QT_TRANSLATE_NOOP("QObject", "FactorySetUpAndTest")},
+});
+
+
 /// Get displayable name
 inline QString ccHeaderGetDisplayableName(CcHeader header)
 {
-	static QMap<CcHeader, QString> name_map = {
-		{CcHeader::Reply, QObject::tr("Reply")},
-		{CcHeader::ResetDevice, QObject::tr("ResetDevice")},
-		{CcHeader::Busy, QObject::tr("Busy")},
-
-		{CcHeader::SwitchBaudRate, QObject::tr("SwitchBaudRate")},
-
-		{CcHeader::GetFraudCounter, QObject::tr("GetFraudCounter")},
-		{CcHeader::GetRejectCounter, QObject::tr("GetRejectCounter")},
-		{CcHeader::GetAcceptCounter, QObject::tr("GetAcceptCounter")},
-		{CcHeader::GetInsertionCounter, QObject::tr("GetInsertionCounter")},
-
-		{CcHeader::ReadBufferedBillEvents, QObject::tr("ReadBufferedBillEvents")},
-		{CcHeader::RouteBill, QObject::tr("RouteBill")},
-		{CcHeader::ReadBufferedCredit, QObject::tr("ReadBufferedCredit")},
-
-		{CcHeader::PerformSelfCheck, QObject::tr("PerformSelfCheck")},
-
-		{CcHeader::GetInhibitStatus, QObject::tr("GetInhibitStatus")},
-		{CcHeader::SetInhibitStatus, QObject::tr("SetInhibitStatus")},
-		{CcHeader::GetMasterInhibitStatus, QObject::tr("GetMasterInhibitStatus")},
-		{CcHeader::SetMasterInhibitStatus, QObject::tr("SetMasterInhibitStatus")},
-		{CcHeader::SetBillOperatingMode, QObject::tr("SetBillOperatingMode")},
-
-		{CcHeader::GetCountryScalingFactor, QObject::tr("GetCountryScalingFactor")},
-		{CcHeader::GetVariableSet, QObject::tr("GetVariableSet")},
-		{CcHeader::GetBillId, QObject::tr("GetBillId")},
-		{CcHeader::GetCoinId, QObject::tr("GetCoinId")},
-
-		{CcHeader::GetBaseYear, QObject::tr("GetBaseYear")},
-		{CcHeader::GetCommsRevision, QObject::tr("GetCommsRevision")},
-		{CcHeader::GetBuildCode, QObject::tr("GetBuildCode")},
-		{CcHeader::GetSoftwareRevision, QObject::tr("GetSoftwareRevision")},
-		{CcHeader::GetSerialNumber, QObject::tr("GetSerialNumber")},
-		{CcHeader::GetProductCode, QObject::tr("GetProductCode")},
-		{CcHeader::GetEquipmentCategory, QObject::tr("GetEquipmentCategory")},
-		{CcHeader::GetManufacturer, QObject::tr("GetManufacturer")},
-
-		{CcHeader::GetStatus, QObject::tr("GetStatus")},
-
-		{CcHeader::GetPollingPriority, QObject::tr("GetPollingPriority")},
-		{CcHeader::AddressPoll, QObject::tr("AddressPoll")},
-		{CcHeader::SimplePoll, QObject::tr("SimplePoll")},
-
-		{CcHeader::FactorySetUpAndTest, QObject::tr("FactorySetUpAndTest")},
-	};
-	return name_map.value(header, QString());
+	return detail::ccTranslateName(cc_header_names[std::size_t(header)]);
+}
+
+
+
+/// Transmit queue priority of a request. The serial worker always sends the
+/// highest-priority queued request next, so that event polling and escrow routing
+/// are not delayed by long identification or diagnostics sequences.
+enum class CcRequestPriority {
+	RealTime,  ///< Credit-critical: event polling and bill routing
+	Normal,  ///< Inhibits, resets, status and other control commands
+	Background,  ///< Identification, counters, diagnostics
+};
+
+
+
+/// Transmit queue priorities of request headers, see ccHeaderGetRequestPriority()
+inline constexpr CcByteTable<CcRequestPriority> cc_header_priorities = detail::ccMakeByteTable<CcHeader, CcRequestPriority>(CcRequestPriority::Normal, {
+	{CcHeader::ReadBufferedBillEvents, CcRequestPriority::RealTime},
+	{CcHeader::RouteBill, CcRequestPriority::RealTime},
+	{CcHeader::ReadBufferedCredit, CcRequestPriority::RealTime},
+
+	{CcHeader::GetFraudCounter, CcRequestPriority::Background},
+	{CcHeader::GetRejectCounter, CcRequestPriority::Background},
+	{CcHeader::GetAcceptCounter, CcRequestPriority::Background},
+	{CcHeader::GetInsertionCounter, CcRequestPriority::Background},
+
+	{CcHeader::PerformSelfCheck, CcRequestPriority::Background},
+
+	{CcHeader::GetCountryScalingFactor, CcRequestPriority::Background},
+	{CcHeader::GetVariableSet, CcRequestPriority::Background},
+	{CcHeader::GetBillId, CcRequestPriority::Background},
+	{CcHeader::GetCoinId, CcRequestPriority::Background},
+
+	{CcHeader::GetBaseYear, CcRequestPriority::Background},
+	{CcHeader::GetCommsRevision, CcRequestPriority::Background},
+	{CcHeader::GetBuildCode, CcRequestPriority::Background},
+	{CcHeader::GetSoftwareRevision, CcRequestPriority::Background},
+	{CcHeader::GetSerialNumber, CcRequestPriority::Background},
+	{CcHeader::GetProductCode, CcRequestPriority::Background},
+	{CcHeader::GetEquipmentCategory, CcRequestPriority::Background},
+	{CcHeader::GetManufacturer, CcRequestPriority::Background},
+
+	{CcHeader::GetPollingPriority, CcRequestPriority::Background},
+});
+
+
+/// Get the transmit queue priority of a request header
+constexpr CcRequestPriority ccHeaderGetRequestPriority(CcHeader header)
+{
+	return cc_header_priorities[std::size_t(header)];
+}
+
+
+
+namespace detail {
+
+	/// Idempotency of a header, used to build cc_idempotent_headers
+	constexpr bool ccHeaderComputeIdempotent(CcHeader header)
+	{
+		switch (header) {
+			case CcHeader::GetFraudCounter:
+			case CcHeader::GetRejectCounter:
+			case CcHeader::GetAcceptCounter:
+			case CcHeader::GetInsertionCounter:
+			case CcHeader::ReadBufferedBillEvents:  // the event counter tells the new events apart
+			case CcHeader::ReadBufferedCredit:
+			case CcHeader::PerformSelfCheck:
+			case CcHeader::GetInhibitStatus:
+			case CcHeader::GetMasterInhibitStatus:
+			case CcHeader::GetCountryScalingFactor:
+			case CcHeader::GetVariableSet:
+			case CcHeader::GetBillId:
+			case CcHeader::GetCoinId:
+			case CcHeader::GetBaseYear:
+			case CcHeader::GetCommsRevision:
+			case CcHeader::GetBuildCode:
+			case CcHeader::GetSoftwareRevision:
+			case CcHeader::GetSerialNumber:
+			case CcHeader::GetProductCode:
+			case CcHeader::GetEquipmentCategory:
+			case CcHeader::GetManufacturer:
+			case CcHeader::GetStatus:
+			case CcHeader::GetPollingPriority:
+			case CcHeader::SimplePoll:
+				return true;
+			default:
+				break;
+		}
+		return false;
+	}
+
+}
+
+
+/// Headers that can be sent several times with the same effect as once, see ccHeaderIsIdempotent()
+inline constexpr CcByteTable<bool> cc_idempotent_headers = detail::ccGenerateByteTable<CcHeader>(detail::ccHeaderComputeIdempotent);
+
+
+/// Return true if sending the request several times has the same effect as sending it once,
+/// so it can be retransmitted after a corrupted or missing reply (see CcRetryPolicy).
+/// These are the read-only requests; RouteBill, inhibit and mode changes, resets and
+/// line speed changes are not idempotent.
+constexpr bool ccHeaderIsIdempotent(CcHeader header)
+{
+	return cc_idempotent_headers[std::size_t(header)];
+}
+
+
+
+/// Default ccTalk line speed. All devices must support it.
+constexpr qint32 cc_default_baud_rate = 9600;
+
+
+
+/// Baud rate code used by SwitchBaudRate command
+enum class CcBaudRate : quint8 {
+	Baud4800 = 0,
+	Baud9600 = 1,
+	Baud19200 = 2,
+	Baud38400 = 3,
+	Baud57600 = 4,
+	Baud115200 = 5,
+};
+
+
+
+/// Line speeds of baud rate codes, see ccBaudRateGetValue()
+inline constexpr CcByteTable<qint32> cc_baud_rate_values = detail::ccMakeByteTable<CcBaudRate, qint32>(0, {
+	{CcBaudRate::Baud4800, 4800},
+	{CcBaudRate::Baud9600, 9600},
+	{CcBaudRate::Baud19200, 19200},
+	{CcBaudRate::Baud38400, 38400},
+	{CcBaudRate::Baud57600, 57600},
+	{CcBaudRate::Baud115200, 115200},
+});
+
+
+/// Get the line speed (bits per second) of a baud rate code. Returns 0 for unknown codes.
+constexpr qint32 ccBaudRateGetValue(CcBaudRate code)
+{
+	return cc_baud_rate_values[std::size_t(code)];
 }
 
 
 
+/// SwitchBaudRate command operation (the first data byte)
+enum class CcBaudRateOperation : quint8 {
+	RequestCurrent = 0,  ///< Reply: [baud rate code]
+	Switch = 1,  ///< Data: [baud rate code]. The device ACKs at the old rate, then switches.
+	RequestMaximum = 2,  ///< Reply: [baud rate code]
+	RequestSupport = 3,  ///< Data: [baud rate code]. Reply: [1 if supported, 0 if not]
+};
+
+
+
 /// Equipment category
 enum class CcCategory {
 	Unknown,
@@ -238,57 +448,73 @@ inline CcCategory ccCategoryFromReportedName(QString reported_name)
 
 
 /// Get default cctalk address for a device category
-inline quint8 ccCategoryGetDefaultAddress(CcCategory category)
+constexpr quint8 ccCategoryGetDefaultAddress(CcCategory category)
 {
-	static QMap<CcCategory, quint8> address_map = {
-		{CcCategory::CoinAcceptor, 2},
-		{CcCategory::Payout, 3},
-		{CcCategory::Reel, 30},
-		{CcCategory::BillValidator, 40},
-		{CcCategory::CardReader, 50},
-		{CcCategory::Changer, 55},
-		{CcCategory::Display, 60},
-		{CcCategory::Keypad, 70},
-		{CcCategory::Dongle, 80},
-		{CcCategory::Meter, 90},
-		{CcCategory::Bootloader, 99},
-		{CcCategory::Power, 100},
-		{CcCategory::Printer, 110},
-		{CcCategory::Rng, 120},
-		{CcCategory::HopperScale, 130},
-		{CcCategory::CoinFeeder, 140},
-		{CcCategory::BillRecycler, 150},
-		{CcCategory::Escrow, 160},
-		{CcCategory::Debug, 240},
-	};
-	return address_map.value(category, 0);
+	switch (category) {
+		case CcCategory::Unknown: break;
+		case CcCategory::CoinAcceptor: return 2;
+		case CcCategory::Payout: return 3;
+		case CcCategory::Reel: return 30;
+		case CcCategory::BillValidator: return 40;
+		case CcCategory::CardReader: return 50;
+		case CcCategory::Changer: return 55;
+		case CcCategory::Display: return 60;
+		case CcCategory::Keypad: return 70;
+		case CcCategory::Dongle: return 80;
+		case CcCategory::Meter: return 90;
+		case CcCategory::Bootloader: return 99;
+		case CcCategory::Power: return 100;
+		case CcCategory::Printer: return 110;
+		case CcCategory::Rng: return 120;
+		case CcCategory::HopperScale: return 130;
+		case CcCategory::CoinFeeder: return 140;
+		case CcCategory::BillRecycler: return 150;
+		case CcCategory::Escrow: return 160;
+		case CcCategory::Debug: return 240;
+	}
+	return 0;
 }
 
 
 
+namespace detail {
+
+	/// Category of a standard address, used to build cc_address_categories
+	constexpr CcCategory ccCategoryComputeFromAddress(quint8 address)
+	{
+		if (address == 2 || (address >= 11 && address <= 17)) return CcCategory::CoinAcceptor;
+		if (address == 3 || (address >= 4 && address <= 10)) return CcCategory::Payout;
+		if (address == 30 || (address >= 31 && address <= 34)) return CcCategory::Reel;
+		if (address == 40 || (address >= 41 && address <= 47)) return CcCategory::BillValidator;
+		if (address == 50) return CcCategory::CardReader;
+		if (address == 55) return CcCategory::Changer;
+		if (address == 60) return CcCategory::Display;
+		if (address == 70) return CcCategory::Keypad;
+		if (address == 80 || (address >= 85 && address <= 89)) return CcCategory::Dongle;
+		if (address == 90) return CcCategory::Meter;
+		if (address == 99) return CcCategory::Bootloader;
+		if (address == 100) return CcCategory::Power;
+		if (address == 110) return CcCategory::Printer;
+		if (address == 120) return CcCategory::Rng;
+		if (address == 130) return CcCategory::HopperScale;
+		if (address == 140) return CcCategory::CoinFeeder;
+		if (address == 150) return CcCategory::BillRecycler;
+		if (address == 160) return CcCategory::Escrow;
+		if (address == 240 || address >= 241) return CcCategory::Debug;
+		return CcCategory::Unknown;
+	}
+
+}
+
+
+/// Device categories of standard addresses, see ccCategoryFromAddress()
+inline constexpr CcByteTable<CcCategory> cc_address_categories = detail::ccGenerateByteTable<quint8>(detail::ccCategoryComputeFromAddress);
+
+
 /// Get cctalk device category from standard address
-inline CcCategory ccCategoryFromAddress(quint8 address)
+constexpr CcCategory ccCategoryFromAddress(quint8 address)
 {
-	if (address == 2 || (address >= 11 && address <= 17)) return CcCategory::CoinAcceptor;
-	if (address == 3 || (address >= 4 && address <= 10)) return CcCategory::Payout;
-	if (address == 30 || (address >= 31 && address <= 34)) return CcCategory::Reel;
-	if (address == 40 || (address >= 41 && address <= 47)) return CcCategory::BillValidator;
-	if (address == 50) return CcCategory::CardReader;
-	if (address == 55) return CcCategory::Changer;
-	if (address == 60) return CcCategory::Display;
-	if (address == 70) return CcCategory::Keypad;
-	if (address == 80 || (address >= 85 && address <= 89)) return CcCategory::Dongle;
-	if (address == 90) return CcCategory::Meter;
-	if (address == 99) return CcCategory::Bootloader;
-	if (address == 100) return CcCategory::Power;
-	if (address == 110) return CcCategory::Printer;
-	if (address == 120) return CcCategory::Rng;
-	if (address == 130) return CcCategory::HopperScale;
-	if (address == 140) return CcCategory::CoinFeeder;
-	if (address == 150) return CcCategory::BillRecycler;
-	if (address == 160) return CcCategory::Escrow;
-	if (address == 240 || address >= 241) return CcCategory::Debug;
-	return CcCategory::Unknown;
+	return cc_address_categories[address];
 }
 
 
@@ -372,72 +598,75 @@ enum class CcFaultCode : quint8 {
 
 
 
+/// Untranslated names, see ccFaultCodeGetDisplayableName()
+inline constexpr CcByteTable<const char*> cc_fault_code_names = detail::ccMakeByteTable<CcFaultCode, const char*>(nullptr, {
+	{CcFaultCode::Ok, QT_TRANSLATE_NOOP("QObject", "No fault")},
+	{CcFaultCode::EepromChecksumCorrupted, QT_TRANSLATE_NOOP("QObject", "EepromChecksumCorrupted")},
+	{CcFaultCode::FaultOnInductiveCoils, QT_TRANSLATE_NOOP("QObject", "FaultOnInductiveCoils")},
+	{CcFaultCode::FaultOnCreditSensor, QT_TRANSLATE_NOOP("QObject", "FaultOnCreditSensor")},
+	{CcFaultCode::FaultOnPiezoSensor, QT_TRANSLATE_NOOP("QObject", "FaultOnPiezoSensor")},
+	{CcFaultCode::FaultOnReflectiveSensor, QT_TRANSLATE_NOOP("QObject", "FaultOnReflectiveSensor")},
+	{CcFaultCode::FaultOnDiameterSensor, QT_TRANSLATE_NOOP("QObject", "FaultOnDiameterSensor")},
+	{CcFaultCode::FaultOnWakeUpSensor, QT_TRANSLATE_NOOP("QObject", "FaultOnWakeUpSensor")},
+	{CcFaultCode::FaultOnSorterExitSensors, QT_TRANSLATE_NOOP("QObject", "FaultOnSorterExitSensors")},
+	{CcFaultCode::NvramChecksumCorrupted, QT_TRANSLATE_NOOP("QObject", "NvramChecksumCorrupted")},
+	{CcFaultCode::CoinDispensingError, QT_TRANSLATE_NOOP("QObject", "CoinDispensingError")},
+	{CcFaultCode::LowLevelSensorError, QT_TRANSLATE_NOOP("QObject", "LowLevelSensorError")},
+	{CcFaultCode::HighLevelSensorError, QT_TRANSLATE_NOOP("QObject", "HighLevelSensorError")},
+	{CcFaultCode::CoinCountingError, QT_TRANSLATE_NOOP("QObject", "CoinCountingError")},
+	{CcFaultCode::KeypadError, QT_TRANSLATE_NOOP("QObject", "KeypadError")},
+	{CcFaultCode::ButtonError, QT_TRANSLATE_NOOP("QObject", "ButtonError")},
+	{CcFaultCode::DisplayError, QT_TRANSLATE_NOOP("QObject", "DisplayError")},
+	{CcFaultCode::CoinAuditingError, QT_TRANSLATE_NOOP("QObject", "CoinAuditingError")},
+	{CcFaultCode::FaultOnRejectSensor, QT_TRANSLATE_NOOP("QObject", "FaultOnRejectSensor")},
+	{CcFaultCode::FaultOnCoinReturnMechanism, QT_TRANSLATE_NOOP("QObject", "FaultOnCoinReturnMechanism")},
+	{CcFaultCode::FaultOnCosMechanism, QT_TRANSLATE_NOOP("QObject", "FaultOnCosMechanism")},
+	{CcFaultCode::FaultOnRimSensor, QT_TRANSLATE_NOOP("QObject", "FaultOnRimSensor")},
+	{CcFaultCode::FaultOnThermistor, QT_TRANSLATE_NOOP("QObject", "FaultOnThermistor")},
+	{CcFaultCode::PayoutMotorFault, QT_TRANSLATE_NOOP("QObject", "PayoutMotorFault")},
+	{CcFaultCode::PayoutTimeout, QT_TRANSLATE_NOOP("QObject", "PayoutTimeout")},
+	{CcFaultCode::PayoutJammed, QT_TRANSLATE_NOOP("QObject", "PayoutJammed")},
+	{CcFaultCode::PayoutSensorFault, QT_TRANSLATE_NOOP("QObject", "PayoutSensorFault")},
+	{CcFaultCode::LevelSensorError, QT_TRANSLATE_NOOP("QObject", "LevelSensorError")},
+	{CcFaultCode::PersonalityModuleNotFitted, QT_TRANSLATE_NOOP("QObject", "PersonalityModuleNotFitted")},
+	{CcFaultCode::PersonalityChecksumCorrupted, QT_TRANSLATE_NOOP("QObject", "PersonalityChecksumCorrupted")},
+	{CcFaultCode::RomChecksumMismatch, QT_TRANSLATE_NOOP("QObject", "RomChecksumMismatch")},
+	{CcFaultCode::MissingSlaveDevice, QT_TRANSLATE_NOOP("QObject", "MissingSlaveDevice")},
+	{CcFaultCode::InternalCommsBad, QT_TRANSLATE_NOOP("QObject", "InternalCommsBad")},
+	{CcFaultCode::SupplyVoltageOutsideOperatingLimits, QT_TRANSLATE_NOOP("QObject", "SupplyVoltageOutsideOperatingLimits")},
+	{CcFaultCode::TemperatureOutsideOperatingLimits, QT_TRANSLATE_NOOP("QObject", "TemperatureOutsideOperatingLimits")},
+	{CcFaultCode::DceFault, QT_TRANSLATE_NOOP("QObject", "DceFault")},
+	{CcFaultCode::FaultOnBillValidatorSensor, QT_TRANSLATE_NOOP("QObject", "FaultOnBillValidatorSensor")},
+	{CcFaultCode::FaultOnBillTransportMotor, QT_TRANSLATE_NOOP("QObject", "FaultOnBillTransportMotor")},
+	{CcFaultCode::FaultOnStacker, QT_TRANSLATE_NOOP("QObject", "FaultOnStacker")},
+	{CcFaultCode::BillJammed, QT_TRANSLATE_NOOP("QObject", "BillJammed")},
+	{CcFaultCode::RamTestFaul, QT_TRANSLATE_NOOP("QObject", "RamTestFaul")},
+	{CcFaultCode::FaultOnStringSensor, QT_TRANSLATE_NOOP("QObject", "FaultOnStringSensor")},
+	{CcFaultCode::AcceptGateFailedOpen, QT_TRANSLATE_NOOP("QObject", "AcceptGateFailedOpen")},
+	{CcFaultCode::AcceptGateFailedClosed, QT_TRANSLATE_NOOP("QObject", "AcceptGateFailedClosed")},
+	{CcFaultCode::StackerMissing, QT_TRANSLATE_NOOP("QObject", "StackerMissing")},
+	{CcFaultCode::StackerFull, QT_TRANSLATE_NOOP("QObject", "StackerFull")},
+	{CcFaultCode::FlashMemoryEraseFaul, QT_TRANSLATE_NOOP("QObject", "FlashMemoryEraseFaul")},
+	{CcFaultCode::FlashMemoryWriteFail, QT_TRANSLATE_NOOP("QObject", "FlashMemoryWriteFail")},
+	{CcFaultCode::SlaveDeviceNotResponding, QT_TRANSLATE_NOOP("QObject", "SlaveDeviceNotResponding")},
+	{CcFaultCode::FaultOnOptoSensor, QT_TRANSLATE_NOOP("QObject", "FaultOnOptoSensor")},
+	{CcFaultCode::BatteryFault, QT_TRANSLATE_NOOP("QObject", "BatteryFault")},
+	{CcFaultCode::DoorOpen, QT_TRANSLATE_NOOP("QObject", "DoorOpen")},
+	{CcFaultCode::MicroswitchFault, QT_TRANSLATE_NOOP("QObject", "MicroswitchFault")},
+	{CcFaultCode::RtcFault, QT_TRANSLATE_NOOP("QObject", "RtcFault")},
+	{CcFaultCode::FirmwareError, QT_TRANSLATE_NOOP("QObject", "FirmwareError")},
+	{CcFaultCode::InitialisationError, QT_TRANSLATE_NOOP("QObject", "InitialisationError")},
+	{CcFaultCode::SupplyCurrentOutsideOperatingLimits, QT_TRANSLATE_NOOP("QObject", "SupplyCurrentOutsideOperatingLimits")},
+	{CcFaultCode::ForcedBootloaderMode, QT_TRANSLATE_NOOP("QObject", "ForcedBootloaderMode")},
+	{CcFaultCode::UnspecifiedFaultCode, QT_TRANSLATE_NOOP("QObject", "UnspecifiedFaultCode")},
+	{CcFaultCode::CustomCommandError, QT_TRANSLATE_NOOP("QObject", "CustomCommandError")},
+});
+
+
 /// Get displayable name
 inline QString ccFaultCodeGetDisplayableName(CcFaultCode code)
 {
-	static QMap<CcFaultCode, QString> name_map = {
-		{CcFaultCode::Ok, QObject::tr("No fault")},
-		{CcFaultCode::EepromChecksumCorrupted, QObject::tr("EepromChecksumCorrupted")},
-		{CcFaultCode::FaultOnInductiveCoils, QObject::tr("FaultOnInductiveCoils")},
-		{CcFaultCode::FaultOnCreditSensor, QObject::tr("FaultOnCreditSensor")},
-		{CcFaultCode::FaultOnPiezoSensor, QObject::tr("FaultOnPiezoSensor")},
-		{CcFaultCode::FaultOnReflectiveSensor, QObject::tr("FaultOnReflectiveSensor")},
-		{CcFaultCode::FaultOnDiameterSensor, QObject::tr("FaultOnDiameterSensor")},
-		{CcFaultCode::FaultOnWakeUpSensor, QObject::tr("FaultOnWakeUpSensor")},
-		{CcFaultCode::FaultOnSorterExitSensors, QObject::tr("FaultOnSorterExitSensors")},
-		{CcFaultCode::NvramChecksumCorrupted, QObject::tr("NvramChecksumCorrupted")},
-		{CcFaultCode::CoinDispensingError, QObject::tr("CoinDispensingError")},
-		{CcFaultCode::LowLevelSensorError, QObject::tr("LowLevelSensorError")},
-		{CcFaultCode::HighLevelSensorError, QObject::tr("HighLevelSensorError")},
-		{CcFaultCode::CoinCountingError, QObject::tr("CoinCountingError")},
-		{CcFaultCode::KeypadError, QObject::tr("KeypadError")},
-		{CcFaultCode::ButtonError, QObject::tr("ButtonError")},
-		{CcFaultCode::DisplayError, QObject::tr("DisplayError")},
-		{CcFaultCode::CoinAuditingError, QObject::tr("CoinAuditingError")},
-		{CcFaultCode::FaultOnRejectSensor, QObject::tr("FaultOnRejectSensor")},
-		{CcFaultCode::FaultOnCoinReturnMechanism, QObject::tr("FaultOnCoinReturnMechanism")},
-		{CcFaultCode::FaultOnCosMechanism, QObject::tr("FaultOnCosMechanism")},
-		{CcFaultCode::FaultOnRimSensor, QObject::tr("FaultOnRimSensor")},
-		{CcFaultCode::FaultOnThermistor, QObject::tr("FaultOnThermistor")},
-		{CcFaultCode::PayoutMotorFault, QObject::tr("PayoutMotorFault")},
-		{CcFaultCode::PayoutTimeout, QObject::tr("PayoutTimeout")},
-		{CcFaultCode::PayoutJammed, QObject::tr("PayoutJammed")},
-		{CcFaultCode::PayoutSensorFault, QObject::tr("PayoutSensorFault")},
-		{CcFaultCode::LevelSensorError, QObject::tr("LevelSensorError")},
-		{CcFaultCode::PersonalityModuleNotFitted, QObject::tr("PersonalityModuleNotFitted")},
-		{CcFaultCode::PersonalityChecksumCorrupted, QObject::tr("PersonalityChecksumCorrupted")},
-		{CcFaultCode::RomChecksumMismatch, QObject::tr("RomChecksumMismatch")},
-		{CcFaultCode::MissingSlaveDevice, QObject::tr("MissingSlaveDevice")},
-		{CcFaultCode::InternalCommsBad, QObject::tr("InternalCommsBad")},
-		{CcFaultCode::SupplyVoltageOutsideOperatingLimits, QObject::tr("SupplyVoltageOutsideOperatingLimits")},
-		{CcFaultCode::TemperatureOutsideOperatingLimits, QObject::tr("TemperatureOutsideOperatingLimits")},
-		{CcFaultCode::DceFault, QObject::tr("DceFault")},
-		{CcFaultCode::FaultOnBillValidatorSensor, QObject::tr("FaultOnBillValidatorSensor")},
-		{CcFaultCode::FaultOnBillTransportMotor, QObject::tr("FaultOnBillTransportMotor")},
-		{CcFaultCode::FaultOnStacker, QObject::tr("FaultOnStacker")},
-		{CcFaultCode::BillJammed, QObject::tr("BillJammed")},
-		{CcFaultCode::RamTestFaul, QObject::tr("RamTestFaul")},
-		{CcFaultCode::FaultOnStringSensor, QObject::tr("FaultOnStringSensor")},
-		{CcFaultCode::AcceptGateFailedOpen, QObject::tr("AcceptGateFailedOpen")},
-		{CcFaultCode::AcceptGateFailedClosed, QObject::tr("AcceptGateFailedClosed")},
-		{CcFaultCode::StackerMissing, QObject::tr("StackerMissing")},
-		{CcFaultCode::StackerFull, QObject::tr("StackerFull")},
-		{CcFaultCode::FlashMemoryEraseFaul, QObject::tr("FlashMemoryEraseFaul")},
-		{CcFaultCode::FlashMemoryWriteFail, QObject::tr("FlashMemoryWriteFail")},
-		{CcFaultCode::SlaveDeviceNotResponding, QObject::tr("SlaveDeviceNotResponding")},
-		{CcFaultCode::FaultOnOptoSensor, QObject::tr("FaultOnOptoSensor")},
-		{CcFaultCode::BatteryFault, QObject::tr("BatteryFault")},
-		{CcFaultCode::DoorOpen, QObject::tr("DoorOpen")},
-		{CcFaultCode::MicroswitchFault, QObject::tr("MicroswitchFault")},
-		{CcFaultCode::RtcFault, QObject::tr("RtcFault")},
-		{CcFaultCode::FirmwareError, QObject::tr("FirmwareError")},
-		{CcFaultCode::InitialisationError, QObject::tr("InitialisationError")},
-		{CcFaultCode::SupplyCurrentOutsideOperatingLimits, QObject::tr("SupplyCurrentOutsideOperatingLimits")},
-		{CcFaultCode::ForcedBootloaderMode, QObject::tr("ForcedBootloaderMode")},
-		{CcFaultCode::UnspecifiedFaultCode, QObject::tr("UnspecifiedFaultCode")},
-		{CcFaultCode::CustomCommandError, QObject::tr("CustomCommandError")},
-	};
-	return name_map.value(code, QString());
+	return detail::ccTranslateName(cc_fault_code_names[std::size_t(code)]);
 }
 
 
@@ -528,90 +757,93 @@ enum class CcCoinAcceptorEventCode : quint8 {
 
 
 
+/// Untranslated names, see ccCoinAcceptorEventCodeGetDisplayableName()
+inline constexpr CcByteTable<const char*> cc_coin_acceptor_event_code_names = detail::ccMakeByteTable<CcCoinAcceptorEventCode, const char*>(nullptr, {
+	{CcCoinAcceptorEventCode::NoError, QT_TRANSLATE_NOOP("QObject", "NoError")},
+	{CcCoinAcceptorEventCode::RejectCoin, QT_TRANSLATE_NOOP("QObject", "RejectCoin")},
+	{CcCoinAcceptorEventCode::InhibitedCoin, QT_TRANSLATE_NOOP("QObject", "InhibitedCoin")},
+	{CcCoinAcceptorEventCode::MultipleWindow, QT_TRANSLATE_NOOP("QObject", "MultipleWindow")},
+	{CcCoinAcceptorEventCode::WakeupTimeout, QT_TRANSLATE_NOOP("QObject", "WakeupTimeout")},
+	{CcCoinAcceptorEventCode::ValidationTimeout, QT_TRANSLATE_NOOP("QObject", "ValidationTimeout")},
+	{CcCoinAcceptorEventCode::CreditSensorTimeout, QT_TRANSLATE_NOOP("QObject", "CreditSensorTimeout")},
+	{CcCoinAcceptorEventCode::SorterOptoTimeout, QT_TRANSLATE_NOOP("QObject", "SorterOptoTimeout")},
+	{CcCoinAcceptorEventCode::SecondCloseCoinError, QT_TRANSLATE_NOOP("QObject", "SecondCloseCoinError")},
+	{CcCoinAcceptorEventCode::AcceptGateNotReady, QT_TRANSLATE_NOOP("QObject", "AcceptGateNotReady")},
+	{CcCoinAcceptorEventCode::CreditSensorNotReady, QT_TRANSLATE_NOOP("QObject", "CreditSensorNotReady")},
+	{CcCoinAcceptorEventCode::SorterNotReady, QT_TRANSLATE_NOOP("QObject", "SorterNotReady")},
+	{CcCoinAcceptorEventCode::RejectCoinNotCleared, QT_TRANSLATE_NOOP("QObject", "RejectCoinNotCleared")},
+	{CcCoinAcceptorEventCode::ValidationSensorNotReady, QT_TRANSLATE_NOOP("QObject", "ValidationSensorNotReady")},
+	{CcCoinAcceptorEventCode::CreditSensorBlocked, QT_TRANSLATE_NOOP("QObject", "CreditSensorBlocked")},
+	{CcCoinAcceptorEventCode::SorterOptoBlocked, QT_TRANSLATE_NOOP("QObject", "SorterOptoBlocked")},
+	{CcCoinAcceptorEventCode::CreditSequenceError, QT_TRANSLATE_NOOP("QObject", "CreditSequenceError")},
+	{CcCoinAcceptorEventCode::CoinGoingBackwards, QT_TRANSLATE_NOOP("QObject", "CoinGoingBackwards")},
+	{CcCoinAcceptorEventCode::CoinTooFastOverCreditSensor, QT_TRANSLATE_NOOP("QObject", "CoinTooFastOverCreditSensor")},
+	{CcCoinAcceptorEventCode::CoinTooSlowOverCreditSensor, QT_TRANSLATE_NOOP("QObject", "CoinTooSlowOverCreditSensor")},
+	{CcCoinAcceptorEventCode::CosMechanismActivated, QT_TRANSLATE_NOOP("QObject", "CosMechanismActivated")},
+	{CcCoinAcceptorEventCode::DceOptoTimeout, QT_TRANSLATE_NOOP("QObject", "DceOptoTimeout")},
+	{CcCoinAcceptorEventCode::DceOptoNotSeen, QT_TRANSLATE_NOOP("QObject", "DceOptoNotSeen")},
+	{CcCoinAcceptorEventCode::CreditSensorReachedTooEarly, QT_TRANSLATE_NOOP("QObject", "CreditSensorReachedTooEarly")},
+	{CcCoinAcceptorEventCode::RejectCoinRepeatedSequentialTrip, QT_TRANSLATE_NOOP("QObject", "RejectCoinRepeatedSequentialTrip")},
+	{CcCoinAcceptorEventCode::RejectSlug, QT_TRANSLATE_NOOP("QObject", "RejectSlug")},
+	{CcCoinAcceptorEventCode::RejectSensorBlocked, QT_TRANSLATE_NOOP("QObject", "RejectSensorBlocked")},
+	{CcCoinAcceptorEventCode::GamesOverload, QT_TRANSLATE_NOOP("QObject", "GamesOverload")},
+	{CcCoinAcceptorEventCode::MaxCoinMeterPulsesExceeded, QT_TRANSLATE_NOOP("QObject", "MaxCoinMeterPulsesExceeded")},
+	{CcCoinAcceptorEventCode::AcceptGateOpenNotClosed, QT_TRANSLATE_NOOP("QObject", "AcceptGateOpenNotClosed")},
+	{CcCoinAcceptorEventCode::AcceptGateClosedNotOpen, QT_TRANSLATE_NOOP("QObject", "AcceptGateClosedNotOpen")},
+	{CcCoinAcceptorEventCode::ManifoldOptoTimeout, QT_TRANSLATE_NOOP("QObject", "ManifoldOptoTimeout")},
+	{CcCoinAcceptorEventCode::ManifoldOptoBlocked, QT_TRANSLATE_NOOP("QObject", "ManifoldOptoBlocked")},
+	{CcCoinAcceptorEventCode::ManifoldNotReady, QT_TRANSLATE_NOOP("QObject", "ManifoldNotReady")},
+	{CcCoinAcceptorEventCode::SecurityStatusChanged, QT_TRANSLATE_NOOP("QObject", "SecurityStatusChanged")},
+	{CcCoinAcceptorEventCode::MotorException, QT_TRANSLATE_NOOP("QObject", "MotorException")},
+	{CcCoinAcceptorEventCode::SwallowedCoin, QT_TRANSLATE_NOOP("QObject", "SwallowedCoin")},
+	{CcCoinAcceptorEventCode::CoinTooFastOverValidationSensor, QT_TRANSLATE_NOOP("QObject", "CoinTooFastOverValidationSensor")},
+	{CcCoinAcceptorEventCode::CoinTooSlowOverValidationSensor, QT_TRANSLATE_NOOP("QObject", "CoinTooSlowOverValidationSensor")},
+	{CcCoinAcceptorEventCode::CoinIncorrectlySorted, QT_TRANSLATE_NOOP("QObject", "CoinIncorrectlySorted")},
+	{CcCoinAcceptorEventCode::ExternalLightAttack, QT_TRANSLATE_NOOP("QObject", "ExternalLightAttack")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType1, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType1")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType2, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType2")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType3, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType3")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType4, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType4")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType5, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType5")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType6, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType6")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType7, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType7")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType8, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType8")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType9, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType9")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType10, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType10")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType11, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType11")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType12, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType12")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType13, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType13")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType14, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType14")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType15, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType15")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType16, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType16")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType17, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType17")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType18, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType18")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType19, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType19")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType20, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType20")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType21, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType21")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType22, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType22")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType23, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType23")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType24, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType24")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType25, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType25")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType26, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType26")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType27, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType27")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType28, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType28")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType29, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType29")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType30, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType30")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType31, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType31")},
+	{CcCoinAcceptorEventCode::InhibitedCoinType32, QT_TRANSLATE_NOOP("QObject", "InhibitedCoinType32")},
+	{CcCoinAcceptorEventCode::ReservedCreditCancelling1, QT_TRANSLATE_NOOP("QObject", "ReservedCreditCancelling1")},
+	{CcCoinAcceptorEventCode::ReservedCreditCancellingN, QT_TRANSLATE_NOOP("QObject", "ReservedCreditCancellingN")},
+	{CcCoinAcceptorEventCode::DataBlockRequest, QT_TRANSLATE_NOOP("QObject", "DataBlockRequest")},
+	{CcCoinAcceptorEventCode::CoinReturnMechanismActivated, QT_TRANSLATE_NOOP("QObject", "CoinReturnMechanismActivated")},
+	{CcCoinAcceptorEventCode::UnspecifiedAlarmCode, QT_TRANSLATE_NOOP("QObject", "UnspecifiedAlarmCode")},
+});
+
+
 /// Get displayable name
 inline QString ccCoinAcceptorEventCodeGetDisplayableName(CcCoinAcceptorEventCode code)
 {
-	static QMap<CcCoinAcceptorEventCode, QString> name_map = {
-		{CcCoinAcceptorEventCode::NoError, QObject::tr("NoError")},
-		{CcCoinAcceptorEventCode::RejectCoin, QObject::tr("RejectCoin")},
-		{CcCoinAcceptorEventCode::InhibitedCoin, QObject::tr("InhibitedCoin")},
-		{CcCoinAcceptorEventCode::MultipleWindow, QObject::tr("MultipleWindow")},
-		{CcCoinAcceptorEventCode::WakeupTimeout, QObject::tr("WakeupTimeout")},
-		{CcCoinAcceptorEventCode::ValidationTimeout, QObject::tr("ValidationTimeout")},
-		{CcCoinAcceptorEventCode::CreditSensorTimeout, QObject::tr("CreditSensorTimeout")},
-		{CcCoinAcceptorEventCode::SorterOptoTimeout, QObject::tr("SorterOptoTimeout")},
-		{CcCoinAcceptorEventCode::SecondCloseCoinError, QObject::tr("SecondCloseCoinError")},
-		{CcCoinAcceptorEventCode::AcceptGateNotReady, QObject::tr("AcceptGateNotReady")},
-		{CcCoinAcceptorEventCode::CreditSensorNotReady, QObject::tr("CreditSensorNotReady")},
-		{CcCoinAcceptorEventCode::SorterNotReady, QObject::tr("SorterNotReady")},
-		{CcCoinAcceptorEventCode::RejectCoinNotCleared, QObject::tr("RejectCoinNotCleared")},
-		{CcCoinAcceptorEventCode::ValidationSensorNotReady, QObject::tr("ValidationSensorNotReady")},
-		{CcCoinAcceptorEventCode::CreditSensorBlocked, QObject::tr("CreditSensorBlocked")},
-		{CcCoinAcceptorEventCode::SorterOptoBlocked, QObject::tr("SorterOptoBlocked")},
-		{CcCoinAcceptorEventCode::CreditSequenceError, QObject::tr("CreditSequenceError")},
-		{CcCoinAcceptorEventCode::CoinGoingBackwards, QObject::tr("CoinGoingBackwards")},
-		{CcCoinAcceptorEventCode::CoinTooFastOverCreditSensor, QObject::tr("CoinTooFastOverCreditSensor")},
-		{CcCoinAcceptorEventCode::CoinTooSlowOverCreditSensor, QObject::tr("CoinTooSlowOverCreditSensor")},
-		{CcCoinAcceptorEventCode::CosMechanismActivated, QObject::tr("CosMechanismActivated")},
-		{CcCoinAcceptorEventCode::DceOptoTimeout, QObject::tr("DceOptoTimeout")},
-		{CcCoinAcceptorEventCode::DceOptoNotSeen, QObject::tr("DceOptoNotSeen")},
-		{CcCoinAcceptorEventCode::CreditSensorReachedTooEarly, QObject::tr("CreditSensorReachedTooEarly")},
-		{CcCoinAcceptorEventCode::RejectCoinRepeatedSequentialTrip, QObject::tr("RejectCoinRepeatedSequentialTrip")},
-		{CcCoinAcceptorEventCode::RejectSlug, QObject::tr("RejectSlug")},
-		{CcCoinAcceptorEventCode::RejectSensorBlocked, QObject::tr("RejectSensorBlocked")},
-		{CcCoinAcceptorEventCode::GamesOverload, QObject::tr("GamesOverload")},
-		{CcCoinAcceptorEventCode::MaxCoinMeterPulsesExceeded, QObject::tr("MaxCoinMeterPulsesExceeded")},
-		{CcCoinAcceptorEventCode::AcceptGateOpenNotClosed, QObject::tr("AcceptGateOpenNotClosed")},
-		{CcCoinAcceptorEventCode::AcceptGateClosedNotOpen, QObject::tr("AcceptGateClosedNotOpen")},
-		{CcCoinAcceptorEventCode::ManifoldOptoTimeout, QObject::tr("ManifoldOptoTimeout")},
-		{CcCoinAcceptorEventCode::ManifoldOptoBlocked, QObject::tr("ManifoldOptoBlocked")},
-		{CcCoinAcceptorEventCode::ManifoldNotReady, QObject::tr("ManifoldNotReady")},
-		{CcCoinAcceptorEventCode::SecurityStatusChanged, QObject::tr("SecurityStatusChanged")},
-		{CcCoinAcceptorEventCode::MotorException, QObject::tr("MotorException")},
-		{CcCoinAcceptorEventCode::SwallowedCoin, QObject::tr("SwallowedCoin")},
-		{CcCoinAcceptorEventCode::CoinTooFastOverValidationSensor, QObject::tr("CoinTooFastOverValidationSensor")},
-		{CcCoinAcceptorEventCode::CoinTooSlowOverValidationSensor, QObject::tr("CoinTooSlowOverValidationSensor")},
-		{CcCoinAcceptorEventCode::CoinIncorrectlySorted, QObject::tr("CoinIncorrectlySorted")},
-		{CcCoinAcceptorEventCode::ExternalLightAttack, QObject::tr("ExternalLightAttack")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType1, QObject::tr("InhibitedCoinType1")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType2, QObject::tr("InhibitedCoinType2")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType3, QObject::tr("InhibitedCoinType3")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType4, QObject::tr("InhibitedCoinType4")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType5, QObject::tr("InhibitedCoinType5")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType6, QObject::tr("InhibitedCoinType6")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType7, QObject::tr("InhibitedCoinType7")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType8, QObject::tr("InhibitedCoinType8")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType9, QObject::tr("InhibitedCoinType9")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType10, QObject::tr("InhibitedCoinType10")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType11, QObject::tr("InhibitedCoinType11")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType12, QObject::tr("InhibitedCoinType12")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType13, QObject::tr("InhibitedCoinType13")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType14, QObject::tr("InhibitedCoinType14")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType15, QObject::tr("InhibitedCoinType15")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType16, QObject::tr("InhibitedCoinType16")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType17, QObject::tr("InhibitedCoinType17")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType18, QObject::tr("InhibitedCoinType18")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType19, QObject::tr("InhibitedCoinType19")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType20, QObject::tr("InhibitedCoinType20")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType21, QObject::tr("InhibitedCoinType21")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType22, QObject::tr("InhibitedCoinType22")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType23, QObject::tr("InhibitedCoinType23")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType24, QObject::tr("InhibitedCoinType24")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType25, QObject::tr("InhibitedCoinType25")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType26, QObject::tr("InhibitedCoinType26")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType27, QObject::tr("InhibitedCoinType27")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType28, QObject::tr("InhibitedCoinType28")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType29, QObject::tr("InhibitedCoinType29")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType30, QObject::tr("InhibitedCoinType30")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType31, QObject::tr("InhibitedCoinType31")},
-		{CcCoinAcceptorEventCode::InhibitedCoinType32, QObject::tr("InhibitedCoinType32")},
-		{CcCoinAcceptorEventCode::ReservedCreditCancelling1, QObject::tr("ReservedCreditCancelling1")},
-		{CcCoinAcceptorEventCode::ReservedCreditCancellingN, QObject::tr("ReservedCreditCancellingN")},
-		{CcCoinAcceptorEventCode::DataBlockRequest, QObject::tr("DataBlockRequest")},
-		{CcCoinAcceptorEventCode::CoinReturnMechanismActivated, QObject::tr("CoinReturnMechanismActivated")},
-		{CcCoinAcceptorEventCode::UnspecifiedAlarmCode, QObject::tr("UnspecifiedAlarmCode")},
-	};
-	return name_map.value(code, QString());
+	return detail::ccTranslateName(cc_coin_acceptor_event_code_names[std::size_t(code)]);
 }
 
 
@@ -628,105 +860,121 @@ enum class CcCoinRejectionType {
 /// Get displayable name
 inline QString ccCoinRejectionTypeGetDisplayableName(CcCoinRejectionType type)
 {
-	static QMap<CcCoinRejectionType, QString> name_map = {
-		{CcCoinRejectionType::Rejected, QObject::tr("Rejected")},
-		{CcCoinRejectionType::Accepted, QObject::tr("Accepted")},
-		{CcCoinRejectionType::Unknown, QObject::tr("Unknown")},
-	};
-	return name_map.value(type, QString());
+	switch (type) {
+		case CcCoinRejectionType::Rejected: return QObject::tr("Rejected");
+		case CcCoinRejectionType::Accepted: return QObject::tr("Accepted");
+		case CcCoinRejectionType::Unknown: return QObject::tr("Unknown");
+	}
+	return QString();
+}
+
+
+
+namespace detail {
+
+	/// Rejection type of an event code, used to build cc_coin_acceptor_event_code_rejection_types
+	constexpr CcCoinRejectionType ccCoinAcceptorEventCodeComputeRejectionType(CcCoinAcceptorEventCode code)
+	{
+		switch (code) {
+			case CcCoinAcceptorEventCode::NoError:
+			case CcCoinAcceptorEventCode::SorterOptoTimeout:
+			case CcCoinAcceptorEventCode::CreditSequenceError:
+			case CcCoinAcceptorEventCode::CoinGoingBackwards:
+			case CcCoinAcceptorEventCode::CoinTooFastOverCreditSensor:
+			case CcCoinAcceptorEventCode::CoinTooSlowOverCreditSensor:
+			case CcCoinAcceptorEventCode::CosMechanismActivated:
+			case CcCoinAcceptorEventCode::CreditSensorReachedTooEarly:
+			case CcCoinAcceptorEventCode::RejectSensorBlocked:
+			case CcCoinAcceptorEventCode::GamesOverload:
+			case CcCoinAcceptorEventCode::MaxCoinMeterPulsesExceeded:
+			case CcCoinAcceptorEventCode::AcceptGateOpenNotClosed:
+			case CcCoinAcceptorEventCode::ManifoldOptoTimeout:
+			case CcCoinAcceptorEventCode::SwallowedCoin:
+			case CcCoinAcceptorEventCode::CoinIncorrectlySorted:
+			case CcCoinAcceptorEventCode::ExternalLightAttack:
+			case CcCoinAcceptorEventCode::DataBlockRequest:
+			case CcCoinAcceptorEventCode::CoinReturnMechanismActivated:
+			case CcCoinAcceptorEventCode::UnspecifiedAlarmCode:
+				return CcCoinRejectionType::Accepted;
+
+			case CcCoinAcceptorEventCode::WakeupTimeout:
+			case CcCoinAcceptorEventCode::ValidationTimeout:
+			case CcCoinAcceptorEventCode::CreditSensorTimeout:
+			case CcCoinAcceptorEventCode::DceOptoTimeout:
+			case CcCoinAcceptorEventCode::SecurityStatusChanged:
+			case CcCoinAcceptorEventCode::MotorException:
+			case CcCoinAcceptorEventCode::ReservedCreditCancelling1:
+			case CcCoinAcceptorEventCode::ReservedCreditCancellingN:
+				return CcCoinRejectionType::Unknown;
+
+			case CcCoinAcceptorEventCode::RejectCoin:
+			case CcCoinAcceptorEventCode::InhibitedCoin:
+			case CcCoinAcceptorEventCode::MultipleWindow:
+			case CcCoinAcceptorEventCode::SecondCloseCoinError:  // rejected 1 or more
+			case CcCoinAcceptorEventCode::AcceptGateNotReady:
+			case CcCoinAcceptorEventCode::CreditSensorNotReady:
+			case CcCoinAcceptorEventCode::SorterNotReady:
+			case CcCoinAcceptorEventCode::RejectCoinNotCleared:
+			case CcCoinAcceptorEventCode::ValidationSensorNotReady:
+			case CcCoinAcceptorEventCode::CreditSensorBlocked:
+			case CcCoinAcceptorEventCode::SorterOptoBlocked:
+			case CcCoinAcceptorEventCode::DceOptoNotSeen:
+			case CcCoinAcceptorEventCode::RejectCoinRepeatedSequentialTrip:
+			case CcCoinAcceptorEventCode::RejectSlug:
+			case CcCoinAcceptorEventCode::AcceptGateClosedNotOpen:
+			case CcCoinAcceptorEventCode::ManifoldOptoBlocked:
+			case CcCoinAcceptorEventCode::ManifoldNotReady:
+			case CcCoinAcceptorEventCode::CoinTooFastOverValidationSensor:
+			case CcCoinAcceptorEventCode::CoinTooSlowOverValidationSensor:
+			case CcCoinAcceptorEventCode::InhibitedCoinType1:
+			case CcCoinAcceptorEventCode::InhibitedCoinType2:
+			case CcCoinAcceptorEventCode::InhibitedCoinType3:
+			case CcCoinAcceptorEventCode::InhibitedCoinType4:
+			case CcCoinAcceptorEventCode::InhibitedCoinType5:
+			case CcCoinAcceptorEventCode::InhibitedCoinType6:
+			case CcCoinAcceptorEventCode::InhibitedCoinType7:
+			case CcCoinAcceptorEventCode::InhibitedCoinType8:
+			case CcCoinAcceptorEventCode::InhibitedCoinType9:
+			case CcCoinAcceptorEventCode::InhibitedCoinType10:
+			case CcCoinAcceptorEventCode::InhibitedCoinType11:
+			case CcCoinAcceptorEventCode::InhibitedCoinType12:
+			case CcCoinAcceptorEventCode::InhibitedCoinType13:
+			case CcCoinAcceptorEventCode::InhibitedCoinType14:
+			case CcCoinAcceptorEventCode::InhibitedCoinType15:
+			case CcCoinAcceptorEventCode::InhibitedCoinType16:
+			case CcCoinAcceptorEventCode::InhibitedCoinType17:
+			case CcCoinAcceptorEventCode::InhibitedCoinType18:
+			case CcCoinAcceptorEventCode::InhibitedCoinType19:
+			case CcCoinAcceptorEventCode::InhibitedCoinType20:
+			case CcCoinAcceptorEventCode::InhibitedCoinType21:
+			case CcCoinAcceptorEventCode::InhibitedCoinType22:
+			case CcCoinAcceptorEventCode::InhibitedCoinType23:
+			case CcCoinAcceptorEventCode::InhibitedCoinType24:
+			case CcCoinAcceptorEventCode::InhibitedCoinType25:
+			case CcCoinAcceptorEventCode::InhibitedCoinType26:
+			case CcCoinAcceptorEventCode::InhibitedCoinType27:
+			case CcCoinAcceptorEventCode::InhibitedCoinType28:
+			case CcCoinAcceptorEventCode::InhibitedCoinType29:
+			case CcCoinAcceptorEventCode::InhibitedCoinType30:
+			case CcCoinAcceptorEventCode::InhibitedCoinType31:
+			case CcCoinAcceptorEventCode::InhibitedCoinType32:
+				return CcCoinRejectionType::Rejected;
+		}
+		return CcCoinRejectionType::Unknown;
+	}
+
 }
 
 
+/// Rejection types of coin acceptor event codes, see ccCoinAcceptorEventCodeGetRejectionType()
+inline constexpr CcByteTable<CcCoinRejectionType> cc_coin_acceptor_event_code_rejection_types
+		= detail::ccGenerateByteTable<CcCoinAcceptorEventCode>(detail::ccCoinAcceptorEventCodeComputeRejectionType);
+
 
 /// See spec part 3, table 2 and section 12.2.
-inline CcCoinRejectionType ccCoinAcceptorEventCodeGetRejectionType(CcCoinAcceptorEventCode code)
+constexpr CcCoinRejectionType ccCoinAcceptorEventCodeGetRejectionType(CcCoinAcceptorEventCode code)
 {
-	switch (code) {
-		case CcCoinAcceptorEventCode::NoError:
-		case CcCoinAcceptorEventCode::SorterOptoTimeout:
-		case CcCoinAcceptorEventCode::CreditSequenceError:
-		case CcCoinAcceptorEventCode::CoinGoingBackwards:
-		case CcCoinAcceptorEventCode::CoinTooFastOverCreditSensor:
-		case CcCoinAcceptorEventCode::CoinTooSlowOverCreditSensor:
-		case CcCoinAcceptorEventCode::CosMechanismActivated:
-		case CcCoinAcceptorEventCode::CreditSensorReachedTooEarly:
-		case CcCoinAcceptorEventCode::RejectSensorBlocked:
-		case CcCoinAcceptorEventCode::GamesOverload:
-		case CcCoinAcceptorEventCode::MaxCoinMeterPulsesExceeded:
-		case CcCoinAcceptorEventCode::AcceptGateOpenNotClosed:
-		case CcCoinAcceptorEventCode::ManifoldOptoTimeout:
-		case CcCoinAcceptorEventCode::SwallowedCoin:
-		case CcCoinAcceptorEventCode::CoinIncorrectlySorted:
-		case CcCoinAcceptorEventCode::ExternalLightAttack:
-		case CcCoinAcceptorEventCode::DataBlockRequest:
-		case CcCoinAcceptorEventCode::CoinReturnMechanismActivated:
-		case CcCoinAcceptorEventCode::UnspecifiedAlarmCode:
-			return CcCoinRejectionType::Accepted;
-
-		case CcCoinAcceptorEventCode::WakeupTimeout:
-		case CcCoinAcceptorEventCode::ValidationTimeout:
-		case CcCoinAcceptorEventCode::CreditSensorTimeout:
-		case CcCoinAcceptorEventCode::DceOptoTimeout:
-		case CcCoinAcceptorEventCode::SecurityStatusChanged:
-		case CcCoinAcceptorEventCode::MotorException:
-		case CcCoinAcceptorEventCode::ReservedCreditCancelling1:
-		case CcCoinAcceptorEventCode::ReservedCreditCancellingN:
-			return CcCoinRejectionType::Unknown;
-
-		case CcCoinAcceptorEventCode::RejectCoin:
-		case CcCoinAcceptorEventCode::InhibitedCoin:
-		case CcCoinAcceptorEventCode::MultipleWindow:
-		case CcCoinAcceptorEventCode::SecondCloseCoinError:  // rejected 1 or more
-		case CcCoinAcceptorEventCode::AcceptGateNotReady:
-		case CcCoinAcceptorEventCode::CreditSensorNotReady:
-		case CcCoinAcceptorEventCode::SorterNotReady:
-		case CcCoinAcceptorEventCode::RejectCoinNotCleared:
-		case CcCoinAcceptorEventCode::ValidationSensorNotReady:
-		case CcCoinAcceptorEventCode::CreditSensorBlocked:
-		case CcCoinAcceptorEventCode::SorterOptoBlocked:
-		case CcCoinAcceptorEventCode::DceOptoNotSeen:
-		case CcCoinAcceptorEventCode::RejectCoinRepeatedSequentialTrip:
-		case CcCoinAcceptorEventCode::RejectSlug:
-		case CcCoinAcceptorEventCode::AcceptGateClosedNotOpen:
-		case CcCoinAcceptorEventCode::ManifoldOptoBlocked:
-		case CcCoinAcceptorEventCode::ManifoldNotReady:
-		case CcCoinAcceptorEventCode::CoinTooFastOverValidationSensor:
-		case CcCoinAcceptorEventCode::CoinTooSlowOverValidationSensor:
-		case CcCoinAcceptorEventCode::InhibitedCoinType1:
-		case CcCoinAcceptorEventCode::InhibitedCoinType2:
-		case CcCoinAcceptorEventCode::InhibitedCoinType3:
-		case CcCoinAcceptorEventCode::InhibitedCoinType4:
-		case CcCoinAcceptorEventCode::InhibitedCoinType5:
-		case CcCoinAcceptorEventCode::InhibitedCoinType6:
-		case CcCoinAcceptorEventCode::InhibitedCoinType7:
-		case CcCoinAcceptorEventCode::InhibitedCoinType8:
-		case CcCoinAcceptorEventCode::InhibitedCoinType9:
-		case CcCoinAcceptorEventCode::InhibitedCoinType10:
-		case CcCoinAcceptorEventCode::InhibitedCoinType11:
-		case CcCoinAcceptorEventCode::InhibitedCoinType12:
-		case CcCoinAcceptorEventCode::InhibitedCoinType13:
-		case CcCoinAcceptorEventCode::InhibitedCoinType14:
-		case CcCoinAcceptorEventCode::InhibitedCoinType15:
-		case CcCoinAcceptorEventCode::InhibitedCoinType16:
-		case CcCoinAcceptorEventCode::InhibitedCoinType17:
-		case CcCoinAcceptorEventCode::InhibitedCoinType18:
-		case CcCoinAcceptorEventCode::InhibitedCoinType19:
-		case CcCoinAcceptorEventCode::InhibitedCoinType20:
-		case CcCoinAcceptorEventCode::InhibitedCoinType21:
-		case CcCoinAcceptorEventCode::InhibitedCoinType22:
-		case CcCoinAcceptorEventCode::InhibitedCoinType23:
-		case CcCoinAcceptorEventCode::InhibitedCoinType24:
-		case CcCoinAcceptorEventCode::InhibitedCoinType25:
-		case CcCoinAcceptorEventCode::InhibitedCoinType26:
-		case CcCoinAcceptorEventCode::InhibitedCoinType27:
-		case CcCoinAcceptorEventCode::InhibitedCoinType28:
-		case CcCoinAcceptorEventCode::InhibitedCoinType29:
-		case CcCoinAcceptorEventCode::InhibitedCoinType30:
-		case CcCoinAcceptorEventCode::InhibitedCoinType31:
-		case CcCoinAcceptorEventCode::InhibitedCoinType32:
-			return CcCoinRejectionType::Rejected;
-	}
-	return CcCoinRejectionType::Unknown;
+	return cc_coin_acceptor_event_code_rejection_types[std::size_t(code)];
 }
 
 
@@ -763,36 +1011,39 @@ enum class CcBillValidatorErrorCode : quint8 {
 
 
 
+/// Untranslated names, see ccBillValidatorErrorCodeGetDisplayableName()
+inline constexpr CcByteTable<const char*> cc_bill_validator_error_code_names = detail::ccMakeByteTable<CcBillValidatorErrorCode, const char*>(nullptr, {
+	{CcBillValidatorErrorCode::MasterInhibitActive, QT_TRANSLATE_NOOP("QObject", "MasterInhibitActive")},
+	{CcBillValidatorErrorCode::BillReturnedFromEscrow, QT_TRANSLATE_NOOP("QObject", "BillReturnedFromEscrow")},
+	{CcBillValidatorErrorCode::InvalidBillValidationFail, QT_TRANSLATE_NOOP("QObject", "InvalidBillValidationFail")},
+	{CcBillValidatorErrorCode::InvalidBillTransportProblem, QT_TRANSLATE_NOOP("QObject", "InvalidBillTransportProblem")},
+	{CcBillValidatorErrorCode::InhibitedBillOnSerial, QT_TRANSLATE_NOOP("QObject", "InhibitedBillOnSerial")},
+	{CcBillValidatorErrorCode::InhibitedBillOnDipSwitches, QT_TRANSLATE_NOOP("QObject", "InhibitedBillOnDipSwitches")},
+	{CcBillValidatorErrorCode::BillJammedInTransportUnsafeMode, QT_TRANSLATE_NOOP("QObject", "BillJammedInTransportUnsafeMode")},
+	{CcBillValidatorErrorCode::BillJammedInStacker, QT_TRANSLATE_NOOP("QObject", "BillJammedInStacker")},
+	{CcBillValidatorErrorCode::BillPulledBackwards, QT_TRANSLATE_NOOP("QObject", "BillPulledBackwards")},
+	{CcBillValidatorErrorCode::BillTamper, QT_TRANSLATE_NOOP("QObject", "BillTamper")},
+	{CcBillValidatorErrorCode::StackerOk, QT_TRANSLATE_NOOP("QObject", "StackerOk")},
+	{CcBillValidatorErrorCode::StackerRemoved, QT_TRANSLATE_NOOP("QObject", "StackerRemoved")},
+	{CcBillValidatorErrorCode::StackerInserted, QT_TRANSLATE_NOOP("QObject", "StackerInserted")},
+	{CcBillValidatorErrorCode::StackerFaulty, QT_TRANSLATE_NOOP("QObject", "StackerFaulty")},
+	{CcBillValidatorErrorCode::StackerFull, QT_TRANSLATE_NOOP("QObject", "StackerFull")},
+	{CcBillValidatorErrorCode::StackerJammed, QT_TRANSLATE_NOOP("QObject", "StackerJammed")},
+	{CcBillValidatorErrorCode::BillJammedInTransportSafeMode, QT_TRANSLATE_NOOP("QObject", "BillJammedInTransportSafeMode")},
+	{CcBillValidatorErrorCode::OptoFraudDetected, QT_TRANSLATE_NOOP("QObject", "OptoFraudDetected")},
+	{CcBillValidatorErrorCode::StringFraudDetected, QT_TRANSLATE_NOOP("QObject", "StringFraudDetected")},
+	{CcBillValidatorErrorCode::AntiStringMechanismFaulty, QT_TRANSLATE_NOOP("QObject", "AntiStringMechanismFaulty")},
+	{CcBillValidatorErrorCode::BarcodeDetected, QT_TRANSLATE_NOOP("QObject", "BarcodeDetected")},
+	{CcBillValidatorErrorCode::UnknownBillTypeStacked, QT_TRANSLATE_NOOP("QObject", "UnknownBillTypeStacked")},
+
+	{CcBillValidatorErrorCode::CustomNoError, QT_TRANSLATE_NOOP("QObject", "CustomNoError")},
+});
+
+
 /// Get displayable name
 inline QString ccBillValidatorErrorCodeGetDisplayableName(CcBillValidatorErrorCode type)
 {
-	static QMap<CcBillValidatorErrorCode, QString> name_map = {
-		{CcBillValidatorErrorCode::MasterInhibitActive, QObject::tr("MasterInhibitActive")},
-		{CcBillValidatorErrorCode::BillReturnedFromEscrow, QObject::tr("BillReturnedFromEscrow")},
-		{CcBillValidatorErrorCode::InvalidBillValidationFail, QObject::tr("InvalidBillValidationFail")},
-		{CcBillValidatorErrorCode::InvalidBillTransportProblem, QObject::tr("InvalidBillTransportProblem")},
-		{CcBillValidatorErrorCode::InhibitedBillOnSerial, QObject::tr("InhibitedBillOnSerial")},
-		{CcBillValidatorErrorCode::InhibitedBillOnDipSwitches, QObject::tr("InhibitedBillOnDipSwitches")},
-		{CcBillValidatorErrorCode::BillJammedInTransportUnsafeMode, QObject::tr("BillJammedInTransportUnsafeMode")},
-		{CcBillValidatorErrorCode::BillJammedInStacker, QObject::tr("BillJammedInStacker")},
-		{CcBillValidatorErrorCode::BillPulledBackwards, QObject::tr("BillPulledBackwards")},
-		{CcBillValidatorErrorCode::BillTamper, QObject::tr("BillTamper")},
-		{CcBillValidatorErrorCode::StackerOk, QObject::tr("StackerOk")},
-		{CcBillValidatorErrorCode::StackerRemoved, QObject::tr("StackerRemoved")},
-		{CcBillValidatorErrorCode::StackerInserted, QObject::tr("StackerInserted")},
-		{CcBillValidatorErrorCode::StackerFaulty, QObject::tr("StackerFaulty")},
-		{CcBillValidatorErrorCode::StackerFull, QObject::tr("StackerFull")},
-		{CcBillValidatorErrorCode::StackerJammed, QObject::tr("StackerJammed")},
-		{CcBillValidatorErrorCode::BillJammedInTransportSafeMode, QObject::tr("BillJammedInTransportSafeMode")},
-		{CcBillValidatorErrorCode::OptoFraudDetected, QObject::tr("OptoFraudDetected")},
-		{CcBillValidatorErrorCode::StringFraudDetected, QObject::tr("StringFraudDetected")},
-		{CcBillValidatorErrorCode::AntiStringMechanismFaulty, QObject::tr("AntiStringMechanismFaulty")},
-		{CcBillValidatorErrorCode::BarcodeDetected, QObject::tr("BarcodeDetected")},
-		{CcBillValidatorErrorCode::UnknownBillTypeStacked, QObject::tr("UnknownBillTypeStacked")},
-
-		{CcBillValidatorErrorCode::CustomNoError, QObject::tr("CustomNoError")},
-	};
-	return name_map.value(type, QString());
+	return detail::ccTranslateName(cc_bill_validator_error_code_names[std::size_t(type)]);
 }
 
 
@@ -808,15 +1059,18 @@ enum class CcBillValidatorSuccessCode : quint8 {
 
 
 
+/// Untranslated names, see ccBillValidatorSuccessCodeGetDisplayableName()
+inline constexpr CcByteTable<const char*> cc_bill_validator_success_code_names = detail::ccMakeByteTable<CcBillValidatorSuccessCode, const char*>(nullptr, {
+	{CcBillValidatorSuccessCode::ValidatedAndAccepted, QT_TRANSLATE_NOOP("QObject", "ValidatedAndAccepted")},
+	{CcBillValidatorSuccessCode::ValidatedAndHeldInEscrow, QT_TRANSLATE_NOOP("QObject", "ValidatedAndHeldInEscrow")},
+	{CcBillValidatorSuccessCode::CustomUnknown, QT_TRANSLATE_NOOP("QObject", "CustomUnknown")},
+});
+
+
 /// Get displayable name
 inline QString ccBillValidatorSuccessCodeGetDisplayableName(CcBillValidatorSuccessCode type)
 {
-	static QMap<CcBillValidatorSuccessCode, QString> name_map = {
-		{CcBillValidatorSuccessCode::ValidatedAndAccepted, QObject::tr("ValidatedAndAccepted")},
-		{CcBillValidatorSuccessCode::ValidatedAndHeldInEscrow, QObject::tr("ValidatedAndHeldInEscrow")},
-		{CcBillValidatorSuccessCode::CustomUnknown, QObject::tr("CustomUnknown")},
-	};
-	return name_map.value(type, QString());
+	return detail::ccTranslateName(cc_bill_validator_success_code_names[std::size_t(type)]);
 }
 
 
@@ -843,49 +1097,53 @@ enum class CcBillValidatorEventType {
 /// Get displayable name
 inline QString ccBillValidatorEventTypeGetDisplayableName(CcBillValidatorEventType type)
 {
-	static QMap<CcBillValidatorEventType, QString> name_map = {
-		{CcBillValidatorEventType::CustomUnknown, QObject::tr("CustomUnknown")},
-// 		{CcBillValidatorEventType::Credit, QObject::tr("Credit")},
-// 		{CcBillValidatorEventType::PendingCredit, QObject::tr("PendingCredit")},
-		{CcBillValidatorEventType::Reject, QObject::tr("Reject")},
-		{CcBillValidatorEventType::FraudAttempt, QObject::tr("FraudAttempt")},
-		{CcBillValidatorEventType::FatalError, QObject::tr("FatalError")},
-		{CcBillValidatorEventType::Status, QObject::tr("Status")},
-	};
-	return name_map.value(type, QString());
+	switch (type) {
+		case CcBillValidatorEventType::CustomUnknown: return QObject::tr("CustomUnknown");
+// 		case CcBillValidatorEventType::Credit: return QObject::tr("Credit");
+// 		case CcBillValidatorEventType::PendingCredit: return QObject::tr("PendingCredit");
+		case CcBillValidatorEventType::Reject: return QObject::tr("Reject");
+		case CcBillValidatorEventType::FraudAttempt: return QObject::tr("FraudAttempt");
+		case CcBillValidatorEventType::FatalError: return QObject::tr("FatalError");
+		case CcBillValidatorEventType::Status: return QObject::tr("Status");
+	}
+	return QString();
 }
 
 
 
+/// Event types of bill validator error codes, see ccBillValidatorErrorCodeGetEventType()
+inline constexpr CcByteTable<CcBillValidatorEventType> cc_bill_validator_error_code_event_types
+		= detail::ccMakeByteTable<CcBillValidatorErrorCode, CcBillValidatorEventType>(CcBillValidatorEventType::FatalError, {
+	{CcBillValidatorErrorCode::MasterInhibitActive, CcBillValidatorEventType::Status},
+	{CcBillValidatorErrorCode::BillReturnedFromEscrow, CcBillValidatorEventType::Status},
+	{CcBillValidatorErrorCode::InvalidBillValidationFail, CcBillValidatorEventType::Reject},
+	{CcBillValidatorErrorCode::InvalidBillTransportProblem, CcBillValidatorEventType::Reject},
+	{CcBillValidatorErrorCode::InhibitedBillOnSerial, CcBillValidatorEventType::Status},
+	{CcBillValidatorErrorCode::InhibitedBillOnDipSwitches, CcBillValidatorEventType::Status},
+	{CcBillValidatorErrorCode::BillJammedInTransportUnsafeMode, CcBillValidatorEventType::FatalError},
+	{CcBillValidatorErrorCode::BillJammedInStacker, CcBillValidatorEventType::FatalError},
+	{CcBillValidatorErrorCode::BillPulledBackwards, CcBillValidatorEventType::FraudAttempt},
+	{CcBillValidatorErrorCode::BillTamper, CcBillValidatorEventType::FraudAttempt},
+	{CcBillValidatorErrorCode::StackerOk, CcBillValidatorEventType::Status},
+	{CcBillValidatorErrorCode::StackerRemoved, CcBillValidatorEventType::Status},
+	{CcBillValidatorErrorCode::StackerInserted, CcBillValidatorEventType::Status},
+	{CcBillValidatorErrorCode::StackerFaulty, CcBillValidatorEventType::FatalError},
+	{CcBillValidatorErrorCode::StackerFull, CcBillValidatorEventType::Status},
+	{CcBillValidatorErrorCode::StackerJammed, CcBillValidatorEventType::FatalError},
+	{CcBillValidatorErrorCode::BillJammedInTransportSafeMode, CcBillValidatorEventType::FatalError},
+	{CcBillValidatorErrorCode::OptoFraudDetected, CcBillValidatorEventType::FraudAttempt},
+	{CcBillValidatorErrorCode::StringFraudDetected, CcBillValidatorEventType::FraudAttempt},
+	{CcBillValidatorErrorCode::AntiStringMechanismFaulty, CcBillValidatorEventType::FatalError},
+	{CcBillValidatorErrorCode::BarcodeDetected, CcBillValidatorEventType::Status},
+	{CcBillValidatorErrorCode::UnknownBillTypeStacked, CcBillValidatorEventType::Status},
+	{CcBillValidatorErrorCode::CustomNoError, CcBillValidatorEventType::FatalError},
+});
+
+
 /// Get event type for CcBillValidatorErrorCode
-inline CcBillValidatorEventType ccBillValidatorErrorCodeGetEventType(CcBillValidatorErrorCode status)
+constexpr CcBillValidatorEventType ccBillValidatorErrorCodeGetEventType(CcBillValidatorErrorCode status)
 {
-	static QMap<CcBillValidatorErrorCode, CcBillValidatorEventType> type_map = {
-		{CcBillValidatorErrorCode::MasterInhibitActive, CcBillValidatorEventType::Status},
-		{CcBillValidatorErrorCode::BillReturnedFromEscrow, CcBillValidatorEventType::Status},
-		{CcBillValidatorErrorCode::InvalidBillValidationFail, CcBillValidatorEventType::Reject},
-		{CcBillValidatorErrorCode::InvalidBillTransportProblem, CcBillValidatorEventType::Reject},
-		{CcBillValidatorErrorCode::InhibitedBillOnSerial, CcBillValidatorEventType::Status},
-		{CcBillValidatorErrorCode::InhibitedBillOnDipSwitches, CcBillValidatorEventType::Status},
-		{CcBillValidatorErrorCode::BillJammedInTransportUnsafeMode, CcBillValidatorEventType::FatalError},
-		{CcBillValidatorErrorCode::BillJammedInStacker, CcBillValidatorEventType::FatalError},
-		{CcBillValidatorErrorCode::BillPulledBackwards, CcBillValidatorEventType::FraudAttempt},
-		{CcBillValidatorErrorCode::BillTamper, CcBillValidatorEventType::FraudAttempt},
-		{CcBillValidatorErrorCode::StackerOk, CcBillValidatorEventType::Status},
-		{CcBillValidatorErrorCode::StackerRemoved, CcBillValidatorEventType::Status},
-		{CcBillValidatorErrorCode::StackerInserted, CcBillValidatorEventType::Status},
-		{CcBillValidatorErrorCode::StackerFaulty, CcBillValidatorEventType::FatalError},
-		{CcBillValidatorErrorCode::StackerFull, CcBillValidatorEventType::Status},
-		{CcBillValidatorErrorCode::StackerJammed, CcBillValidatorEventType::FatalError},
-		{CcBillValidatorErrorCode::BillJammedInTransportSafeMode, CcBillValidatorEventType::FatalError},
-		{CcBillValidatorErrorCode::OptoFraudDetected, CcBillValidatorEventType::FraudAttempt},
-		{CcBillValidatorErrorCode::StringFraudDetected, CcBillValidatorEventType::FraudAttempt},
-		{CcBillValidatorErrorCode::AntiStringMechanismFaulty, CcBillValidatorEventType::FatalError},
-		{CcBillValidatorErrorCode::BarcodeDetected, CcBillValidatorEventType::Status},
-		{CcBillValidatorErrorCode::UnknownBillTypeStacked, CcBillValidatorEventType::Status},
-		{CcBillValidatorErrorCode::CustomNoError, CcBillValidatorEventType::FatalError},
-	};
-	return type_map.value(status, CcBillValidatorEventType::FatalError);
+	return cc_bill_validator_error_code_event_types[std::size_t(status)];
 }
 
 /*
@@ -911,15 +1169,18 @@ enum class CcBillRouteCommandType : quint8 {
 
 
 
+/// Untranslated names, see ccBillRouteCommandTypeGetDisplayableName()
+inline constexpr CcByteTable<const char*> cc_bill_route_command_type_names = detail::ccMakeByteTable<CcBillRouteCommandType, const char*>(nullptr, {
+	{CcBillRouteCommandType::ReturnBill, QT_TRANSLATE_NOOP("QObject", "ReturnBill")},
+	{CcBillRouteCommandType::RouteToStacker, QT_TRANSLATE_NOOP("QObject", "RouteToStacker")},
+	{CcBillRouteCommandType::IncreaseTimeout, QT_TRANSLATE_NOOP("QObject", "IncreaseTimeout")},
+});
+
+
 /// Get displayable name
 inline QString ccBillRouteCommandTypeGetDisplayableName(CcBillRouteCommandType type)
 {
-	static QMap<CcBillRouteCommandType, QString> name_map = {
-		{CcBillRouteCommandType::ReturnBill, QObject::tr("ReturnBill")},
-		{CcBillRouteCommandType::RouteToStacker, QObject::tr("RouteToStacker")},
-		{CcBillRouteCommandType::IncreaseTimeout, QObject::tr("IncreaseTimeout")},
-	};
-	return name_map.value(type, QString());
+	return detail::ccTranslateName(cc_bill_route_command_type_names[std::size_t(type)]);
 }
 
 
@@ -933,19 +1194,28 @@ enum class CcBillRouteStatus : quint8 {
 
 
 
+/// Untranslated names, see ccBillRouteStatusGetDisplayableName()
+inline constexpr CcByteTable<const char*> cc_bill_route_status_names = detail::ccMakeByteTable<CcBillRouteStatus, const char*>(nullptr, {
+	{CcBillRouteStatus::Routed, QT_TRANSLATE_NOOP("QObject", "Routed")},
+	{CcBillRouteStatus::EscrowEmpty, QT_TRANSLATE_NOOP("QObject", "EscrowEmpty")},
+	{CcBillRouteStatus::FailedToRoute, QT_TRANSLATE_NOOP("QObject", "FailedToRoute")},
+});
+
+
 /// Get displayable name
 inline QString ccBillRouteStatusGetDisplayableName(CcBillRouteStatus type)
 {
-	static QMap<CcBillRouteStatus, QString> name_map = {
-		{CcBillRouteStatus::Routed, QObject::tr("Routed")},
-		{CcBillRouteStatus::EscrowEmpty, QObject::tr("EscrowEmpty")},
-		{CcBillRouteStatus::FailedToRoute, QObject::tr("FailedToRoute")},
-	};
-	return name_map.value(type, QString());
+	return detail::ccTranslateName(cc_bill_route_status_names[std::size_t(type)]);
 }
 
 
 
+/// Number of events held by the device event buffer (ReadBufferedBillEvents / ReadBufferedCredit).
+/// If more events happen between two polls, the oldest ones are lost.
+constexpr int cc_event_buffer_size = 5;
+
+
+
 /// ccTalk event data, as returned by ReadBufferedBillEvents and ReadBufferedCredit commands
 struct CcEventData {
 
@@ -999,61 +1269,136 @@ struct CcEventData {
 
 
 
-/// Get coin values according to coin code (cctalk spec Appendix 3 (2.1))
+/// Coin value code (cctalk spec Appendix 3 (2.1)), see ccCoinValueCodeGetValue()
+struct CcCoinValueCode {
+	char code[4] = {};  ///< Three-character value code, e.g. "2K5"
+	quint64 value = 0;  ///< Coin value, to be divided by 10^decimal_places
+	quint8 decimal_places = 0;  ///< Decimal places of value
+};
+
+
+/// Coin value codes. The values are looked up through cc_coin_value_code_slots.
+inline constexpr CcCoinValueCode cc_coin_value_codes[] = {
+	{"5m0", 5, 3},  // 0.005
+	{"10m", 1, 2},  // 0.01
+	{".01", 1, 2},  // 0.01
+	{"20m", 2, 2},  // 0.02
+	{".02", 2, 2},  // 0.02
+	{"25m", 25, 3},  // 0.025
+	{"50m", 5, 2},  // 0.05
+	{".05", 5, 2},  // 0.05
+	{".10", 1, 1},  // 0.10
+	{".20", 2, 1},  // 0.20
+	{".25", 25, 2},  // 0.25
+	{".50", 5, 1},  // 0.50
+	{"001", 1, 0},  // 1
+	{"002", 1, 0},  // 2
+	{"2.5", 25, 1},  // 2.5
+	{"005", 5, 0},  // 5
+	{"010", 10, 0},  // 10
+	{"020", 20, 0},  // 20
+	{"025", 25, 0},  // 25
+	{"050", 50, 0},  // 50
+	{"100", 100, 0},  // 100
+	{"200", 200, 0},  // 200
+	{"250", 250, 0},  // 250
+	{"500", 500, 0},  // 500
+	{"1K0", 1000, 0},  // 1 000
+	{"2K0", 2000, 0},  // 2 000
+	{"2K5", 2500, 0},  // 2 500
+	{"5K0", 5000, 0},  // 5 000
+	{"10K", 10000, 0},  // 10 000
+	{"20K", 20000, 0},  // 20 000
+	{"25K", 25000, 0},  // 25 000
+	{"50K", 50000, 0},  // 50 000
+	{"M10", 100000, 0},  // 100 000
+	{"M20", 200000, 0},  // 200 000
+	{"M25", 250000, 0},  // 250 000
+	{"M50", 500000, 0},  // 500 000
+	{"1M0", 1000000, 0},  // 1 000 000
+	{"2M0", 2000000, 0},  // 2 000 000
+	{"2M5", 2500000, 0},  // 2 500 000
+	{"5M0", 5000000, 0},  // 5 000 000
+	{"10M", 10000000, 0},  // 10 000 000
+	{"20M", 20000000, 0},  // 20 000 000
+	{"25M", 25000000, 0},  // 25 000 000
+	{"50M", 50000000, 0},  // 50 000 000
+	{"G10", 100000000, 0},  // 100 000 000
+};
+
+
+namespace detail {
+
+	/// Size of the coin value code hash table
+	constexpr std::size_t cc_coin_value_code_hash_size = 128;
+
+	/// Perfect hash of the codes in cc_coin_value_codes. The coefficients were chosen so that
+	/// there are no collisions (this is checked below), adding a code may require new ones.
+	constexpr std::size_t ccCoinValueCodeHash(char c0, char c1, char c2)
+	{
+		return (std::size_t(quint8(c0)) * 11 + std::size_t(quint8(c1)) * 6 + std::size_t(quint8(c2)))
+				% cc_coin_value_code_hash_size;
+	}
+
+
+	/// Create the hash table of cc_coin_value_codes: indices into it, -1 for empty slots
+	constexpr std::array<qint8, cc_coin_value_code_hash_size> ccMakeCoinValueCodeSlots()
+	{
+		std::array<qint8, cc_coin_value_code_hash_size> slots = {};
+		for (auto& slot : slots) {
+			slot = -1;
+		}
+		for (std::size_t i = 0; i < std::size(cc_coin_value_codes); ++i) {
+			const CcCoinValueCode& entry = cc_coin_value_codes[i];
+			slots[ccCoinValueCodeHash(entry.code[0], entry.code[1], entry.code[2])] = qint8(i);
+		}
+		return slots;
+	}
+
+}
+
+
+/// Hash table of cc_coin_value_codes, see ccCoinValueCodeGetValue()
+inline constexpr std::array<qint8, detail::cc_coin_value_code_hash_size> cc_coin_value_code_slots
+		= detail::ccMakeCoinValueCodeSlots();
+
+
+namespace detail {
+
+	/// Check that each code in cc_coin_value_codes got its own slot
+	constexpr bool ccCoinValueCodeHashIsPerfect()
+	{
+		std::size_t used_slots = 0;
+		for (qint8 slot : cc_coin_value_code_slots) {
+			used_slots += (slot >= 0 ? 1 : 0);
+		}
+		return used_slots == std::size(cc_coin_value_codes);
+	}
+
+	static_assert(ccCoinValueCodeHashIsPerfect(), "Coin value code hash has collisions, choose new coefficients");
+
+}
+
+
+/// Get coin values according to coin code (cctalk spec Appendix 3 (2.1)).
+/// Returns 0 (and 0 decimal places) for unknown codes.
 inline quint64 ccCoinValueCodeGetValue(const QByteArray& three_char_code, quint8& decimal_places)
 {
-	// coin code -> (coin_value, decimal_places).
-	static QMap<QByteArray, QPair<quint64, quint8>> value_map = {
-		{"5m0", {5, 3}},  // 0.005
-		{"10m", {1, 2}},  // 0.01
-		{".01", {1, 2}},  // 0.01
-		{"20m", {2, 2}},  // 0.02
-		{".02", {2, 2}},  // 0.02
-		{"25m", {25, 3}},  // 0.025
-		{"50m", {5, 2}},  // 0.05
-		{".05", {5, 2}},  // 0.05
-		{".10", {1, 1}},  // 0.10
-		{".20", {2, 1}},  // 0.20
-		{".25", {25, 2}},  // 0.25
-		{".50", {5, 1}},  // 0.50
-		{"001", {1, 0}},  // 1
-		{"002", {1, 0}},  // 2
-		{"2.5", {25, 1}},  // 2.5
-		{"005", {5, 0}},  // 5
-		{"010", {10, 0}},  // 10
-		{"020", {20, 0}},  // 20
-		{"025", {25, 0}},  // 25
-		{"050", {50, 0}},  // 50
-		{"100", {100, 0}},  // 100
-		{"200", {200, 0}},  // 200
-		{"250", {250, 0}},  // 250
-		{"500", {500, 0}},  // 500
-		{"1K0", {1000, 0}},  // 1 000
-		{"2K0", {2000, 0}},  // 2 000
-		{"2K5", {2500, 0}},  // 2 500
-		{"5K0", {5000, 0}},  // 5 000
-		{"10K", {10000, 0}},  // 10 000
-		{"20K", {20000, 0}},  // 20 000
-		{"25K", {25000, 0}},  // 25 000
-		{"50K", {50000, 0}},  // 50 000
-		{"M10", {100000, 0}},  // 100 000
-		{"M20", {200000, 0}},  // 200 000
-		{"M25", {250000, 0}},  // 250 000
-		{"M50", {500000, 0}},  // 500 000
-		{"1M0", {1000000, 0}},  // 1 000 000
-		{"2M0", {2000000, 0}},  // 2 000 000
-		{"2M5", {2500000, 0}},  // 2 500 000
-		{"5M0", {5000000, 0}},  // 5 000 000
-		{"10M", {10000000, 0}},  // 10 000 000
-		{"20M", {20000000, 0}},  // 20 000 000
-		{"25M", {25000000, 0}},  // 25 000 000
-		{"50M", {50000000, 0}},  // 50 000 000
-		{"G10", {100000000, 0}},  // 100 000 000
-	};
-
-	QPair<quint64, quint8> value = value_map.value(three_char_code, QPair<quint64, quint8>());
-	decimal_places = value.second;
-	return value.first;
+	decimal_places = 0;
+	if (three_char_code.size() != 3) {
+		return 0;
+	}
+	const char* code = three_char_code.constData();
+	const qint8 slot = cc_coin_value_code_slots[detail::ccCoinValueCodeHash(code[0], code[1], code[2])];
+	if (slot < 0) {
+		return 0;
+	}
+	const CcCoinValueCode& entry = cc_coin_value_codes[std::size_t(slot)];
+	if (entry.code[0] != code[0] || entry.code[1] != code[1] || entry.code[2] != code[2]) {
+		return 0;
+	}
+	decimal_places = entry.decimal_places;
+	return entry.value;
 }
 
 
@@ -1133,6 +1478,8 @@ struct CcIdentifier {
 }
 
 
+Q_DECLARE_METATYPE(qtcc::CcIdentifier)
+
 
 #endif
 
@@ -0,0 +1,306 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_FRAME_H
+#define CCTALK_FRAME_H
+
+#include <QByteArray>
+#include <QMetaType>
+#include <array>
+#include <algorithm>
+
+#include "cctalk_checksum.h"
+#include "helpers/debug.h"
+
+
+namespace qtcc {
+
+
+/**
+\file
+
+Allocation-free ccTalk frame handling.
+
+CcFrame is a fixed-capacity value type, large enough for any ccTalk frame, so building,
+sending, receiving and parsing a frame doesn't touch the heap. The payload is exposed
+through CcByteView, a non-owning view into the frame bytes.
+*/
+
+
+
+/// Non-owning view of a byte range (e.g. a frame payload).
+/// The viewed data must outlive the view.
+class CcByteView {
+	public:
+
+		/// Constructor (empty view)
+		constexpr CcByteView() = default;
+
+		/// Constructor
+		constexpr CcByteView(const char* data, int size)
+				: data_(data), size_(size)
+		{ }
+
+		/// Constructor, views the array data (no copying)
+		CcByteView(const QByteArray& array)
+				: data_(array.constData()), size_(array.size())
+		{ }
+
+
+		/// Get the data pointer
+		[[nodiscard]] constexpr const char* data() const
+		{
+			return data_;
+		}
+
+		/// Get the number of bytes
+		[[nodiscard]] constexpr int size() const
+		{
+			return size_;
+		}
+
+		/// Check if the view is empty
+		[[nodiscard]] constexpr bool isEmpty() const
+		{
+			return size_ == 0;
+		}
+
+		/// Get a byte
+		[[nodiscard]] char at(int pos) const
+		{
+			DBG_ASSERT(pos >= 0 && pos < size_);
+			return data_[pos];
+		}
+
+		/// Get a byte
+		[[nodiscard]] char operator[](int pos) const
+		{
+			return at(pos);
+		}
+
+		/// Iteration support
+		[[nodiscard]] constexpr const char* begin() const
+		{
+			return data_;
+		}
+
+		/// Iteration support
+		[[nodiscard]] constexpr const char* end() const
+		{
+			return data_ + size_;
+		}
+
+		/// Get a sub-view, clipped to the available data
+		[[nodiscard]] CcByteView mid(int pos, int len = -1) const
+		{
+			pos = std::clamp(pos, 0, size_);
+			const int available = size_ - pos;
+			return CcByteView(data_ + pos, (len < 0 || len > available) ? available : len);
+		}
+
+		/// Create a deep copy
+		[[nodiscard]] QByteArray toByteArray() const
+		{
+			return QByteArray(data_, size_);
+		}
+
+
+	private:
+
+		const char* data_ = nullptr;  ///< Viewed data
+		int size_ = 0;  ///< Number of viewed bytes
+
+};
+
+
+
+/// Complete ccTalk frame: [destination] [data size] [source] [header] [data ...] [checksum].
+class CcFrame {
+	public:
+
+		/// Maximum payload size
+		static constexpr int max_data_size = 255;
+
+		/// Maximum frame size
+		static constexpr int max_size = cc_frame_overhead_size + max_data_size;
+
+
+		/// Build a frame with the checksum policy \c Checksum.
+		template<typename Checksum>
+		[[nodiscard]] static CcFrame build(quint8 destination_addr, quint8 source_addr, quint8 header, CcByteView data);
+
+
+		/// Assign raw frame bytes (e.g. received from a device). The data is truncated
+		/// to max_size (as a result, the frame will have an invalid size).
+		void assign(CcByteView raw_data)
+		{
+			size_ = std::min(raw_data.size(), max_size);
+			std::copy_n(raw_data.data(), size_, bytes_.data());
+		}
+
+
+		/// Get the number of frame bytes
+		[[nodiscard]] int size() const
+		{
+			return size_;
+		}
+
+		/// Get the frame bytes
+		[[nodiscard]] const char* data() const
+		{
+			return bytes_.data();
+		}
+
+		/// Get a view of all the frame bytes
+		[[nodiscard]] CcByteView getBytes() const
+		{
+			return CcByteView(bytes_.data(), size_);
+		}
+
+
+		/// Check that the frame is large enough to have all the header fields and a checksum,
+		/// and that the data size field matches the frame size.
+		[[nodiscard]] bool hasValidSize() const
+		{
+			return size_ >= cc_frame_overhead_size && size_ == cc_frame_overhead_size + int(getDataSize());
+		}
+
+		/// Get the destination address. The frame must be at least cc_frame_overhead_size bytes.
+		[[nodiscard]] quint8 getDestinationAddress() const
+		{
+			return quint8(bytes_[0]);
+		}
+
+		/// Get the data size field. The frame must be at least cc_frame_overhead_size bytes.
+		[[nodiscard]] quint8 getDataSize() const
+		{
+			return quint8(bytes_[1]);
+		}
+
+		/// Get the source address field (CRC LSB in 16-bit CRC mode).
+		/// The frame must be at least cc_frame_overhead_size bytes.
+		[[nodiscard]] quint8 getSourceAddress() const
+		{
+			return quint8(bytes_[cc_frame_source_offset]);
+		}
+
+		/// Get the header (command) field. The frame must be at least cc_frame_overhead_size bytes.
+		[[nodiscard]] quint8 getHeader() const
+		{
+			return quint8(bytes_[3]);
+		}
+
+		/// Get a view of the payload, clipped to the available data.
+		[[nodiscard]] CcByteView getData() const
+		{
+			if (size_ < cc_frame_overhead_size) {
+				return CcByteView();
+			}
+			return getBytes().mid(4, std::min(int(getDataSize()), size_ - cc_frame_overhead_size));
+		}
+
+
+		/// Verify the frame checksum with the checksum policy \c Checksum.
+		/// The frame must be at least cc_frame_overhead_size bytes.
+		template<typename Checksum>
+		[[nodiscard]] bool verify() const
+		{
+			return Checksum::verify(bytes_.data(), size_);
+		}
+
+
+	private:
+
+		std::array<char, max_size> bytes_;  ///< Frame bytes. Only the first size_ bytes are valid.
+		int size_ = 0;  ///< Number of frame bytes
+
+};
+
+
+
+template<typename Checksum>
+CcFrame CcFrame::build(quint8 destination_addr, quint8 source_addr, quint8 header, CcByteView data)
+{
+	DBG_ASSERT(data.size() <= max_data_size);
+
+	CcFrame frame;
+	const int data_size = std::min(data.size(), max_data_size);
+	frame.bytes_[0] = char(destination_addr);  // Field: Destination address. 0 means broadcast to all devices on port.
+	frame.bytes_[1] = char(data_size);  // Field: Data size
+	frame.bytes_[2] = char(Checksum::has_source_address ? source_addr : 0);  // Field: Source address (1 means master) or CRC LSB
+	frame.bytes_[3] = char(header);  // Field: Command
+	std::copy_n(data.data(), data_size, frame.bytes_.data() + 4);  // Field: The data (if data size != 0)
+	frame.size_ = cc_frame_overhead_size + data_size;
+	frame.bytes_[std::size_t(frame.size_ - 1)] = 0;  // Field: Checksum or CRC MSB
+	Checksum::seal(frame.bytes_.data(), frame.size_);
+	return frame;
+}
+
+
+
+/// Build a frame with the checksum policy \c Checksum (free function for taking the address of)
+template<typename Checksum>
+CcFrame ccBuildFrame(quint8 destination_addr, quint8 source_addr, quint8 header, CcByteView data)
+{
+	return CcFrame::build<Checksum>(destination_addr, source_addr, header, data);
+}
+
+
+
+/// Verify a frame checksum with the checksum policy \c Checksum (free function for taking the address of)
+template<typename Checksum>
+bool ccVerifyFrame(const CcFrame& frame)
+{
+	return frame.verify<Checksum>();
+}
+
+
+
+/// Nesting depth of CcFramingScope on the current thread
+inline thread_local int cc_framing_scope_depth = 0;
+
+
+/// Marks the framing code along the request path (building the request frame, assembling and
+/// parsing the reply) on the current thread, so that heap allocation counters (see cctalk_bench)
+/// can tell the framing layer allocations apart. Writing to the transport, the timers, the request
+/// tables and the queued signals between threads are outside of the scopes.
+class CcFramingScope {
+	public:
+
+		/// Constructor
+		CcFramingScope() noexcept
+		{
+			++cc_framing_scope_depth;
+		}
+
+		/// Non-copyable
+		CcFramingScope(const CcFramingScope& other) = delete;
+
+		/// Non-copyable
+		CcFramingScope& operator=(const CcFramingScope& other) = delete;
+
+		/// Destructor
+		~CcFramingScope()
+		{
+			--cc_framing_scope_depth;
+		}
+
+		/// Check whether the current thread is in the framing code
+		[[nodiscard]] static bool isActive() noexcept
+		{
+			return cc_framing_scope_depth > 0;
+		}
+
+};
+
+
+
+}
+
+
+Q_DECLARE_METATYPE(qtcc::CcFrame)
+
+
+#endif
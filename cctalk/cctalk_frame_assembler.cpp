@@ -0,0 +1,116 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <algorithm>
+#include <cstring>
+
+#include "cctalk_frame_assembler.h"
+#include "serial_transport.h"
+
+
+namespace qtcc {
+
+
+
+void CcFrameAssembler::reset(CcByteView echo)
+{
+	const CcFramingScope framing_scope;
+	echo_size_ = std::min(echo.size(), int(echo_.size()));
+	std::copy_n(echo.data(), echo_size_, echo_.data());
+	size_ = 0;
+	discarded_size_ = 0;
+	echo_verified_ = (echo_size_ == 0);
+}
+
+
+
+void CcFrameAssembler::readFrom(SerialTransport& transport)
+{
+	const CcFramingScope framing_scope;
+	const qint64 read_size = transport.read(data_.data() + size_, capacity - size_);
+	if (read_size > 0) {
+		size_ += int(read_size);
+		discardStaleData();
+	}
+	if (size_ == capacity) {
+		// Drain the rest without allocating, this is garbage anyway.
+		std::array<char, 64> discarded;
+		while (transport.read(discarded.data(), qint64(discarded.size())) > 0) { }
+	}
+}
+
+
+
+bool CcFrameAssembler::hasReplyData() const
+{
+	return size_ > echo_size_;
+}
+
+
+
+int CcFrameAssembler::getExpectedSize() const
+{
+	if (size_ <= echo_size_ + data_size_offset) {
+		return -1;
+	}
+	auto data_size = static_cast<quint8>(data_[std::size_t(echo_size_ + data_size_offset)]);
+	return echo_size_ + min_frame_size + int(data_size);
+}
+
+
+
+bool CcFrameAssembler::isComplete() const
+{
+	const int expected_size = getExpectedSize();
+	return expected_size != -1 && size_ >= expected_size;
+}
+
+
+
+CcByteView CcFrameAssembler::getData() const
+{
+	return CcByteView(data_.data(), size_);
+}
+
+
+
+CcByteView CcFrameAssembler::getReplyData() const
+{
+	return getData().mid(echo_size_);
+}
+
+
+
+int CcFrameAssembler::getDiscardedSize() const
+{
+	return discarded_size_;
+}
+
+
+
+void CcFrameAssembler::discardStaleData()
+{
+	if (echo_verified_) {
+		return;
+	}
+	// Find the first position where the received data matches (the beginning of) the echo.
+	int start = 0;
+	for (; start < size_; ++start) {
+		const int compare_size = std::min(size_ - start, echo_size_);
+		if (std::memcmp(data_.data() + start, echo_.data(), std::size_t(compare_size)) == 0) {
+			break;
+		}
+	}
+	if (start > 0) {
+		std::memmove(data_.data(), data_.data() + start, std::size_t(size_ - start));
+		size_ -= start;
+		discarded_size_ += start;
+	}
+	echo_verified_ = (size_ >= echo_size_);
+}
+
+
+
+}
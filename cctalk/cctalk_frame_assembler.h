@@ -0,0 +1,93 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_FRAME_ASSEMBLER_H
+#define CCTALK_FRAME_ASSEMBLER_H
+
+#include <array>
+
+#include "cctalk_frame.h"
+
+
+
+namespace qtcc {
+
+
+class SerialTransport;
+
+
+
+/// Streaming assembler for ccTalk response frames.
+/// The serial line receives the local echo of the request first, followed by the
+/// device reply: [destination] [data size] [source] [header] [data ...] [checksum].
+/// Once the data size byte is seen, the total length is known, so the frame can be
+/// declared complete as soon as its last byte arrives (instead of waiting for
+/// a period of silence on the line).
+/// The data is received into a fixed-size buffer, without any heap allocations.
+/// Bytes preceding the expected echo (e.g. a late reply to a timed out request) are
+/// discarded, so they are not taken for the start of this transaction.
+class CcFrameAssembler {
+	public:
+
+		/// Minimum reply frame size (empty data).
+		static constexpr int min_frame_size = cc_frame_overhead_size;
+
+		/// Offset of the "data size" field in a reply frame.
+		static constexpr int data_size_offset = 1;
+
+		/// Buffer capacity: the largest echo followed by the largest reply.
+		static constexpr int capacity = 2 * CcFrame::max_size;
+
+
+		/// Start assembling a new response. \c echo is the request echoed back to
+		/// us before the reply (empty if there is no local echo). It's copied.
+		void reset(CcByteView echo);
+
+		/// Read all the available data from \c transport. Any data that doesn't fit
+		/// into the buffer is discarded (the frame will be reported as malformed).
+		void readFrom(SerialTransport& transport);
+
+		/// Return true if at least one byte of the reply (after the echo) was received.
+		[[nodiscard]] bool hasReplyData() const;
+
+		/// Return the full expected size (echo + reply) or -1 if the reply header
+		/// hasn't been received yet.
+		[[nodiscard]] int getExpectedSize() const;
+
+		/// Return true if the expected number of bytes has been received.
+		[[nodiscard]] bool isComplete() const;
+
+		/// Get the received data, including the echo.
+		[[nodiscard]] CcByteView getData() const;
+
+		/// Get the received data after the echo.
+		[[nodiscard]] CcByteView getReplyData() const;
+
+		/// Get the number of stale bytes discarded before the echo since reset()
+		[[nodiscard]] int getDiscardedSize() const;
+
+
+	private:
+
+		/// Discard the received bytes that can't be the start of the echo
+		void discardStaleData();
+
+
+		std::array<char, CcFrame::max_size> echo_;  ///< Expected echo. Only the first echo_size_ bytes are valid.
+		std::array<char, capacity> data_;  ///< Received data (echo + reply). Only the first size_ bytes are valid.
+		int size_ = 0;  ///< Number of received bytes
+		int echo_size_ = 0;  ///< Number of echoed request bytes preceding the reply
+		int discarded_size_ = 0;  ///< Stale bytes discarded since reset()
+		bool echo_verified_ = false;  ///< True once the whole echo has been matched
+
+};
+
+
+
+}
+
+
+
+#endif
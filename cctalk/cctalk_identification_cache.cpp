@@ -0,0 +1,128 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <QMutexLocker>
+#include <QStringList>
+
+#include "cctalk_identification_cache.h"
+#include "helpers/debug.h"
+
+
+namespace qtcc {
+
+
+
+CcIdentificationCache::CcIdentificationCache(const QString& file_name)
+		: settings_(file_name, QSettings::IniFormat)
+{ }
+
+
+
+QString CcIdentificationCache::createKey(const QByteArray& serial_number, const QByteArray& build_code,
+		const QByteArray& software_revision)
+{
+	// Hex-encoded, so that the key is a valid INI group name.
+	return QStringList({
+		QString::fromLatin1(serial_number.toHex()),
+		QString::fromLatin1(build_code.toHex()),
+		QString::fromLatin1(software_revision.toHex())
+	}).join(QStringLiteral("_"));
+}
+
+
+
+bool CcIdentificationCache::lookup(const QString& key, CcIdentificationCacheEntry& entry) const
+{
+	QMutexLocker locker(&mutex_);
+
+	if (key.isEmpty() || !settings_.childGroups().contains(key)) {
+		return false;
+	}
+
+	settings_.beginGroup(key);
+
+	bool valid = settings_.value(QStringLiteral("format_version")).toInt() == format_version;
+
+	CcIdentificationCacheEntry loaded;
+	loaded.category = CcCategory(settings_.value(QStringLiteral("category")).toInt());
+	loaded.manufacturing_info = settings_.value(QStringLiteral("manufacturing_info")).toString();
+	valid = valid && (loaded.category == CcCategory::BillValidator || loaded.category == CcCategory::CoinAcceptor);
+
+	const int size = settings_.beginReadArray(QStringLiteral("identifiers"));
+	for (int i = 0; i < size; ++i) {
+		settings_.setArrayIndex(i);
+		const int position = settings_.value(QStringLiteral("position")).toInt();
+		const QByteArray id_string = settings_.value(QStringLiteral("id_string")).toByteArray();
+		if (position < 1 || position > 255 || id_string.isEmpty()) {
+			valid = false;
+			continue;
+		}
+		CcCountryScalingData scaling_data;
+		scaling_data.scaling_factor = quint16(settings_.value(QStringLiteral("scaling_factor"), 1).toUInt());
+		scaling_data.decimal_places = quint8(settings_.value(QStringLiteral("decimal_places"), 0).toUInt());
+
+		CcIdentifier identifier(id_string);
+		identifier.setCountryScalingData(scaling_data);
+		loaded.identifiers.insert(quint8(position), identifier);
+	}
+	settings_.endArray();
+
+	settings_.endGroup();
+
+	if (valid) {
+		entry = loaded;
+	}
+	return valid;
+}
+
+
+
+void CcIdentificationCache::store(const QString& key, const CcIdentificationCacheEntry& entry)
+{
+	DBG_ASSERT_RETURN_NONE(!key.isEmpty());
+	QMutexLocker locker(&mutex_);
+
+	settings_.remove(key);
+	settings_.beginGroup(key);
+
+	settings_.setValue(QStringLiteral("format_version"), format_version);
+	settings_.setValue(QStringLiteral("category"), int(entry.category));
+	settings_.setValue(QStringLiteral("manufacturing_info"), entry.manufacturing_info);
+
+	settings_.beginWriteArray(QStringLiteral("identifiers"), entry.identifiers.size());
+	int index = 0;
+	for (auto iter = entry.identifiers.constBegin(); iter != entry.identifiers.constEnd(); ++iter, ++index) {
+		settings_.setArrayIndex(index);
+		settings_.setValue(QStringLiteral("position"), int(iter.key()));
+		settings_.setValue(QStringLiteral("id_string"), iter.value().id_string);
+		settings_.setValue(QStringLiteral("scaling_factor"), uint(iter.value().country_scaling_data.scaling_factor));
+		settings_.setValue(QStringLiteral("decimal_places"), uint(iter.value().country_scaling_data.decimal_places));
+	}
+	settings_.endArray();
+
+	settings_.endGroup();
+	settings_.sync();
+}
+
+
+
+void CcIdentificationCache::remove(const QString& key)
+{
+	DBG_ASSERT_RETURN_NONE(!key.isEmpty());  // an empty key would remove everything
+	QMutexLocker locker(&mutex_);
+	settings_.remove(key);
+	settings_.sync();
+}
+
+
+
+QString CcIdentificationCache::getFileName() const
+{
+	return settings_.fileName();
+}
+
+
+
+}
@@ -0,0 +1,87 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_IDENTIFICATION_CACHE_H
+#define CCTALK_IDENTIFICATION_CACHE_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QMap>
+#include <QMutex>
+#include <QSettings>
+
+#include "cctalk_enums.h"
+
+
+namespace qtcc {
+
+
+/**
+\file
+
+Persistent cache of device identification data.
+
+Reading the manufacturing info and the coin / bill identifiers takes more than 20 requests,
+which is several seconds at 9600 baud. The cache stores these results on disk, keyed by
+the device serial number, build code and software revision, so that re-initialization
+(e.g. after a power cycle) needs only the 3 key requests when the device hasn't changed.
+A firmware update or a different device changes the key and causes a full refresh.
+*/
+
+
+
+/// Cached identification data of a single device
+struct CcIdentificationCacheEntry {
+	CcCategory category = CcCategory::Unknown;  ///< Equipment category
+	QString manufacturing_info;  ///< Free-form text product information
+	QMap<quint8, CcIdentifier> identifiers;  ///< Coin positions / bill types and IDs, with country scaling data
+};
+
+
+
+/// On-disk (INI file) cache of device identification data.
+/// One cache file may be shared by several devices, also in different threads.
+class CcIdentificationCache {
+	public:
+
+		/// Constructor. The file is created when the first entry is stored.
+		explicit CcIdentificationCache(const QString& file_name);
+
+
+		/// Build a cache key from the device replies to GetSerialNumber, GetBuildCode and GetSoftwareRevision.
+		[[nodiscard]] static QString createKey(const QByteArray& serial_number, const QByteArray& build_code,
+				const QByteArray& software_revision);
+
+
+		/// Look up the entry stored with \c key.
+		/// \return false if there is no (valid) entry.
+		bool lookup(const QString& key, CcIdentificationCacheEntry& entry) const;
+
+		/// Store an entry, replacing the previous one with the same key.
+		void store(const QString& key, const CcIdentificationCacheEntry& entry);
+
+		/// Remove the entry stored with \c key, if any.
+		void remove(const QString& key);
+
+		/// Get the cache file name
+		[[nodiscard]] QString getFileName() const;
+
+
+	private:
+
+		/// Version of the entry format. Entries with a different version are ignored.
+		static constexpr int format_version = 1;
+
+		mutable QMutex mutex_;  ///< Protects settings_
+		mutable QSettings settings_;  ///< Cache file
+
+};
+
+
+
+}
+
+
+#endif
@@ -3,11 +3,17 @@ Copyright: (C) 2014 - 2021 Alexander Shaduri
 License: BSD-3-Clause
 ***************************************************************************/
 
+#include <algorithm>
 #include <memory>
+#include <optional>
+#include <utility>
+#include <QVector>
+#include <QMetaMethod>
 
 #include "cctalk_link_controller.h"
+#include "cctalk_bus.h"
+#include "cctalk_coroutine.h"
 #include "helpers/debug.h"
-#include "serial_worker.h"
 
 
 namespace qtcc {
@@ -17,26 +23,6 @@ namespace qtcc {
 
 CctalkLinkController::CctalkLinkController()
 {
-	serial_worker_.reset(new SerialWorker());
-
-	serial_worker_->moveToThread(&worker_thread_);
-	connect(&worker_thread_, &QThread::finished, serial_worker_.data(), &QObject::deleteLater);
-
-	// Connect our proxy signals to their slots.
-	connect(this, &CctalkLinkController::openPortInWorker, serial_worker_.data(), &SerialWorker::openPort, Qt::QueuedConnection);
-	connect(this, &CctalkLinkController::closePortInWorker, serial_worker_.data(), &SerialWorker::closePort, Qt::QueuedConnection);
-	connect(this, &CctalkLinkController::sendRequestToWorker, serial_worker_.data(), &SerialWorker::sendRequest, Qt::QueuedConnection);
-
-	// Handle their signals
-	connect(serial_worker_.data(), &SerialWorker::responseReceived, this, &CctalkLinkController::onResponseReceive, Qt::QueuedConnection);
-
-	// Mirror some signals
-	connect(serial_worker_.data(), &SerialWorker::portError, this, &CctalkLinkController::portError, Qt::QueuedConnection);
-	connect(serial_worker_.data(), &SerialWorker::portOpen, this, &CctalkLinkController::portOpen, Qt::QueuedConnection);
-// 	connect(serial_worker_.data(), &SerialWorker::requestTimeout, this, &CctalkLinkController::requestTimeout, Qt::QueuedConnection);
-// 	connect(serial_worker_.data(), &SerialWorker::responseTimeout, this, &CctalkLinkController::responseTimeout, Qt::QueuedConnection);
-	connect(serial_worker_.data(), &SerialWorker::logMessage, this, &CctalkLinkController::logMessage, Qt::QueuedConnection);
-
 	// Log message structure errors
 	connect(this, &CctalkLinkController::ccResponseMessageStructureError, [this]([[maybe_unused]] quint64 request_id,
 			const QString& error_msg) {
@@ -44,39 +30,68 @@ CctalkLinkController::CctalkLinkController()
 	});
 
 
-	// requestFinishedOrError signal, which signals the executeOnReturn() function to call its callback.
+	// Finish the pending requests. Replies are finished directly by onResponseReceive(),
+	// so that the data doesn't have to be copied.
 
-	connect(this, &CctalkLinkController::ccResponseReply, [this](quint64 request_id, const QByteArray& command_data) {
-		emit requestFinishedOrError(request_id, QString(), command_data);
+	connect(this, &CctalkLinkController::ccResponseMessageStructureError, [this](quint64 request_id, const QString& error_msg) {
+		auto iter = pending_requests_.constFind(request_id);
+		if (iter != pending_requests_.constEnd()) {
+			statistics_->recordStructureError(iter->command);
+		}
+		finishRequest(request_id, error_msg, CcByteView());
 	});
 
-	connect(serial_worker_.data(), &SerialWorker::portError, [this](const QString& error_msg) {
-		emit requestFinishedOrError(0, error_msg, QByteArray());
-	});
+	const int expiry_check_interval_msec = 1000;
+	pending_expiry_timer_.setInterval(expiry_check_interval_msec);
+	connect(&pending_expiry_timer_, &QTimer::timeout, this, &CctalkLinkController::expirePendingRequests);
 
-	connect(serial_worker_.data(), &SerialWorker::requestTimeout, [this](quint64 request_id) {
-		emit requestFinishedOrError(request_id, QObject::tr("Request #%1 write timeout").arg(request_id), QByteArray());
-	});
+	// Use a private bus until told otherwise.
+	setBus(std::make_shared<CctalkBus>());
+}
 
-	connect(serial_worker_.data(), &SerialWorker::responseTimeout, [this](quint64 request_id) {
-		emit requestFinishedOrError(request_id, QObject::tr("Response #%1 read timeout").arg(request_id), QByteArray());
-	});
 
-	connect(this, &CctalkLinkController::ccResponseMessageStructureError, [this](quint64 request_id, const QString& error_msg) {
-		emit requestFinishedOrError(request_id, error_msg, QByteArray());
-	});
+
+CctalkLinkController::~CctalkLinkController()
+{
+	if (bus_) {
+		bus_->detach(this);
+	}
+}
 
 
-	// Start the thread (calls run(), enters event loop).
-	worker_thread_.start();
+
+void CctalkLinkController::setBus(std::shared_ptr<CctalkBus> bus)
+{
+	DBG_ASSERT_RETURN_NONE(bus);
+	if (bus_ == bus) {
+		return;
+	}
+	if (bus_) {
+		bus_->detach(this);
+	}
+	bus_ = std::move(bus);
+	bus_->attach(this);
 }
 
 
 
-CctalkLinkController::~CctalkLinkController()
+std::shared_ptr<CctalkBus> CctalkLinkController::getBus() const
 {
-	worker_thread_.quit();
-	worker_thread_.wait();
+	return bus_;
+}
+
+
+
+void CctalkLinkController::moveToControllerThread(QThread* thread)
+{
+	DBG_ASSERT_RETURN_NONE(thread);
+
+	moveToThread(thread);
+	pending_expiry_timer_.moveToThread(thread);
+	// The worker signals are queued to the bus thread, so they follow it.
+	if (bus_ && bus_->thread() != thread) {
+		bus_->moveToThread(thread);
+	}
 }
 
 
@@ -87,6 +102,29 @@ void CctalkLinkController::setCcTalkOptions(const QString& port_device, quint8 d
 	device_addr_ = device_addr;
 	checksum_16bit_ = checksum_16bit;
 	des_encrypted_ = des_encrypted;
+
+	// Select the checksum policy once, instead of checking it for each frame.
+	if (checksum_16bit_) {
+		build_frame_ = &ccBuildFrame<CcChecksum16>;
+		verify_frame_ = &ccVerifyFrame<CcChecksum16>;
+	} else {
+		build_frame_ = &ccBuildFrame<CcChecksum8>;
+		verify_frame_ = &ccVerifyFrame<CcChecksum8>;
+	}
+}
+
+
+
+quint8 CctalkLinkController::getDeviceAddress() const
+{
+	return device_addr_;
+}
+
+
+
+bool CctalkLinkController::getChecksum16bit() const
+{
+	return checksum_16bit_;
 }
 
 
@@ -94,7 +132,7 @@ void CctalkLinkController::setCcTalkOptions(const QString& port_device, quint8 d
 void CctalkLinkController::setLoggingOptions(bool show_full_response, bool show_serial_request, bool show_serial_response,
 		bool show_cctalk_request, bool show_cctalk_response)
 {
-	serial_worker_->setLoggingOptions(show_full_response, show_serial_request, show_serial_response);
+	bus_->setLoggingOptions(show_full_response, show_serial_request, show_serial_response);
 	show_cctalk_request_ = show_cctalk_request;
 	show_cctalk_response_ = show_cctalk_response;
 }
@@ -103,20 +141,100 @@ void CctalkLinkController::setLoggingOptions(bool show_full_response, bool show_
 
 void CctalkLinkController::openPort(const std::function<void(const QString& error_msg)>& finish_callback)
 {
-	emit openPortInWorker(port_device_);  // Queued
-	connect(serial_worker_.data(), &SerialWorker::portError, [=](const QString& error_msg) {
-		finish_callback(error_msg);
-	});
-	connect(serial_worker_.data(), &SerialWorker::portOpen, [=]() {
-		finish_callback(QString());
-	});
+	bus_->openPort(this, port_device_, finish_callback);
 }
 
 
 
 void CctalkLinkController::closePort()
 {
-	emit closePortInWorker();
+	bus_->closePort(this);
+	clearReplyCache();
+	failPendingRequests(tr("Port closed"));
+}
+
+
+
+void CctalkLinkController::setLogPipeline(std::shared_ptr<CcLogPipeline> pipeline)
+{
+	log_pipeline_ = std::move(pipeline);
+}
+
+
+
+std::shared_ptr<CcLogPipeline> CctalkLinkController::getLogPipeline() const
+{
+	return log_pipeline_;
+}
+
+
+
+void CctalkLinkController::setRetryPolicy(const CcRetryPolicy& policy)
+{
+	retry_policy_ = policy;
+}
+
+
+
+const CcRetryPolicy& CctalkLinkController::getRetryPolicy() const
+{
+	return retry_policy_;
+}
+
+
+
+void CctalkLinkController::setAdaptiveTimeoutsEnabled(bool enabled)
+{
+	adaptive_timeouts_ = enabled;
+}
+
+
+
+bool CctalkLinkController::getAdaptiveTimeoutsEnabled() const
+{
+	return adaptive_timeouts_;
+}
+
+
+
+void CctalkLinkController::setRequestCoalescingEnabled(bool enabled)
+{
+	coalescing_enabled_ = enabled;
+	if (!coalescing_enabled_) {
+		coalescing_requests_.clear();
+	}
+}
+
+
+
+bool CctalkLinkController::getRequestCoalescingEnabled() const
+{
+	return coalescing_enabled_;
+}
+
+
+
+void CctalkLinkController::setReplyCacheTtl(CcHeader command, int ttl_msec)
+{
+	// The replies to state-changing commands can't be reused.
+	DBG_ASSERT_RETURN_NONE(ccHeaderIsIdempotent(command));
+	reply_cache_ttls_.at(std::size_t(command)) = std::max(ttl_msec, 0);
+}
+
+
+
+int CctalkLinkController::getReplyCacheTtl(CcHeader command) const
+{
+	return reply_cache_ttls_.at(std::size_t(command));
+}
+
+
+
+void CctalkLinkController::clearReplyCache()
+{
+	reply_cache_.clear();
+	// The replies in flight may be older than the reason for clearing, don't cache them.
+	++cache_generation_;
 }
 
 
@@ -133,108 +251,375 @@ quint64 CctalkLinkController::ccRequest(CcHeader command, const QByteArray& data
 		emit logMessage(tr("! ccTalk encryption requested, unsupported. Aborting request."));
 		return 0;
 	}
-	if (checksum_16bit_) {
-		// TODO support this
-		emit logMessage(tr("! ccTalk 16-bit CRC checksums requested, unsupported. Aborting request."));
-		return 0;
+
+	// Idempotent requests may be answered without a transaction, from the reply cache
+	// or by joining an identical request in flight.
+	QByteArray request_key;
+	if (ccHeaderIsIdempotent(command)) {
+		const int cache_ttl_msec = reply_cache_ttls_.at(std::size_t(command));
+		if (cache_ttl_msec > 0 || coalescing_enabled_) {
+			request_key = getRequestKey(command, data);
+		}
+
+		if (cache_ttl_msec > 0) {
+			auto cached = reply_cache_.find(request_key);
+			if (cached != reply_cache_.end()) {
+				if (!cached->expiry.hasExpired()) {
+					statistics_->recordCacheHit(command);
+					const quint64 request_id = addLocalRequest(command, QDeadlineTimer(pending_request_grace_msec_));
+					// Finish it asynchronously, as if it was sent; the caller attaches its callback afterwards.
+					QMetaObject::invokeMethod(this, [this, request_id, reply_data = cached->data]() {
+						finishRequest(request_id, QString(), reply_data);
+					}, Qt::QueuedConnection);
+					return request_id;
+				}
+				reply_cache_.erase(cached);
+			}
+		}
+
+		if (coalescing_enabled_) {
+			const quint64 in_flight_id = coalescing_requests_.value(request_key, 0);
+			if (in_flight_id != 0) {
+				statistics_->recordCoalesced(command);
+				const QDeadlineTimer deadline = pending_requests_[in_flight_id].deadline;
+				const quint64 request_id = addLocalRequest(command, deadline);
+				pending_requests_[in_flight_id].coalesced_requests.append(request_id);
+				return request_id;
+			}
+		}
+
+	} else {
+		// The device state may change, don't reuse the replies to the requests sent before this one.
+		clearReplyCache();
+		coalescing_requests_.clear();
 	}
 
-	if (show_cctalk_request_) {
+	if (log_pipeline_) {
+		// Nothing is formatted here, the sink does it if needed.
+		if (log_pipeline_->isEnabled(CcLogLevel::Debug, CcLogCategory::Request)) {
+			CcLogRecord record;
+			record.event = CcLogEvent::CcRequest;
+			record.category = CcLogCategory::Request;
+			record.header = quint8(command);
+			record.address = device_addr_;
+			record.setPayload(data);
+			log_pipeline_->push(record);
+		}
+	} else if (show_cctalk_request_) {
 		emit logMessage(tr("> ccTalk request: %1, address: %2, data: %3").arg(ccHeaderGetDisplayableName(command))
 				.arg(int(device_addr_))
 				.arg(data.isEmpty() ? tr("(empty)") : QString::fromLatin1(data.toHex())));
 	}
 
 	// Note: The request and response messages have the same format (with source/dest addresses swapped).
-	QByteArray request_data;
-	request_data.append(char(device_addr_));  // Field: Destination address. 0 means broadcast to all devices on port.
-	request_data.append(char(data.size()));  // Field: Data size
-	request_data.append(char(controller_addr_));  // Field: Source address. 1 means master.
-	request_data.append(char(command));  // Field: Command
-	request_data.append(data);  // Field: The data (if data size != 0)
-
-	quint8 checksum = 0;
-	for (char c : request_data) {
-		checksum = static_cast<quint8>(checksum + c);
+	CcFrame request_frame;
+	{
+		const CcFramingScope framing_scope;
+		request_frame = build_frame_(device_addr_, controller_addr_, quint8(command), data);
 	}
-	checksum = static_cast<quint8>(256 - checksum);
-	request_data.append(char(checksum));  // Field: Checksum
 
-	quint64 request_id = ++req_num_;
-	if (request_id == 0) {
-		request_id = ++req_num_;
+	const bool response_contains_request = true;  // due to local loopback of serial port.
+	// Each byte takes 10 bits on the line (start bit, 8 data bits, stop bit). Allow twice the
+	// transmission time at the current line speed, plus a fixed allowance for driver latency.
+	const qint64 transmission_time_msec = qint64(request_frame.size()) * 10 * 1000 / bus_->getBaudRate();
+	const int write_timeout_msec = 500 + int(transmission_time_msec * 2) + 1;
+
+	if (response_timeout_msec < 0) {
+		response_timeout_msec = adaptive_timeouts_ ? rtt_estimator_->getResponseTimeout(command) : default_response_timeout_msec;
 	}
 
-	const bool response_contains_request = true;  // due to local loopback of serial port.
-	const int write_timeout_msec = 500 + request_data.size() * 2;  // should be more than enough at 9600 baud.
+	// Malformed and missing replies are retransmitted by the worker.
+	SerialWorkerRetry retry;
+	retry.max_retries = retry_policy_.getRetryBudget(command);
+	retry.max_timeout_retries = std::min(retry_policy_.getTimeoutRetryBudget(), retry.max_retries);
+	retry.verify_frame = verify_frame_;
 
-	// The actual request will be sent on the next main loop iteration, when it reaches the serial worker.
+	// The actual request is sent by the worker thread, and the response arrives through a queued signal.
 	// This means that we can safely connect to response / error signals right after this function.
-	emit sendRequestToWorker(request_id, request_data, response_contains_request, write_timeout_msec, response_timeout_msec);
+	quint64 request_id = bus_->sendRequest(this, request_frame, response_contains_request, write_timeout_msec, response_timeout_msec,
+			ccHeaderGetRequestPriority(command), retry);
+
+	PendingRequest& pending = pending_requests_[request_id];
+	pending.command = command;
+	pending.deadline = QDeadlineTimer((retry.max_retries + 1) * (write_timeout_msec + response_timeout_msec) + pending_request_grace_msec_);
+	pending.request_key = request_key;
+	pending.cache_generation = cache_generation_;
+
+	if (coalescing_enabled_ && !request_key.isEmpty()) {
+		coalescing_requests_.insert(request_key, request_id);
+	}
+
+	if (!pending_expiry_timer_.isActive()) {
+		pending_expiry_timer_.start();
+	}
 
 	return request_id;
 }
 
 
 
-void CctalkLinkController::executeOnReturn(quint64 sent_request_id,
-		const std::function<void(quint64 request_id, const QString& error_msg, const QByteArray& command_data)>& callback) const
+#ifdef QTCC_COROUTINES
+CcRequestAwaitable CctalkLinkController::ccRequestAwait(CcHeader command, QByteArray data, int response_timeout_msec)
+{
+	return CcRequestAwaitable(this, command, std::move(data), response_timeout_msec);
+}
+#endif
+
+
+
+void CctalkLinkController::executeOnReturn(quint64 sent_request_id, const ResponseFunc& callback)
 {
 	if (sent_request_id == 0) {  // nothing was sent
 		return;
 	}
-	auto conn = std::make_shared<QMetaObject::Connection>();
+	executeOnReturnView(sent_request_id, [callback](quint64 request_id, const QString& error_msg, CcByteView command_data) {
+		callback(request_id, error_msg, command_data.toByteArray());
+	});
+}
 
-	*conn = connect(this, &CctalkLinkController::requestFinishedOrError,
-			[=](quint64 request_id, const QString& error_msg, const QByteArray& command_data) mutable
-	{
-		if (sent_request_id != request_id) {  // should not happen, since we won't have two active requests at the same time, but just in case...
-			return;
+
+
+void CctalkLinkController::executeOnReturnView(quint64 sent_request_id, const ResponseViewFunc& callback)
+{
+	if (sent_request_id == 0) {  // nothing was sent
+		return;
+	}
+	auto iter = pending_requests_.find(sent_request_id);
+	// The request is finished through a queued worker response, so it can't be finished yet.
+	DBG_ASSERT_RETURN_NONE(iter != pending_requests_.end());
+
+	// Only one callback per request, don't replace it silently.
+	if (iter->callback) {
+		emit logMessage(tr("! ccTalk request #%1 (%2) already has a return callback, the new one is ignored.")
+				.arg(sent_request_id).arg(ccHeaderGetDisplayableName(iter->command)));
+		return;
+	}
+	iter->callback = callback;
+}
+
+
+
+void CctalkLinkController::cancelOnReturn(quint64 sent_request_id)
+{
+	auto iter = pending_requests_.find(sent_request_id);
+	if (iter != pending_requests_.end()) {
+		iter->callback = nullptr;
+	}
+}
+
+
+
+int CctalkLinkController::getPendingRequestCount() const
+{
+	return pending_requests_.size();
+}
+
+
+
+std::shared_ptr<CcLinkStatistics> CctalkLinkController::getStatistics() const
+{
+	return statistics_;
+}
+
+
+
+std::shared_ptr<CcRttEstimator> CctalkLinkController::getRttEstimator() const
+{
+	return rtt_estimator_;
+}
+
+
+
+void CctalkLinkController::onBusPortOpen()
+{
+	emit portOpen();
+}
+
+
+
+void CctalkLinkController::onBusPortError(const QString& error_msg)
+{
+	emit portError(error_msg);
+	clearReplyCache();
+	failPendingRequests(error_msg);
+}
+
+
+
+void CctalkLinkController::onBusBaudRateChange()
+{
+	// The adaptive timeouts are measured again at the new speed.
+	rtt_estimator_->reset();
+}
+
+
+
+void CctalkLinkController::onRequestTimeout(quint64 request_id)
+{
+	finishRequest(request_id, QObject::tr("Request #%1 write timeout").arg(request_id), QByteArray());
+}
+
+
+
+void CctalkLinkController::onResponseTimeout(quint64 request_id)
+{
+	finishRequest(request_id, QObject::tr("Response #%1 read timeout").arg(request_id), QByteArray());
+}
+
+
+
+void CctalkLinkController::onBusLogMessage(const QString& msg)
+{
+	emit logMessage(msg);
+}
+
+
+
+void CctalkLinkController::finishRequest(quint64 request_id, const QString& error_msg, CcByteView command_data)
+{
+	auto iter = pending_requests_.find(request_id);
+	if (iter == pending_requests_.end()) {
+		return;  // already finished (e.g. failed on port error)
+	}
+	ResponseViewFunc callback = std::move(iter->callback);
+	const CcHeader command = iter->command;
+	const QByteArray request_key = iter->request_key;
+	const quint64 cache_generation = iter->cache_generation;
+	const QVector<quint64> coalesced_requests = std::move(iter->coalesced_requests);
+	pending_requests_.erase(iter);
+
+	if (pending_requests_.isEmpty()) {
+		pending_expiry_timer_.stop();
+	}
+
+	if (!request_key.isEmpty()) {
+		auto in_flight = coalescing_requests_.find(request_key);
+		if (in_flight != coalescing_requests_.end() && in_flight.value() == request_id) {
+			coalescing_requests_.erase(in_flight);
+		}
+		// Don't cache the reply if a state-changing command was sent after the request.
+		const int cache_ttl_msec = reply_cache_ttls_.at(std::size_t(command));
+		if (error_msg.isEmpty() && cache_ttl_msec > 0 && cache_generation == cache_generation_) {
+			CachedReply& cached = reply_cache_[request_key];
+			cached.data = command_data.toByteArray();
+			cached.expiry = QDeadlineTimer(cache_ttl_msec);
 		}
-		QObject::disconnect(*conn);  // it's a one-time slot
+	}
 
+	if (isSignalConnected(QMetaMethod::fromSignal(&CctalkLinkController::requestFinishedOrError))) {
+		emit requestFinishedOrError(request_id, error_msg, command_data.toByteArray());
+	}
+	if (callback) {
 		callback(request_id, error_msg, command_data);
-	});
+	}
+
+	// The joined requests get the same result.
+	for (quint64 coalesced_id : coalesced_requests) {
+		finishRequest(coalesced_id, error_msg, command_data);
+	}
+}
+
+
+
+QByteArray CctalkLinkController::getRequestKey(CcHeader command, const QByteArray& data) const
+{
+	QByteArray key;
+	key.reserve(data.size() + 2);
+	key.append(char(device_addr_));
+	key.append(char(command));
+	key.append(data);
+	return key;
+}
+
+
+
+quint64 CctalkLinkController::addLocalRequest(CcHeader command, QDeadlineTimer deadline)
+{
+	const quint64 request_id = bus_->allocateRequestId();
+	PendingRequest& pending = pending_requests_[request_id];
+	pending.command = command;
+	pending.deadline = deadline;
+
+	if (!pending_expiry_timer_.isActive()) {
+		pending_expiry_timer_.start();
+	}
+	return request_id;
 }
 
 
 
-void CctalkLinkController::onResponseReceive(quint64 request_id, const QByteArray& response_data)
+void CctalkLinkController::failPendingRequests(const QString& error_msg)
 {
-	if (response_data.size() < 5) {
+	if (pending_requests_.isEmpty()) {
+		return;
+	}
+
+	// The callbacks may send new requests, don't let them see the old ones.
+	auto failed_requests = std::move(pending_requests_);
+	pending_requests_.clear();
+	coalescing_requests_.clear();
+	pending_expiry_timer_.stop();
+
+	for (auto iter = failed_requests.begin(); iter != failed_requests.end(); ++iter) {
+		emit requestFinishedOrError(iter.key(), error_msg, QByteArray());
+		if (iter->callback) {
+			iter->callback(iter.key(), error_msg, CcByteView());
+		}
+	}
+}
+
+
+
+void CctalkLinkController::expirePendingRequests()
+{
+	QVector<quint64> expired_ids;
+	for (auto iter = pending_requests_.constBegin(); iter != pending_requests_.constEnd(); ++iter) {
+		if (iter->deadline.hasExpired()) {
+			expired_ids << iter.key();
+		}
+	}
+	for (quint64 request_id : expired_ids) {
+		// Coalesced requests share the deadline of the request they joined, and are finished with it.
+		auto iter = pending_requests_.constFind(request_id);
+		if (iter == pending_requests_.constEnd()) {
+			continue;
+		}
+		const QString error_msg = tr("! ccTalk request #%1 (%2) expired without a response.")
+				.arg(request_id).arg(ccHeaderGetDisplayableName(iter->command));
+		emit logMessage(error_msg);
+		finishRequest(request_id, error_msg, CcByteView());
+	}
+}
+
+
+
+void CctalkLinkController::onResponseReceive(quint64 request_id, const qtcc::CcFrame& response_frame)
+{
+	// Parsing the frame is part of the framing layer, the logging and the callbacks are not.
+	std::optional<CcFramingScope> framing_scope(std::in_place);
+
+	if (response_frame.size() < cc_frame_overhead_size) {
 		emit ccResponseMessageStructureError(request_id, QObject::tr("! ccTalk response #%1 size too small (%2 bytes).")
-				.arg(request_id).arg(response_data.size()));
-		// TODO The command should be retried.
+				.arg(request_id).arg(response_frame.size()));
 		return;
 	}
 
-	quint8 destination_addr = response_data[0];
-	quint8 data_size = response_data[1];
-	quint8 source_addr = response_data[2];
-	quint8 command = response_data[3];
-	QByteArray command_data = response_data.mid(4, data_size);
-	// quint8 received_checksum = response_data[response_data.size() - 1];
+	quint8 destination_addr = response_frame.getDestinationAddress();
+	quint8 source_addr = response_frame.getSourceAddress();
+	quint8 command = response_frame.getHeader();
+	CcByteView command_data = response_frame.getData();  // a view into response_frame, no copying
 
-	// Format error
-	if (response_data.size() != 5 + command_data.size()) {
+	// Format error. The worker has already retried the command, if the retry policy allows it.
+	if (!response_frame.hasValidSize()) {
 		emit ccResponseMessageStructureError(request_id, QObject::tr("! Invalid ccTalk response #%1 size (%2 bytes).")
-				.arg(request_id).arg(response_data.size()));
-		// TODO The command should be retried.
+				.arg(request_id).arg(response_frame.size()));
 		return;
 	}
 
-	// Checksum error
-	{
-		quint8 checksum = 0;
-		for (char c : response_data) {
-			checksum = static_cast<quint8>(checksum + c);
-		}
-		// The sum of all bytes must be 0.
-		if (checksum != 0) {
-			emit ccResponseMessageStructureError(request_id, QObject::tr("! Invalid ccTalk response #%1 checksum.").arg(request_id));
-			// TODO The command should be retried.
-			return;
-		}
+	// Checksum error. The worker has already retried the command, if the retry policy allows it.
+	if (!verify_frame_(response_frame)) {
+		emit ccResponseMessageStructureError(request_id, QObject::tr("! Invalid ccTalk response #%1 checksum.").arg(request_id));
+		return;
 	}
 
 	// We should be the only destination. In multi-host networks this should be
@@ -247,14 +632,17 @@ void CctalkLinkController::onResponseReceive(quint64 request_id, const QByteArra
 
 	// We should be the only destination. In multi-host networks this should be
 	// ignored, but not here.
+	// With 16-bit CRC checksums the source address field holds the CRC LSB, so there
+	// is nothing to check; the reply comes from the addressed device.
+	if (checksum_16bit_) {
+		source_addr = device_addr_;
+	}
 	if (device_addr_ != 0 && source_addr != device_addr_) {
 		emit ccResponseMessageStructureError(request_id, QObject::tr("! Invalid ccTalk response #%1 source address %2, expected %3.")
 				.arg(request_id).arg(int(source_addr)).arg(int(device_addr_)));
 		return;
 	}
 
-	QString formatted_data = command_data.isEmpty() ? tr("(empty)") : QString::fromLatin1(command_data.toHex());
-
 	// Every reply must have the command field set to 0.
 	if (command != static_cast<decltype(command)>(CcHeader::Reply)) {
 		emit ccResponseMessageStructureError(request_id,
@@ -263,15 +651,31 @@ void CctalkLinkController::onResponseReceive(quint64 request_id, const QByteArra
 		return;
 	}
 
+	framing_scope.reset();
+
 // 	if (command == static_cast<decltype(command)>(CcHeader::Reply)) {
 // 		emit logMessage(QObject::tr("< ccTalk response #%1 data: %2")
 // 				.arg(request_id).arg(formatted_data));
-		if (show_cctalk_response_) {
+		if (log_pipeline_) {
+			if (log_pipeline_->isEnabled(CcLogLevel::Debug, CcLogCategory::Response)) {
+				CcLogRecord record;
+				record.request_id = request_id;
+				record.event = CcLogEvent::CcResponse;
+				record.category = CcLogCategory::Response;
+				record.address = source_addr;
+				record.setPayload(command_data);
+				log_pipeline_->push(record);
+			}
+		} else if (show_cctalk_response_) {
+			QString formatted_data = command_data.isEmpty() ? tr("(empty)") : QString::fromLatin1(command_data.toByteArray().toHex());
 			// Don't print response_id, it interferes with identical message hiding.
 			emit logMessage(QObject::tr("< ccTalk response from address %1, data: %2")
 					.arg(int(source_addr)).arg(formatted_data));
 		}
-		emit ccResponseReply(request_id, command_data);
+		if (isSignalConnected(QMetaMethod::fromSignal(&CctalkLinkController::ccResponseReply))) {
+			emit ccResponseReply(request_id, command_data.toByteArray());
+		}
+		finishRequest(request_id, QString(), command_data);
 // 	} else {
 // 		QString command_name = ccHeaderGetDisplayableName(CcHeader(command));
 // 		if (command_name.isEmpty()) {
@@ -6,17 +6,30 @@ License: BSD-3-Clause
 #ifndef CCTALK_LINK_CONTROLLER_H
 #define CCTALK_LINK_CONTROLLER_H
 
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QTimer>
 #include <QThread>
+#include <QDeadlineTimer>
+#include <array>
 #include <functional>
+#include <memory>
 
 #include "cctalk_enums.h"
+#include "cctalk_frame.h"
+#include "cctalk_link_statistics.h"
+#include "cctalk_log.h"
+#include "cctalk_retry_policy.h"
+#include "cctalk_rtt_estimator.h"
 
 
 namespace qtcc {
 
 
 
-class SerialWorker;
+class CctalkBus;
+class CcRequestAwaitable;
 
 
 /**
@@ -24,12 +37,23 @@ class SerialWorker;
 
 How it all works:
 
-SerialWorker runs in its own thread (launched by CctalkLinkController) and
-performs blocking operations on a serial port. CctalkLinkController communicates
-with it using a queued signal/slot mechanism only. To transmit requests,
-CctalkLinkController emits signals that are tied to SerialWorker slots.
-The receiving of results, errors, timeout conditions and log messages
-happens by connecting SerialWorker signals to CctalkLinkController slots.
+CctalkLinkController builds the ccTalk frames of one device (address), and parses and
+checks its replies. It doesn't own the serial port: it is attached to a CctalkBus, which
+owns the SerialWorker of a serial line and (unless the I/O thread is shared) the thread it
+runs in. By default, each controller
+has its own private bus. Controllers of devices that share a serial line (with different
+addresses) should be attached to the same CctalkBus object using setBus(); the bus
+interleaves their requests in the worker's priority queue.
+
+ccRequest() passes the frame to the bus, which assigns a bus-wide unique request ID and
+remembers which controller issued it. The replies and timeouts come back from the worker
+to the bus through queued signals, and the bus routes each of them to the controller that
+owns the request ID. Port errors go to all the attached controllers. The controller keeps its requests in a pending request
+table, and finishes each one exactly once (see executeOnReturn()).
+
+The worker runs in one of two modes (see SerialWorkerMode): in Blocking mode it waits
+for each request in a private thread, in Async mode it is driven by the transport signals,
+so that the buses of several serial lines may share one I/O thread.
 */
 
 
@@ -47,6 +71,13 @@ class CctalkLinkController : public QObject {
 		/// void callback(quint8 command, const QByteArray& command_data)
 		using ResponseWithCommandFunc = std::function<void(quint8 command, const QByteArray& command_data)>;
 
+		/// void callback(quint64 request_id, const QString& error_msg, const QByteArray& command_data)
+		using ResponseFunc = std::function<void(quint64 request_id, const QString& error_msg, const QByteArray& command_data)>;
+
+		/// void callback(quint64 request_id, const QString& error_msg, CcByteView command_data)
+		/// The data view is only valid during the callback.
+		using ResponseViewFunc = std::function<void(quint64 request_id, const QString& error_msg, CcByteView command_data)>;
+
 
 		/// Constructor
 		CctalkLinkController();
@@ -55,17 +86,86 @@ class CctalkLinkController : public QObject {
 		~CctalkLinkController() override;
 
 
+		/// Attach the controller to a (possibly shared) bus, detaching it from the current one.
+		/// Call before opening the device.
+		void setBus(std::shared_ptr<CctalkBus> bus);
+
+		/// Get the bus this controller is attached to.
+		[[nodiscard]] std::shared_ptr<CctalkBus> getBus() const;
+
+		/// Move the controller, its timers and its bus to \c thread. This must be called
+		/// from the current controller thread. Controllers sharing a bus must all be moved
+		/// to the same thread.
+		void moveToControllerThread(QThread* thread);
+
+
 		/// Set ccTalk options. Call before opening the device.
+		/// This selects the checksum policy used for building and verifying the frames.
 		void setCcTalkOptions(const QString& port_device, quint8 device_addr, bool checksum_16bit, bool des_encrypted);
 
+		/// Get the ccTalk device address set with setCcTalkOptions()
+		[[nodiscard]] quint8 getDeviceAddress() const;
+
+		/// Check whether the 16-bit CRC checksum is used (see setCcTalkOptions())
+		[[nodiscard]] bool getChecksum16bit() const;
+
 		/// Set logging options (though logMessage() signal). Call before opening the device.
 		void setLoggingOptions(bool show_full_response, bool show_serial_request, bool show_serial_response,
 				bool show_cctalk_request, bool show_cctalk_response);
 
-		/// Open the serial port.
+		/// Set a structured log pipeline (possibly shared with other controllers). While it's set,
+		/// ccTalk requests and responses are pushed to it (subject to its filter) instead of
+		/// being formatted and sent through logMessage(), and the show_cctalk_* logging options are ignored.
+		void setLogPipeline(std::shared_ptr<CcLogPipeline> pipeline);
+
+		/// Get the pipeline set with setLogPipeline(). May be null.
+		[[nodiscard]] std::shared_ptr<CcLogPipeline> getLogPipeline() const;
+
+		/// Set the retransmission policy for malformed and missing replies. The default
+		/// policy retries the idempotent (read-only) commands only, see CcRetryPolicy.
+		/// Affects the requests sent afterwards.
+		void setRetryPolicy(const CcRetryPolicy& policy);
+
+		/// Get the policy set with setRetryPolicy()
+		[[nodiscard]] const CcRetryPolicy& getRetryPolicy() const;
+
+		/// Enable or disable the adaptive response timeouts (enabled by default). If enabled,
+		/// the requests sent without an explicit timeout use the timeout derived from the
+		/// measured device response times (see CcRttEstimator), so that a device that stopped
+		/// responding is detected quickly. Otherwise default_response_timeout_msec is used.
+		void setAdaptiveTimeoutsEnabled(bool enabled);
+
+		/// Check whether the adaptive response timeouts are enabled
+		[[nodiscard]] bool getAdaptiveTimeoutsEnabled() const;
+
+		/// Enable or disable request coalescing (disabled by default). If enabled, an idempotent
+		/// request (see ccHeaderIsIdempotent()) identical to one in flight (same header, data and
+		/// address) is not sent. It gets its own request ID and is finished with the result of
+		/// the request in flight. Requests sent before a state-changing command are not joined.
+		void setRequestCoalescingEnabled(bool enabled);
+
+		/// Check whether request coalescing is enabled
+		[[nodiscard]] bool getRequestCoalescingEnabled() const;
+
+		/// Set the reply cache lifetime of an idempotent \c command. 0 (the default) disables caching.
+		/// A successful reply is reused for identical requests sent within \c ttl_msec; these are
+		/// finished (asynchronously, as usual) without a transaction. Sending any state-changing
+		/// command through this controller clears the cache, as do port errors.
+		void setReplyCacheTtl(CcHeader command, int ttl_msec);
+
+		/// Get the reply cache lifetime of \c command
+		[[nodiscard]] int getReplyCacheTtl(CcHeader command) const;
+
+		/// Forget all the cached replies
+		void clearReplyCache();
+
+		/// Open the serial port. If the port is shared with other controllers and
+		/// is already open, the callback is called immediately.
 		void openPort(const std::function<void(const QString& error_msg)>& finish_callback);
 
-		/// Close the serial port.
+		/// Close the serial port. If the port is shared with other controllers, it is
+		/// closed when the last one of them closes it.
+		/// All pending requests of this controller are finished with an error.
 		void closePort();
 
 
@@ -73,7 +173,8 @@ class CctalkLinkController : public QObject {
 	signals:
 
 		/// Emitted whenever a cctalk generic reply is received. If the data size is 0,
-		/// the message should be treated as ACK.
+		/// the message should be treated as ACK. The data is only copied if this
+		/// signal is connected to.
 		void ccResponseReply(quint64 request_id, const QByteArray& command_data);
 
 		/// Emitted whenever cctalk message parsing fails (on general level; the actual
@@ -94,63 +195,166 @@ class CctalkLinkController : public QObject {
 // 		void responseTimeout(quint64 request_id);
 
 
-		/// This signals the executeOnReturn() function to call its callback.
+		/// Emitted whenever a request is finished, successfully or not. The callbacks
+		/// registered with executeOnReturn() are called right after this.
+		/// Port errors (and port closing) are reported once for each pending request.
+		/// The data is only copied if this signal is connected to.
 		void requestFinishedOrError(quint64 request_id, const QString& error_msg, const QByteArray& command_data);
 
 		/// Mirrored from SerialWorker and expanded with local events.
 		void logMessage(const QString& msg);
 
 
-	// SerialWorker caller signals. There are emitted internally to call SerialWorker slots.
-	// For each slot in SerialWorker there should be a signal here.
-
-	// Private signals
-	signals:
-
-		/// Proxy signal to call a slot in the worker thread.
-		void openPortInWorker(const QString& port_name);
-
-		/// Proxy signal to call a slot in the worker thread.
-		void closePortInWorker();
+	public:
 
-		/// Proxy signal to call a slot in the worker thread.
-		void sendRequestToWorker(quint64 request_id, const QByteArray& request_data,
-				bool request_needs_response, int write_timeout_msec, int response_timeout_msec);
+		/// Pass this as a response timeout to use the adaptive timeout (see setAdaptiveTimeoutsEnabled()).
+		static constexpr int adaptive_response_timeout = -1;
 
+		/// Response timeout used if the adaptive timeouts are disabled
+		static constexpr int default_response_timeout_msec = 1500;
 
-	public:
 
 		/// Send request to serial port.
 		/// The returned value is request ID which can be used to identify which
 		/// response comes from which request.
-		quint64 ccRequest(CcHeader command, const QByteArray& data, int response_timeout_msec = 1500);
+		/// An explicit \c response_timeout_msec overrides the adaptive timeout.
+		quint64 ccRequest(CcHeader command, const QByteArray& data, int response_timeout_msec = adaptive_response_timeout);
+
+#ifdef QTCC_COROUTINES
+		/// Coroutine version of ccRequest() and executeOnReturn(). The request is sent
+		/// when the result is co_awaited, and the coroutine is resumed with a CcReply when the
+		/// request finishes (successfully or with an error). Include cctalk_coroutine.h to use it.
+		[[nodiscard]] CcRequestAwaitable ccRequestAwait(CcHeader command, QByteArray data = QByteArray(),
+				int response_timeout_msec = adaptive_response_timeout);
+#endif
 
 		/// A helper function for writing response handlers.
-		void executeOnReturn(quint64 sent_request_id,
-				const std::function<void(quint64 request_id, const QString& error_msg, const QByteArray& command_data)>& callback) const;
+		/// The callback is called exactly once, when the request finishes (successfully
+		/// or with an error, including port errors and port closing).
+		/// A request has at most one callback; registering another one is an error, it is
+		/// logged and the new callback is ignored.
+		void executeOnReturn(quint64 sent_request_id, const ResponseFunc& callback);
+
+		/// Same as executeOnReturn(), but the callback receives a view into the reply frame
+		/// instead of a copy of the data. Use this for frequently sent requests (e.g. polling).
+		void executeOnReturnView(quint64 sent_request_id, const ResponseViewFunc& callback);
+
+		/// Remove the callback registered with executeOnReturn() or executeOnReturnView(),
+		/// e.g. because the object it refers to is being destroyed. The request itself is
+		/// not affected. Does nothing if the request is already finished.
+		void cancelOnReturn(quint64 sent_request_id);
+
+		/// Get the number of requests waiting for their replies.
+		[[nodiscard]] int getPendingRequestCount() const;
+
+		/// Get the link statistics (per-command request counts, latency histograms, timeouts,
+		/// retries and reply errors). The object may be kept and read (or reset) from any thread.
+		[[nodiscard]] std::shared_ptr<CcLinkStatistics> getStatistics() const;
+
+		/// Get the response time estimator, e.g. to set the timeout limits or to read the
+		/// current estimates. The object may be kept and used from any thread.
+		[[nodiscard]] std::shared_ptr<CcRttEstimator> getRttEstimator() const;
 
 
 	protected slots:
 
 		/// Handle generic serial response and emit ccResponse
-		void onResponseReceive(quint64 request_id, const QByteArray& response_data);
+		void onResponseReceive(quint64 request_id, const qtcc::CcFrame& response_frame);
+
+
+	protected:
+
+		// These are called by CctalkBus.
+		friend class CctalkBus;
+
+		/// Handle port open event of the bus
+		void onBusPortOpen();
+
+		/// Handle port error of the bus
+		void onBusPortError(const QString& error_msg);
+
+		/// Handle line speed change of the bus
+		void onBusBaudRateChange();
+
+		/// Handle request write timeout of a request sent by us
+		void onRequestTimeout(quint64 request_id);
+
+		/// Handle response timeout of a request sent by us
+		void onResponseTimeout(quint64 request_id);
+
+		/// Handle port-level log message of the bus
+		void onBusLogMessage(const QString& msg);
+
+
+		/// Remove the request from the pending request table and call its callback.
+		void finishRequest(quint64 request_id, const QString& error_msg, CcByteView command_data);
+
+		/// Finish all pending requests with an error.
+		void failPendingRequests(const QString& error_msg);
+
+		/// Fail the pending requests whose deadline has passed. This is a safety net in case
+		/// the worker doesn't report back (it always should).
+		void expirePendingRequests();
 
 
 	private:
 
-		QScopedPointer<SerialWorker> serial_worker_;  ///< Serial port worker, lives in worker_thread_.
-		QThread worker_thread_;  ///< The thread that SerialWorker lives in
+		/// Outstanding request, waiting for its reply.
+		struct PendingRequest {
+			CcHeader command = CcHeader::Reply;  ///< Request command
+			QDeadlineTimer deadline;  ///< The request is failed if not finished by this time
+			ResponseViewFunc callback;  ///< executeOnReturn() / executeOnReturnView() callback
+			QByteArray request_key;  ///< Coalescing / cache key if the request is idempotent, empty otherwise
+			quint64 cache_generation = 0;  ///< cache_generation_ when the request was sent
+			QVector<quint64> coalesced_requests;  ///< Requests finished together with this one
+		};
+
+		/// Reply kept in the reply cache
+		struct CachedReply {
+			QByteArray data;  ///< Reply data
+			QDeadlineTimer expiry;  ///< The reply is not used after this time
+		};
+
+
+		/// Get the coalescing / cache key of a request
+		[[nodiscard]] QByteArray getRequestKey(CcHeader command, const QByteArray& data) const;
+
+		/// Add a pending request that is not sent to the bus, but finished by us
+		quint64 addLocalRequest(CcHeader command, QDeadlineTimer deadline);
+
+
+		std::shared_ptr<CctalkBus> bus_;  ///< Serial line (worker and its thread), possibly shared with other controllers.
 
 		QString port_device_;  ///< Serial port device, e.g. /dev/ttyUSB0
 		quint8 device_addr_ = 0x00;  ///< ccTalk destination address, used to differentiate different devices on the same serial bus. 0 for all.
 		quint8 controller_addr_ = 0x01;  ///< Controller address. 1 means "Master". There is no reason to change this.
-		bool checksum_16bit_ = false;  /// If true, use 16-bit CRC checksum. Otherwise use simple 8-bit checksum. The device must be set to the same value.
+		bool checksum_16bit_ = false;  ///< If true, use 16-bit CRC checksum. Otherwise use simple 8-bit checksum. The device must be set to the same value.
 		bool des_encrypted_ = false;  ///< If true, use DES encryption. The device must be set to the same value. NOTE: Unsupported.
 
-		quint64 req_num_ = 0;  ///< Request number. This is used to identify which response came from which request.
+		/// Frame builder for the selected checksum policy
+		CcFrame (*build_frame_)(quint8 destination_addr, quint8 source_addr, quint8 header, CcByteView data) = &ccBuildFrame<CcChecksum8>;
+
+		/// Frame checksum validator for the selected checksum policy
+		bool (*verify_frame_)(const CcFrame& frame) = &ccVerifyFrame<CcChecksum8>;
 
 		bool show_cctalk_request_ = true;
 		bool show_cctalk_response_ = true;
+		std::shared_ptr<CcLogPipeline> log_pipeline_;  ///< Structured log pipeline. May be null.
+		CcRetryPolicy retry_policy_;  ///< Retransmission policy
+		bool adaptive_timeouts_ = true;  ///< If true, use rtt_estimator_ for the response timeouts
+		std::shared_ptr<CcRttEstimator> rtt_estimator_ = std::make_shared<CcRttEstimator>();  ///< Fed by the serial worker
+
+		bool coalescing_enabled_ = false;  ///< If true, identical idempotent requests in flight are joined
+		QHash<QByteArray, quint64> coalescing_requests_;  ///< Request key -> ID of the request in flight that identical requests join
+		std::array<int, 256> reply_cache_ttls_ = {};  ///< Header -> reply cache lifetime (msec), 0 if not cached
+		QHash<QByteArray, CachedReply> reply_cache_;  ///< Request key -> cached reply
+		quint64 cache_generation_ = 0;  ///< Incremented by each state-changing request. Older replies are not cached.
+
+		std::shared_ptr<CcLinkStatistics> statistics_ = std::make_shared<CcLinkStatistics>();  ///< Link statistics, recorded by the serial worker and us
+
+		QHash<quint64, PendingRequest> pending_requests_;  ///< Request ID -> pending request
+		QTimer pending_expiry_timer_;  ///< Runs expirePendingRequests() while there are pending requests
+		const int pending_request_grace_msec_ = 10000;  ///< Time allowed for a request to wait in the bus queue, on top of its own timeouts
 
 };
 
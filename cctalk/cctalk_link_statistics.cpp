@@ -0,0 +1,362 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <QtAlgorithms>
+#include <algorithm>
+#include <cmath>
+
+#include "cctalk_link_statistics.h"
+
+
+namespace qtcc {
+
+
+namespace {
+
+	/// Bucket 0 holds everything below this (8us)
+	constexpr int first_octave = 3;
+
+	/// Buckets per power of two
+	constexpr int sub_bucket_bits = 2;
+	constexpr int sub_bucket_count = 1 << sub_bucket_bits;
+
+}
+
+
+
+quint64 CcLatencySnapshot::getPercentileUsec(double percentile) const
+{
+	if (count == 0) {
+		return 0;
+	}
+	const auto rank = quint64(std::ceil(double(count) * std::clamp(percentile, 0.0, 100.0) / 100.0));
+	quint64 seen = 0;
+	for (int i = 0; i < cc_latency_bucket_count; ++i) {
+		seen += buckets.at(std::size_t(i));
+		if (seen >= std::max<quint64>(rank, 1)) {
+			return std::min(CcLatencyHistogram::getBucketUpperBound(i), max_usec);
+		}
+	}
+	return max_usec;
+}
+
+
+
+quint64 CcLatencySnapshot::getMeanUsec() const
+{
+	return count == 0 ? 0 : (total_usec / count);
+}
+
+
+
+void CcLatencySnapshot::merge(const CcLatencySnapshot& other)
+{
+	for (std::size_t i = 0; i < buckets.size(); ++i) {
+		buckets[i] += other.buckets[i];
+	}
+	count += other.count;
+	total_usec += other.total_usec;
+	max_usec = std::max(max_usec, other.max_usec);
+}
+
+
+
+void CcCommandStatistics::merge(const CcCommandStatistics& other)
+{
+	request_count += other.request_count;
+	retry_count += other.retry_count;
+	coalesced_count += other.coalesced_count;
+	cache_hit_count += other.cache_hit_count;
+	write_timeout_count += other.write_timeout_count;
+	response_timeout_count += other.response_timeout_count;
+	structure_error_count += other.structure_error_count;
+	write_time.merge(other.write_time);
+	first_byte_time.merge(other.first_byte_time);
+	round_trip_time.merge(other.round_trip_time);
+}
+
+
+
+void CcEventBufferStatistics::merge(const CcEventBufferStatistics& other)
+{
+	for (std::size_t i = 0; i < new_event_histogram.size(); ++i) {
+		new_event_histogram[i] += other.new_event_histogram[i];
+	}
+	overflow_count += other.overflow_count;
+	lost_event_count += other.lost_event_count;
+}
+
+
+
+CcCommandStatistics CcLinkStatisticsSnapshot::getTotal() const
+{
+	CcCommandStatistics total;
+	for (const auto& command_statistics : commands) {
+		total.merge(command_statistics);
+	}
+	return total;
+}
+
+
+
+void CcLinkStatisticsSnapshot::merge(const CcLinkStatisticsSnapshot& other)
+{
+	for (auto iter = other.commands.constBegin(); iter != other.commands.constEnd(); ++iter) {
+		commands[iter.key()].merge(iter.value());
+	}
+	event_buffer.merge(other.event_buffer);
+}
+
+
+
+void CcLatencyHistogram::record(quint64 usec)
+{
+	buckets_.at(std::size_t(getBucketIndex(usec))).fetch_add(1, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+	total_usec_.fetch_add(usec, std::memory_order_relaxed);
+
+	quint64 max_usec = max_usec_.load(std::memory_order_relaxed);
+	while (usec > max_usec && !max_usec_.compare_exchange_weak(max_usec, usec, std::memory_order_relaxed)) {
+		// max_usec is reloaded by compare_exchange_weak()
+	}
+}
+
+
+
+CcLatencySnapshot CcLatencyHistogram::getSnapshot() const
+{
+	CcLatencySnapshot snapshot;
+	for (std::size_t i = 0; i < buckets_.size(); ++i) {
+		snapshot.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+	}
+	snapshot.count = count_.load(std::memory_order_relaxed);
+	snapshot.total_usec = total_usec_.load(std::memory_order_relaxed);
+	snapshot.max_usec = max_usec_.load(std::memory_order_relaxed);
+	return snapshot;
+}
+
+
+
+void CcLatencyHistogram::reset()
+{
+	for (auto& bucket : buckets_) {
+		bucket.store(0, std::memory_order_relaxed);
+	}
+	count_.store(0, std::memory_order_relaxed);
+	total_usec_.store(0, std::memory_order_relaxed);
+	max_usec_.store(0, std::memory_order_relaxed);
+}
+
+
+
+int CcLatencyHistogram::getBucketIndex(quint64 usec)
+{
+	if (usec < (quint64(1) << first_octave)) {
+		return 0;
+	}
+	const int octave = 63 - int(qCountLeadingZeroBits(usec));
+	const int sub_bucket = int(usec >> (octave - sub_bucket_bits)) & (sub_bucket_count - 1);
+	const int index = (octave - first_octave) * sub_bucket_count + sub_bucket + 1;
+	return std::min(index, cc_latency_bucket_count - 1);
+}
+
+
+
+quint64 CcLatencyHistogram::getBucketUpperBound(int index)
+{
+	if (index <= 0) {
+		return quint64(1) << first_octave;
+	}
+	const int octave = (index - 1) / sub_bucket_count + first_octave;
+	const int sub_bucket = (index - 1) % sub_bucket_count;
+	return quint64(sub_bucket_count + sub_bucket + 1) << (octave - sub_bucket_bits);
+}
+
+
+
+CcLinkStatistics::CcLinkStatistics()
+{
+	for (auto& command : commands_) {
+		command.store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+
+
+CcLinkStatistics::~CcLinkStatistics()
+{
+	for (auto& command : commands_) {
+		delete command.load(std::memory_order_relaxed);
+	}
+}
+
+
+
+void CcLinkStatistics::recordRequest(CcHeader command)
+{
+	getCounters(command).request_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+
+void CcLinkStatistics::recordWriteTime(CcHeader command, quint64 usec)
+{
+	getCounters(command).write_time.record(usec);
+}
+
+
+
+void CcLinkStatistics::recordFirstByteTime(CcHeader command, quint64 usec)
+{
+	getCounters(command).first_byte_time.record(usec);
+}
+
+
+
+void CcLinkStatistics::recordRoundTripTime(CcHeader command, quint64 usec)
+{
+	getCounters(command).round_trip_time.record(usec);
+}
+
+
+
+void CcLinkStatistics::recordRetry(CcHeader command)
+{
+	getCounters(command).retry_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+
+void CcLinkStatistics::recordCoalesced(CcHeader command)
+{
+	getCounters(command).coalesced_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+
+void CcLinkStatistics::recordCacheHit(CcHeader command)
+{
+	getCounters(command).cache_hit_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+
+void CcLinkStatistics::recordWriteTimeout(CcHeader command)
+{
+	getCounters(command).write_timeout_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+
+void CcLinkStatistics::recordResponseTimeout(CcHeader command)
+{
+	getCounters(command).response_timeout_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+
+void CcLinkStatistics::recordStructureError(CcHeader command)
+{
+	getCounters(command).structure_error_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+
+void CcLinkStatistics::recordEventPoll(int new_events)
+{
+	const int index = std::clamp(new_events, 0, cc_event_buffer_size + 1);
+	new_event_histogram_.at(std::size_t(index)).fetch_add(1, std::memory_order_relaxed);
+}
+
+
+
+void CcLinkStatistics::recordEventBufferOverflow(int lost_events)
+{
+	overflow_count_.fetch_add(1, std::memory_order_relaxed);
+	lost_event_count_.fetch_add(quint64(std::max(lost_events, 0)), std::memory_order_relaxed);
+}
+
+
+
+CcLinkStatisticsSnapshot CcLinkStatistics::getSnapshot() const
+{
+	CcLinkStatisticsSnapshot snapshot;
+	for (int header = 0; header < command_count; ++header) {
+		const CommandCounters* counters = commands_.at(std::size_t(header)).load(std::memory_order_acquire);
+		if (!counters) {
+			continue;
+		}
+		CcCommandStatistics& command_statistics = snapshot.commands[CcHeader(header)];
+		command_statistics.request_count = counters->request_count.load(std::memory_order_relaxed);
+		command_statistics.retry_count = counters->retry_count.load(std::memory_order_relaxed);
+		command_statistics.coalesced_count = counters->coalesced_count.load(std::memory_order_relaxed);
+		command_statistics.cache_hit_count = counters->cache_hit_count.load(std::memory_order_relaxed);
+		command_statistics.write_timeout_count = counters->write_timeout_count.load(std::memory_order_relaxed);
+		command_statistics.response_timeout_count = counters->response_timeout_count.load(std::memory_order_relaxed);
+		command_statistics.structure_error_count = counters->structure_error_count.load(std::memory_order_relaxed);
+		command_statistics.write_time = counters->write_time.getSnapshot();
+		command_statistics.first_byte_time = counters->first_byte_time.getSnapshot();
+		command_statistics.round_trip_time = counters->round_trip_time.getSnapshot();
+	}
+
+	for (std::size_t i = 0; i < new_event_histogram_.size(); ++i) {
+		snapshot.event_buffer.new_event_histogram[i] = new_event_histogram_[i].load(std::memory_order_relaxed);
+	}
+	snapshot.event_buffer.overflow_count = overflow_count_.load(std::memory_order_relaxed);
+	snapshot.event_buffer.lost_event_count = lost_event_count_.load(std::memory_order_relaxed);
+	return snapshot;
+}
+
+
+
+void CcLinkStatistics::reset()
+{
+	// The counters are kept allocated, the recording threads may be using them.
+	for (auto& command : commands_) {
+		CommandCounters* counters = command.load(std::memory_order_acquire);
+		if (!counters) {
+			continue;
+		}
+		counters->request_count.store(0, std::memory_order_relaxed);
+		counters->retry_count.store(0, std::memory_order_relaxed);
+		counters->coalesced_count.store(0, std::memory_order_relaxed);
+		counters->cache_hit_count.store(0, std::memory_order_relaxed);
+		counters->write_timeout_count.store(0, std::memory_order_relaxed);
+		counters->response_timeout_count.store(0, std::memory_order_relaxed);
+		counters->structure_error_count.store(0, std::memory_order_relaxed);
+		counters->write_time.reset();
+		counters->first_byte_time.reset();
+		counters->round_trip_time.reset();
+	}
+
+	for (auto& count : new_event_histogram_) {
+		count.store(0, std::memory_order_relaxed);
+	}
+	overflow_count_.store(0, std::memory_order_relaxed);
+	lost_event_count_.store(0, std::memory_order_relaxed);
+}
+
+
+
+CcLinkStatistics::CommandCounters& CcLinkStatistics::getCounters(CcHeader command)
+{
+	std::atomic<CommandCounters*>& slot = commands_.at(std::size_t(command));
+	CommandCounters* counters = slot.load(std::memory_order_acquire);
+	if (counters) {
+		return *counters;
+	}
+
+	// First use of this command. If another thread wins the race, use its counters.
+	auto* new_counters = new CommandCounters();
+	if (slot.compare_exchange_strong(counters, new_counters, std::memory_order_acq_rel, std::memory_order_acquire)) {
+		return *new_counters;
+	}
+	delete new_counters;
+	return *counters;
+}
+
+
+
+}
@@ -0,0 +1,244 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_LINK_STATISTICS_H
+#define CCTALK_LINK_STATISTICS_H
+
+#include <QtGlobal>
+#include <QMap>
+#include <array>
+#include <atomic>
+
+#include "cctalk_enums.h"
+
+
+namespace qtcc {
+
+
+/**
+\file
+
+Link statistics: per-command request counters and latency histograms.
+
+The statistics are recorded by SerialWorker (write time, time to the first reply byte,
+full round trip, timeouts, retransmissions), CctalkLinkController
+(message structure and checksum errors, coalesced and cached requests)
+and CctalkDevice (event buffer usage), and can be read from any thread as a snapshot.
+Recording only performs relaxed atomic increments on fixed-size histograms, so it's cheap
+enough to stay enabled in production.
+
+Latency histograms have 4 buckets per power of two (a bucket is at most 25% wide),
+covering 8us to 8s. Percentiles are reported as the upper bound of the bucket they fall in.
+*/
+
+
+
+/// Number of latency histogram buckets
+constexpr int cc_latency_bucket_count = 81;
+
+
+
+/// Read-only copy of a latency histogram
+struct CcLatencySnapshot {
+	std::array<quint64, cc_latency_bucket_count> buckets = {};  ///< Number of samples in each bucket
+	quint64 count = 0;  ///< Number of samples
+	quint64 total_usec = 0;  ///< Sum of all samples
+	quint64 max_usec = 0;  ///< Largest sample
+
+	/// Get the latency below which \c percentile (0 - 100) percent of the samples fall.
+	/// Returns 0 if there are no samples.
+	[[nodiscard]] quint64 getPercentileUsec(double percentile) const;
+
+	/// Get the average latency. Returns 0 if there are no samples.
+	[[nodiscard]] quint64 getMeanUsec() const;
+
+	/// Add the samples of another snapshot to this one
+	void merge(const CcLatencySnapshot& other);
+};
+
+
+
+/// Statistics of a single ccTalk command (request header)
+struct CcCommandStatistics {
+	quint64 request_count = 0;  ///< Number of requests sent to the port, not counting the retries
+	quint64 retry_count = 0;  ///< Number of retransmissions after corrupted or missing replies (see CcRetryPolicy)
+	quint64 coalesced_count = 0;  ///< Number of requests attached to an identical request in flight, not sent to the port
+	quint64 cache_hit_count = 0;  ///< Number of requests answered from the reply cache, not sent to the port
+	quint64 write_timeout_count = 0;  ///< Number of request write timeouts
+	quint64 response_timeout_count = 0;  ///< Number of response timeouts
+	quint64 structure_error_count = 0;  ///< Number of malformed replies (size, checksum, address errors)
+
+	CcLatencySnapshot write_time;  ///< Time to write the request
+	CcLatencySnapshot first_byte_time;  ///< Time from the start of writing to the first reply byte (after the echo)
+	CcLatencySnapshot round_trip_time;  ///< Time from the start of writing to the complete reply
+
+	/// Add the statistics of another command (e.g. to get the link totals)
+	void merge(const CcCommandStatistics& other);
+};
+
+
+
+/// Device event buffer usage, as seen by event polling
+struct CcEventBufferStatistics {
+	/// Number of polls by the number of new events they found (0 to cc_event_buffer_size).
+	/// The last element counts the polls that found more new events than the buffer holds.
+	std::array<quint64, cc_event_buffer_size + 2> new_event_histogram = {};
+
+	quint64 overflow_count = 0;  ///< Number of buffer overflows (credits possibly lost)
+	quint64 lost_event_count = 0;  ///< Total number of events lost in overflows
+
+	/// Add the statistics of another device
+	void merge(const CcEventBufferStatistics& other);
+};
+
+
+
+/// Snapshot of the link statistics
+struct CcLinkStatisticsSnapshot {
+	QMap<CcHeader, CcCommandStatistics> commands;  ///< Per-command statistics, for the commands that were sent at least once
+	CcEventBufferStatistics event_buffer;  ///< Event buffer usage
+
+	/// Get the statistics of all the commands combined
+	[[nodiscard]] CcCommandStatistics getTotal() const;
+
+	/// Add the statistics of another link (e.g. to get the statistics of all the devices)
+	void merge(const CcLinkStatisticsSnapshot& other);
+};
+
+
+
+/// Fixed-bucket latency histogram. Recording and reading are lock-free.
+class CcLatencyHistogram {
+	public:
+
+		/// Add a sample
+		void record(quint64 usec);
+
+		/// Get a copy of the histogram
+		[[nodiscard]] CcLatencySnapshot getSnapshot() const;
+
+		/// Remove all samples
+		void reset();
+
+
+		/// Get the bucket index of a latency value
+		[[nodiscard]] static int getBucketIndex(quint64 usec);
+
+		/// Get the (exclusive) upper bound of a bucket
+		[[nodiscard]] static quint64 getBucketUpperBound(int index);
+
+
+	private:
+
+		std::array<std::atomic<quint64>, cc_latency_bucket_count> buckets_ = {};  ///< Number of samples in each bucket
+		std::atomic<quint64> count_ = {0};  ///< Number of samples
+		std::atomic<quint64> total_usec_ = {0};  ///< Sum of all samples
+		std::atomic<quint64> max_usec_ = {0};  ///< Largest sample
+
+};
+
+
+
+/// Per-command link statistics. All functions may be called from any thread.
+/// Snapshots are not atomic as a whole (a request being recorded concurrently may
+/// be partially visible), which is fine for monitoring.
+class CcLinkStatistics {
+	public:
+
+		/// Constructor
+		CcLinkStatistics();
+
+		/// Destructor
+		~CcLinkStatistics();
+
+		/// Non-copyable
+		CcLinkStatistics(const CcLinkStatistics& other) = delete;
+
+		/// Non-copyable
+		CcLinkStatistics& operator=(const CcLinkStatistics& other) = delete;
+
+
+		/// Record a request being sent
+		void recordRequest(CcHeader command);
+
+		/// Record the time taken to write a request
+		void recordWriteTime(CcHeader command, quint64 usec);
+
+		/// Record the time to the first reply byte
+		void recordFirstByteTime(CcHeader command, quint64 usec);
+
+		/// Record the full round-trip time
+		void recordRoundTripTime(CcHeader command, quint64 usec);
+
+		/// Record a retransmission of a request
+		void recordRetry(CcHeader command);
+
+		/// Record a request attached to an identical request in flight
+		void recordCoalesced(CcHeader command);
+
+		/// Record a request answered from the reply cache
+		void recordCacheHit(CcHeader command);
+
+		/// Record a request write timeout
+		void recordWriteTimeout(CcHeader command);
+
+		/// Record a response timeout
+		void recordResponseTimeout(CcHeader command);
+
+		/// Record a malformed reply
+		void recordStructureError(CcHeader command);
+
+		/// Record an event poll that found \c new_events new events
+		void recordEventPoll(int new_events);
+
+		/// Record an event buffer overflow, with \c lost_events events lost
+		void recordEventBufferOverflow(int lost_events);
+
+
+		/// Get a copy of the statistics
+		[[nodiscard]] CcLinkStatisticsSnapshot getSnapshot() const;
+
+		/// Reset all the counters and histograms
+		void reset();
+
+
+	private:
+
+		/// Statistics of a single command
+		struct CommandCounters {
+			std::atomic<quint64> request_count = {0};
+			std::atomic<quint64> retry_count = {0};
+			std::atomic<quint64> coalesced_count = {0};
+			std::atomic<quint64> cache_hit_count = {0};
+			std::atomic<quint64> write_timeout_count = {0};
+			std::atomic<quint64> response_timeout_count = {0};
+			std::atomic<quint64> structure_error_count = {0};
+			CcLatencyHistogram write_time;
+			CcLatencyHistogram first_byte_time;
+			CcLatencyHistogram round_trip_time;
+		};
+
+
+		/// Get the counters of a command, allocating them on first use (lock-free).
+		CommandCounters& getCounters(CcHeader command);
+
+
+		/// Number of possible header values
+		static constexpr int command_count = 256;
+
+		std::array<std::atomic<CommandCounters*>, command_count> commands_;  ///< Header -> counters, allocated on first use
+
+		std::array<std::atomic<quint64>, cc_event_buffer_size + 2> new_event_histogram_ = {};  ///< See CcEventBufferStatistics
+		std::atomic<quint64> overflow_count_ = {0};  ///< Number of event buffer overflows
+		std::atomic<quint64> lost_event_count_ = {0};  ///< Number of events lost in overflows
+
+};
+
+
+
+}
+
+
+#endif
@@ -0,0 +1,142 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <QDateTime>
+#include <QObject>
+#include <QStringList>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "cctalk_log.h"
+#include "helpers/debug.h"
+
+
+namespace qtcc {
+
+
+
+void CcLogRecord::setPayload(CcByteView data)
+{
+	data_size = quint8(std::clamp(data.size(), 0, 255));
+	if (data_size > 0) {
+		std::memcpy(payload.data(), data.data(), std::size_t(std::min(int(data_size), cc_log_payload_capacity)));
+	}
+}
+
+
+
+bool CcLogRecord::isTruncated() const
+{
+	return data_size > cc_log_payload_capacity;
+}
+
+
+
+CcLogPipeline::CcLogPipeline(int capacity)
+		: ring_(std::size_t(std::max(capacity, 2)), true)
+{ }
+
+
+
+void CcLogPipeline::setFilter(CcLogLevel min_level, quint32 category_mask)
+{
+	filter_.store((quint32(min_level) << 24) | (category_mask & 0x00ffffff), std::memory_order_relaxed);
+}
+
+
+
+void CcLogPipeline::setDataAvailableCallback(DataAvailableFunc callback)
+{
+	ring_.setDataAvailableCallback(std::move(callback));
+}
+
+
+
+bool CcLogPipeline::push(CcLogRecord record)
+{
+	if (record.timestamp_msec == 0) {
+		record.timestamp_msec = QDateTime::currentMSecsSinceEpoch();
+	}
+
+	return ring_.push(record);
+}
+
+
+
+int CcLogPipeline::drain(CcLogRecord* records, int max_count)
+{
+	return ring_.drain(records, max_count);
+}
+
+
+
+QVector<CcLogRecord> CcLogPipeline::drain(int max_count)
+{
+	QVector<CcLogRecord> records;
+	ring_.drainInto(records, max_count);
+	return records;
+}
+
+
+
+quint64 CcLogPipeline::getDroppedCount() const
+{
+	return ring_.getDroppedCount();
+}
+
+
+
+int CcLogPipeline::getCapacity() const
+{
+	return int(ring_.getCapacity());
+}
+
+
+
+QString CcLogPipeline::formatRecord(const CcLogRecord& record)
+{
+	const int stored_size = std::min(int(record.data_size), cc_log_payload_capacity);
+	const QByteArray payload = QByteArray::fromRawData(record.payload.data(), stored_size);
+
+	QString formatted_data = payload.isEmpty() ? QObject::tr("(empty)") : QString::fromLatin1(payload.toHex());
+	if (record.isTruncated()) {
+		formatted_data += QObject::tr("... (%1 bytes)").arg(int(record.data_size));
+	}
+
+	switch (record.event) {
+		case CcLogEvent::CcRequest:
+			return QObject::tr("> ccTalk request: %1, address: %2, data: %3")
+					.arg(ccHeaderGetDisplayableName(CcHeader(record.header)))
+					.arg(int(record.address)).arg(formatted_data);
+
+		case CcLogEvent::CcResponse:
+			// Don't print request_id, it interferes with identical message hiding.
+			return QObject::tr("< ccTalk response from address %1, data: %2")
+					.arg(int(record.address)).arg(formatted_data);
+
+		case CcLogEvent::EventTable:
+		{
+			const QString coin_bill = (record.device_category == CcCategory::CoinAcceptor ? QObject::tr("Coin") : QObject::tr("Bill"));
+			QStringList strs;
+			strs << QObject::tr("* %1 buffered credit / event table (newest to oldest):").arg(coin_bill);
+			strs << QObject::tr("*** Host-side last processed event number: %1").arg(int(record.host_event_number));
+			if (!payload.isEmpty()) {
+				strs << QObject::tr("*** Device-side event counter: %1").arg(int(quint8(payload.at(0))));
+			}
+			for (int i = 1; (i+1) < payload.size(); i += 2) {
+				strs << QObject::tr("*** Credit: %1, error / sorter: %2").arg(int(payload.at(i))).arg(int(payload.at(i+1)));
+			}
+			return strs.join(QStringLiteral("\n"));
+		}
+	}
+
+	DBG_ASSERT(0);
+	return QString();
+}
+
+
+
+}
@@ -0,0 +1,169 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_LOG_H
+#define CCTALK_LOG_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QVector>
+#include <array>
+#include <atomic>
+#include <type_traits>
+
+#include "cctalk_enums.h"
+#include "cctalk_frame.h"
+#include "helpers/lockfree_ring.h"
+
+
+namespace qtcc {
+
+
+/**
+\file
+
+Structured log pipeline for the frequent (per-request) messages.
+
+Instead of formatting a QString for every request, response and event table and sending
+it through the logMessage() signals, the link controller and the device push compact
+records (event kind plus raw fields) into a bounded lock-free ring. The level and category
+filter is checked before anything is built, so disabled messages cost a single relaxed load.
+Sinks drain the records in batches from their own thread, and only the sinks that need
+text call formatRecord().
+
+Infrequent messages (errors, initialization reports) still go through logMessage().
+*/
+
+
+
+/// Log record severity
+enum class CcLogLevel : quint8 {
+	Debug,
+	Info,
+	Warning,
+	Error,
+};
+
+
+/// Log record category (a bit mask for filtering)
+enum class CcLogCategory : quint32 {
+	Request = 1 << 0,  ///< ccTalk requests
+	Response = 1 << 1,  ///< ccTalk responses
+	EventTable = 1 << 2,  ///< Buffered credit / bill event tables
+	All = 0xffffffff,
+};
+
+
+/// Log record kind
+enum class CcLogEvent : quint8 {
+	CcRequest,  ///< A ccTalk request was sent. \c header, \c address and \c payload are set.
+	CcResponse,  ///< A ccTalk reply was received. \c address (source) and \c payload are set.
+	EventTable,  ///< A device event table changed. \c payload holds the event counter and the result pairs.
+};
+
+
+/// Number of payload bytes kept in a record. Longer payloads are truncated (see CcLogRecord::data_size).
+constexpr int cc_log_payload_capacity = 32;
+
+
+
+/// Structured log record
+struct CcLogRecord {
+	qint64 timestamp_msec = 0;  ///< UTC milliseconds since epoch
+	quint64 request_id = 0;  ///< Request ID, 0 if not applicable
+	CcLogEvent event = CcLogEvent::CcRequest;  ///< Record kind
+	CcLogLevel level = CcLogLevel::Debug;  ///< Severity
+	CcLogCategory category = CcLogCategory::Request;  ///< Category
+	CcCategory device_category = CcCategory::Unknown;  ///< Device category, if known
+	quint8 header = 0;  ///< ccTalk header (command)
+	quint8 address = 0;  ///< ccTalk device address
+	quint8 host_event_number = 0;  ///< EventTable: host-side last processed event number
+	quint8 data_size = 0;  ///< Full payload size (up to 255)
+	std::array<char, cc_log_payload_capacity> payload = {};  ///< Payload bytes, the first min(data_size, cc_log_payload_capacity)
+
+	/// Set the payload fields from a byte view
+	void setPayload(CcByteView data);
+
+	/// Check if the payload was truncated
+	[[nodiscard]] bool isTruncated() const;
+};
+
+static_assert(std::is_trivially_copyable_v<CcLogRecord>, "CcLogRecord must be trivially copyable");
+
+
+
+/// Lock-free bounded log record pipeline. Any number of producers (devices in any
+/// thread), a single consumer (sink).
+class CcLogPipeline {
+	public:
+
+		/// Called by a producer when the pipeline becomes non-empty, see NotifyingRing
+		using DataAvailableFunc = NotifyingRing<CcLogRecord>::DataAvailableFunc;
+
+
+		/// Constructor. The capacity is rounded up to a power of two.
+		explicit CcLogPipeline(int capacity = 4096);
+
+		/// Non-copyable
+		CcLogPipeline(const CcLogPipeline& other) = delete;
+
+		/// Non-copyable
+		CcLogPipeline& operator=(const CcLogPipeline& other) = delete;
+
+
+		/// Set the filter: records below \c min_level or outside \c category_mask
+		/// (a combination of CcLogCategory flags) are not recorded. May be called from any thread.
+		void setFilter(CcLogLevel min_level, quint32 category_mask = quint32(CcLogCategory::All));
+
+		/// Check if a record would pass the filter. Call this before building the record.
+		[[nodiscard]] bool isEnabled(CcLogLevel level, CcLogCategory category) const
+		{
+			const quint32 filter = filter_.load(std::memory_order_relaxed);
+			return int(level) >= int(filter >> 24) && (filter & quint32(category) & 0x00ffffff) != 0;
+		}
+
+		/// Set the data-available callback. Set it before the producers start.
+		void setDataAvailableCallback(DataAvailableFunc callback);
+
+
+		/// Producer function. The timestamp is set if it's 0.
+		/// \return false if the pipeline was full and the record was dropped.
+		bool push(CcLogRecord record);
+
+
+		/// Consumer function. Move up to \c max_count records into \c records.
+		/// \return the number of records drained.
+		int drain(CcLogRecord* records, int max_count);
+
+		/// Consumer function. Drain up to \c max_count records (all of them if \c max_count is 0).
+		[[nodiscard]] QVector<CcLogRecord> drain(int max_count = 0);
+
+
+		/// Get the number of records dropped due to a full pipeline
+		[[nodiscard]] quint64 getDroppedCount() const;
+
+		/// Get the pipeline capacity
+		[[nodiscard]] int getCapacity() const;
+
+
+		/// Render a record as text, in the same format as the corresponding logMessage() messages
+		[[nodiscard]] static QString formatRecord(const CcLogRecord& record);
+
+
+	private:
+
+		NotifyingRing<CcLogRecord> ring_;  ///< Records
+
+		/// Minimum level (top 8 bits) and category mask (lower 24 bits)
+		std::atomic<quint32> filter_ = {quint32(CcLogCategory::All) & 0x00ffffff};
+
+};
+
+
+
+}
+
+
+#endif
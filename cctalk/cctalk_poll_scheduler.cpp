@@ -0,0 +1,129 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <algorithm>
+
+#include "cctalk_poll_scheduler.h"
+
+
+namespace qtcc {
+
+
+
+void CcPollScheduler::setIdleInterval(int msec)
+{
+	idle_interval_msec_ = std::max(msec, 0);
+	if (!bursting_) {
+		current_delay_msec_ = std::min(current_delay_msec_, idle_interval_msec_);
+	}
+}
+
+
+
+int CcPollScheduler::getIdleInterval() const
+{
+	return idle_interval_msec_;
+}
+
+
+
+void CcPollScheduler::reportBufferPressure(int unread_events, int buffer_size)
+{
+	if (buffer_size <= 0 || unread_events * 2 <= buffer_size) {
+		return;
+	}
+	// The events arrived within about one idle interval.
+	const int interval_msec = std::max(idle_interval_msec_ * buffer_size / (2 * unread_events), backoff_start_msec);
+	if (pressure_interval_msec_ == 0 || interval_msec < getEffectiveIdleInterval()) {
+		pressure_interval_msec_ = interval_msec;
+	}
+	pressure_timer_.start();
+}
+
+
+
+int CcPollScheduler::getEffectiveIdleInterval() const
+{
+	if (pressure_interval_msec_ > 0 && pressure_timer_.isValid() && !pressure_timer_.hasExpired(pressure_hold_msec)) {
+		return std::min(pressure_interval_msec_, idle_interval_msec_);
+	}
+	return idle_interval_msec_;
+}
+
+
+
+void CcPollScheduler::reset()
+{
+	bursting_ = false;
+	current_delay_msec_ = idle_interval_msec_;
+	iteration_timer_.invalidate();
+}
+
+
+
+void CcPollScheduler::iterationStarted()
+{
+	iteration_timer_.start();
+}
+
+
+
+int CcPollScheduler::iterationFinished(bool activity_detected)
+{
+	last_iteration_msec_ = iteration_timer_.isValid() ? int(iteration_timer_.elapsed()) : 0;
+	if (last_iteration_msec_ > idle_interval_msec_) {
+		++consecutive_overrun_count_;
+		++overrun_count_;
+	} else {
+		consecutive_overrun_count_ = 0;
+	}
+
+	if (activity_detected) {
+		// Poll again right away, the device may have more events coming.
+		bursting_ = true;
+		current_delay_msec_ = 0;
+	} else if (bursting_) {
+		bursting_ = false;
+		current_delay_msec_ = std::min(backoff_start_msec, getEffectiveIdleInterval());
+	} else {
+		current_delay_msec_ = std::min(std::max(current_delay_msec_ * 2, backoff_start_msec), getEffectiveIdleInterval());
+	}
+
+	// The delay counts from now (the completion time), so a long iteration doesn't
+	// cause the next poll to be skipped or bunched up.
+	return current_delay_msec_;
+}
+
+
+
+bool CcPollScheduler::isBursting() const
+{
+	return bursting_;
+}
+
+
+
+int CcPollScheduler::getLastIterationTime() const
+{
+	return last_iteration_msec_;
+}
+
+
+
+int CcPollScheduler::getConsecutiveOverrunCount() const
+{
+	return consecutive_overrun_count_;
+}
+
+
+
+quint64 CcPollScheduler::getOverrunCount() const
+{
+	return overrun_count_;
+}
+
+
+
+}
@@ -0,0 +1,106 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_POLL_SCHEDULER_H
+#define CCTALK_POLL_SCHEDULER_H
+
+#include <QtGlobal>
+#include <QElapsedTimer>
+
+
+namespace qtcc {
+
+
+/**
+\file
+
+Poll scheduler for CctalkDevice.
+
+The next poll is planned from the completion time of the previous one, so a slow
+round trip delays the next poll instead of dropping it. While the device reports new
+events (or holds a bill in escrow), the device is polled back to back (burst mode):
+the ccTalk event buffer holds only 5 events, and a burst of coins may overflow it
+if we wait for the full polling interval. Once the device is idle, the delay is doubled
+with each poll until it reaches the idle (device-recommended) interval.
+
+Buffer pressure (how full the event buffer was when polled) tightens the idle interval
+for a while, so that the next burst is caught before the buffer overflows.
+*/
+
+
+
+/// Adaptive poll scheduler
+class CcPollScheduler {
+	public:
+
+		/// Set the polling interval used when the device is idle
+		void setIdleInterval(int msec);
+
+		/// Get the polling interval used when the device is idle
+		[[nodiscard]] int getIdleInterval() const;
+
+		/// Report the number of unread events a poll found in the device buffer of \c buffer_size.
+		/// If the buffer was more than half full, the idle interval is shortened (for
+		/// pressure_hold_msec) so that the same event rate would fill at most half of it.
+		void reportBufferPressure(int unread_events, int buffer_size);
+
+		/// Get the idle interval, shortened by recent buffer pressure
+		[[nodiscard]] int getEffectiveIdleInterval() const;
+
+
+		/// Forget the burst state (e.g. when polling is restarted)
+		void reset();
+
+		/// Mark the start of a poll iteration
+		void iterationStarted();
+
+		/// Mark the end of a poll iteration. \c activity_detected should be true if the
+		/// iteration found new events or a bill held in escrow.
+		/// \return the delay before the next iteration.
+		int iterationFinished(bool activity_detected);
+
+
+		/// Check if the device is being polled in burst mode
+		[[nodiscard]] bool isBursting() const;
+
+		/// Get the duration of the last finished iteration
+		[[nodiscard]] int getLastIterationTime() const;
+
+		/// Get the number of consecutive iterations (up to and including the last one) that took
+		/// longer than the idle interval, that is, the device could not be polled as often as requested.
+		[[nodiscard]] int getConsecutiveOverrunCount() const;
+
+		/// Get the number of overrun iterations since the scheduler was created
+		[[nodiscard]] quint64 getOverrunCount() const;
+
+
+	private:
+
+		/// First delay after a burst; doubled with each idle iteration
+		static constexpr int backoff_start_msec = 10;
+
+		/// For how long the buffer pressure keeps the idle interval shortened
+		static constexpr int pressure_hold_msec = 30 * 1000;
+
+		int idle_interval_msec_ = 100;  ///< Polling interval when the device is idle
+		int current_delay_msec_ = 100;  ///< Delay planned after the last iteration
+		bool bursting_ = false;  ///< True while the device reports activity
+
+		int pressure_interval_msec_ = 0;  ///< Idle interval limit due to buffer pressure. 0 if none.
+		QElapsedTimer pressure_timer_;  ///< Started when pressure_interval_msec_ is set
+
+		QElapsedTimer iteration_timer_;  ///< Started at the beginning of each iteration
+		int last_iteration_msec_ = 0;  ///< Duration of the last finished iteration
+		int consecutive_overrun_count_ = 0;  ///< Number of consecutive iterations that took longer than the idle interval
+		quint64 overrun_count_ = 0;  ///< Number of overrun iterations
+
+};
+
+
+
+}
+
+
+#endif
@@ -0,0 +1,71 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <algorithm>
+
+#include "cctalk_retry_policy.h"
+
+
+namespace qtcc {
+
+
+
+void CcRetryPolicy::setDefaultRetryBudget(int retries)
+{
+	default_retry_budget_ = std::max(retries, 0);
+}
+
+
+
+int CcRetryPolicy::getDefaultRetryBudget() const
+{
+	return default_retry_budget_;
+}
+
+
+
+void CcRetryPolicy::setRetryBudget(CcHeader command, int retries)
+{
+	command_retry_budgets_[command] = std::max(retries, 0);
+}
+
+
+
+int CcRetryPolicy::getRetryBudget(CcHeader command) const
+{
+	auto iter = command_retry_budgets_.constFind(command);
+	if (iter != command_retry_budgets_.constEnd()) {
+		return iter.value();
+	}
+	return ccHeaderIsIdempotent(command) ? default_retry_budget_ : 0;
+}
+
+
+
+void CcRetryPolicy::setTimeoutRetryBudget(int retries)
+{
+	timeout_retry_budget_ = std::max(retries, 0);
+}
+
+
+
+int CcRetryPolicy::getTimeoutRetryBudget() const
+{
+	return timeout_retry_budget_;
+}
+
+
+
+CcRetryPolicy CcRetryPolicy::createDisabled()
+{
+	CcRetryPolicy policy;
+	policy.setDefaultRetryBudget(0);
+	policy.setTimeoutRetryBudget(0);
+	return policy;
+}
+
+
+
+}
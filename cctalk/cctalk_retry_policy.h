@@ -0,0 +1,79 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_RETRY_POLICY_H
+#define CCTALK_RETRY_POLICY_H
+
+#include <QtGlobal>
+#include <QMap>
+
+#include "cctalk_enums.h"
+
+
+namespace qtcc {
+
+
+/**
+\file
+
+Link-level retransmission policy.
+
+A reply corrupted by line noise (wrong size, bad checksum) or a missing reply is
+retransmitted by the serial worker right away, without a round trip to the controller
+thread, so a single noise burst doesn't fail the request (and possibly the device state)
+in the controller. Only the final result is reported back.
+
+Retransmitting is only safe for commands that don't change the device state
+(see ccHeaderIsIdempotent()): a corrupted ACK to RouteBill doesn't mean that the bill
+wasn't routed. Such commands are not retried unless explicitly given a budget.
+*/
+
+
+
+/// Retransmission policy of a link, see CctalkLinkController::setRetryPolicy()
+class CcRetryPolicy {
+	public:
+
+		/// Set the number of retries of idempotent commands that have no budget of their own.
+		/// 0 disables retransmission (except for the commands given an explicit budget).
+		void setDefaultRetryBudget(int retries);
+
+		/// Get the budget set with setDefaultRetryBudget()
+		[[nodiscard]] int getDefaultRetryBudget() const;
+
+		/// Set the number of retries of \c command, overriding the default. This is the only
+		/// way to enable retransmission of non-idempotent commands; do that only if the device
+		/// is known to handle a repeated command safely.
+		void setRetryBudget(CcHeader command, int retries);
+
+		/// Get the number of retries of \c command
+		[[nodiscard]] int getRetryBudget(CcHeader command) const;
+
+		/// Set the maximum number of retries after response timeouts (within the command budget).
+		/// Each one costs a full response timeout, which delays detecting a disconnected device.
+		void setTimeoutRetryBudget(int retries);
+
+		/// Get the budget set with setTimeoutRetryBudget()
+		[[nodiscard]] int getTimeoutRetryBudget() const;
+
+
+		/// Get a policy with retransmission disabled
+		[[nodiscard]] static CcRetryPolicy createDisabled();
+
+
+	private:
+
+		int default_retry_budget_ = 2;  ///< Retries of idempotent commands
+		int timeout_retry_budget_ = 1;  ///< Retries after response timeouts
+		QMap<CcHeader, int> command_retry_budgets_;  ///< Per-command budgets, overriding the default
+
+};
+
+
+
+}
+
+
+#endif
@@ -0,0 +1,160 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <algorithm>
+
+#include "cctalk_rtt_estimator.h"
+
+
+namespace qtcc {
+
+
+
+CcRttEstimator::CcRttEstimator()
+{
+	for (std::size_t i = 0; i < command_min_timeout_msec_.size(); ++i) {
+		command_min_timeout_msec_[i].store(ccHeaderIsSlow(CcHeader(i)) ? default_slow_command_min_timeout_msec : 0,
+				std::memory_order_relaxed);
+	}
+}
+
+
+
+void CcRttEstimator::setTimeoutLimits(int min_msec, int max_msec)
+{
+	min_timeout_msec_.store(std::max(min_msec, 1), std::memory_order_relaxed);
+	max_timeout_msec_.store(std::max(max_msec, std::max(min_msec, 1)), std::memory_order_relaxed);
+}
+
+
+
+int CcRttEstimator::getMinimumTimeout() const
+{
+	return min_timeout_msec_.load(std::memory_order_relaxed);
+}
+
+
+
+int CcRttEstimator::getMaximumTimeout() const
+{
+	return max_timeout_msec_.load(std::memory_order_relaxed);
+}
+
+
+
+void CcRttEstimator::setCommandMinimumTimeout(CcHeader command, int min_msec)
+{
+	command_min_timeout_msec_.at(std::size_t(command)).store(std::max(min_msec, 0), std::memory_order_relaxed);
+}
+
+
+
+int CcRttEstimator::getCommandMinimumTimeout(CcHeader command) const
+{
+	return command_min_timeout_msec_.at(std::size_t(command)).load(std::memory_order_relaxed);
+}
+
+
+
+void CcRttEstimator::recordSample(CcHeader command, quint64 usec)
+{
+	addSample(commands_.at(std::size_t(command)), usec);
+	addSample(link_, usec);
+}
+
+
+
+void CcRttEstimator::recordTimeout(CcHeader command)
+{
+	Estimator& estimator = commands_.at(std::size_t(command));
+	const int shift = estimator.backoff_shift.load(std::memory_order_relaxed);
+	estimator.backoff_shift.store(std::min(shift + 1, max_backoff_shift), std::memory_order_relaxed);
+}
+
+
+
+int CcRttEstimator::getResponseTimeout(CcHeader command) const
+{
+	const int max_msec = getMaximumTimeout();
+	const int min_msec = std::min(std::max(getMinimumTimeout(), getCommandMinimumTimeout(command)), max_msec);
+
+	// Not measured yet, use the static timeout
+	const CcRttEstimate estimate = getEstimate(command);
+	if (estimate.sample_count < min_sample_count) {
+		return max_msec;
+	}
+
+	// RTO = SRTT + max(G, 4 * RTTVAR), doubled for each consecutive timeout.
+	quint64 rto_usec = estimate.srtt_usec + std::max(granularity_usec, 4 * estimate.rttvar_usec);
+	rto_usec <<= estimate.backoff_shift;
+	const quint64 rto_msec = (rto_usec + 999) / 1000;
+	return int(std::clamp(rto_msec, quint64(min_msec), quint64(max_msec)));
+}
+
+
+
+CcRttEstimate CcRttEstimator::getEstimate(CcHeader command) const
+{
+	return getSnapshot(commands_.at(std::size_t(command)));
+}
+
+
+
+CcRttEstimate CcRttEstimator::getLinkEstimate() const
+{
+	return getSnapshot(link_);
+}
+
+
+
+void CcRttEstimator::reset()
+{
+	for (auto& estimator : commands_) {
+		estimator.sample_count.store(0, std::memory_order_relaxed);
+		estimator.backoff_shift.store(0, std::memory_order_relaxed);
+	}
+	link_.sample_count.store(0, std::memory_order_relaxed);
+	link_.backoff_shift.store(0, std::memory_order_relaxed);
+}
+
+
+
+void CcRttEstimator::addSample(Estimator& estimator, quint64 usec)
+{
+	const quint64 count = estimator.sample_count.load(std::memory_order_relaxed);
+	quint64 srtt = estimator.srtt_usec.load(std::memory_order_relaxed);
+	quint64 rttvar = estimator.rttvar_usec.load(std::memory_order_relaxed);
+
+	if (count == 0) {
+		srtt = usec;
+		rttvar = usec / 2;
+	} else {
+		// RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R
+		const quint64 delta = (srtt > usec ? srtt - usec : usec - srtt);
+		rttvar = (3 * rttvar + delta) / 4;
+		srtt = (7 * srtt + usec) / 8;
+	}
+
+	estimator.srtt_usec.store(srtt, std::memory_order_relaxed);
+	estimator.rttvar_usec.store(rttvar, std::memory_order_relaxed);
+	estimator.backoff_shift.store(0, std::memory_order_relaxed);
+	estimator.sample_count.store(count + 1, std::memory_order_release);
+}
+
+
+
+CcRttEstimate CcRttEstimator::getSnapshot(const Estimator& estimator)
+{
+	CcRttEstimate estimate;
+	estimate.sample_count = estimator.sample_count.load(std::memory_order_acquire);
+	estimate.srtt_usec = estimator.srtt_usec.load(std::memory_order_relaxed);
+	estimate.rttvar_usec = estimator.rttvar_usec.load(std::memory_order_relaxed);
+	estimate.backoff_shift = estimator.backoff_shift.load(std::memory_order_relaxed);
+	return estimate;
+}
+
+
+
+}
@@ -0,0 +1,174 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_RTT_ESTIMATOR_H
+#define CCTALK_RTT_ESTIMATOR_H
+
+#include <QtGlobal>
+#include <array>
+#include <atomic>
+
+#include "cctalk_enums.h"
+
+
+namespace qtcc {
+
+
+/**
+\file
+
+Adaptive response timeouts.
+
+The serial worker measures the device response time of each request: the time from the
+request being written to the first reply byte (the reply length and the line speed
+don't matter here). CcRttEstimator keeps a smoothed response time and its variance
+per command, as in RFC 6298 (TCP retransmission timer), and derives the response timeout
+from them: SRTT + 4 * RTTVAR, clamped to a floor and a ceiling.
+
+A command without enough samples of its own uses the ceiling (the static timeout);
+the link-wide estimate is dominated by the fast poll commands and says nothing about
+e.g. PerformSelfCheck. Commands that make the device do actual work (self check, reset,
+routing, settings written into EEPROM) also have a higher floor of their own, since
+their processing time varies. Each timeout doubles the timeout of that command (up to
+4 times the estimate), and the next measured response resets it. Retransmissions are
+not measured, since their replies are ambiguous.
+
+With a typical device replying in 5-20 ms, a dead device is detected in around 100 ms
+(floor timeout plus one retry) instead of seconds.
+*/
+
+
+
+/// Check if the device may take a long (and varying) time to process \c command.
+/// These get a minimum timeout of their own, see CcRttEstimator.
+constexpr bool ccHeaderIsSlow(CcHeader command)
+{
+	switch (command) {
+		case CcHeader::ResetDevice:
+		case CcHeader::SwitchBaudRate:
+		case CcHeader::RouteBill:
+		case CcHeader::PerformSelfCheck:
+		case CcHeader::SetInhibitStatus:
+		case CcHeader::SetMasterInhibitStatus:
+		case CcHeader::SetBillOperatingMode:
+		case CcHeader::FactorySetUpAndTest:
+			return true;
+		default:
+			return false;
+	}
+}
+
+
+
+/// Smoothed response time of a command, see CcRttEstimator::getEstimate()
+struct CcRttEstimate {
+	quint64 srtt_usec = 0;  ///< Smoothed response time
+	quint64 rttvar_usec = 0;  ///< Response time variation
+	quint64 sample_count = 0;  ///< Number of measured responses
+	int backoff_shift = 0;  ///< Timeout is multiplied by 2^backoff_shift after timeouts
+};
+
+
+
+/// Response time estimator of a single link (device). The samples are recorded by the
+/// serial worker; the functions may be called from any thread.
+class CcRttEstimator {
+	public:
+
+		/// Default minimum response timeout
+		static constexpr int default_min_timeout_msec = 50;
+
+		/// Default maximum response timeout, also used for commands without an estimate
+		static constexpr int default_max_timeout_msec = 1500;
+
+		/// Default minimum response timeout of the slow commands, see ccHeaderIsSlow()
+		static constexpr int default_slow_command_min_timeout_msec = 500;
+
+
+		/// Constructor
+		CcRttEstimator();
+
+
+		/// Set the response timeout floor and ceiling
+		void setTimeoutLimits(int min_msec, int max_msec);
+
+		/// Get the response timeout floor
+		[[nodiscard]] int getMinimumTimeout() const;
+
+		/// Get the response timeout ceiling
+		[[nodiscard]] int getMaximumTimeout() const;
+
+		/// Set the response timeout floor of a single command. The global floor still applies.
+		void setCommandMinimumTimeout(CcHeader command, int min_msec);
+
+		/// Get the response timeout floor of a single command
+		[[nodiscard]] int getCommandMinimumTimeout(CcHeader command) const;
+
+
+		/// Record the response time of a (not retransmitted) request
+		void recordSample(CcHeader command, quint64 usec);
+
+		/// Record a response timeout of a request, backing off its timeout
+		void recordTimeout(CcHeader command);
+
+
+		/// Get the response timeout to use for \c command
+		[[nodiscard]] int getResponseTimeout(CcHeader command) const;
+
+		/// Get the current estimate of \c command
+		[[nodiscard]] CcRttEstimate getEstimate(CcHeader command) const;
+
+		/// Get the current link-wide estimate (all commands combined)
+		[[nodiscard]] CcRttEstimate getLinkEstimate() const;
+
+		/// Forget all the estimates, e.g. after a line speed change
+		void reset();
+
+
+	private:
+
+		/// Estimator state. Written by the worker thread only.
+		struct Estimator {
+			std::atomic<quint64> srtt_usec = {0};
+			std::atomic<quint64> rttvar_usec = {0};
+			std::atomic<quint64> sample_count = {0};
+			std::atomic<int> backoff_shift = {0};
+		};
+
+
+		/// Add a sample to an estimator
+		static void addSample(Estimator& estimator, quint64 usec);
+
+		/// Get a copy of the estimator state
+		[[nodiscard]] static CcRttEstimate getSnapshot(const Estimator& estimator);
+
+
+		/// Number of samples needed before an estimate is used
+		static constexpr quint64 min_sample_count = 4;
+
+		/// Maximum timeout backoff (2^max_backoff_shift times the estimate)
+		static constexpr int max_backoff_shift = 2;
+
+		/// Clock granularity, the minimum variation allowance
+		static constexpr quint64 granularity_usec = 1000;
+
+		/// Number of possible header values
+		static constexpr int command_count = 256;
+
+		std::array<Estimator, command_count> commands_;  ///< Per-command estimators
+		Estimator link_;  ///< All the commands combined
+
+		std::atomic<int> min_timeout_msec_ = {default_min_timeout_msec};  ///< Timeout floor
+		std::atomic<int> max_timeout_msec_ = {default_max_timeout_msec};  ///< Timeout ceiling
+		std::array<std::atomic<int>, command_count> command_min_timeout_msec_;  ///< Per-command timeout floors
+
+};
+
+
+
+}
+
+
+#endif
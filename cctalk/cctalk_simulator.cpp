@@ -0,0 +1,582 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <QHash>
+#include <QMutexLocker>
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#include "cctalk_simulator.h"
+
+
+namespace qtcc {
+
+
+namespace {
+
+	/// Fill in the defaults of the unset device information fields
+	CcSimulatedDeviceInfo completeDeviceInfo(CcSimulatedDeviceInfo info)
+	{
+		DBG_ASSERT(info.category == CcCategory::CoinAcceptor || info.category == CcCategory::BillValidator);
+
+		if (info.address == 0) {
+			info.address = ccCategoryGetDefaultAddress(info.category);
+		}
+		if (info.identifiers.isEmpty()) {
+			if (info.category == CcCategory::CoinAcceptor) {
+				info.identifiers = {
+					{1, "GE.10A"}, {2, "GE.20A"}, {3, "GE.50A"}, {4, "GE001A"}, {5, "GE002A"},
+				};
+			} else {
+				info.identifiers = {
+					{1, "GE0005A"}, {2, "GE0010A"}, {3, "GE0020A"}, {4, "GE0050A"}, {5, "GE0100A"},
+				};
+			}
+		}
+		return info;
+	}
+
+
+	/// Simulated port registry
+	struct SimulatorRegistry {
+		QMutex mutex;  ///< Protects ports
+		QHash<QString, std::shared_ptr<CcSimulatedPort>> ports;  ///< Port name -> port
+	};
+
+
+	/// Get the registry
+	SimulatorRegistry& getRegistry()
+	{
+		static SimulatorRegistry registry;
+		return registry;
+	}
+
+}
+
+
+
+CcSimulatedDevice::CcSimulatedDevice(CcSimulatedDeviceInfo info)
+		: info_(completeDeviceInfo(std::move(info))), fault_code_(info_.fault_code)
+{
+	clock_.start();
+}
+
+
+
+const CcSimulatedDeviceInfo& CcSimulatedDevice::getInfo() const
+{
+	return info_;
+}
+
+
+
+void CcSimulatedDevice::insertCredit(quint8 position)
+{
+	QMutexLocker locker(&mutex_);
+	scheduleCreditsLocked(0, position, 1, 0);
+}
+
+
+
+void CcSimulatedDevice::scheduleCredits(int delay_msec, quint8 position, int count, int interval_msec)
+{
+	QMutexLocker locker(&mutex_);
+	scheduleCreditsLocked(delay_msec, position, count, interval_msec);
+}
+
+
+
+void CcSimulatedDevice::insertEvent(quint8 result_a, quint8 result_b)
+{
+	QMutexLocker locker(&mutex_);
+	addEventLocked(result_a, result_b);
+}
+
+
+
+void CcSimulatedDevice::setFaultCode(CcFaultCode fault_code)
+{
+	QMutexLocker locker(&mutex_);
+	fault_code_ = fault_code;
+}
+
+
+
+void CcSimulatedDevice::reset()
+{
+	QMutexLocker locker(&mutex_);
+	resetLocked();
+}
+
+
+
+bool CcSimulatedDevice::handleRequest(const CcFrame& request_frame, qint32 line_baud_rate, CcFrame& reply_frame)
+{
+	QMutexLocker locker(&mutex_);
+
+	// Garbage at a different line speed, or the device is still booting.
+	if (line_baud_rate != baud_rate_ || clock_.elapsed() < down_until_msec_) {
+		return false;
+	}
+	// Real devices silently ignore the frames with bad checksums.
+	if (!(info_.checksum_16bit ? request_frame.verify<CcChecksum16>() : request_frame.verify<CcChecksum8>())) {
+		return false;
+	}
+
+	processScheduleLocked();
+
+	const auto header = CcHeader(request_frame.getHeader());
+	QByteArray reply;
+	if (!buildReplyLocked(header, request_frame.getData(), reply)) {
+		return false;
+	}
+
+	// The device replies at the old line speed, then switches.
+	if (pending_baud_rate_ != 0) {
+		baud_rate_ = pending_baud_rate_;
+		pending_baud_rate_ = 0;
+	}
+
+	const quint8 host_address = 1;
+	reply_frame = info_.checksum_16bit
+			? CcFrame::build<CcChecksum16>(host_address, info_.address, quint8(CcHeader::Reply), reply)
+			: CcFrame::build<CcChecksum8>(host_address, info_.address, quint8(CcHeader::Reply), reply);
+
+	// The device acknowledges the reset, then goes down.
+	if (header == CcHeader::ResetDevice) {
+		resetLocked();
+	}
+	return true;
+}
+
+
+
+void CcSimulatedDevice::resetLocked()
+{
+	down_until_msec_ = clock_.elapsed() + info_.reset_time_msec;
+	baud_rate_ = cc_default_baud_rate;
+	pending_baud_rate_ = 0;
+	event_counter_ = 0;
+	events_.clear();
+	master_accept_ = false;
+	accept_mask_ = 0;
+	bill_operating_mode_ = 0;
+	escrow_position_ = 0;
+}
+
+
+
+void CcSimulatedDevice::scheduleCreditsLocked(int delay_msec, quint8 position, int count, int interval_msec)
+{
+	const qint64 now_msec = clock_.elapsed();
+	for (int i = 0; i < count; ++i) {
+		ScheduledCredit credit;
+		credit.due_msec = now_msec + delay_msec + qint64(i) * interval_msec;
+		credit.position = position;
+		auto iter = std::upper_bound(schedule_.begin(), schedule_.end(), credit,
+				[](const ScheduledCredit& a, const ScheduledCredit& b) { return a.due_msec < b.due_msec; });
+		schedule_.insert(iter, credit);
+	}
+}
+
+
+
+void CcSimulatedDevice::processScheduleLocked()
+{
+	const qint64 now_msec = clock_.elapsed();
+	while (!schedule_.isEmpty() && schedule_.constFirst().due_msec <= now_msec) {
+		if (!insertCreditLocked(schedule_.constFirst().position)) {
+			break;  // a bill is waiting in escrow, insert the rest later
+		}
+		schedule_.removeFirst();
+	}
+}
+
+
+
+bool CcSimulatedDevice::insertCreditLocked(quint8 position)
+{
+	const bool accepted = master_accept_ && position >= 1 && position <= 16
+			&& (accept_mask_ & (1U << (position - 1))) != 0 && info_.identifiers.contains(position);
+
+	if (info_.category == CcCategory::CoinAcceptor) {
+		if (accepted) {
+			addEventLocked(position, 1);  // sorter path 1
+		} else {
+			addEventLocked(0, quint8(CcCoinAcceptorEventCode::InhibitedCoin));
+		}
+		return true;
+	}
+
+	// Bill validator
+	if (escrow_position_ != 0) {
+		return false;
+	}
+	if (!accepted) {
+		addEventLocked(0, quint8(CcBillValidatorErrorCode::InhibitedBillOnSerial));
+	} else if ((bill_operating_mode_ & 0x2) != 0) {
+		escrow_position_ = position;
+		addEventLocked(position, quint8(CcBillValidatorSuccessCode::ValidatedAndHeldInEscrow));
+	} else {
+		addEventLocked(position, quint8(CcBillValidatorSuccessCode::ValidatedAndAccepted));
+	}
+	return true;
+}
+
+
+
+void CcSimulatedDevice::addEventLocked(quint8 result_a, quint8 result_b)
+{
+	events_.prepend(qMakePair(result_a, result_b));
+	if (events_.size() > cc_event_buffer_size) {
+		events_.resize(cc_event_buffer_size);
+	}
+	// Wraps from 255 to 1, 0 is only used after reset.
+	event_counter_ = quint8(event_counter_ == 255 ? 1 : event_counter_ + 1);
+}
+
+
+
+bool CcSimulatedDevice::buildReplyLocked(CcHeader header, CcByteView data, QByteArray& reply)
+{
+	const bool coin_acceptor = (info_.category == CcCategory::CoinAcceptor);
+
+	switch (header) {
+		case CcHeader::SimplePoll:
+			return true;  // ACK
+
+		case CcHeader::GetEquipmentCategory:
+			reply = coin_acceptor ? QByteArray("Coin Acceptor") : QByteArray("Bill Validator");
+			return true;
+
+		case CcHeader::GetManufacturer:
+			reply = info_.manufacturer;
+			return true;
+
+		case CcHeader::GetProductCode:
+			reply = info_.product_code;
+			return true;
+
+		case CcHeader::GetBuildCode:
+			reply = info_.build_code;
+			return true;
+
+		case CcHeader::GetSerialNumber:
+			reply = info_.serial_number;
+			return true;
+
+		case CcHeader::GetSoftwareRevision:
+			reply = info_.software_revision;
+			return true;
+
+		case CcHeader::GetCommsRevision:
+			reply = QByteArray("\x01\x04\x02", 3);  // release 1, ccTalk 4.2
+			return true;
+
+		case CcHeader::GetPollingPriority:
+			reply.append(char(1)).append(char(info_.polling_interval_msec));  // unit: 1ms
+			return true;
+
+		case CcHeader::GetStatus:
+			if (!coin_acceptor) {
+				return false;
+			}
+			reply.append(char(0));  // OK
+			return true;
+
+		case CcHeader::SwitchBaudRate:
+		{
+			if (data.isEmpty()) {
+				return false;
+			}
+			const auto operation = CcBaudRateOperation(data.at(0));
+			const auto code = data.size() > 1 ? CcBaudRate(data.at(1)) : CcBaudRate::Baud9600;
+			const bool supported = data.size() > 1 && ccBaudRateGetValue(code) >= cc_default_baud_rate
+					&& quint8(code) <= quint8(info_.maximum_baud_rate);
+			switch (operation) {
+				case CcBaudRateOperation::RequestCurrent:
+				{
+					CcBaudRate current = CcBaudRate::Baud9600;
+					for (int c = int(CcBaudRate::Baud4800); c <= int(CcBaudRate::Baud115200); ++c) {
+						if (ccBaudRateGetValue(CcBaudRate(c)) == baud_rate_) {
+							current = CcBaudRate(c);
+						}
+					}
+					reply.append(char(current));
+					return true;
+				}
+				case CcBaudRateOperation::Switch:
+					if (!supported) {
+						return false;
+					}
+					pending_baud_rate_ = ccBaudRateGetValue(code);
+					return true;  // ACK
+				case CcBaudRateOperation::RequestMaximum:
+					reply.append(char(info_.maximum_baud_rate));
+					return true;
+				case CcBaudRateOperation::RequestSupport:
+					reply.append(char(supported ? 1 : 0));
+					return true;
+			}
+			return false;
+		}
+
+		case CcHeader::GetVariableSet:
+			if (coin_acceptor) {
+				return false;
+			}
+			reply.append(char(info_.identifiers.isEmpty() ? 0 : info_.identifiers.lastKey())).append(char(1));  // bill types, banks
+			return true;
+
+		case CcHeader::GetCoinId:
+		case CcHeader::GetBillId:
+			if (data.isEmpty() || coin_acceptor != (header == CcHeader::GetCoinId)) {
+				return false;
+			}
+			reply = info_.identifiers.value(quint8(data.at(0)), QByteArray("......"));
+			return true;
+
+		case CcHeader::GetCountryScalingFactor:
+		{
+			if (coin_acceptor || data.size() != 2) {
+				return false;
+			}
+			const QByteArray country = data.toByteArray();
+			const bool known = std::any_of(info_.identifiers.cbegin(), info_.identifiers.cend(),
+					[&country](const QByteArray& id) { return id.startsWith(country); });
+			const quint16 factor = known ? info_.bill_scaling_factor : 0;
+			reply.append(char(factor & 0xff)).append(char(factor >> 8)).append(char(known ? info_.bill_decimal_places : 0));
+			return true;
+		}
+
+		case CcHeader::SetInhibitStatus:
+			if (data.size() != 2) {
+				return false;
+			}
+			accept_mask_ = quint16(quint8(data.at(0)) | (quint16(quint8(data.at(1))) << 8));
+			return true;  // ACK
+
+		case CcHeader::GetInhibitStatus:
+			reply.append(char(accept_mask_ & 0xff)).append(char(accept_mask_ >> 8));
+			return true;
+
+		case CcHeader::SetMasterInhibitStatus:
+			if (data.size() != 1) {
+				return false;
+			}
+			master_accept_ = (data.at(0) & 0x1) != 0;
+			return true;  // ACK
+
+		case CcHeader::GetMasterInhibitStatus:
+			reply.append(char(master_accept_ ? 1 : 0));
+			return true;
+
+		case CcHeader::SetBillOperatingMode:
+			if (coin_acceptor || data.size() != 1) {
+				return false;
+			}
+			bill_operating_mode_ = quint8(data.at(0));
+			return true;  // ACK
+
+		case CcHeader::ReadBufferedCredit:
+		case CcHeader::ReadBufferedBillEvents:
+			if (coin_acceptor != (header == CcHeader::ReadBufferedCredit)) {
+				return false;
+			}
+			reply.append(char(event_counter_));
+			for (int i = 0; i < cc_event_buffer_size; ++i) {
+				const auto event = events_.value(i);
+				reply.append(char(event.first)).append(char(event.second));
+			}
+			return true;
+
+		case CcHeader::RouteBill:
+		{
+			if (coin_acceptor || data.size() != 1) {
+				return false;
+			}
+			const auto route = CcBillRouteCommandType(data.at(0));
+			if (route == CcBillRouteCommandType::IncreaseTimeout) {
+				return true;  // ACK
+			}
+			if (escrow_position_ == 0) {
+				reply.append(char(CcBillRouteStatus::EscrowEmpty));
+				return true;
+			}
+			if (route == CcBillRouteCommandType::RouteToStacker) {
+				addEventLocked(escrow_position_, quint8(CcBillValidatorSuccessCode::ValidatedAndAccepted));
+			} else {
+				addEventLocked(0, quint8(CcBillValidatorErrorCode::BillReturnedFromEscrow));
+			}
+			escrow_position_ = 0;
+			return true;  // ACK
+		}
+
+		case CcHeader::PerformSelfCheck:
+			reply.append(char(fault_code_));
+			return true;
+
+		case CcHeader::ResetDevice:
+			return true;  // ACK, the reset follows
+
+		default:
+			break;
+	}
+
+	// Unsupported commands are not answered.
+	return false;
+}
+
+
+
+CcSimulatedPort::CcSimulatedPort(CcSimulatorOptions options)
+		: options_(options),
+		random_(options.random_seed != 0 ? options.random_seed : QRandomGenerator::global()->generate())
+{ }
+
+
+
+const CcSimulatorOptions& CcSimulatedPort::getOptions() const
+{
+	return options_;
+}
+
+
+
+std::shared_ptr<CcSimulatedDevice> CcSimulatedPort::addDevice(CcSimulatedDeviceInfo info)
+{
+	auto device = std::make_shared<CcSimulatedDevice>(std::move(info));
+	QMutexLocker locker(&mutex_);
+	DBG_ASSERT(!devices_.contains(device->getInfo().address));
+	devices_.insert(device->getInfo().address, device);
+	return device;
+}
+
+
+
+std::shared_ptr<CcSimulatedDevice> CcSimulatedPort::getDevice(quint8 address) const
+{
+	QMutexLocker locker(&mutex_);
+	return devices_.value(address);
+}
+
+
+
+bool CcSimulatedPort::handleRequest(const CcFrame& request_frame, qint32 line_baud_rate, CcFrame& reply_frame, int& latency_usec)
+{
+	request_count_.fetch_add(1, std::memory_order_relaxed);
+	if (!request_frame.hasValidSize()) {
+		return false;
+	}
+
+	std::shared_ptr<CcSimulatedDevice> device;
+	bool inject_reset = false, inject_no_reply = false, inject_bad_checksum = false;
+	{
+		QMutexLocker locker(&mutex_);
+		const quint8 address = request_frame.getDestinationAddress();
+		if (address == 0) {
+			// Broadcast. Only a single device may reply, otherwise the replies collide.
+			if (devices_.size() == 1) {
+				device = devices_.first();
+			}
+		} else {
+			device = devices_.value(address);
+		}
+		if (!device) {
+			return false;
+		}
+
+		// Draw all the random numbers here, the generator is not thread-safe.
+		inject_reset = options_.reset_probability > 0. && random_.generateDouble() < options_.reset_probability;
+		inject_no_reply = options_.no_reply_probability > 0. && random_.generateDouble() < options_.no_reply_probability;
+		inject_bad_checksum = options_.bad_checksum_probability > 0. && random_.generateDouble() < options_.bad_checksum_probability;
+		latency_usec = options_.reply_latency_usec;
+		if (options_.latency_jitter_usec > 0) {
+			latency_usec += int(random_.bounded(options_.latency_jitter_usec + 1));
+		}
+	}
+
+	if (inject_reset) {
+		injected_error_count_.fetch_add(1, std::memory_order_relaxed);
+		device->reset();
+		return false;  // down
+	}
+
+	// The device processes the request even if the reply is lost.
+	if (!device->handleRequest(request_frame, line_baud_rate, reply_frame)) {
+		return false;
+	}
+	if (inject_no_reply) {
+		injected_error_count_.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	if (inject_bad_checksum) {
+		injected_error_count_.fetch_add(1, std::memory_order_relaxed);
+		std::array<char, CcFrame::max_size> bytes;
+		std::copy_n(reply_frame.data(), reply_frame.size(), bytes.data());
+		bytes[std::size_t(reply_frame.size() - 1)] = char(bytes[std::size_t(reply_frame.size() - 1)] ^ 0x5a);
+		reply_frame.assign(CcByteView(bytes.data(), reply_frame.size()));
+	}
+	return true;
+}
+
+
+
+quint64 CcSimulatedPort::getRequestCount() const
+{
+	return request_count_.load(std::memory_order_relaxed);
+}
+
+
+
+quint64 CcSimulatedPort::getInjectedErrorCount() const
+{
+	return injected_error_count_.load(std::memory_order_relaxed);
+}
+
+
+
+std::shared_ptr<CcSimulatedPort> CcSimulator::addPort(const QString& port_name, CcSimulatorOptions options)
+{
+	auto port = std::make_shared<CcSimulatedPort>(options);
+	SimulatorRegistry& registry = getRegistry();
+	QMutexLocker locker(&registry.mutex);
+	registry.ports.insert(port_name, port);
+	return port;
+}
+
+
+
+void CcSimulator::removePort(const QString& port_name)
+{
+	SimulatorRegistry& registry = getRegistry();
+	QMutexLocker locker(&registry.mutex);
+	registry.ports.remove(port_name);
+}
+
+
+
+std::shared_ptr<CcSimulatedPort> CcSimulator::findPort(const QString& port_name)
+{
+	SimulatorRegistry& registry = getRegistry();
+	QMutexLocker locker(&registry.mutex);
+	return registry.ports.value(port_name);
+}
+
+
+
+QStringList CcSimulator::getPortNames()
+{
+	SimulatorRegistry& registry = getRegistry();
+	QMutexLocker locker(&registry.mutex);
+	QStringList names = registry.ports.keys();
+	names.sort();
+	return names;
+}
+
+
+
+}
@@ -0,0 +1,258 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_SIMULATOR_H
+#define CCTALK_SIMULATOR_H
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QMutex>
+#include <QRandomGenerator>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <atomic>
+#include <memory>
+
+#include "cctalk_enums.h"
+#include "cctalk_frame.h"
+
+
+namespace qtcc {
+
+
+/**
+\file
+
+In-process ccTalk device simulator, used through SerialTransportKind::Simulator.
+
+A simulated port (CcSimulatedPort) is registered under a port name with CcSimulator::addPort(),
+and one or more simulated coin acceptors / bill validators (CcSimulatedDevice) are attached to it.
+A SerialWorker opening that port name with the simulator transport talks to these devices
+as it would to the real ones: the request is echoed back, and the addressed device replies
+after its line transmission time plus a configurable latency.
+
+With CcSimulatorOptions::emulate_line_speed disabled ("infinite baud"), the replies are delivered
+right away, which measures the library's own overhead.
+*/
+
+
+
+/// Line and error injection options of a simulated port
+struct CcSimulatorOptions {
+	/// If true, the transmission time of each byte (10 bits) at the port baud rate is emulated.
+	/// If false, the line has "infinite baud": the echo and the replies arrive without delay.
+	bool emulate_line_speed = true;
+
+	int reply_latency_usec = 2000;  ///< Device processing time before replying (if emulate_line_speed)
+	int latency_jitter_usec = 1000;  ///< Maximum random extra latency, uniformly distributed (if emulate_line_speed)
+
+	double bad_checksum_probability = 0.;  ///< Probability of a reply with a corrupted checksum
+	double no_reply_probability = 0.;  ///< Probability of a missing reply (response timeout)
+	double reset_probability = 0.;  ///< Probability of a device reset (power glitch) before a request
+
+	quint32 random_seed = 0;  ///< Error injection / jitter seed. 0 means a random seed.
+};
+
+
+
+/// Identity and behavior of a simulated device
+struct CcSimulatedDeviceInfo {
+	CcCategory category = CcCategory::CoinAcceptor;  ///< CoinAcceptor or BillValidator
+	quint8 address = 0;  ///< ccTalk address. 0 means the category default address.
+	bool checksum_16bit = false;  ///< Use 16-bit CRC checksums instead of 8-bit ones
+
+	QByteArray manufacturer = "QTC";  ///< GetManufacturer reply
+	QByteArray product_code = "SIMULATOR";  ///< GetProductCode reply
+	QByteArray build_code = "1";  ///< GetBuildCode reply
+	QByteArray serial_number = QByteArray("\x01\x00\x00", 3);  ///< GetSerialNumber reply
+	QByteArray software_revision = "1.0";  ///< GetSoftwareRevision reply
+
+	/// Coin / bill identifiers by position. If empty, a default set is used.
+	QMap<quint8, QByteArray> identifiers;
+
+	quint16 bill_scaling_factor = 100;  ///< Bill validators: GetCountryScalingFactor reply
+	quint8 bill_decimal_places = 2;  ///< Bill validators: GetCountryScalingFactor reply
+
+	quint8 polling_interval_msec = 100;  ///< GetPollingPriority reply, in milliseconds (0 means "see the device docs")
+	CcBaudRate maximum_baud_rate = CcBaudRate::Baud115200;  ///< SwitchBaudRate support
+	int reset_time_msec = 200;  ///< How long a reset device doesn't respond
+	CcFaultCode fault_code = CcFaultCode::Ok;  ///< PerformSelfCheck reply
+};
+
+
+
+/// Simulated coin acceptor or bill validator. The functions are thread-safe.
+class CcSimulatedDevice {
+	public:
+
+		/// Constructor
+		explicit CcSimulatedDevice(CcSimulatedDeviceInfo info);
+
+		/// Non-copyable
+		CcSimulatedDevice(const CcSimulatedDevice& other) = delete;
+
+		/// Non-copyable
+		CcSimulatedDevice& operator=(const CcSimulatedDevice& other) = delete;
+
+
+		/// Get the device information
+		[[nodiscard]] const CcSimulatedDeviceInfo& getInfo() const;
+
+
+		/// Insert a coin / bill at position \c position. It shows up in the next event poll.
+		/// Coins are accepted (or rejected if inhibited), bills are held in escrow if escrow
+		/// is enabled by the host.
+		void insertCredit(quint8 position);
+
+		/// Schedule a credit burst: \c count coins / bills at \c position, the first one after
+		/// \c delay_msec, then one every \c interval_msec.
+		void scheduleCredits(int delay_msec, quint8 position, int count, int interval_msec);
+
+		/// Add a raw event (result A, result B) to the event buffer, e.g. an error code
+		void insertEvent(quint8 result_a, quint8 result_b);
+
+		/// Set the PerformSelfCheck fault code
+		void setFaultCode(CcFaultCode fault_code);
+
+		/// Reset the device (as if power-cycled). It doesn't respond for CcSimulatedDeviceInfo::reset_time_msec.
+		void reset();
+
+
+		/// Handle a request frame that was verified to be addressed to this device, received
+		/// at \c line_baud_rate. Sets \c reply_frame and returns true if the device replies.
+		bool handleRequest(const CcFrame& request_frame, qint32 line_baud_rate, CcFrame& reply_frame);
+
+
+	private:
+
+		/// A scheduled credit
+		struct ScheduledCredit {
+			qint64 due_msec = 0;  ///< Due time on clock_
+			quint8 position = 0;  ///< Coin / bill position
+		};
+
+
+		/// Reset the state. The mutex must be locked.
+		void resetLocked();
+
+		/// Add credits to the schedule. The mutex must be locked.
+		void scheduleCreditsLocked(int delay_msec, quint8 position, int count, int interval_msec);
+
+		/// Insert the scheduled credits that are due. The mutex must be locked.
+		void processScheduleLocked();
+
+		/// Insert a credit. The mutex must be locked.
+		/// \return false if the credit cannot be inserted now (a bill in escrow).
+		bool insertCreditLocked(quint8 position);
+
+		/// Add an event to the buffer, incrementing the event counter. The mutex must be locked.
+		void addEventLocked(quint8 result_a, quint8 result_b);
+
+		/// Build the reply data for a request. The mutex must be locked.
+		/// \return false if the device doesn't reply to this request.
+		bool buildReplyLocked(CcHeader header, CcByteView data, QByteArray& reply);
+
+
+		const CcSimulatedDeviceInfo info_;  ///< Device information
+
+		mutable QMutex mutex_;  ///< Protects the members below
+		QElapsedTimer clock_;  ///< Started on construction
+		qint64 down_until_msec_ = 0;  ///< The device doesn't respond until this time (after a reset)
+		qint32 baud_rate_ = cc_default_baud_rate;  ///< Current line speed of the device
+		qint32 pending_baud_rate_ = 0;  ///< Line speed to switch to after the current reply, 0 if none
+		quint8 event_counter_ = 0;  ///< Event counter, 0 after reset, wraps from 255 to 1
+		QVector<QPair<quint8, quint8>> events_;  ///< Event buffer, newest first
+		bool master_accept_ = false;  ///< Master inhibit status (true means accepting)
+		quint16 accept_mask_ = 0;  ///< Per-position accept mask (bit set means accepting)
+		quint8 bill_operating_mode_ = 0;  ///< Bill validators: B0 stacker, B1 escrow
+		quint8 escrow_position_ = 0;  ///< Bill validators: bill in escrow, 0 if none
+		CcFaultCode fault_code_ = CcFaultCode::Ok;  ///< PerformSelfCheck reply
+		QVector<ScheduledCredit> schedule_;  ///< Scheduled credits, sorted by due time
+
+};
+
+
+
+/// Simulated serial line with one or more devices attached. The functions are thread-safe.
+class CcSimulatedPort {
+	public:
+
+		/// Constructor
+		explicit CcSimulatedPort(CcSimulatorOptions options = CcSimulatorOptions());
+
+		/// Non-copyable
+		CcSimulatedPort(const CcSimulatedPort& other) = delete;
+
+		/// Non-copyable
+		CcSimulatedPort& operator=(const CcSimulatedPort& other) = delete;
+
+
+		/// Get the options
+		[[nodiscard]] const CcSimulatorOptions& getOptions() const;
+
+		/// Attach a device. Attach the devices before opening the port.
+		std::shared_ptr<CcSimulatedDevice> addDevice(CcSimulatedDeviceInfo info);
+
+		/// Get the device at \c address, null if none
+		[[nodiscard]] std::shared_ptr<CcSimulatedDevice> getDevice(quint8 address) const;
+
+
+		/// Handle a request frame received at \c line_baud_rate. Called by the transport.
+		/// If one of the devices replies, \c reply_frame is set, \c latency_usec is set to the
+		/// device processing time, and true is returned.
+		bool handleRequest(const CcFrame& request_frame, qint32 line_baud_rate, CcFrame& reply_frame, int& latency_usec);
+
+
+		/// Get the number of requests received
+		[[nodiscard]] quint64 getRequestCount() const;
+
+		/// Get the number of injected errors (corrupted or missing replies, resets)
+		[[nodiscard]] quint64 getInjectedErrorCount() const;
+
+
+	private:
+
+		const CcSimulatorOptions options_;  ///< Options
+
+		mutable QMutex mutex_;  ///< Protects the members below
+		QMap<quint8, std::shared_ptr<CcSimulatedDevice>> devices_;  ///< Address -> device
+		QRandomGenerator random_;  ///< Error injection / jitter generator
+
+		std::atomic<quint64> request_count_ = {0};  ///< Number of requests
+		std::atomic<quint64> injected_error_count_ = {0};  ///< Number of injected errors
+
+};
+
+
+
+/// Registry of the simulated ports, looked up by the simulator transport by port name.
+/// The functions are thread-safe.
+class CcSimulator {
+	public:
+
+		/// Register a simulated port, replacing any previous port with the same name.
+		/// Ports that are open keep using the previous one until they are reopened.
+		static std::shared_ptr<CcSimulatedPort> addPort(const QString& port_name, CcSimulatorOptions options = CcSimulatorOptions());
+
+		/// Unregister a simulated port
+		static void removePort(const QString& port_name);
+
+		/// Get a registered port, null if none
+		[[nodiscard]] static std::shared_ptr<CcSimulatedPort> findPort(const QString& port_name);
+
+		/// Get the names of the registered ports
+		[[nodiscard]] static QStringList getPortNames();
+
+};
+
+
+
+}
+
+
+#endif
@@ -0,0 +1,311 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QObject>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+#include "cctalk_wire_capture.h"
+#include "helpers/debug.h"
+
+
+namespace qtcc {
+
+
+namespace {
+
+	/// File magic
+	constexpr char capture_magic[8] = {'Q', 'T', 'C', 'C', 'C', 'A', 'P', '\0'};
+
+	/// File format version
+	constexpr quint32 capture_format_version = 1;
+
+
+	/// Store a little-endian value at \c dest
+	template<typename T>
+	inline void putLittleEndian(char* dest, T value)
+	{
+		qToLittleEndian(value, dest);
+	}
+
+	/// Load a little-endian value from \c src
+	template<typename T>
+	inline T getLittleEndian(const uchar* src)
+	{
+		return qFromLittleEndian<T>(src);
+	}
+
+}
+
+
+
+CcWireCapture::CcWireCapture(int buffer_size, int flush_interval_msec)
+		: buffer_(std::size_t(std::max(buffer_size, 4096))), flush_interval_msec_(flush_interval_msec)
+{ }
+
+
+
+CcWireCapture::~CcWireCapture()
+{
+	close();
+}
+
+
+
+bool CcWireCapture::open(const QString& file_name, QString& error_msg)
+{
+	QMutexLocker locker(&mutex_);
+
+	if (file_.isOpen()) {
+		flushLocked();
+		file_.close();
+	}
+
+	file_.setFileName(file_name);
+	if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		error_msg = QObject::tr("! Cannot create capture file \"%1\": %2").arg(file_name, file_.errorString());
+		return false;
+	}
+
+	char header[cc_capture_file_header_size] = {};
+	std::memcpy(header, capture_magic, sizeof(capture_magic));
+	putLittleEndian<quint32>(header + 8, capture_format_version);
+	putLittleEndian<quint32>(header + 12, quint32(cc_capture_record_header_size));
+	putLittleEndian<qint64>(header + 16, QDateTime::currentMSecsSinceEpoch());
+	if (file_.write(header, sizeof(header)) != qint64(sizeof(header))) {
+		error_msg = QObject::tr("! Cannot write capture file \"%1\": %2").arg(file_name, file_.errorString());
+		file_.close();
+		return false;
+	}
+
+	buffer_used_ = 0;
+	buffered_record_count_ = 0;
+	ports_.clear();
+	clock_.start();
+	flush_timer_.start();
+	return true;
+}
+
+
+
+void CcWireCapture::close()
+{
+	QMutexLocker locker(&mutex_);
+	if (file_.isOpen()) {
+		flushLocked();
+		file_.close();
+	}
+}
+
+
+
+bool CcWireCapture::isOpen() const
+{
+	QMutexLocker locker(&mutex_);
+	return file_.isOpen();
+}
+
+
+
+quint16 CcWireCapture::registerPort(const QString& port_name)
+{
+	QMutexLocker locker(&mutex_);
+
+	auto iter = ports_.constFind(port_name);
+	if (iter != ports_.constEnd()) {
+		return iter.value();
+	}
+	const auto port_id = quint16(ports_.size());
+	ports_.insert(port_name, port_id);
+
+	const QByteArray name = port_name.toUtf8();
+	appendLocked(port_id, CcCaptureDirection::PortName, 0, name, 0);
+	return port_id;
+}
+
+
+
+void CcWireCapture::record(quint16 port_id, CcCaptureDirection direction, quint64 request_id, CcByteView data, quint8 flags)
+{
+	QMutexLocker locker(&mutex_);
+	appendLocked(port_id, direction, request_id, data, flags);
+}
+
+
+
+void CcWireCapture::flush()
+{
+	QMutexLocker locker(&mutex_);
+	flushLocked();
+}
+
+
+
+quint64 CcWireCapture::getRecordCount() const
+{
+	QMutexLocker locker(&mutex_);
+	return record_count_;
+}
+
+
+
+quint64 CcWireCapture::getDroppedCount() const
+{
+	QMutexLocker locker(&mutex_);
+	return dropped_count_;
+}
+
+
+
+void CcWireCapture::appendLocked(quint16 port_id, CcCaptureDirection direction, quint64 request_id, CcByteView data, quint8 flags)
+{
+	if (!file_.isOpen()) {
+		return;
+	}
+
+	const std::size_t record_size = std::size_t(cc_capture_record_header_size) + std::size_t(data.size());
+	if (buffer_used_ + record_size > buffer_.size()) {
+		flushLocked();
+	}
+	if (record_size > buffer_.size()) {
+		buffer_.resize(record_size);  // a single oversized record
+	}
+
+	char* header = buffer_.data() + buffer_used_;
+	putLittleEndian<quint64>(header, quint64(clock_.nsecsElapsed()));
+	putLittleEndian<quint64>(header + 8, request_id);
+	putLittleEndian<quint16>(header + 16, port_id);
+	header[18] = char(direction);
+	header[19] = char(flags);
+	putLittleEndian<quint32>(header + 20, quint32(data.size()));
+	if (!data.isEmpty()) {
+		std::memcpy(header + cc_capture_record_header_size, data.data(), std::size_t(data.size()));
+	}
+	buffer_used_ += record_size;
+	++buffered_record_count_;
+	++record_count_;
+
+	if (flush_timer_.hasExpired(flush_interval_msec_)) {
+		flushLocked();
+	}
+}
+
+
+
+void CcWireCapture::flushLocked()
+{
+	flush_timer_.start();
+	if (buffer_used_ == 0 || !file_.isOpen()) {
+		return;
+	}
+	if (file_.write(buffer_.data(), qint64(buffer_used_)) != qint64(buffer_used_)) {
+		dropped_count_ += buffered_record_count_;
+	}
+	file_.flush();
+	buffer_used_ = 0;
+	buffered_record_count_ = 0;
+}
+
+
+
+bool CcCaptureReader::open(const QString& file_name, QString& error_msg)
+{
+	close();
+
+	file_.setFileName(file_name);
+	if (!file_.open(QIODevice::ReadOnly)) {
+		error_msg = QObject::tr("! Cannot open capture file \"%1\": %2").arg(file_name, file_.errorString());
+		return false;
+	}
+	size_ = file_.size();
+	data_ = size_ > 0 ? file_.map(0, size_) : nullptr;
+	if (!data_ || size_ < cc_capture_file_header_size) {
+		error_msg = QObject::tr("! Cannot map capture file \"%1\", or the file is too small.").arg(file_name);
+		close();
+		return false;
+	}
+
+	if (std::memcmp(data_, capture_magic, sizeof(capture_magic)) != 0
+			|| getLittleEndian<quint32>(data_ + 8) != capture_format_version
+			|| getLittleEndian<quint32>(data_ + 12) != quint32(cc_capture_record_header_size)) {
+		error_msg = QObject::tr("! File \"%1\" is not a supported capture file.").arg(file_name);
+		close();
+		return false;
+	}
+	start_time_msec_ = getLittleEndian<qint64>(data_ + 16);
+
+	rewind();
+	return true;
+}
+
+
+
+void CcCaptureReader::close()
+{
+	if (data_) {
+		file_.unmap(const_cast<uchar*>(data_));
+		data_ = nullptr;
+	}
+	file_.close();
+	size_ = 0;
+	pos_ = 0;
+	port_names_.clear();
+}
+
+
+
+bool CcCaptureReader::next(CcCaptureRecord& record)
+{
+	if (!data_ || pos_ + cc_capture_record_header_size > size_) {
+		return false;
+	}
+
+	const uchar* header = data_ + pos_;
+	const auto data_size = qint64(getLittleEndian<quint32>(header + 20));
+	if (pos_ + cc_capture_record_header_size + data_size > size_) {
+		return false;  // truncated (e.g. the capture was not closed)
+	}
+	pos_ += cc_capture_record_header_size + data_size;
+
+	record.timestamp_nsec = getLittleEndian<quint64>(header);
+	record.request_id = getLittleEndian<quint64>(header + 8);
+	record.port_id = getLittleEndian<quint16>(header + 16);
+	record.direction = CcCaptureDirection(header[18]);
+	record.flags = quint8(header[19]);
+	record.data = CcByteView(reinterpret_cast<const char*>(header + cc_capture_record_header_size), int(data_size));
+
+	if (record.direction == CcCaptureDirection::PortName) {
+		port_names_.insert(record.port_id, QString::fromUtf8(record.data.data(), record.data.size()));
+	}
+	return true;
+}
+
+
+
+void CcCaptureReader::rewind()
+{
+	pos_ = cc_capture_file_header_size;
+}
+
+
+
+qint64 CcCaptureReader::getStartTime() const
+{
+	return start_time_msec_;
+}
+
+
+
+QString CcCaptureReader::getPortName(quint16 port_id) const
+{
+	return port_names_.value(port_id);
+}
+
+
+
+}
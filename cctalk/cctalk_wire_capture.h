@@ -0,0 +1,208 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef CCTALK_WIRE_CAPTURE_H
+#define CCTALK_WIRE_CAPTURE_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QFile>
+#include <QHash>
+#include <QVector>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <vector>
+
+#include "cctalk_frame.h"
+
+
+namespace qtcc {
+
+
+/**
+\file
+
+Binary wire capture of the serial worker traffic.
+
+A capture file starts with a file header, followed by records. Each record is a
+fixed-size header followed by the raw bytes:
+
+File header (24 bytes):
+- magic: 8 bytes, "QTCCCAP" followed by a zero byte
+- format version: uint32
+- record header size: uint32
+- capture start time: int64, UTC milliseconds since epoch
+
+Record header (24 bytes):
+- timestamp: uint64, nanoseconds since the capture start (monotonic clock)
+- request ID: uint64, bus-wide request ID, 0 if not applicable
+- port ID: uint16, assigned by a PortName record
+- direction: uint8, see CcCaptureDirection
+- flags: uint8, a combination of CcCaptureFlag values
+- data length: uint32
+
+All the fields are little-endian. Requests are recorded as full frames, responses
+as full reply frames without the local echo. The checksum mode of the frames is
+recorded in the flags, since the devices on a bus may use different ones.
+
+The records are appended to a preallocated buffer, which is written to the file when it's
+full, every flush interval (checked when recording), and on flush() / close().
+*/
+
+
+
+/// Record type
+enum class CcCaptureDirection : quint8 {
+	PortName = 0,  ///< Port registration. The data is the UTF-8 port name.
+	Request = 1,  ///< Request frame, recorded when written to the port
+	Response = 2,  ///< Reply frame (without the echo)
+	RequestTimeout = 3,  ///< Request write timeout. No data.
+	ResponseTimeout = 4,  ///< Response timeout. No data.
+};
+
+
+/// Record flags
+enum class CcCaptureFlag : quint8 {
+	None = 0,
+	Checksum16 = 1 << 0,  ///< The frame uses the 16-bit CRC checksum, not the 8-bit one
+};
+
+
+/// Capture file header size
+constexpr int cc_capture_file_header_size = 24;
+
+/// Capture record header size
+constexpr int cc_capture_record_header_size = 24;
+
+
+
+/// Binary traffic capture writer. All functions are thread-safe, so
+/// a single capture may be shared by serial workers in different threads.
+class CcWireCapture {
+	public:
+
+		/// Constructor
+		explicit CcWireCapture(int buffer_size = 1024 * 1024, int flush_interval_msec = 1000);
+
+		/// Destructor. Flushes and closes the file.
+		~CcWireCapture();
+
+		/// Non-copyable
+		CcWireCapture(const CcWireCapture& other) = delete;
+
+		/// Non-copyable
+		CcWireCapture& operator=(const CcWireCapture& other) = delete;
+
+
+		/// Create (truncate) the capture file and write the file header.
+		/// \return false on error, with \c error_msg set.
+		bool open(const QString& file_name, QString& error_msg);
+
+		/// Flush and close the file
+		void close();
+
+		/// Check if the file is open
+		[[nodiscard]] bool isOpen() const;
+
+
+		/// Get the port ID of \c port_name, recording a PortName record when a port is first seen
+		quint16 registerPort(const QString& port_name);
+
+		/// Append a record. \c flags is a combination of CcCaptureFlag values.
+		void record(quint16 port_id, CcCaptureDirection direction, quint64 request_id, CcByteView data = CcByteView(),
+				quint8 flags = 0);
+
+		/// Write the buffered records to the file
+		void flush();
+
+
+		/// Get the number of records written (or buffered) so far
+		[[nodiscard]] quint64 getRecordCount() const;
+
+		/// Get the number of records lost due to file write errors
+		[[nodiscard]] quint64 getDroppedCount() const;
+
+
+	private:
+
+		/// Append a record. The mutex must be locked.
+		void appendLocked(quint16 port_id, CcCaptureDirection direction, quint64 request_id, CcByteView data, quint8 flags);
+
+		/// Write the buffer to the file. The mutex must be locked.
+		void flushLocked();
+
+
+		mutable QMutex mutex_;  ///< Protects the members below
+		QFile file_;  ///< Capture file
+		std::vector<char> buffer_;  ///< Preallocated record buffer
+		std::size_t buffer_used_ = 0;  ///< Number of used bytes in buffer_
+		std::size_t buffered_record_count_ = 0;  ///< Number of records in buffer_
+		const int flush_interval_msec_;  ///< Maximum time the records may stay in the buffer
+		QElapsedTimer clock_;  ///< Record timestamp clock, started on open()
+		QElapsedTimer flush_timer_;  ///< Time since the last flush
+		QHash<QString, quint16> ports_;  ///< Port name -> port ID
+		quint64 record_count_ = 0;  ///< Number of records
+		quint64 dropped_count_ = 0;  ///< Number of records lost in write errors
+
+};
+
+
+
+/// A record read by CcCaptureReader
+struct CcCaptureRecord {
+	quint64 timestamp_nsec = 0;  ///< Nanoseconds since the capture start
+	quint64 request_id = 0;  ///< Request ID
+	quint16 port_id = 0;  ///< Port ID
+	CcCaptureDirection direction = CcCaptureDirection::PortName;  ///< Record type
+	quint8 flags = 0;  ///< Combination of CcCaptureFlag values
+	CcByteView data;  ///< Record data, pointing into the mapped file
+};
+
+
+
+/// Capture file reader. The file is memory-mapped, and the record data is not copied.
+class CcCaptureReader {
+	public:
+
+		/// Map the capture file and verify its header.
+		/// \return false on error, with \c error_msg set.
+		bool open(const QString& file_name, QString& error_msg);
+
+		/// Unmap and close the file
+		void close();
+
+
+		/// Read the next record. PortName records are handled here as well (see getPortName()).
+		/// \return false at the end of file, or if the rest of the file is truncated.
+		bool next(CcCaptureRecord& record);
+
+		/// Start reading from the first record again
+		void rewind();
+
+
+		/// Get the capture start time, UTC milliseconds since epoch
+		[[nodiscard]] qint64 getStartTime() const;
+
+		/// Get the name of a port registered by a PortName record read so far
+		[[nodiscard]] QString getPortName(quint16 port_id) const;
+
+
+	private:
+
+		QFile file_;  ///< Capture file
+		const uchar* data_ = nullptr;  ///< Mapped file data
+		qint64 size_ = 0;  ///< Mapped size
+		qint64 pos_ = 0;  ///< Read position
+		qint64 start_time_msec_ = 0;  ///< Capture start time
+		QHash<quint16, QString> port_names_;  ///< Port ID -> name
+
+};
+
+
+
+}
+
+
+#endif
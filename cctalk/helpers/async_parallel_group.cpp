@@ -0,0 +1,164 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <utility>
+#include <algorithm>
+
+#include "async_parallel_group.h"
+#include "debug.h"
+
+
+
+std::shared_ptr<AsyncJoin> AsyncJoin::create(int branch_count, FinishHandler finish_handler)
+{
+	return std::make_shared<AsyncJoin>(branch_count, std::move(finish_handler));
+}
+
+
+
+AsyncJoin::AsyncJoin(int branch_count, FinishHandler finish_handler)
+		: finish_handler_(std::move(finish_handler)),
+		errors_(std::max(branch_count, 0)),
+		arrived_(std::max(branch_count, 0), false),
+		remaining_count_(std::max(branch_count, 0))
+{
+	if (remaining_count_ == 0 && finish_handler_) {
+		finish_handler_(errors_);
+	}
+}
+
+
+
+void AsyncJoin::arrive(int branch_index, const QString& error_msg)
+{
+	DBG_ASSERT_RETURN_NONE(branch_index >= 0 && branch_index < arrived_.size());
+	DBG_ASSERT_RETURN_NONE(!arrived_.at(branch_index));  // each branch arrives once
+
+	arrived_[branch_index] = true;
+	errors_[branch_index] = error_msg;
+
+	if (--remaining_count_ == 0 && finish_handler_) {
+		// Release the handler (and any references it holds) after the call.
+		FinishHandler handler = std::move(finish_handler_);
+		finish_handler_ = nullptr;
+		handler(errors_);
+	}
+}
+
+
+
+std::function<void(const QString& error_msg)> AsyncJoin::getArrivalCallback(
+		const std::shared_ptr<AsyncJoin>& join, int branch_index)
+{
+	return [join, branch_index](const QString& error_msg) {
+		join->arrive(branch_index, error_msg);
+	};
+}
+
+
+
+bool AsyncJoin::isFinished() const
+{
+	return remaining_count_ == 0;
+}
+
+
+
+AsyncParallelGroup::AsyncParallelGroup(FinishHandler finish_handler, bool delete_this_on_finish)
+		: finish_handler_(std::move(finish_handler)), delete_this_on_finish_(delete_this_on_finish)
+{ }
+
+
+
+int AsyncParallelGroup::add(const AsyncParallelGroup::BranchFunc& func)
+{
+	DBG_ASSERT(!join_);  // cannot add branches after start()
+	branches_ << func;
+	return branches_.size() - 1;
+}
+
+
+
+bool AsyncParallelGroup::start()
+{
+	DBG_ASSERT_RETURN(!join_, false);
+
+	if (branches_.empty()) {
+		finish_handler_(this);
+		if (delete_this_on_finish_) {
+			delete this;
+		}
+		return false;
+	}
+
+	join_ = AsyncJoin::create(branches_.size(), [this](const QVector<QString>& errors) {
+		finish(errors);
+	});
+
+	// A branch may finish synchronously. Don't finish (and possibly delete this) until
+	// all the branches have been started.
+	starting_ = true;
+	const auto branches = branches_;
+	for (int i = 0; i < branches.size(); ++i) {
+		branches.at(i)(this, i);
+	}
+	starting_ = false;
+
+	if (finish_pending_) {
+		finish_pending_ = false;
+		finish(errors_);
+	}
+	return true;
+}
+
+
+
+void AsyncParallelGroup::finishBranch(int branch_index, const QString& error_msg)
+{
+	DBG_ASSERT_RETURN_NONE(join_);
+	auto join = join_;  // the finish handler may delete this
+	join->arrive(branch_index, error_msg);
+}
+
+
+
+QVector<QString> AsyncParallelGroup::getErrors() const
+{
+	return errors_;
+}
+
+
+
+bool AsyncParallelGroup::hasErrors() const
+{
+	return std::any_of(errors_.cbegin(), errors_.cend(), [](const QString& error_msg) {
+		return !error_msg.isEmpty();
+	});
+}
+
+
+
+int AsyncParallelGroup::getBranchCount() const
+{
+	return branches_.size();
+}
+
+
+
+void AsyncParallelGroup::finish(const QVector<QString>& errors)
+{
+	errors_ = errors;
+	if (starting_) {
+		finish_pending_ = true;
+		return;
+	}
+
+	// Don't hold any variable references in executor functors / lambdas.
+	branches_.clear();
+	finish_handler_(this);
+	if (delete_this_on_finish_) {
+		delete this;
+	}
+}
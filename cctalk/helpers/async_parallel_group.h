@@ -0,0 +1,122 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef ASYNC_PARALLEL_GROUP_H
+#define ASYNC_PARALLEL_GROUP_H
+
+#include <QObject>
+#include <QVector>
+#include <QString>
+
+#include <functional>
+#include <memory>
+
+
+
+/// Join point (barrier) for a fixed number of asynchronous branches.
+/// Each branch reports its completion (with an optional error) exactly once;
+/// the finish handler is called when the last one arrives, with the errors of all branches.
+/// Share it between the branches using std::shared_ptr (see create()).
+class AsyncJoin {
+	public:
+
+		/// Finish handler. \c errors has one element per branch, empty if the branch succeeded.
+		using FinishHandler = std::function<void(const QVector<QString>& errors)>;
+
+
+		/// Create a join point waiting for \c branch_count branches.
+		/// If \c branch_count is 0, the finish handler is called immediately.
+		[[nodiscard]] static std::shared_ptr<AsyncJoin> create(int branch_count, FinishHandler finish_handler);
+
+		/// Constructor. Prefer create().
+		AsyncJoin(int branch_count, FinishHandler finish_handler);
+
+		/// Report branch completion. Each branch must arrive exactly once.
+		/// The finish handler is called from the last arrive() call.
+		void arrive(int branch_index, const QString& error_msg = QString());
+
+		/// Get a callback which calls arrive() for \c branch_index, keeping this object alive.
+		[[nodiscard]] static std::function<void(const QString& error_msg)> getArrivalCallback(
+				const std::shared_ptr<AsyncJoin>& join, int branch_index);
+
+		/// Check if all branches have arrived
+		[[nodiscard]] bool isFinished() const;
+
+
+	private:
+
+		FinishHandler finish_handler_;  ///< Finish handler
+		QVector<QString> errors_;  ///< Branch errors
+		QVector<bool> arrived_;  ///< Branch completion flags
+		int remaining_count_ = 0;  ///< Number of branches that haven't arrived yet
+
+};
+
+
+
+/// Execute multiple independent jobs (e.g. AsyncSerializer chains) concurrently
+/// and call a single finish handler when all of them are finished.
+/// This is the parallel counterpart of AsyncSerializer.
+class AsyncParallelGroup : public QObject {
+	Q_OBJECT
+	public:
+
+		/// Constructor argument. Use getErrors() to get the per-branch results.
+		using FinishHandler = std::function<void(AsyncParallelGroup* group)>;
+
+		/// Branch executor function. The function (or one of its asynchronous callbacks)
+		/// must eventually call finishBranch() with \c branch_index.
+		using BranchFunc = std::function<void(AsyncParallelGroup* group, int branch_index)>;
+
+
+		/// Constructor. finish_handler is executed when all branches are finished.
+		explicit AsyncParallelGroup(FinishHandler finish_handler, bool delete_this_on_finish = true);
+
+		/// Add a branch executor function.
+		/// \return the branch index, as passed to the executor function.
+		int add(const BranchFunc& func);
+
+		/// Start all the branches (in order of addition). This function is non-blocking.
+		/// If there are no branches, the finish handler is called immediately.
+		/// Returns true if execution has started.
+		bool start();
+
+
+		/// This should be called from the branch executor's "finished" callback.
+		/// \c error_msg is empty if the branch succeeded.
+		void finishBranch(int branch_index, const QString& error_msg = QString());
+
+
+		/// Get the branch errors, one element per branch (empty if the branch succeeded).
+		/// Valid in the finish handler.
+		[[nodiscard]] QVector<QString> getErrors() const;
+
+		/// Check if any of the branches failed. Valid in the finish handler.
+		[[nodiscard]] bool hasErrors() const;
+
+		/// Get the number of branches
+		[[nodiscard]] int getBranchCount() const;
+
+
+	private:
+
+		/// Called by join_ when all branches are finished
+		void finish(const QVector<QString>& errors);
+
+
+		FinishHandler finish_handler_;  ///< Finish handler
+		bool delete_this_on_finish_ = false;  ///< Delete this object on finish
+		QVector<BranchFunc> branches_;  ///< Branch executor functions
+		std::shared_ptr<AsyncJoin> join_;  ///< Join point, created by start()
+		QVector<QString> errors_;  ///< Branch errors, set on finish
+		bool starting_ = false;  ///< True while start() runs the executors
+		bool finish_pending_ = false;  ///< All branches finished while starting_ was true
+
+};
+
+
+
+
+#endif
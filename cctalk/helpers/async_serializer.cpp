@@ -12,22 +12,20 @@ License: BSD-3-Clause
 
 AsyncSerializer::AsyncSerializer(FinishHandler finish_handler, bool delete_this_on_finish)
 		: finish_handler_(std::move(finish_handler)), delete_this_on_finish_(delete_this_on_finish)
-{
-	timer_.setSingleShot(true);
-}
+{ }
 
 
 
-void AsyncSerializer::add(const AsyncSerializer::ExecutorFunc& func)
+void AsyncSerializer::add(AsyncSerializer::ExecutorFunc func)
 {
-	executors_ << func;
+	executors_.append(std::move(func));
 }
 
 
 
 bool AsyncSerializer::start()
 {
-	if (executors_.empty()) {
+	if (executors_.isEmpty()) {
 		finish_handler_(this);
 		if (delete_this_on_finish_) {
 			delete this;
@@ -43,15 +41,20 @@ bool AsyncSerializer::start()
 
 void AsyncSerializer::continueSequence(bool queue_next)
 {
+	// Called from inside the executor function; executeNextFunc() handles it
+	// once the function returns.
+	if (executing_) {
+		continue_requested_ = true;
+		queue_next_ = queue_next;
+		return;
+	}
+
 	// If there are still some functions to go and the user wishes so, queue the next one.
-	if (queue_next && (current_func_index_ + 1 < executors_.size())) {
-		QObject::connect(&timer_, SIGNAL(timeout()), this, SLOT(executeNextFunc()), Qt::QueuedConnection);
-		timer_.start(0);  // it's a single-shot timer
+	// We may be deep inside some other object's callback here, so don't run it inline.
+	if (queue_next && hasNextFunc()) {
+		QMetaObject::invokeMethod(this, [this]() { executeNextFunc(); }, Qt::QueuedConnection);
 	} else {
-		current_func_index_ = -1;
-		executors_.clear();
-		finish_handler_(this);
-		delete this;
+		finish();
 	}
 }
 
@@ -59,20 +62,52 @@ void AsyncSerializer::continueSequence(bool queue_next)
 
 void AsyncSerializer::executeNextFunc()
 {
-	++current_func_index_;  // initially -1
+	// Functions that finish synchronously are chained in this loop instead of recursing.
+	while (true) {
+		++current_func_index_;  // initially -1
+
+		DBG_ASSERT(current_func_index_ < executors_.size());
+		if (current_func_index_ >= executors_.size()) {  // we reached the end (shouldn't happen)
+			current_func_index_ = -1;
+			return;
+		}
 
-	QTimer::disconnect(&timer_, nullptr, nullptr, nullptr);
+		// Moved out, so that clearing executors_ doesn't destroy the running function.
+		ExecutorFunc func = std::move(executors_[current_func_index_]);
+		DBG_ASSERT(func);
 
-	ExecutorFunc func = executors_.value(current_func_index_);
-	DBG_ASSERT(func);
-	if (!func) {  // we reached the end (shouldn't happen)
-		current_func_index_ = -1;
-		return;
+		continue_requested_ = false;
+		executing_ = true;
+		if (func) {
+			func(this);  // This may call continueSequence().
+		}
+		executing_ = false;
+
+		if (!continue_requested_) {
+			return;  // the function continues asynchronously
+		}
+		if (!queue_next_ || !hasNextFunc()) {
+			finish();
+			return;
+		}
 	}
+}
 
-	// Run the next job.
-	func(this);  // This may call stop().
+
+
+bool AsyncSerializer::hasNextFunc() const
+{
+	return current_func_index_ + 1 < executors_.size();
 }
 
 
 
+void AsyncSerializer::finish()
+{
+	current_func_index_ = -1;
+	executors_.clear();
+	finish_handler_(this);
+	if (delete_this_on_finish_) {
+		delete this;
+	}
+}
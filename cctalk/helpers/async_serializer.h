@@ -7,8 +7,7 @@ License: BSD-3-Clause
 #define ASYNC_SERIALIZER_H
 
 #include <QObject>
-#include <QVector>
-#include <QTimer>
+#include <QVarLengthArray>
 
 #include <functional>
 
@@ -33,11 +32,13 @@ class AsyncSerializer : public QObject {
 		explicit AsyncSerializer(FinishHandler finish_handler, bool delete_this_on_finish = true);
 
 		/// Add an executor function to function list.
-		void add(const ExecutorFunc& func);
+		void add(ExecutorFunc func);
 
 		/// Start executing the functions. This function is non-blocking.
-		/// When a function call is finished, the next function from the list is executed
-		/// on the next event loop iteration (QTimer::singleShot()).
+		/// When a function finishes asynchronously (from a callback), the next function
+		/// from the list is executed on the next event loop iteration (a single queued
+		/// invocation). When it finishes synchronously (calls continueSequence() before
+		/// returning), the next function is executed right away, without recursion.
 		/// Returns true if execution has started.
 		bool start();
 
@@ -57,12 +58,25 @@ class AsyncSerializer : public QObject {
 
 	private:
 
-		QTimer timer_;  ///< Single-shot timer
+		/// Check if there is a function after the current one
+		[[nodiscard]] bool hasNextFunc() const;
+
+		/// Clear the executors, call the finish handler and delete this if requested.
+		void finish();
+
+
+		/// Number of executors stored without a heap allocation
+		static constexpr int inline_executor_count = 16;
+
 		FinishHandler finish_handler_;  ///< Finish handler
 		bool delete_this_on_finish_ = false;  ///< Delete this object on finish
-		QVector<ExecutorFunc> executors_;  ///< Executor functions
+		QVarLengthArray<ExecutorFunc, inline_executor_count> executors_;  ///< Executor functions, moved out when executed
 		int current_func_index_ = 0;  ///< An index of currently executing function in executors_.
 
+		bool executing_ = false;  ///< True while an executor function runs (synchronous part)
+		bool continue_requested_ = false;  ///< continueSequence() was called while executing_
+		bool queue_next_ = false;  ///< continueSequence() argument, if continue_requested_
+
 };
 
 
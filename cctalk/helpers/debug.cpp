@@ -4,15 +4,20 @@ License: BSD-3-Clause
 ***************************************************************************/
 
 #include <cstdarg>  // va_*
+#include <cstdio>  // std::vsnprintf
 #include <map>
+#include <memory>
 #include <ostream>
 #include <vector>
 #include <fstream>
 #include <ios>  // std::ios::*
 #include <cstddef>  // std::size_t
 #include <cstdlib>  // std::exit, SUCCESS_FAILURE
+#include <algorithm>  // std::min
 #include <QMutex>
 #include <QMutexLocker>
+#include <QThread>
+#include <QWaitCondition>
 
 #ifndef _WIN32
 	#include <syslog.h>
@@ -20,6 +25,7 @@ License: BSD-3-Clause
 #endif
 
 #include "debug.h"
+#include "lockfree_ring.h"
 
 
 /// \def HAVE_WIN_SE_FUNCS
@@ -107,7 +113,64 @@ namespace {
 
 	/// This is not thread-safe, modify from a single thread only, before other threads
 	/// can access it. The actual writing is thread-safe.
-	std::map<debug_level::flag, std::pair<QMutex*, std::string> > s_debug_output_files;
+	std::map<debug_level::flag, std::pair<std::shared_ptr<QMutex>, std::string> > s_debug_output_files;
+
+
+	/// Maximum message size of the async sink, longer messages are truncated
+	constexpr std::size_t debug_async_max_message_size = 1024;
+
+	/// Message queued for the async sink. Stored in the ring slot itself, so queueing
+	/// a message doesn't allocate.
+	struct DebugAsyncRecord {
+		debug_level::flag level = debug_level::none;
+		unsigned long dests = 0;  ///< debug_dest::file and / or debug_dest::syslog
+		std::size_t size = 0;  ///< Number of valid bytes in text
+		char text[debug_async_max_message_size] = {};  ///< Message, not null-terminated
+	};
+
+	/// Async sink queue. Created by debug_start_async_sink() and kept until exit.
+	std::unique_ptr<MpscRing<DebugAsyncRecord>> s_debug_async_ring;
+
+	/// Async sink thread
+	std::unique_ptr<QThread> s_debug_async_thread;
+
+	/// True while the async sink thread accepts messages
+	std::atomic<bool> s_debug_async_running = {false};
+
+	/// Producers between checking s_debug_async_running and finishing their push
+	std::atomic<int> s_debug_async_in_flight = {0};
+
+	/// True if the async sink thread has been (or is being) woken up since its last wait
+	std::atomic<bool> s_debug_async_notify_pending = {false};
+
+	/// Protects the async sink thread wait
+	QMutex s_debug_async_wait_mutex;
+
+	/// Wakes up the async sink thread
+	QWaitCondition s_debug_async_wait_condition;
+
+	/// Messages dropped due to a full ring
+	std::atomic<std::uint64_t> s_debug_async_dropped_count = {0};
+
+
+
+	/// Update debug_internal::active_levels after changing the settings above
+	void debug_update_active_levels()
+	{
+		unsigned long active = 0;
+		if (s_debug_global_enabled) {
+			for (auto level : {debug_level::dump, debug_level::info, debug_level::warn, debug_level::error, debug_level::fatal}) {
+				auto iter = s_debug_default_dests.find(level);
+				// A level without default destinations still reports that, see debug_send_to_stream().
+				if (iter == s_debug_default_dests.end()
+						|| (iter->second.to_ulong() & ~static_cast<unsigned long>(debug_dest::def)) != 0) {
+					active |= level;
+				}
+			}
+			active |= s_debug_abort_on_levels.to_ulong();
+		}
+		debug_internal::active_levels.store(active, std::memory_order_relaxed);
+	}
 
 }
 
@@ -147,6 +210,7 @@ namespace debug_level {
 void debug_global_enable(bool enabled)
 {
 	s_debug_global_enabled = enabled;
+	debug_update_active_levels();
 }
 
 
@@ -159,6 +223,7 @@ void debug_set_default_dests(debug_level::type levels, debug_dest::type dests)
 	for(auto iter : matched) {
 		s_debug_default_dests[iter] = dests;
 	}
+	debug_update_active_levels();
 }
 
 
@@ -166,6 +231,7 @@ void debug_set_default_dests(debug_level::type levels, debug_dest::type dests)
 void debug_set_abort_on_levels(debug_level::type levels)
 {
 	s_debug_abort_on_levels = levels;
+	debug_update_active_levels();
 }
 
 
@@ -191,6 +257,19 @@ void debug_set_application_name(const std::string& name)
 
 
 
+void debug_set_file(debug_level::type levels, const std::string& file)
+{
+	std::vector<debug_level::flag> matched;
+	debug_level::get_matched_levels_array(levels, matched);
+
+	auto mutex = std::make_shared<QMutex>();  // shared by all levels writing to this file
+	for (auto iter : matched) {
+		s_debug_output_files[iter] = std::make_pair(mutex, file);
+	}
+}
+
+
+
 namespace {
 
 	/// Holder for (internal) debug_format::flag enum and related.
@@ -247,6 +326,107 @@ namespace {
 
 
 
+	/// Write a message to the syslog and file destinations in \c dests.
+	/// Called directly or from the async sink thread.
+	void debug_write_slow_dests(debug_level::flag level, unsigned long val, const std::string& msg)
+	{
+#ifndef _WIN32
+		if (val & debug_dest::syslog) {
+			int priority = LOG_ALERT;  // internal error, invalid level.
+			switch(level) {
+				case debug_level::dump: priority = LOG_DEBUG; break;
+				case debug_level::info: priority = LOG_INFO; break;
+				case debug_level::warn: priority = LOG_WARNING; break;
+				case debug_level::error: priority = LOG_ERR; break;
+				case debug_level::fatal: priority = LOG_CRIT; break;
+				default: break;  // shut up compiler
+			}
+
+			// Log to syslog server.
+			openlog(s_debug_application_name.c_str(), LOG_PID, LOG_USER);
+			syslog(priority, "%s", debug_format_message(level, debug_format::none, msg).c_str());
+			closelog();
+		}
+#endif
+
+
+
+		if (val & debug_dest::file) {
+			auto iter = s_debug_output_files.find(level);
+
+			if (iter != s_debug_output_files.end()) {
+				std::string file = iter->second.second;
+				QMutexLocker locker(iter->second.first.get());
+				if (!file.empty()) {
+					// Open it each time. This will hopefully help with avoiding fs buffers and ntfs corruption.
+					std::ofstream of(file.c_str(), std::ios::app | std::ios::out | std::ios::binary);  // append
+					if (of.fail()) {
+						// failed, send the error to all the other destinations
+						debug_send_to_stream(debug_level::error,
+								"debug_send_to_stream(): Could not open log file \"" + file + "\" for writing.",
+								debug_dest::type(val & ~static_cast<unsigned long>(debug_dest::file)));
+					}
+
+					debug_format::type flags = debug_format::level | debug_format::appname | debug_format::time;
+
+					of << debug_format_message(level, flags, msg) << "\n";
+
+					of.close();
+
+					if (of.fail()) {
+						// failed, send the error to all the other destinations
+						debug_send_to_stream(debug_level::error,
+								"debug_send_to_stream(): Could not write/close log file \"" + file + "\".",
+								debug_dest::type(val & ~static_cast<unsigned long>(debug_dest::file)));
+					}
+				}
+			}
+		}
+	}
+
+
+
+	/// Write all the queued async sink messages.
+	/// \return false if there was nothing to write.
+	bool debug_drain_async_ring()
+	{
+		bool written = false;
+		DebugAsyncRecord record;
+		while (s_debug_async_ring->pop(record)) {
+			debug_write_slow_dests(record.level, record.dests, std::string(record.text, record.size));
+			written = true;
+		}
+		return written;
+	}
+
+
+
+	/// Queue a message for the async sink thread and wake it up if it's waiting.
+	/// \return false if the ring is full.
+	bool debug_push_async_record(debug_level::flag level, unsigned long dests, const std::string& msg)
+	{
+		DebugAsyncRecord record;
+		record.level = level;
+		record.dests = dests;
+		record.size = std::min(msg.size(), debug_async_max_message_size);
+		msg.copy(record.text, record.size);
+		if (record.size < msg.size()) {
+			std::fill_n(record.text + record.size - 3, 3, '.');  // truncated
+		}
+		if (!s_debug_async_ring->push(record)) {
+			return false;
+		}
+
+		// Only the first producer after the thread wakes up needs to lock the mutex.
+		if (!s_debug_async_notify_pending.exchange(true, std::memory_order_acq_rel)) {
+			QMutexLocker locker(&s_debug_async_wait_mutex);
+			s_debug_async_wait_condition.wakeOne();
+		}
+		return true;
+	}
+
+
+
 }  // anon ns
 
 
@@ -302,89 +482,135 @@ void debug_send_to_stream(debug_level::flag level, const std::string& msg, debug
 
 
 
-#ifndef _WIN32
-	if (val & debug_dest::syslog) {
-		int priority = LOG_ALERT;  // internal error, invalid level.
-		switch(level) {
-			case debug_level::dump: priority = LOG_DEBUG; break;
-			case debug_level::info: priority = LOG_INFO; break;
-			case debug_level::warn: priority = LOG_WARNING; break;
-			case debug_level::error: priority = LOG_ERR; break;
-			case debug_level::fatal: priority = LOG_CRIT; break;
-			default: break;  // shut up compiler
+	if (val & (debug_dest::syslog | debug_dest::file)) {
+		// Written from the async sink thread, unless the program is about to abort.
+		// debug_stop_async_sink() waits for the in-flight producers before the final drain.
+		const bool aborting = (s_debug_abort_on_levels.to_ulong() & level);
+		s_debug_async_in_flight.fetch_add(1, std::memory_order_seq_cst);
+		if (!aborting && s_debug_async_running.load(std::memory_order_seq_cst)) {
+			if (!debug_push_async_record(level, val & (debug_dest::syslog | debug_dest::file), msg)) {
+				s_debug_async_dropped_count.fetch_add(1, std::memory_order_relaxed);
+			}
+			s_debug_async_in_flight.fetch_sub(1, std::memory_order_release);
+		} else {
+			s_debug_async_in_flight.fetch_sub(1, std::memory_order_release);
+			debug_write_slow_dests(level, val, msg);
 		}
+	}
+
 
-		// Log to syslog server.
-		openlog(s_debug_application_name.c_str(), LOG_PID, LOG_USER);
-		syslog(priority, "%s", debug_format_message(level, debug_format::none, msg).c_str());
-		closelog();
+
+	// if fatal, exit
+	if (s_debug_abort_on_levels.to_ulong() & level) {
+		throw DebugFatalException(msg.c_str());
+		// Note that Qt doesn't support throwing exceptions from slots, so we have
+		// to catch them in QApplication::notify().
+		// We could call exit() (no stack unwind, but calls static object destructors
+		// and flushes C streams), but it's hard to get automatic core dump or backtrace
+		// from it.
+		// We could call abort() (no unwind at all), but it's too brutal.
 	}
-#endif
+
+}
 
 
 
-	if (val & debug_dest::file) {
-		auto iter = s_debug_output_files.find(level);
 
-		if (iter != s_debug_output_files.end()) {
-			std::string file = iter->second.second;
-			QMutexLocker locker(iter->second.first);
-			if (!file.empty()) {
-				// Open it each time. This will hopefully help with avoiding fs buffers and ntfs corruption.
-				std::ofstream of(file.c_str(), std::ios::app | std::ios::out | std::ios::binary);  // append
-				if (of.fail()) {
-					// failed, send the error to all the other destinations
-					debug_send_to_stream(debug_level::error,
-							"debug_send_to_stream(): Could not open log file \"" + file + "\" for writing.",
-							dests & ~debug_dest::type(debug_dest::file));
-				}
+void debug_print(debug_level::flag level, debug_dest::type dests, const char* format, ...)
+{
+	if ((dests.to_ulong() & debug_dest::def) && !debug_level_enabled(level)) {
+		return;  // don't format it
+	}
+
+	std::va_list ap;
+	va_start(ap, format);
+
+	std::va_list ap_size;
+	va_copy(ap_size, ap);
+	const int size = std::vsnprintf(nullptr, 0, format, ap_size);
+	va_end(ap_size);
+
+	std::string s;
+	if (size > 0) {
+		s.resize(std::size_t(size));
+		std::vsnprintf(s.data(), s.size() + 1, format, ap);
+	}
+
+	va_end(ap);
+	debug_send_to_stream(level, s, dests);
+}
 
-				debug_format::type flags = debug_format::level | debug_format::appname | debug_format::time;
 
-				of << debug_format_message(level, flags, msg) << "\n";
 
-				of.close();
+bool debug_start_async_sink(std::size_t capacity)
+{
+	if (s_debug_async_running.load(std::memory_order_relaxed)) {
+		return false;  // already running
+	}
+	// No producer holds the ring while the sink is stopped.
+	if (!s_debug_async_ring || s_debug_async_ring->getCapacity() < capacity) {
+		s_debug_async_ring = std::make_unique<MpscRing<DebugAsyncRecord>>(capacity);
+	}
 
-				if (of.fail()) {
-					// failed, send the error to all the other destinations
-					debug_send_to_stream(debug_level::error,
-							"debug_send_to_stream(): Could not write/close log file \"" + file + "\".",
-							dests & ~debug_dest::type(debug_dest::file));
+	s_debug_async_running.store(true, std::memory_order_seq_cst);
+	s_debug_async_thread.reset(QThread::create([]() {
+		std::uint64_t reported_dropped_count = s_debug_async_dropped_count.load(std::memory_order_relaxed);
+		while (true) {
+			{
+				QMutexLocker locker(&s_debug_async_wait_mutex);
+				while (!s_debug_async_notify_pending.load(std::memory_order_acquire)
+						&& s_debug_async_running.load(std::memory_order_acquire)) {
+					s_debug_async_wait_condition.wait(&s_debug_async_wait_mutex);
 				}
 			}
+			// Any push after this is followed by another wakeup.
+			s_debug_async_notify_pending.exchange(false, std::memory_order_acq_rel);
+
+			if (!s_debug_async_running.load(std::memory_order_acquire)) {
+				break;  // debug_stop_async_sink() drains the rest
+			}
+			debug_drain_async_ring();
+
+			const std::uint64_t dropped_count = s_debug_async_dropped_count.load(std::memory_order_relaxed);
+			if (dropped_count != reported_dropped_count) {
+				debug_send_to_stream(debug_level::warn, "debug_start_async_sink(): "
+						+ std::to_string(dropped_count - reported_dropped_count) + " messages dropped, the queue is full.");
+				reported_dropped_count = dropped_count;
+			}
 		}
-	}
+	}));
+	s_debug_async_thread->start(QThread::LowPriority);
+	return true;
+}
 
 
 
-	// if fatal, exit
-	if (s_debug_abort_on_levels.to_ulong() & level) {
-		throw DebugFatalException(msg.c_str());
-		// Note that Qt doesn't support throwing exceptions from slots, so we have
-		// to catch them in QApplication::notify().
-		// We could call exit() (no stack unwind, but calls static object destructors
-		// and flushes C streams), but it's hard to get automatic core dump or backtrace
-		// from it.
-		// We could call abort() (no unwind at all), but it's too brutal.
+void debug_stop_async_sink()
+{
+	if (!s_debug_async_thread) {
+		return;
+	}
+	s_debug_async_running.store(false, std::memory_order_seq_cst);
+	{
+		QMutexLocker locker(&s_debug_async_wait_mutex);
+		s_debug_async_wait_condition.wakeOne();
 	}
+	s_debug_async_thread->wait();
+	s_debug_async_thread.reset();
 
+	// The producers that saw the sink running may still be pushing. The new ones write directly.
+	while (s_debug_async_in_flight.load(std::memory_order_acquire) != 0) {
+		QThread::yieldCurrentThread();
+	}
+	debug_drain_async_ring();
 }
 
 
 
-
-//
-// void debug_print(debug_level::flag level, debug_dest::type dests, const char* format, ...)
-// {
-// 	std::va_list ap;
-// 	va_start(ap, format);
-//
-// 	std::string s = hz::string_vsprintf(format, ap);
-//
-// 	va_end(ap);
-// 	debug_send_to_stream(level, s, dests);
-// }
-//
+std::uint64_t debug_get_async_sink_dropped_count()
+{
+	return s_debug_async_dropped_count.load(std::memory_order_relaxed);
+}
 
 
 
@@ -6,7 +6,9 @@ License: BSD-3-Clause
 #ifndef DEBUG_H
 #define DEBUG_H
 
+#include <atomic>
 #include <bitset>
+#include <cstdint>
 #include <string>
 #include <sstream>
 #include <exception>  // std::exception
@@ -152,6 +154,42 @@ namespace debug_dest {
 
 
 
+/** \def DEBUG_MIN_LEVEL
+Compile-time minimum level, as a debug_level::flag value. debug_out_*() and debug_print_*()
+calls below it are compiled out entirely, including the formatting of their arguments.
+The error and fatal levels (and so the assertions) are always compiled in.
+Release builds compile out dump and info levels, see helpers/CMakeLists.txt.
+*/
+#ifndef DEBUG_MIN_LEVEL
+	#define DEBUG_MIN_LEVEL debug_level::dump
+#endif
+
+
+/// Check if messages of \c level are compiled in, see DEBUG_MIN_LEVEL.
+constexpr bool debug_level_compiled_in(debug_level::flag level)
+{
+	return level >= debug_level::error || level >= debug_level::flag(DEBUG_MIN_LEVEL);
+}
+
+
+namespace debug_internal {
+
+	/// Levels that have at least one default destination (or abort the program).
+	/// Updated by the management functions below.
+	inline std::atomic<unsigned long> active_levels = {debug_level::all};
+
+}
+
+
+/// Check if a message of \c level sent to the default destinations would go anywhere.
+/// This is checked before formatting the message.
+inline bool debug_level_enabled(debug_level::flag level)
+{
+	return (debug_internal::active_levels.load(std::memory_order_relaxed) & level) != 0;
+}
+
+
+
 
 // -------------------------------- Management interface
 
@@ -207,6 +245,40 @@ COMMON_SYSTEM_LIBRARY_EXPORT
 void debug_set_application_name(const std::string& name);
 
 
+/// Set the file for debug_dest::file messages of \c levels. The file is appended to.
+/// Set to empty string to disable.
+/// This function is not thread-safe, so it must be called from the main thread
+/// before the other threads start using libdebug.
+COMMON_SYSTEM_LIBRARY_EXPORT
+void debug_set_file(debug_level::type levels, const std::string& file);
+
+
+/// Write debug_dest::file and debug_dest::syslog messages from a background thread.
+/// The message is queued into a lock-free ring of \c capacity messages and the calling
+/// thread (e.g. a serial worker) never waits for the disk or the syslog daemon; if the
+/// ring is full, the message is dropped (see debug_get_async_sink_dropped_count()).
+/// The ring slots are allocated once, messages longer than 1024 bytes are truncated.
+/// Messages of the abort levels are still written directly, and so are the console
+/// and custom destinations, to keep them ordered with the program's other output.
+/// This function is not thread-safe, so it must be called from the main thread
+/// before the other threads start using libdebug.
+COMMON_SYSTEM_LIBRARY_EXPORT
+bool debug_start_async_sink(std::size_t capacity = 1024);
+
+
+/// Write the queued messages and stop the background thread. The messages are
+/// written directly again after that. Waits for the threads still queueing a message.
+/// This function is not thread-safe, so it must be called from the main thread
+/// after the other threads have stopped using libdebug.
+COMMON_SYSTEM_LIBRARY_EXPORT
+void debug_stop_async_sink();
+
+
+/// Get the number of messages dropped due to a full async sink ring
+COMMON_SYSTEM_LIBRARY_EXPORT
+std::uint64_t debug_get_async_sink_dropped_count();
+
+
 
 
 // -------------------------------- Stream-like interface
@@ -226,25 +298,22 @@ void debug_send_to_stream(debug_level::flag level, const std::string& msg,
 
 // Convenience macros
 
-#define debug_out_dump(output) \
-	{ std::stringstream debug_ss; 	debug_ss << output; \
-		debug_send_to_stream(debug_level::dump, debug_ss.str()); }
+/// Implementation of debug_out_*(). The message is only formatted if \c level
+/// is compiled in and has a destination.
+#define debug_internal_out(level, output) \
+	{ if (debug_level_compiled_in(level) && debug_level_enabled(level)) { \
+		std::stringstream debug_ss; 	debug_ss << output; \
+		debug_send_to_stream(level, debug_ss.str()); } }
+
+#define debug_out_dump(output) debug_internal_out(debug_level::dump, output)
 
-#define debug_out_info(output) \
-	{ std::stringstream debug_ss; 	debug_ss << output; \
-		debug_send_to_stream(debug_level::info, debug_ss.str()); }
+#define debug_out_info(output) debug_internal_out(debug_level::info, output)
 
-#define debug_out_warn(output) \
-	{ std::stringstream debug_ss; 	debug_ss << output; \
-		debug_send_to_stream(debug_level::warn, debug_ss.str()); }
+#define debug_out_warn(output) debug_internal_out(debug_level::warn, output)
 
-#define debug_out_error(output) \
-	{ std::stringstream debug_ss; 	debug_ss << output; \
-		debug_send_to_stream(debug_level::error, debug_ss.str()); }
+#define debug_out_error(output) debug_internal_out(debug_level::error, output)
 
-#define debug_out_fatal(output) \
-	{ std::stringstream debug_ss; 	debug_ss << output; \
-		debug_send_to_stream(debug_level::fatal, debug_ss.str()); }
+#define debug_out_fatal(output) debug_internal_out(debug_level::fatal, output)
 
 
 
@@ -252,26 +321,30 @@ void debug_send_to_stream(debug_level::flag level, const std::string& msg,
 
 
 /// A printf()-like interface to debug_send_to_stream().
+/// The message is not formatted if sent to default destinations of a disabled level.
 COMMON_SYSTEM_LIBRARY_EXPORT
 void debug_print(debug_level::flag level, debug_dest::type dests,
 		const char* format, ...);
 
 
+/// Implementation of debug_print_*(), compiled out below DEBUG_MIN_LEVEL
+#define debug_internal_print(level, dests, ...) \
+	(debug_level_compiled_in(level) ? debug_print(level, dests, __VA_ARGS__) : void())
 
 #define debug_print_dump(dests, ...) \
-	debug_print(debug_level::dump, dests, __VA_ARGS__)
+	debug_internal_print(debug_level::dump, dests, __VA_ARGS__)
 
 #define debug_print_info(dests, ...) \
-	debug_print(debug_level::info, dests, __VA_ARGS__)
+	debug_internal_print(debug_level::info, dests, __VA_ARGS__)
 
 #define debug_print_warn(dests, ...) \
-	debug_print(debug_level::warn, dests, __VA_ARGS__)
+	debug_internal_print(debug_level::warn, dests, __VA_ARGS__)
 
 #define debug_print_error(dests, ...) \
-	debug_print(debug_level::error, dests, __VA_ARGS__)
+	debug_internal_print(debug_level::error, dests, __VA_ARGS__)
 
 #define debug_print_fatal(dests, ...) \
-	debug_print(debug_level::fatal, dests, __VA_ARGS__)
+	debug_internal_print(debug_level::fatal, dests, __VA_ARGS__)
 
 
 
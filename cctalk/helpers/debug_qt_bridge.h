@@ -7,14 +7,14 @@ License: BSD-3-Clause
 #define DEBUG_QT_BRIDGE_H
 
 #include <QtGlobal>
-#include <QMutex>
+#include <atomic>
 #include "debug.h"
 
 
 namespace DebugQtMessageFlagsHolder {
 
-	inline bool suppress_messages = false;
-	inline QMutex mutex;
+	/// Checked for each Qt message, from any thread
+	inline std::atomic<bool> suppress_messages = {false};
 
 }
 
@@ -22,10 +22,7 @@ namespace DebugQtMessageFlagsHolder {
 /// Enable / disable showing of Qt messages. Returns the old value.
 inline bool debug_qt_suppress_messages(bool suppress)
 {
-	QMutexLocker locker(&DebugQtMessageFlagsHolder::mutex);
-	bool old_value = DebugQtMessageFlagsHolder::suppress_messages;
-	DebugQtMessageFlagsHolder::suppress_messages = suppress;
-	return old_value;
+	return DebugQtMessageFlagsHolder::suppress_messages.exchange(suppress, std::memory_order_relaxed);
 }
 
 
@@ -50,44 +47,23 @@ class DebugQtError : public std::logic_error {
 
 inline void debug_qt5_message_handler(QtMsgType type, const QMessageLogContext& context, const QString& msg)
 {
-	{
-		QMutexLocker locker(&DebugQtMessageFlagsHolder::mutex);
-		if (DebugQtMessageFlagsHolder::suppress_messages) {
-			// fatal errors still abort (Qt does that).
-			return;
-		}
-	}
-
-	std::string function = (context.function ? context.function : "");
-	std::string file = (context.file ? context.file : "");
-// 	int line = context.line;
-	std::string category = (context.category ? context.category : "");
-
-	std::string cat = "Qt";
-	if (!category.empty()) {
-		cat = "Qt " + category;
-	}
-
-	std::string decorated_message = std::string("[") + cat + "] " + msg.toUtf8().constData();
-	if (!function.empty()) {
-		decorated_message += std::string("\nFunction: ") + function;
+	if (DebugQtMessageFlagsHolder::suppress_messages.load(std::memory_order_relaxed)) {
+		// fatal errors still abort (Qt does that).
+		return;
 	}
 
+	debug_level::flag level = debug_level::error;
 	switch (type) {
 		case QtDebugMsg:
-			debug_out_info(decorated_message);
-			break;
 		case QtInfoMsg:
-			debug_out_info(decorated_message);
+			level = debug_level::info;
 			break;
 		case QtWarningMsg:
-			debug_out_warn(decorated_message);
+			level = debug_level::warn;
 			break;
 		case QtCriticalMsg:
-			debug_out_error(decorated_message);
-			break;
 		case QtFatalMsg:  // QVector uses Q_ASSERT(), which uses qFatal().
-			debug_out_error(decorated_message);  // just prints the message (don't use "fatal", it aborts).
+			// Just print the message (don't use "fatal", it aborts).
 			// Qt does not support throwing exceptions from message handler
 			// (it has calling functions marked as noexcept), so we can only print here.
 			// Fatal messages in Qt will cause a break in Windows debugger and
@@ -95,9 +71,31 @@ inline void debug_qt5_message_handler(QtMsgType type, const QMessageLogContext&
 			// We _could_ define Q_ASSERT() and Q_ASSERT_X() to something throwing
 			// (project-wide), but cmake doesn't support function-like macro definition and
 			// it can cause trouble in Qt since it's not designed for exception safety.
-// 			throw DebugQtError(msg, category, function, file, line);
+			level = debug_level::error;
 			break;
 	}
+
+	// Don't decorate the messages that go nowhere.
+	if (!debug_level_compiled_in(level) || !debug_level_enabled(level)) {
+		return;
+	}
+
+	std::string function = (context.function ? context.function : "");
+	std::string file = (context.file ? context.file : "");
+// 	int line = context.line;
+	std::string category = (context.category ? context.category : "");
+
+	std::string cat = "Qt";
+	if (!category.empty()) {
+		cat = "Qt " + category;
+	}
+
+	std::string decorated_message = std::string("[") + cat + "] " + msg.toUtf8().constData();
+	if (!function.empty()) {
+		decorated_message += std::string("\nFunction: ") + function;
+	}
+
+	debug_send_to_stream(level, decorated_message);
 }
 
 
@@ -0,0 +1,311 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef LOCKFREE_RING_H
+#define LOCKFREE_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+
+
+/// Round \c value up to a power of two (at least 2)
+constexpr std::size_t lockfreeRingRoundCapacity(std::size_t value)
+{
+	std::size_t capacity = 2;
+	while (capacity < value) {
+		capacity *= 2;
+	}
+	return capacity;
+}
+
+
+/// Assumed cache line size, to keep the producer and consumer positions apart
+constexpr std::size_t lockfree_ring_cache_line_size = 64;
+
+
+
+/// Bounded single-producer, single-consumer lock-free ring buffer.
+/// push() may be called from one thread and pop() from another one.
+template<typename T>
+class SpscRing {
+	static_assert(std::is_trivially_copyable_v<T>, "SpscRing elements must be trivially copyable");
+
+	public:
+
+		/// Constructor. The capacity is rounded up to a power of two.
+		explicit SpscRing(std::size_t capacity)
+				: capacity_(lockfreeRingRoundCapacity(capacity)), buffer_(new T[capacity_])
+		{ }
+
+		/// Add an element. Returns false if the ring is full.
+		bool push(const T& value)
+		{
+			const std::size_t head = head_.load(std::memory_order_relaxed);
+			if (head - tail_.load(std::memory_order_acquire) >= capacity_) {
+				return false;
+			}
+			buffer_[head & (capacity_ - 1)] = value;
+			head_.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		/// Remove the oldest element. Returns false if the ring is empty.
+		bool pop(T& value)
+		{
+			const std::size_t tail = tail_.load(std::memory_order_relaxed);
+			if (tail == head_.load(std::memory_order_acquire)) {
+				return false;
+			}
+			value = buffer_[tail & (capacity_ - 1)];
+			tail_.store(tail + 1, std::memory_order_release);
+			return true;
+		}
+
+		/// Get the capacity
+		[[nodiscard]] std::size_t getCapacity() const
+		{
+			return capacity_;
+		}
+
+
+	private:
+
+		const std::size_t capacity_;  ///< Power of two
+		std::unique_ptr<T[]> buffer_;  ///< Elements
+		alignas(lockfree_ring_cache_line_size) std::atomic<std::size_t> head_ = {0};  ///< Next write position (producer)
+		alignas(lockfree_ring_cache_line_size) std::atomic<std::size_t> tail_ = {0};  ///< Next read position (consumer)
+
+};
+
+
+
+/// Bounded multi-producer, single-consumer lock-free ring buffer
+/// (Dmitry Vyukov's bounded queue, with a single consumer).
+/// push() may be called from any number of threads and pop() from one thread.
+template<typename T>
+class MpscRing {
+	static_assert(std::is_trivially_copyable_v<T>, "MpscRing elements must be trivially copyable");
+
+	public:
+
+		/// Constructor. The capacity is rounded up to a power of two.
+		explicit MpscRing(std::size_t capacity)
+				: capacity_(lockfreeRingRoundCapacity(capacity)), cells_(new Cell[capacity_])
+		{
+			for (std::size_t i = 0; i < capacity_; ++i) {
+				cells_[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		/// Add an element. Returns false if the ring is full.
+		bool push(const T& value)
+		{
+			Cell* cell = nullptr;
+			std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+			while (true) {
+				cell = &cells_[pos & (capacity_ - 1)];
+				const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+				const auto diff = std::intptr_t(sequence) - std::intptr_t(pos);
+				if (diff == 0) {
+					// The cell is free, claim it.
+					if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						break;
+					}
+				} else if (diff < 0) {
+					return false;  // full
+				} else {
+					pos = enqueue_pos_.load(std::memory_order_relaxed);  // another producer claimed it
+				}
+			}
+			cell->data = value;
+			cell->sequence.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		/// Remove the oldest element. Returns false if the ring is empty (or the oldest
+		/// element is still being written by its producer).
+		bool pop(T& value)
+		{
+			Cell& cell = cells_[dequeue_pos_ & (capacity_ - 1)];
+			const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			if (std::intptr_t(sequence) - std::intptr_t(dequeue_pos_ + 1) < 0) {
+				return false;
+			}
+			value = cell.data;
+			cell.sequence.store(dequeue_pos_ + capacity_, std::memory_order_release);
+			++dequeue_pos_;
+			return true;
+		}
+
+		/// Get the capacity
+		[[nodiscard]] std::size_t getCapacity() const
+		{
+			return capacity_;
+		}
+
+
+	private:
+
+		/// Ring cell
+		struct Cell {
+			std::atomic<std::size_t> sequence = {0};  ///< Cell state: pos if free, pos + 1 if written
+			T data = {};  ///< Element
+		};
+
+		const std::size_t capacity_;  ///< Power of two
+		std::unique_ptr<Cell[]> cells_;  ///< Cells
+		alignas(lockfree_ring_cache_line_size) std::atomic<std::size_t> enqueue_pos_ = {0};  ///< Next write position (producers)
+		alignas(lockfree_ring_cache_line_size) std::size_t dequeue_pos_ = 0;  ///< Next read position (consumer)
+
+};
+
+
+
+/// Bounded lock-free queue (SpscRing or MpscRing) that notifies the consumer when it
+/// becomes non-empty, once per drain. Full queues drop the new elements and count them.
+template<typename T>
+class NotifyingRing {
+	public:
+
+		/// Called by a producer when the queue becomes non-empty. It must be thread-safe
+		/// and cheap, e.g. a queued QMetaObject::invokeMethod() call to the consumer.
+		using DataAvailableFunc = std::function<void()>;
+
+
+		/// Constructor. The capacity is rounded up to a power of two. If \c multi_producer
+		/// is false, push() may only be called from one thread at a time.
+		NotifyingRing(std::size_t capacity, bool multi_producer)
+		{
+			if (multi_producer) {
+				mpsc_ring_ = std::make_unique<MpscRing<T>>(capacity);
+			} else {
+				spsc_ring_ = std::make_unique<SpscRing<T>>(capacity);
+			}
+		}
+
+		/// Non-copyable
+		NotifyingRing(const NotifyingRing& other) = delete;
+
+		/// Non-copyable
+		NotifyingRing& operator=(const NotifyingRing& other) = delete;
+
+
+		/// Set the data-available callback. Set it before the producers start.
+		void setDataAvailableCallback(DataAvailableFunc callback)
+		{
+			data_available_callback_ = std::move(callback);
+		}
+
+
+		/// Producer function. Add an element.
+		/// \return false if the queue was full and the element was dropped.
+		bool push(const T& value)
+		{
+			const bool pushed = spsc_ring_ ? spsc_ring_->push(value) : mpsc_ring_->push(value);
+			if (!pushed) {
+				dropped_count_.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+
+			// Notify once per drain, not once per element.
+			notify();
+			return true;
+		}
+
+
+		/// Consumer function. Move up to \c max_count elements into \c values.
+		/// \return the number of elements drained.
+		int drain(T* values, int max_count)
+		{
+			beginDrain();
+
+			int count = 0;
+			while (count < max_count && pop(values[count])) {
+				++count;
+			}
+			if (count == max_count) {
+				notify();  // stopped at the limit, elements may still be queued
+			}
+			return count;
+		}
+
+		/// Consumer function. Append up to \c max_count elements (all of them if \c max_count is 0)
+		/// to \c container with push_back().
+		/// \return the number of elements drained.
+		template<typename Container>
+		int drainInto(Container& container, int max_count = 0)
+		{
+			beginDrain();
+
+			int count = 0;
+			T value;
+			while ((max_count <= 0 || count < max_count) && pop(value)) {
+				container.push_back(value);
+				++count;
+			}
+			if (max_count > 0 && count == max_count) {
+				notify();  // stopped at the limit, elements may still be queued
+			}
+			return count;
+		}
+
+
+		/// Get the number of elements dropped due to a full queue
+		[[nodiscard]] std::uint64_t getDroppedCount() const
+		{
+			return dropped_count_.load(std::memory_order_relaxed);
+		}
+
+		/// Get the capacity
+		[[nodiscard]] std::size_t getCapacity() const
+		{
+			return spsc_ring_ ? spsc_ring_->getCapacity() : mpsc_ring_->getCapacity();
+		}
+
+
+	private:
+
+		/// Call the data-available callback unless a notification is already pending
+		void notify()
+		{
+			if (data_available_callback_ && !notify_pending_.exchange(true, std::memory_order_acq_rel)) {
+				data_available_callback_();
+			}
+		}
+
+		/// Clear the pending notification before popping, so that an element pushed during
+		/// the drain triggers a new one. The read-modify-write keeps the following pop loads
+		/// from being reordered before the clear (a plain store would allow a lost wakeup).
+		void beginDrain()
+		{
+			notify_pending_.exchange(false, std::memory_order_acq_rel);
+		}
+
+		/// Remove the oldest element from whichever ring is used
+		bool pop(T& value)
+		{
+			return spsc_ring_ ? spsc_ring_->pop(value) : mpsc_ring_->pop(value);
+		}
+
+
+		std::unique_ptr<SpscRing<T>> spsc_ring_;  ///< Ring for a single producer
+		std::unique_ptr<MpscRing<T>> mpsc_ring_;  ///< Ring for multiple producers
+
+		std::atomic<std::uint64_t> dropped_count_ = {0};  ///< Number of dropped elements
+		std::atomic<bool> notify_pending_ = {false};  ///< True after the data-available callback, until the next drain
+		DataAvailableFunc data_available_callback_;  ///< Data-available callback
+
+};
+
+
+
+
+#endif
@@ -0,0 +1,415 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <QDeadlineTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaMethod>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <linux/serial.h>
+
+#include "linux_serial_transport.h"
+
+
+namespace qtcc {
+
+
+
+LinuxSerialTransport::~LinuxSerialTransport()
+{
+	close();
+}
+
+
+
+bool LinuxSerialTransport::open(const QString& port_name, qint32 baud_rate, QString& error_msg)
+{
+	close();
+
+	// QSerialPort accepts "ttyUSB0" as well, so do we.
+	port_name_ = port_name;
+	const QString device = port_name.startsWith(QLatin1Char('/')) ? port_name : (QStringLiteral("/dev/") + port_name);
+
+	settings_description_.clear();
+
+	fd_ = ::open(QFile::encodeName(device).constData(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd_ == -1) {
+		setErrorFromErrno(tr("open"));
+		error_msg = tr("Can't open port %1: %2").arg(port_name).arg(error_string_);
+		return false;
+	}
+
+	// Don't let other processes open the port while we use it.
+	if (::ioctl(fd_, TIOCEXCL) == -1) {
+		setErrorFromErrno(tr("TIOCEXCL"));
+		error_msg = tr("Can't lock port %1: %2").arg(port_name).arg(error_string_);
+		close();
+		return false;
+	}
+
+	if (!configureLine(baud_rate, error_msg)) {
+		close();
+		return false;
+	}
+
+	enableLowLatency(device);
+
+	epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = fd_;
+	if (epoll_fd_ == -1 || ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd_, &event) == -1) {
+		setErrorFromErrno(tr("epoll"));
+		error_msg = tr("Can't set up polling on port %1: %2").arg(port_name).arg(error_string_);
+		close();
+		return false;
+	}
+
+	read_notifier_.reset(new QSocketNotifier(fd_, QSocketNotifier::Read));
+	connect(read_notifier_.data(), &QSocketNotifier::activated, this, &LinuxSerialTransport::onReadActivated);
+
+	write_notifier_.reset(new QSocketNotifier(fd_, QSocketNotifier::Write));
+	write_notifier_->setEnabled(false);  // enabled while there is pending output
+	connect(write_notifier_.data(), &QSocketNotifier::activated, this, &LinuxSerialTransport::onWriteActivated);
+
+	return true;
+}
+
+
+
+void LinuxSerialTransport::close()
+{
+	read_notifier_.reset();
+	write_notifier_.reset();
+
+	if (epoll_fd_ != -1) {
+		::close(epoll_fd_);
+		epoll_fd_ = -1;
+	}
+	if (fd_ != -1) {
+		::close(fd_);
+		fd_ = -1;
+	}
+	output_size_ = 0;
+}
+
+
+
+bool LinuxSerialTransport::isOpen() const
+{
+	return fd_ != -1;
+}
+
+
+
+QString LinuxSerialTransport::getPortName() const
+{
+	return port_name_;
+}
+
+
+
+QString LinuxSerialTransport::getErrorString() const
+{
+	return error_string_;
+}
+
+
+
+QString LinuxSerialTransport::getSettingsDescription() const
+{
+	return settings_description_.join(QStringLiteral(", "));
+}
+
+
+
+qint64 LinuxSerialTransport::write(const char* data, qint64 size)
+{
+	if (fd_ == -1) {
+		error_string_ = tr("Port is not open");
+		return -1;
+	}
+
+	const int accepted = int(std::min<qint64>(size, output_capacity - output_size_));
+	std::copy_n(data, accepted, output_.data() + output_size_);
+	output_size_ += accepted;
+
+	// Written (and bytesWritten() emitted) from the event loop, as with QSerialPort.
+	if (accepted > 0) {
+		write_notifier_->setEnabled(true);
+	}
+	return accepted;
+}
+
+
+
+qint64 LinuxSerialTransport::bytesToWrite() const
+{
+	return output_size_;
+}
+
+
+
+bool LinuxSerialTransport::waitForBytesWritten(int msecs)
+{
+	QDeadlineTimer deadline(msecs);
+	while (output_size_ > 0) {
+		if (!waitForEvents(EPOLLOUT, int(deadline.remainingTime())) || !flushOutput()) {
+			return false;
+		}
+	}
+	write_notifier_->setEnabled(false);
+	return true;
+}
+
+
+
+bool LinuxSerialTransport::waitForReadyRead(int msecs)
+{
+	return waitForEvents(EPOLLIN, msecs);
+}
+
+
+
+qint64 LinuxSerialTransport::read(char* data, qint64 max_size)
+{
+	if (fd_ == -1) {
+		error_string_ = tr("Port is not open");
+		return -1;
+	}
+	while (true) {
+		const ssize_t read_size = ::read(fd_, data, std::size_t(max_size));
+		if (read_size >= 0) {
+			return read_size;
+		}
+		if (errno == EINTR) {
+			continue;
+		}
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return 0;
+		}
+		setErrorFromErrno(tr("read"));
+		return -1;
+	}
+}
+
+
+
+void LinuxSerialTransport::clearInput()
+{
+	if (fd_ != -1) {
+		::tcflush(fd_, TCIFLUSH);
+	}
+}
+
+
+
+bool LinuxSerialTransport::setBaudRate(qint32 baud_rate, QString& error_msg)
+{
+	if (fd_ == -1) {
+		error_msg = tr("Can't set baud rate %1: port is not open").arg(baud_rate);
+		return false;
+	}
+
+	const speed_t speed = getSpeedConstant(baud_rate);
+	termios tio = {};
+	if (speed == B0 || ::tcgetattr(fd_, &tio) == -1) {
+		error_msg = tr("Can't set baud rate %1 on port %2").arg(baud_rate).arg(port_name_);
+		return false;
+	}
+
+	// TCSADRAIN lets the pending output (e.g. the switch command itself) go out at the old rate.
+	if (::cfsetispeed(&tio, speed) == -1 || ::cfsetospeed(&tio, speed) == -1
+			|| ::tcsetattr(fd_, TCSADRAIN, &tio) == -1) {
+		setErrorFromErrno(tr("tcsetattr"));
+		error_msg = tr("Can't set baud rate %1 on port %2: %3").arg(baud_rate).arg(port_name_).arg(error_string_);
+		return false;
+	}
+	return true;
+}
+
+
+
+bool LinuxSerialTransport::configureLine(qint32 baud_rate, QString& error_msg)
+{
+	const speed_t speed = getSpeedConstant(baud_rate);
+	if (speed == B0) {
+		error_msg = tr("Unsupported baud rate %1 on port %2").arg(baud_rate).arg(port_name_);
+		return false;
+	}
+
+	termios tio = {};
+	if (::tcgetattr(fd_, &tio) == -1) {
+		setErrorFromErrno(tr("tcgetattr"));
+		error_msg = tr("Can't get settings of port %1: %2").arg(port_name_).arg(error_string_);
+		return false;
+	}
+
+	::cfmakeraw(&tio);
+	tio.c_cflag |= (CLOCAL | CREAD);
+	tio.c_cflag &= ~tcflag_t(CSIZE | PARENB | CSTOPB | CRTSCTS);
+	tio.c_cflag |= CS8;  // 8 data bits, no parity, 1 stop bit
+	tio.c_iflag &= ~tcflag_t(IXON | IXOFF | IXANY);  // no software flow control
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 0;
+
+	// cctalk uses 9600 by default, but can use 115200 over usb
+	if (::cfsetispeed(&tio, speed) == -1 || ::cfsetospeed(&tio, speed) == -1
+			|| ::tcsetattr(fd_, TCSANOW, &tio) == -1) {
+		setErrorFromErrno(tr("tcsetattr"));
+		error_msg = tr("Can't set %1 8N1 on port %2: %3").arg(baud_rate).arg(port_name_).arg(error_string_);
+		return false;
+	}
+
+	::tcflush(fd_, TCIOFLUSH);
+	return true;
+}
+
+
+
+speed_t LinuxSerialTransport::getSpeedConstant(qint32 baud_rate)
+{
+	switch (baud_rate) {
+		case 4800: return B4800;
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+		default: return B0;
+	}
+}
+
+
+
+void LinuxSerialTransport::enableLowLatency(const QString& device)
+{
+	serial_struct serial = {};
+	if (::ioctl(fd_, TIOCGSERIAL, &serial) == 0) {
+		serial.flags |= ASYNC_LOW_LATENCY;
+		if (::ioctl(fd_, TIOCSSERIAL, &serial) == 0) {
+			settings_description_ << tr("low latency mode");
+		}
+	}
+
+	// FTDI adapters buffer the received data for up to latency_timer milliseconds (16 by default).
+	// Resolve symlinks like /dev/serial/by-id/... to get the tty name.
+	const QString tty_name = QFileInfo(QFileInfo(device).canonicalFilePath()).fileName();
+	QFile latency_file(QStringLiteral("/sys/bus/usb-serial/devices/%1/latency_timer").arg(tty_name));
+	if (!tty_name.isEmpty() && latency_file.exists() && latency_file.open(QIODevice::WriteOnly)) {
+		if (latency_file.write("1") == 1) {
+			settings_description_ << tr("USB latency timer 1ms");
+		}
+	}
+}
+
+
+
+bool LinuxSerialTransport::waitForEvents(quint32 events, int msecs)
+{
+	if (fd_ == -1) {
+		error_string_ = tr("Port is not open");
+		return false;
+	}
+
+	epoll_event event = {};
+	event.events = events;
+	event.data.fd = fd_;
+	if (::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd_, &event) == -1) {
+		setErrorFromErrno(tr("epoll_ctl"));
+		return false;
+	}
+
+	QDeadlineTimer deadline(msecs);  // negative means forever
+	while (true) {
+		epoll_event ready_event = {};
+		const int ready = ::epoll_wait(epoll_fd_, &ready_event, 1, int(deadline.remainingTime()));
+		if (ready > 0) {
+			if (ready_event.events & (EPOLLERR | EPOLLHUP)) {
+				error_string_ = tr("Device disconnected or I/O error");
+				return false;
+			}
+			return true;
+		}
+		if (ready == 0) {
+			error_string_ = tr("Timed out");
+			return false;
+		}
+		if (errno != EINTR) {
+			setErrorFromErrno(tr("epoll_wait"));
+			return false;
+		}
+	}
+}
+
+
+
+bool LinuxSerialTransport::flushOutput()
+{
+	while (output_size_ > 0) {
+		const ssize_t written = ::write(fd_, output_.data(), std::size_t(output_size_));
+		if (written > 0) {
+			std::copy(output_.data() + written, output_.data() + output_size_, output_.data());
+			output_size_ -= int(written);
+			emit bytesWritten(written);
+			continue;
+		}
+		if (written == -1 && errno == EINTR) {
+			continue;
+		}
+		if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return true;  // try again when writable
+		}
+		setErrorFromErrno(tr("write"));
+		return false;
+	}
+	return true;
+}
+
+
+
+void LinuxSerialTransport::onReadActivated()
+{
+	// Nobody reads data in blocking mode outside the waits; the pending data would
+	// keep activating the notifier. Anything arriving between requests is stale anyway.
+	if (!isSignalConnected(QMetaMethod::fromSignal(&SerialTransport::readyRead))) {
+		clearInput();
+		return;
+	}
+	emit readyRead();
+}
+
+
+
+void LinuxSerialTransport::onWriteActivated()
+{
+	if (!flushOutput()) {
+		output_size_ = 0;  // the write timeout will be reported by the worker
+	}
+	if (output_size_ == 0 && write_notifier_) {
+		write_notifier_->setEnabled(false);
+	}
+}
+
+
+
+void LinuxSerialTransport::setErrorFromErrno(const QString& operation)
+{
+	const int error_code = errno;
+	error_string_ = QStringLiteral("%1: %2").arg(operation, QString::fromLocal8Bit(std::strerror(error_code)));
+}
+
+
+
+}
@@ -0,0 +1,125 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef LINUX_SERIAL_TRANSPORT_H
+#define LINUX_SERIAL_TRANSPORT_H
+
+#include <QSocketNotifier>
+#include <QScopedPointer>
+#include <QStringList>
+#include <array>
+#include <termios.h>
+
+#include "serial_transport.h"
+
+
+namespace qtcc {
+
+
+
+/// Linux-native serial transport: the tty is configured with termios, and the blocking
+/// waits use epoll. To minimize the reply latency of USB serial adapters, ASYNC_LOW_LATENCY
+/// is set on the tty, and the FTDI latency timer (16ms by default) is set to 1ms through
+/// sysfs when available. These are best-effort (they may require permissions); see
+/// getSettingsDescription() for what was actually applied.
+class LinuxSerialTransport : public SerialTransport {
+	Q_OBJECT
+	public:
+
+		/// Destructor
+		~LinuxSerialTransport() override;
+
+		// Reimplemented
+		bool open(const QString& port_name, qint32 baud_rate, QString& error_msg) override;
+
+		// Reimplemented
+		bool setBaudRate(qint32 baud_rate, QString& error_msg) override;
+
+		// Reimplemented
+		void close() override;
+
+		// Reimplemented
+		[[nodiscard]] bool isOpen() const override;
+
+		// Reimplemented
+		[[nodiscard]] QString getPortName() const override;
+
+		// Reimplemented
+		[[nodiscard]] QString getErrorString() const override;
+
+		// Reimplemented
+		[[nodiscard]] QString getSettingsDescription() const override;
+
+		// Reimplemented
+		qint64 write(const char* data, qint64 size) override;
+
+		// Reimplemented
+		[[nodiscard]] qint64 bytesToWrite() const override;
+
+		// Reimplemented
+		bool waitForBytesWritten(int msecs) override;
+
+		// Reimplemented
+		bool waitForReadyRead(int msecs) override;
+
+		// Reimplemented
+		qint64 read(char* data, qint64 max_size) override;
+
+		// Reimplemented
+		void clearInput() override;
+
+
+	private:
+
+		/// Set the ccTalk line settings (8N1, raw mode, no flow control) and the line speed
+		bool configureLine(qint32 baud_rate, QString& error_msg);
+
+		/// Get the termios speed constant for a baud rate. Returns B0 if unsupported.
+		[[nodiscard]] static speed_t getSpeedConstant(qint32 baud_rate);
+
+		/// Enable ASYNC_LOW_LATENCY and lower the USB adapter latency timer, if possible
+		void enableLowLatency(const QString& device);
+
+		/// Wait for \c events (EPOLLIN / EPOLLOUT) on the tty for at most \c msecs.
+		/// Returns false on timeout or error.
+		bool waitForEvents(quint32 events, int msecs);
+
+		/// Write as much of the pending output as the tty accepts without blocking.
+		/// Returns false on error.
+		bool flushOutput();
+
+		/// Handle read notifier activation
+		void onReadActivated();
+
+		/// Handle write notifier activation
+		void onWriteActivated();
+
+		/// Set error_string_ from errno
+		void setErrorFromErrno(const QString& operation);
+
+
+		/// Output buffer capacity. Much larger than any ccTalk frame.
+		static constexpr int output_capacity = 1024;
+
+		int fd_ = -1;  ///< tty file descriptor
+		int epoll_fd_ = -1;  ///< epoll instance for blocking waits
+		QString port_name_;  ///< Port device, as given to open()
+		QString error_string_;  ///< Last error
+		QStringList settings_description_;  ///< Applied transport-specific settings
+
+		std::array<char, output_capacity> output_;  ///< Pending output. Only the first output_size_ bytes are valid.
+		int output_size_ = 0;  ///< Number of pending output bytes
+
+		QScopedPointer<QSocketNotifier> read_notifier_;  ///< Emits readyRead() in event-driven mode
+		QScopedPointer<QSocketNotifier> write_notifier_;  ///< Flushes the pending output in event-driven mode
+
+};
+
+
+
+}
+
+
+#endif
@@ -0,0 +1,146 @@
+/**************************************************************************
+Copyright: (C) 2014 - 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include "qt_serial_transport.h"
+
+
+namespace qtcc {
+
+
+
+QtSerialTransport::QtSerialTransport()
+{
+	serial_port_.setParent(this);  // follow us to other threads
+
+	connect(&serial_port_, &QSerialPort::readyRead, this, &SerialTransport::readyRead);
+	connect(&serial_port_, &QSerialPort::bytesWritten, this, &SerialTransport::bytesWritten);
+}
+
+
+
+bool QtSerialTransport::open(const QString& port_name, qint32 baud_rate, QString& error_msg)
+{
+	serial_port_.setPortName(port_name);
+
+	if (!serial_port_.open(QIODevice::ReadWrite)) {
+		error_msg = tr("Can't open port %1: %2").arg(serial_port_.portName()).arg(serial_port_.errorString());
+		return false;
+	}
+
+	// cctalk uses 9600 by default, but can use 115200 over usb
+	if (!setBaudRate(baud_rate, error_msg)) {
+		return false;
+	}
+
+	// TODO Start bits? cctalk wants 1 start bit.
+
+	if (!serial_port_.setDataBits(QSerialPort::Data8)) {
+		error_msg = tr("Can't set 8 data bits on port %1, error code %2").arg(serial_port_.portName()).arg(int(serial_port_.error()));
+		return false;
+	}
+
+	if (!serial_port_.setParity(QSerialPort::NoParity)) {
+		error_msg = tr("Can't set no parity on port %1, error code %2").arg(serial_port_.portName()).arg(int(serial_port_.error()));
+		return false;
+	}
+
+	if (!serial_port_.setStopBits(QSerialPort::OneStop)) {
+		error_msg = tr("Can't set 1 stop bit on port %1, error code %2").arg(serial_port_.portName()).arg(int(serial_port_.error()));
+		return false;
+	}
+
+	if (!serial_port_.setFlowControl(QSerialPort::NoFlowControl)) {
+		error_msg = tr("Can't set no flow control on port %1, error code %2").arg(serial_port_.portName()).arg(int(serial_port_.error()));
+		return false;
+	}
+
+	return true;
+}
+
+
+
+bool QtSerialTransport::setBaudRate(qint32 baud_rate, QString& error_msg)
+{
+	if (!serial_port_.setBaudRate(baud_rate)) {
+		error_msg = tr("Can't set baud rate %1 on port %2, error code %3").arg(baud_rate)
+				.arg(serial_port_.portName()).arg(int(serial_port_.error()));
+		return false;
+	}
+	return true;
+}
+
+
+
+void QtSerialTransport::close()
+{
+	serial_port_.close();
+}
+
+
+
+bool QtSerialTransport::isOpen() const
+{
+	return serial_port_.isOpen();
+}
+
+
+
+QString QtSerialTransport::getPortName() const
+{
+	return serial_port_.portName();
+}
+
+
+
+QString QtSerialTransport::getErrorString() const
+{
+	return serial_port_.errorString();
+}
+
+
+
+qint64 QtSerialTransport::write(const char* data, qint64 size)
+{
+	return serial_port_.write(data, size);
+}
+
+
+
+qint64 QtSerialTransport::bytesToWrite() const
+{
+	return serial_port_.bytesToWrite();
+}
+
+
+
+bool QtSerialTransport::waitForBytesWritten(int msecs)
+{
+	return serial_port_.waitForBytesWritten(msecs);
+}
+
+
+
+bool QtSerialTransport::waitForReadyRead(int msecs)
+{
+	return serial_port_.waitForReadyRead(msecs);
+}
+
+
+
+qint64 QtSerialTransport::read(char* data, qint64 max_size)
+{
+	return serial_port_.read(data, max_size);
+}
+
+
+
+void QtSerialTransport::clearInput()
+{
+	serial_port_.clear(QSerialPort::Input);
+}
+
+
+
+}
@@ -0,0 +1,74 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef QT_SERIAL_TRANSPORT_H
+#define QT_SERIAL_TRANSPORT_H
+
+#include <QSerialPort>
+
+#include "serial_transport.h"
+
+
+namespace qtcc {
+
+
+
+/// QSerialPort-based serial transport
+class QtSerialTransport : public SerialTransport {
+	Q_OBJECT
+	public:
+
+		/// Constructor
+		QtSerialTransport();
+
+		// Reimplemented
+		bool open(const QString& port_name, qint32 baud_rate, QString& error_msg) override;
+
+		// Reimplemented
+		bool setBaudRate(qint32 baud_rate, QString& error_msg) override;
+
+		// Reimplemented
+		void close() override;
+
+		// Reimplemented
+		[[nodiscard]] bool isOpen() const override;
+
+		// Reimplemented
+		[[nodiscard]] QString getPortName() const override;
+
+		// Reimplemented
+		[[nodiscard]] QString getErrorString() const override;
+
+		// Reimplemented
+		qint64 write(const char* data, qint64 size) override;
+
+		// Reimplemented
+		[[nodiscard]] qint64 bytesToWrite() const override;
+
+		// Reimplemented
+		bool waitForBytesWritten(int msecs) override;
+
+		// Reimplemented
+		bool waitForReadyRead(int msecs) override;
+
+		// Reimplemented
+		qint64 read(char* data, qint64 max_size) override;
+
+		// Reimplemented
+		void clearInput() override;
+
+
+	private:
+
+		QSerialPort serial_port_;  ///< Serial port
+
+};
+
+
+
+}
+
+
+#endif
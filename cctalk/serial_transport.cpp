@@ -0,0 +1,56 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include "serial_transport.h"
+#include "qt_serial_transport.h"
+#include "simulator_transport.h"
+#ifdef QTCC_HAVE_LINUX_TRANSPORT
+	#include "linux_serial_transport.h"
+#endif
+
+
+namespace qtcc {
+
+
+
+std::unique_ptr<SerialTransport> SerialTransport::create(SerialTransportKind kind)
+{
+	switch (kind) {
+		case SerialTransportKind::QtSerialPort:
+			break;
+		case SerialTransportKind::LinuxNative:
+#ifdef QTCC_HAVE_LINUX_TRANSPORT
+			return std::make_unique<LinuxSerialTransport>();
+#else
+			break;
+#endif
+		case SerialTransportKind::Simulator:
+			return std::make_unique<SimulatorTransport>();
+	}
+	return std::make_unique<QtSerialTransport>();
+}
+
+
+
+bool SerialTransport::isSupported(SerialTransportKind kind)
+{
+	switch (kind) {
+		case SerialTransportKind::QtSerialPort:
+			return true;
+		case SerialTransportKind::LinuxNative:
+#ifdef QTCC_HAVE_LINUX_TRANSPORT
+			return true;
+#else
+			return false;
+#endif
+		case SerialTransportKind::Simulator:
+			return true;
+	}
+	return false;
+}
+
+
+
+}
@@ -0,0 +1,115 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef SERIAL_TRANSPORT_H
+#define SERIAL_TRANSPORT_H
+
+#include <QObject>
+#include <QString>
+#include <memory>
+
+
+namespace qtcc {
+
+
+/**
+\file
+
+Serial line transport used by SerialWorker. The transport opens the serial device
+with the ccTalk line settings (9600 baud unless negotiated otherwise, 8 data bits, no parity,
+1 stop bit, no flow control)
+and provides both blocking (waitFor...()) and signal-driven (readyRead(), bytesWritten())
+access to it.
+*/
+
+
+
+/// Serial transport implementation
+enum class SerialTransportKind {
+	QtSerialPort,  ///< QSerialPort-based, portable (default)
+	LinuxNative,  ///< Linux termios / epoll, with low-latency USB adapter settings. Linux only.
+	Simulator,  ///< In-process simulated devices, see cctalk_simulator.h. The port name selects a CcSimulator port.
+};
+
+
+
+/// Serial line transport interface.
+/// All functions must be called from the thread the transport lives in.
+class SerialTransport : public QObject {
+	Q_OBJECT
+	public:
+
+		/// Open and configure the port. On error, \c error_msg is set and false is returned.
+		virtual bool open(const QString& port_name, qint32 baud_rate, QString& error_msg) = 0;
+
+		/// Change the line speed of an open port. Pending output is written out first.
+		/// On error, \c error_msg is set and false is returned.
+		virtual bool setBaudRate(qint32 baud_rate, QString& error_msg) = 0;
+
+		/// Close the port
+		virtual void close() = 0;
+
+		/// Check if the port is open
+		[[nodiscard]] virtual bool isOpen() const = 0;
+
+		/// Get the port name (device) the transport was opened with
+		[[nodiscard]] virtual QString getPortName() const = 0;
+
+		/// Get the last error as a displayable string
+		[[nodiscard]] virtual QString getErrorString() const = 0;
+
+		/// Get a displayable description of the transport-specific settings applied when
+		/// opening the port (e.g. latency tweaks). Empty if there is nothing to report.
+		[[nodiscard]] virtual QString getSettingsDescription() const
+		{
+			return QString();
+		}
+
+
+		/// Queue data for writing. Returns the number of bytes accepted, or -1 on error.
+		virtual qint64 write(const char* data, qint64 size) = 0;
+
+		/// Get the number of bytes that are not yet written to the device
+		[[nodiscard]] virtual qint64 bytesToWrite() const = 0;
+
+		/// Block until all data is written or \c msecs have passed. Returns false on timeout or error.
+		virtual bool waitForBytesWritten(int msecs) = 0;
+
+
+		/// Block until new data is available for reading or \c msecs have passed.
+		/// Returns false on timeout or error.
+		virtual bool waitForReadyRead(int msecs) = 0;
+
+		/// Read at most \c max_size available bytes. Returns the number of bytes read, or -1 on error.
+		virtual qint64 read(char* data, qint64 max_size) = 0;
+
+		/// Discard all received, unread data
+		virtual void clearInput() = 0;
+
+
+		/// Create a transport of the specified kind. If the kind is not supported on
+		/// this platform, the QSerialPort transport is created instead.
+		[[nodiscard]] static std::unique_ptr<SerialTransport> create(SerialTransportKind kind);
+
+		/// Check if the transport kind is supported on this platform
+		[[nodiscard]] static bool isSupported(SerialTransportKind kind);
+
+
+	signals:
+
+		/// Emitted when new data is available for reading
+		void readyRead();
+
+		/// Emitted when a chunk of data has been written to the device
+		void bytesWritten(qint64 bytes);
+
+};
+
+
+
+}
+
+
+#endif
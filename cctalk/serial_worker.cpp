@@ -3,6 +3,11 @@ Copyright: (C) 2014 - 2021 Alexander Shaduri
 License: BSD-3-Clause
 ***************************************************************************/
 
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <algorithm>
+#include <utility>
+
 #include "serial_worker.h"
 
 
@@ -10,15 +15,30 @@ namespace qtcc {
 
 
 
-SerialWorker::SerialWorker()
+SerialWorker::SerialWorker(SerialWorkerMode mode, SerialTransportKind transport_kind)
+		: mode_(mode), transport_kind_(transport_kind)
 {
 	connect(this, &SerialWorker::portError, [this](const QString& error_msg) {
-		emit logMessage(tr("! Serial port %1 error: %2").arg(serial_port_ ? serial_port_->portName() : tr("[unknown]")).arg(error_msg));
+		emit logMessage(tr("! Serial port %1 error: %2").arg(transport_ ? transport_->getPortName() : tr("[unknown]")).arg(error_msg));
 	});
 }
 
 
 
+SerialWorkerMode SerialWorker::getMode() const
+{
+	return mode_;
+}
+
+
+
+SerialTransportKind SerialWorker::getTransportKind() const
+{
+	return transport_kind_;
+}
+
+
+
 void SerialWorker::setLoggingOptions(bool show_full_response, bool show_serial_request, bool show_serial_response)
 {
 	show_full_response_ = show_full_response;
@@ -28,54 +48,89 @@ void SerialWorker::setLoggingOptions(bool show_full_response, bool show_serial_r
 
 
 
-void SerialWorker::openPort(const QString& port_name)
+void SerialWorker::enqueueRequest(SerialWorkerRequest request)
 {
-	if (!serial_port_) {
-		serial_port_.reset(new QSerialPort());
+	bool schedule = false;
+	{
+		QMutexLocker locker(&queue_mutex_);
+		queue_lanes_.at(std::size_t(request.priority)).enqueue(std::move(request));
+		schedule = !queue_processing_scheduled_;
+		queue_processing_scheduled_ = true;
 	}
 
-	if (serial_port_->isOpen()) {
-		closePort();
+	if (schedule) {
+		// Start processing in the worker thread. This is queued after any previously
+		// emitted openPort() / closePort() calls, so their order is preserved.
+		QMetaObject::invokeMethod(this, [this]() { processQueue(); }, Qt::QueuedConnection);
 	}
+}
 
-	serial_port_->setPortName(port_name);
 
-	emit logMessage(tr("* Opening port \"%1\".").arg(port_name));
 
-	if (!serial_port_->open(QIODevice::ReadWrite)) {
-		emit portError(tr("Can't open port %1: %2").arg(serial_port_->portName()).arg(serial_port_->errorString()));
-		return;
+QVector<quint64> SerialWorker::clearQueue()
+{
+	QVector<quint64> request_ids;
+	QMutexLocker locker(&queue_mutex_);
+	for (auto& lane : queue_lanes_) {
+		for (const SerialWorkerRequest& request : lane) {
+			if (request.request_id != 0) {  // not a line speed change
+				request_ids << request.request_id;
+			}
+		}
+		lane.clear();
 	}
+	return request_ids;
+}
 
-	// cctalk uses 9600 by default, but can use 115200 over usb
-	if (!serial_port_->setBaudRate(QSerialPort::Baud9600)) {
-		emit portError(tr("Can't set baud rate on port %1, error code %2").arg(serial_port_->portName()).arg(int(serial_port_->error())));
-		return;
-	}
 
-	// TODO Start bits? cctalk wants 1 start bit.
 
-	if (!serial_port_->setDataBits(QSerialPort::Data8)) {
-		emit portError(tr("Can't set 8 data bits on port %1, error code %2").arg(serial_port_->portName()).arg(int(serial_port_->error())));
-		return;
+int SerialWorker::getQueueSize() const
+{
+	QMutexLocker locker(&queue_mutex_);
+	int size = 0;
+	for (const auto& lane : queue_lanes_) {
+		size += lane.size();
 	}
+	return size;
+}
 
-	if (!serial_port_->setParity(QSerialPort::NoParity)) {
-		emit portError(tr("Can't set no parity on port %1, error code %2").arg(serial_port_->portName()).arg(int(serial_port_->error())));
-		return;
+
+
+void SerialWorker::openPort(const QString& port_name, qint32 baud_rate)
+{
+	if (!transport_) {
+		transport_.reset(SerialTransport::create(transport_kind_).release());
+
+		if (mode_ == SerialWorkerMode::Async) {
+			connect(transport_.data(), &SerialTransport::bytesWritten, this, &SerialWorker::onAsyncBytesWritten);
+			connect(transport_.data(), &SerialTransport::readyRead, this, &SerialWorker::onAsyncReadyRead);
+
+			deadline_timer_.reset(new QTimer());
+			deadline_timer_->setSingleShot(true);
+			deadline_timer_->setTimerType(Qt::PreciseTimer);
+			connect(deadline_timer_.data(), &QTimer::timeout, this, &SerialWorker::onAsyncDeadline);
+		}
 	}
 
-	if (!serial_port_->setStopBits(QSerialPort::OneStop)) {
-		emit portError(tr("Can't set 1 stop bit on port %1, error code %2").arg(serial_port_->portName()).arg(int(serial_port_->error())));
-		return;
+	if (transport_->isOpen()) {
+		closePort();
 	}
+	capture_port_id_ = -1;  // registered with the new name on first use
+
+	emit logMessage(tr("* Opening port \"%1\" at %2 baud.").arg(port_name).arg(baud_rate));
 
-	if (!serial_port_->setFlowControl(QSerialPort::NoFlowControl)) {
-		emit portError(tr("Can't set no flow control on port %1, error code %2").arg(serial_port_->portName()).arg(int(serial_port_->error())));
+	QString error_msg;
+	if (!transport_->open(port_name, baud_rate, error_msg)) {
+		emit portError(error_msg);
 		return;
 	}
 
-	emit logMessage(tr("* Port \"%1\" opened.").arg(port_name));
+	const QString settings_description = transport_->getSettingsDescription();
+	if (settings_description.isEmpty()) {
+		emit logMessage(tr("* Port \"%1\" opened.").arg(port_name));
+	} else {
+		emit logMessage(tr("* Port \"%1\" opened (%2).").arg(port_name).arg(settings_description));
+	}
 
 	emit portOpen();
 }
@@ -84,72 +139,516 @@ void SerialWorker::openPort(const QString& port_name)
 
 void SerialWorker::closePort()
 {
-	if (serial_port_) {
-		emit logMessage(tr("* Port \"%1\" closed.").arg(serial_port_->portName()));
-		serial_port_->close();
+	// Abandon the request in flight. Its owner is not interested in it anymore
+	// (the port is only closed when there are no more users).
+	if (async_stage_ != AsyncStage::Idle) {
+		deadline_timer_->stop();
+		async_stage_ = AsyncStage::Idle;
+	}
+
+	if (transport_) {
+		emit logMessage(tr("* Port \"%1\" closed.").arg(transport_->getPortName()));
+		transport_->close();
+	}
+}
+
+
+
+void SerialWorker::processQueue()
+{
+	// Send the next request as soon as the previous one completes. New requests
+	// (possibly with a higher priority) may arrive from the controller thread meanwhile;
+	// they are picked up on the next iteration.
+	while (true) {
+		SerialWorkerRequest request;
+		{
+			QMutexLocker locker(&queue_mutex_);
+			// In asynchronous mode, the processing continues when the active request finishes.
+			const bool busy = (async_stage_ != AsyncStage::Idle);
+			auto lane = std::find_if(queue_lanes_.begin(), queue_lanes_.end(),
+					[](const QQueue<SerialWorkerRequest>& l) { return !l.isEmpty(); });
+			if (busy || lane == queue_lanes_.end()) {
+				queue_processing_scheduled_ = false;
+				return;
+			}
+			request = lane->dequeue();
+		}
+
+		if (request.baud_rate > 0) {
+			changeBaudRate(request.baud_rate);
+		} else if (mode_ == SerialWorkerMode::Async) {
+			// If it failed immediately, continue with the next one.
+			startAsyncRequest(std::move(request));
+		} else {
+			sendRequest(request);
+		}
+	}
+}
+
+
+
+void SerialWorker::readResponseFrame(CcByteView echo, int response_timeout_msec)
+{
+	// We only wait for the inter-byte timeout if the frame is incomplete (malformed
+	// or truncated), since the header tells us exactly how many bytes to expect.
+
+	QElapsedTimer response_timer;
+	response_timer.start();
+
+	frame_assembler_.reset(echo);
+	frame_assembler_.readFrom(*transport_);
+	recordReplyProgress();
+
+	while (!frame_assembler_.isComplete()) {
+		int timeout_msec = inter_byte_timeout_msec;
+		// The local echo arrives right away; the device may take longer to start replying.
+		if (!frame_assembler_.hasReplyData()) {
+			timeout_msec = std::max(int(response_timeout_msec - response_timer.elapsed()), inter_byte_timeout_msec);
+		}
+		if (!transport_->waitForReadyRead(timeout_msec)) {
+			break;  // the controller will report the size error
+		}
+		frame_assembler_.readFrom(*transport_);
+		recordReplyProgress();
 	}
 }
 
 
 
-void SerialWorker::sendRequest(quint64 request_id, const QByteArray& request_data,
-		bool request_needs_response, int write_timeout_msec, int response_timeout_msec)
+void SerialWorker::sendRequest(const SerialWorkerRequest& request)
 {
+	const quint64 request_id = request.request_id;
+	const CcFrame& request_frame = request.request_frame;
+	const int write_timeout_msec = request.write_timeout_msec;
+	const int response_timeout_msec = request.response_timeout_msec;
+
 	// Keep in mind:
 	// At 9600 baud, each byte transmitted or received takes 1.042ms.
 
 	if (show_serial_request_) {
-		emit logMessage(QObject::tr("> Request: %2").arg(QString::fromLatin1(request_data.toHex())));
-	}
-
-	// NOTE Retrying is implemented on ccTalk level, no need to do it here.
-
-// 	int left_retries = request_max_retries_;
-
-	// Write request
-// 	while (left_retries--) {
-		serial_port_->write(request_data);
-
-		if (serial_port_->waitForBytesWritten(write_timeout_msec)) {
-			emit requestWritten(request_id);
-
-			if (request_needs_response) {
-				// Read response
-				if (serial_port_->waitForReadyRead(response_timeout_msec)) {  // first read
-					QByteArray response_data = serial_port_->readAll();
-					while (serial_port_->waitForReadyRead(50)) {  // subsequent data chunks. ccTalk recommends using 50ms.
-						response_data += serial_port_->readAll();
-					}
-					if (response_contains_request_) {
-						if (show_full_response_) {
-							emit logMessage(QObject::tr("< Full response: %1").arg(QString::fromLatin1(response_data.toHex())));
-						}
-						response_data = response_data.right(response_data.size() - request_data.size());
-					}
-					if (show_serial_response_) {
-						emit logMessage(QObject::tr("< Response: %1").arg(QString::fromLatin1(response_data.toHex())));
-					}
-					emit responseReceived(request_id, response_data);
-					return;  // all done
-
-// 				} else if (left_retries > 0) {
-// 					emit logMessage(QObject::tr("> Retrying request #%1 (try #%2)").arg(request_id).arg(request_max_retries_ - left_retries));
-// 					emit requestRetry(request_id);
-				} else {
-					emit logMessage(QObject::tr("!< Response #%1 read timeout (%2ms)").arg(request_id).arg(response_timeout_msec));
-					emit responseTimeout(request_id);
-				}
-			} else {
-				return;  // all done, one try only
-			}
-		} else {
+		emit logMessage(QObject::tr("> Request: %2").arg(QString::fromLatin1(request_frame.getBytes().toByteArray().toHex())));
+	}
+
+	// Malformed or missing replies are retransmitted here, without returning to the controller
+	// (see CcRetryPolicy). Only the final result is reported.
+	retry_count_ = 0;
+	timeout_retry_count_ = 0;
+
+	const CcByteView echo = response_contains_request_ ? request_frame.getBytes() : CcByteView();
+
+	for (bool retry = false; ; retry = true) {
+		// Whatever arrived since the previous transaction (e.g. a reply after its timeout)
+		// is not an answer to this request.
+		transport_->clearInput();
+
+		recordRequestStart(request, retry);
+		transport_->write(request_frame.data(), request_frame.size());
+
+		if (!transport_->waitForBytesWritten(write_timeout_msec)) {
+			recordTimeout(true);
 			emit logMessage(QObject::tr("!> Request #%1 write timeout (%2ms)").arg(request_id).arg(write_timeout_msec));
 			emit requestTimeout(request_id);
+			return;
+		}
+
+		recordRequestWritten();
+		emit requestWritten(request_id);
+
+		if (!request.request_needs_response) {
+			return;  // all done, one try only
+		}
+
+		// Read response. Only the local echo arriving means the device didn't answer.
+		frame_assembler_.reset(echo);
+		if (transport_->waitForReadyRead(response_timeout_msec)) {  // first read
+			readResponseFrame(echo, response_timeout_msec);
+		}
+		if (frame_assembler_.hasReplyData()) {
+			captureResponse(request_id);  // including the malformed replies that are retried
+			if (!isReplyValid(request) && consumeRetry(request, false)) {
+				continue;
+			}
+			emitResponse(request_id);
+			return;  // all done
+		}
+
+		recordTimeout(false);
+		if (!consumeRetry(request, true)) {
+			emit logMessage(QObject::tr("!< Response #%1 read timeout (%2ms)").arg(request_id).arg(response_timeout_msec));
+			emit responseTimeout(request_id);
+			return;
+		}
+	}
+}
+
+
+
+void SerialWorker::changeBaudRate(qint32 baud_rate)
+{
+	if (!transport_ || !transport_->isOpen()) {
+		return;  // the next open uses the bus baud rate anyway
+	}
+
+	QString error_msg;
+	if (transport_->setBaudRate(baud_rate, error_msg)) {
+		emit logMessage(tr("* Port \"%1\" switched to %2 baud.").arg(transport_->getPortName()).arg(baud_rate));
+	} else {
+		emit logMessage(tr("! %1").arg(error_msg));
+	}
+
+	// Anything received so far was sent at the old speed.
+	transport_->clearInput();
+}
+
+
+
+void SerialWorker::emitResponse(quint64 request_id)
+{
+	if (frame_assembler_.getDiscardedSize() > 0) {
+		emit logMessage(QObject::tr("!< Discarded %1 stale bytes before response #%2")
+				.arg(frame_assembler_.getDiscardedSize()).arg(request_id));
+	}
+	if (response_contains_request_ && show_full_response_) {
+		emit logMessage(QObject::tr("< Full response: %1")
+				.arg(QString::fromLatin1(frame_assembler_.getData().toByteArray().toHex())));
+	}
+	if (frame_assembler_.isComplete()) {
+		recordResponseComplete();
+	}
+	CcFrame response_frame;
+	{
+		const CcFramingScope framing_scope;
+		response_frame.assign(frame_assembler_.getReplyData());
+	}
+	if (show_serial_response_) {
+		emit logMessage(QObject::tr("< Response: %1").arg(QString::fromLatin1(response_frame.getBytes().toByteArray().toHex())));
+	}
+	emit responseReceived(request_id, response_frame);
+}
+
+
+
+void SerialWorker::captureResponse(quint64 request_id)
+{
+	if (wire_capture_) {
+		CcFrame response_frame;
+		response_frame.assign(frame_assembler_.getReplyData());
+		captureRecord(CcCaptureDirection::Response, request_id, response_frame.getBytes());
+	}
+}
+
+
+
+bool SerialWorker::isReplyValid(const SerialWorkerRequest& request) const
+{
+	const CcFramingScope framing_scope;
+	if (!frame_assembler_.isComplete()) {
+		return false;
+	}
+	CcFrame reply_frame;
+	reply_frame.assign(frame_assembler_.getReplyData());
+	if (!reply_frame.hasValidSize()) {
+		return false;
+	}
+	return !request.retry.verify_frame || request.retry.verify_frame(reply_frame);
+}
+
+
+
+bool SerialWorker::consumeRetry(const SerialWorkerRequest& request, bool timeout)
+{
+	if (retry_count_ >= request.retry.max_retries
+			|| (timeout && timeout_retry_count_ >= request.retry.max_timeout_retries)) {
+		return false;
+	}
+	++retry_count_;
+	if (timeout) {
+		++timeout_retry_count_;
+	}
+	emit logMessage(QObject::tr("!< Response #%1 %2, retrying (%3 of %4)").arg(request.request_id)
+			.arg(timeout ? QObject::tr("read timeout") : QObject::tr("malformed"))
+			.arg(retry_count_).arg(request.retry.max_retries));
+	return true;
+}
+
+
+
+void SerialWorker::setWireCapture(std::shared_ptr<CcWireCapture> capture)
+{
+	wire_capture_ = std::move(capture);
+	capture_port_id_ = -1;
+}
+
+
+
+void SerialWorker::captureRecord(CcCaptureDirection direction, quint64 request_id, CcByteView data)
+{
+	if (!wire_capture_) {
+		return;
+	}
+	if (capture_port_id_ < 0) {
+		capture_port_id_ = int(wire_capture_->registerPort(transport_ ? transport_->getPortName() : QString()));
+	}
+	wire_capture_->record(quint16(capture_port_id_), direction, request_id, data, timing_.capture_flags);
+}
+
+
+
+void SerialWorker::recordRequestStart(const SerialWorkerRequest& request, bool retry)
+{
+	timing_.request_id = request.request_id;
+	timing_.capture_flags = quint8(request.checksum_16bit ? CcCaptureFlag::Checksum16 : CcCaptureFlag::None);
+	captureRecord(CcCaptureDirection::Request, request.request_id, request.request_frame.getBytes());
+
+	timing_.statistics = request.statistics;
+	timing_.rtt_estimator = request.rtt_estimator;
+	if (!timing_.statistics && !timing_.rtt_estimator) {
+		return;
+	}
+	timing_.command = CcHeader(request.request_frame.getHeader());
+	timing_.sample_response_time = !retry;
+	timing_.written_usec = -1;
+	timing_.first_byte_recorded = false;
+	if (timing_.statistics) {
+		if (retry) {
+			timing_.statistics->recordRetry(timing_.command);
+		} else {
+			timing_.statistics->recordRequest(timing_.command);
 		}
-// 	}
+	}
+	timing_.timer.start();
 }
 
 
 
+void SerialWorker::recordRequestWritten()
+{
+	if (!timing_.statistics && !timing_.rtt_estimator) {
+		return;
+	}
+	timing_.written_usec = timing_.timer.nsecsElapsed() / 1000;
+	if (timing_.statistics) {
+		timing_.statistics->recordWriteTime(timing_.command, quint64(timing_.written_usec));
+	}
 }
 
+
+
+void SerialWorker::recordReplyProgress()
+{
+	if ((!timing_.statistics && !timing_.rtt_estimator) || timing_.first_byte_recorded || !frame_assembler_.hasReplyData()) {
+		return;
+	}
+	timing_.first_byte_recorded = true;
+	const qint64 usec = timing_.timer.nsecsElapsed() / 1000;
+	if (timing_.statistics) {
+		timing_.statistics->recordFirstByteTime(timing_.command, quint64(usec));
+	}
+	if (timing_.rtt_estimator && timing_.sample_response_time && timing_.written_usec >= 0) {
+		timing_.rtt_estimator->recordSample(timing_.command, quint64(std::max(usec - timing_.written_usec, qint64(0))));
+	}
+}
+
+
+
+void SerialWorker::recordResponseComplete()
+{
+	if (timing_.statistics) {
+		timing_.statistics->recordRoundTripTime(timing_.command, quint64(timing_.timer.nsecsElapsed() / 1000));
+	}
+}
+
+
+
+void SerialWorker::recordTimeout(bool write_timeout)
+{
+	captureRecord(write_timeout ? CcCaptureDirection::RequestTimeout : CcCaptureDirection::ResponseTimeout, timing_.request_id);
+
+	if (!write_timeout && timing_.rtt_estimator) {
+		timing_.rtt_estimator->recordTimeout(timing_.command);
+	}
+	if (!timing_.statistics) {
+		return;
+	}
+	if (write_timeout) {
+		timing_.statistics->recordWriteTimeout(timing_.command);
+	} else {
+		timing_.statistics->recordResponseTimeout(timing_.command);
+	}
+}
+
+
+
+bool SerialWorker::startAsyncRequest(SerialWorkerRequest request, bool retry)
+{
+	if (show_serial_request_) {
+		emit logMessage(QObject::tr("> Request: %2").arg(QString::fromLatin1(request.request_frame.getBytes().toByteArray().toHex())));
+	}
+
+	if (!retry) {
+		retry_count_ = 0;
+		timeout_retry_count_ = 0;
+	}
+	// Whatever arrived since the previous transaction (e.g. a reply after its timeout)
+	// is not an answer to this request.
+	if (transport_ && transport_->isOpen()) {
+		transport_->clearInput();
+	}
+
+	recordRequestStart(request, retry);
+
+	const CcFrame& frame = request.request_frame;
+	if (!transport_ || !transport_->isOpen() || transport_->write(frame.data(), frame.size()) != frame.size()) {
+		recordTimeout(true);
+		emit logMessage(QObject::tr("!> Request #%1 write timeout (%2ms)").arg(request.request_id).arg(request.write_timeout_msec));
+		emit requestTimeout(request.request_id);
+		return false;
+	}
+
+	async_request_ = std::move(request);
+	async_stage_ = AsyncStage::Writing;
+
+	// The local echo may start arriving before the write is finished.
+	frame_assembler_.reset(response_contains_request_ ? async_request_.request_frame.getBytes() : CcByteView());
+
+	deadline_timer_->start(async_request_.write_timeout_msec);
+	return true;
+}
+
+
+
+bool SerialWorker::retryAsyncRequest(bool timeout)
+{
+	if (!consumeRetry(async_request_, timeout)) {
+		return false;
+	}
+	deadline_timer_->stop();
+	async_stage_ = AsyncStage::Idle;
+
+	// If the resend fails right away, the failure is reported and the queue continues.
+	if (!startAsyncRequest(std::move(async_request_), true)) {
+		finishAsyncRequest();
+	}
+	return true;
+}
+
+
+
+void SerialWorker::finishAsyncRequest()
+{
+	deadline_timer_->stop();
+	async_stage_ = AsyncStage::Idle;
+
+	// Start the next frame right away.
+	{
+		QMutexLocker locker(&queue_mutex_);
+		if (queue_processing_scheduled_) {
+			return;  // already scheduled
+		}
+		queue_processing_scheduled_ = true;
+	}
+	processQueue();
+}
+
+
+
+void SerialWorker::onAsyncBytesWritten()
+{
+	if (async_stage_ != AsyncStage::Writing || transport_->bytesToWrite() > 0) {
+		return;
+	}
+
+	recordRequestWritten();
+	emit requestWritten(async_request_.request_id);
+
+	if (!async_request_.request_needs_response) {
+		finishAsyncRequest();  // all done, one try only
+		return;
+	}
+
+	async_stage_ = AsyncStage::WaitingForResponse;
+	deadline_timer_->start(async_request_.response_timeout_msec);
+	checkAsyncResponse();  // the echo (or even the reply) may be here already
+}
+
+
+
+void SerialWorker::onAsyncReadyRead()
+{
+	if (async_stage_ == AsyncStage::Idle) {
+		// Nobody is waiting for this (e.g. a late reply to a timed out request).
+		transport_->clearInput();
+		return;
+	}
+
+	frame_assembler_.readFrom(*transport_);
+
+	if (async_stage_ != AsyncStage::Writing) {
+		checkAsyncResponse();
+	}
+}
+
+
+
+void SerialWorker::onAsyncDeadline()
+{
+	switch (async_stage_) {
+		case AsyncStage::Idle:
+			break;
+
+		case AsyncStage::Writing:
+			recordTimeout(true);
+			emit logMessage(QObject::tr("!> Request #%1 write timeout (%2ms)")
+					.arg(async_request_.request_id).arg(async_request_.write_timeout_msec));
+			emit requestTimeout(async_request_.request_id);
+			finishAsyncRequest();
+			break;
+
+		case AsyncStage::WaitingForResponse:
+			recordTimeout(false);
+			if (retryAsyncRequest(true)) {
+				break;
+			}
+			emit logMessage(QObject::tr("!< Response #%1 read timeout (%2ms)")
+					.arg(async_request_.request_id).arg(async_request_.response_timeout_msec));
+			emit responseTimeout(async_request_.request_id);
+			finishAsyncRequest();
+			break;
+
+		case AsyncStage::ReadingResponse:
+			// Inter-byte timeout, the frame is incomplete. The controller will report the size error.
+			captureResponse(async_request_.request_id);
+			if (retryAsyncRequest(false)) {
+				break;
+			}
+			emitResponse(async_request_.request_id);
+			finishAsyncRequest();
+			break;
+	}
+}
+
+
+
+void SerialWorker::checkAsyncResponse()
+{
+	recordReplyProgress();
+
+	if (frame_assembler_.isComplete()) {
+		captureResponse(async_request_.request_id);  // including the malformed replies that are retried
+		if (!isReplyValid(async_request_) && retryAsyncRequest(false)) {
+			return;
+		}
+		emitResponse(async_request_.request_id);
+		finishAsyncRequest();
+
+	} else if (frame_assembler_.hasReplyData()) {
+		// The device started replying, expect the rest of it without long pauses.
+		async_stage_ = AsyncStage::ReadingResponse;
+		deadline_timer_->start(inter_byte_timeout_msec);
+	}
+	// Otherwise only (a part of) the echo is here; keep waiting for the response timeout.
+}
+
+
+
+}
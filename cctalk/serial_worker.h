@@ -9,7 +9,21 @@ License: BSD-3-Clause
 #include <QObject>
 #include <QString>
 #include <QByteArray>
-#include <QSerialPort>
+#include <QScopedPointer>
+#include <QTimer>
+#include <QMutex>
+#include <QQueue>
+#include <QVector>
+#include <QElapsedTimer>
+#include <array>
+#include <memory>
+
+#include "cctalk_frame_assembler.h"
+#include "serial_transport.h"
+#include "cctalk_enums.h"
+#include "cctalk_link_statistics.h"
+#include "cctalk_rtt_estimator.h"
+#include "cctalk_wire_capture.h"
 
 
 
@@ -17,33 +31,97 @@ namespace qtcc {
 
 
 
+/// SerialWorker I/O mode
+enum class SerialWorkerMode {
+	/// Each request blocks the worker thread until it's finished (waitForBytesWritten(),
+	/// waitForReadyRead()). This requires one thread per serial port.
+	Blocking,
+
+	/// Requests are driven by SerialTransport::bytesWritten() / readyRead() signals and deadline
+	/// timers. The worker never blocks its thread, so several workers (serial ports) may
+	/// share a single thread.
+	Async,
+};
+
+
+
+/// Retransmission settings of a request (see CcRetryPolicy)
+struct SerialWorkerRetry {
+	int max_retries = 0;  ///< Resend after a malformed reply (size or checksum error) at most this many times
+	int max_timeout_retries = 0;  ///< Of these, resend after a response timeout at most this many times
+	bool (*verify_frame)(const CcFrame& frame) = nullptr;  ///< Reply checksum verification. If null, only the size is verified.
+};
+
+
+
+/// A request waiting in the SerialWorker transmit queue
+struct SerialWorkerRequest {
+	quint64 request_id = 0;  ///< Bus-wide request ID
+	CcFrame request_frame;  ///< Full request frame
+	bool request_needs_response = true;  ///< If false, the request is only written
+	int write_timeout_msec = 0;  ///< Write timeout
+	int response_timeout_msec = 0;  ///< Response timeout
+	CcRequestPriority priority = CcRequestPriority::Normal;  ///< Transmit queue lane
+	qint32 baud_rate = 0;  ///< If non-zero, this is not a frame, but a line speed change, performed in queue order
+	SerialWorkerRetry retry;  ///< Retransmission settings
+	bool checksum_16bit = false;  ///< Checksum mode of the frames, recorded in the wire capture
+	std::shared_ptr<CcLinkStatistics> statistics;  ///< Statistics of the requesting controller. May be null.
+	std::shared_ptr<CcRttEstimator> rtt_estimator;  ///< Response time estimator of the requesting controller. May be null.
+};
+
+
+
 /// Serial port communication handler.
-/// Note that except construction, all of the code is executed in the worker thread.
+/// Note that except construction and the transmit queue functions, all of the code
+/// is executed in the worker thread.
 class SerialWorker : public QObject {
 	Q_OBJECT
 	public:
 
-		/// Constructor
-		SerialWorker();
+		/// Constructor. If \c transport_kind is not supported on this platform,
+		/// QSerialPort is used.
+		explicit SerialWorker(SerialWorkerMode mode = SerialWorkerMode::Blocking,
+				SerialTransportKind transport_kind = SerialTransportKind::QtSerialPort);
+
+		/// Get the I/O mode
+		[[nodiscard]] SerialWorkerMode getMode() const;
+
+		/// Get the requested transport kind
+		[[nodiscard]] SerialTransportKind getTransportKind() const;
 
 		/// Set logging options for logMessage() signal.
 		void setLoggingOptions(bool show_full_response, bool show_serial_request, bool show_serial_response);
 
+		/// Set the binary traffic capture (possibly shared with other workers). Null disables capturing.
+		/// This must be called in the worker thread (see CctalkBus::setWireCapture()).
+		void setWireCapture(std::shared_ptr<CcWireCapture> capture);
+
+
+		/// Add a request to the transmit queue. This may be called from any thread.
+		/// Requests are sent one after another without returning to the caller's event loop,
+		/// highest priority lane first, in FIFO order within each lane.
+		void enqueueRequest(SerialWorkerRequest request);
+
+		/// Drop all the queued (not yet sent) requests. This may be called from any thread.
+		/// No signals are emitted for the dropped requests.
+		/// \return the IDs of the dropped requests.
+		QVector<quint64> clearQueue();
+
+		/// Get the number of queued (not yet sent) requests. This may be called from any thread.
+		[[nodiscard]] int getQueueSize() const;
+
 
 	public slots:
 
 		// NOTE These slots may only be called through queued connections from the controller thread.
 
-		/// Open the serial port (e.g. /dev/ttyUSB0).
+		/// Open the serial port (e.g. /dev/ttyUSB0) at \c baud_rate.
 		/// If the port is already open, it is closed first, then reopened.
-		void openPort(const QString& port_name);
+		void openPort(const QString& port_name, qint32 baud_rate);
 
 		/// Close the serial port.
 		void closePort();
 
-		/// Send request to serial port and listen to response if needed.
-		void sendRequest(quint64 request_id, const QByteArray& request_data,
-				bool request_needs_response, int write_timeout_msec, int response_timeout_msec);
 
 
 	signals:
@@ -59,7 +137,7 @@ class SerialWorker : public QObject {
 		void requestWritten(quint64 request_id);
 
 		/// Emitted whenever response is received
-		void responseReceived(quint64 request_id, const QByteArray& response_data);
+		void responseReceived(quint64 request_id, const qtcc::CcFrame& response_frame);
 
 
 		/// Emitted on request write timeout
@@ -69,10 +147,6 @@ class SerialWorker : public QObject {
 		void responseTimeout(quint64 request_id);
 
 
-		/// Emitted each time the request is retried
-// 		void requestRetry(quint64 request_id);
-
-
 		/// This can be used to log requests and responses.
 		/// All errors and timeouts are sent here as well.
 		void logMessage(const QString& msg);
@@ -80,7 +154,135 @@ class SerialWorker : public QObject {
 
 	private:
 
-		QScopedPointer<QSerialPort> serial_port_;  ///< Serial port
+		/// Stage of the request being processed in asynchronous mode
+		enum class AsyncStage {
+			Idle,  ///< No request in flight
+			Writing,  ///< Waiting for the request to be written
+			WaitingForResponse,  ///< Waiting for the first byte of the reply
+			ReadingResponse,  ///< Reply started, waiting for the rest of the frame
+		};
+
+
+		/// Send all the queued requests, one by one, until the queue is empty.
+		/// In asynchronous mode, this returns as soon as a request is in flight; the
+		/// processing is continued when it finishes.
+		void processQueue();
+
+		/// Send request to serial port and listen to response if needed.
+		void sendRequest(const SerialWorkerRequest& request);
+
+		/// Change the line speed of the open port. Errors are logged; the device is expected
+		/// to verify the new speed (see CctalkDevice baud rate negotiation).
+		void changeBaudRate(qint32 baud_rate);
+
+		/// Emit responseReceived() for the frame in frame_assembler_, removing the echo.
+		void emitResponse(quint64 request_id);
+
+		/// Return true if the reply in frame_assembler_ is complete and its checksum is valid.
+		/// Other errors (e.g. addresses) are left for the controller to report.
+		[[nodiscard]] bool isReplyValid(const SerialWorkerRequest& request) const;
+
+		/// Check the retry budget of \c request after a malformed reply or a response
+		/// timeout (\c timeout true), and if it's not exhausted, count and log the retry.
+		/// \return true if the request should be resent.
+		bool consumeRetry(const SerialWorkerRequest& request, bool timeout);
+
+
+		/// Add a record of the active request to the wire capture, if set
+		void captureRecord(CcCaptureDirection direction, quint64 request_id, CcByteView data = CcByteView());
+
+		/// Capture the reply in frame_assembler_ (without the echo), before deciding whether
+		/// to retry, so that the malformed replies are recorded too
+		void captureResponse(quint64 request_id);
+
+		/// Start timing a request (or its retransmission, if \c retry is true) for
+		/// the link statistics, and capture it
+		void recordRequestStart(const SerialWorkerRequest& request, bool retry = false);
+
+		/// Record the request write time
+		void recordRequestWritten();
+
+		/// Record the time to the first reply byte, if it has just arrived into frame_assembler_.
+		/// The device response time (from the end of writing) is passed to the response time estimator.
+		void recordReplyProgress();
+
+		/// Record the round-trip time of a complete reply
+		void recordResponseComplete();
+
+		/// Record a write (\c write_timeout true) or response timeout
+		void recordTimeout(bool write_timeout);
+
+
+		/// Asynchronous mode: start sending a request (or resending it, if \c retry is true).
+		/// \return false if the request failed immediately (the failure is reported).
+		bool startAsyncRequest(SerialWorkerRequest request, bool retry = false);
+
+		/// Asynchronous mode: resend the active request, if its retry budget allows it.
+		/// \return false if the request is out of retries and should be finished.
+		bool retryAsyncRequest(bool timeout);
+
+		/// Asynchronous mode: finish the current request and continue with the queue.
+		void finishAsyncRequest();
+
+		/// Asynchronous mode: handle SerialTransport::bytesWritten()
+		void onAsyncBytesWritten();
+
+		/// Asynchronous mode: handle SerialTransport::readyRead()
+		void onAsyncReadyRead();
+
+		/// Asynchronous mode: handle the deadline timer
+		void onAsyncDeadline();
+
+		/// Asynchronous mode: check the received data and deliver the frame if it's complete
+		void checkAsyncResponse();
+
+		/// Read the response after the first chunk of it has arrived into frame_assembler_.
+		/// This returns as soon as a complete frame is received, or after an inter-byte timeout
+		/// if the frame is malformed.
+		void readResponseFrame(CcByteView echo, int response_timeout_msec);
+
+
+		/// Timing of the request being processed, for link statistics
+		struct RequestTiming {
+			quint64 request_id = 0;  ///< Request ID
+			quint8 capture_flags = 0;  ///< Wire capture record flags (checksum mode)
+			std::shared_ptr<CcLinkStatistics> statistics;  ///< Statistics to record into. May be null.
+			std::shared_ptr<CcRttEstimator> rtt_estimator;  ///< Response time estimator to record into. May be null.
+			bool sample_response_time = false;  ///< False for retransmissions, whose replies are ambiguous
+			CcHeader command = CcHeader::Reply;  ///< Request header
+			QElapsedTimer timer;  ///< Started before the request is written
+			qint64 written_usec = -1;  ///< Time when the request was written, -1 if not yet
+			bool first_byte_recorded = false;  ///< True if the first reply byte has arrived
+		};
+
+
+		/// ccTalk recommends using 50ms as an inter-byte timeout.
+		static constexpr int inter_byte_timeout_msec = 50;
+
+
+		const SerialWorkerMode mode_;  ///< I/O mode
+		const SerialTransportKind transport_kind_;  ///< Transport to create when opening the port
+
+		QScopedPointer<SerialTransport> transport_;  ///< Serial port
+		CcFrameAssembler frame_assembler_;  ///< Assembles response frames from the incoming data chunks
+
+		QScopedPointer<QTimer> deadline_timer_;  ///< Asynchronous mode: write / response / inter-byte timeout
+		AsyncStage async_stage_ = AsyncStage::Idle;  ///< Asynchronous mode: stage of the active request
+		SerialWorkerRequest async_request_;  ///< Asynchronous mode: the active request
+
+		RequestTiming timing_;  ///< Timing of the active request
+		int retry_count_ = 0;  ///< Retransmissions of the active request
+		int timeout_retry_count_ = 0;  ///< Retransmissions of the active request after response timeouts
+
+		std::shared_ptr<CcWireCapture> wire_capture_;  ///< Traffic capture. May be null.
+		int capture_port_id_ = -1;  ///< Port ID in wire_capture_, -1 if not registered yet
+
+		/// Number of CcRequestPriority values
+		static constexpr int priority_lane_count = int(CcRequestPriority::Background) + 1;
+
+		mutable QMutex queue_mutex_;  ///< Protects the members below
+		std::array<QQueue<SerialWorkerRequest>, priority_lane_count> queue_lanes_;  ///< Transmit queue, one lane per priority
+		bool queue_processing_scheduled_ = false;  ///< True if processQueue() is scheduled or running
 
 		/// If true, the response from serial port comes with request prepended to it (e.g. cctalk), remove it.
 		/// This is due to bi-directional nature of the data line.
@@ -90,8 +292,6 @@ class SerialWorker : public QObject {
 		bool show_serial_request_ = false;
 		bool show_serial_response_ = false;
 
-// 		int request_max_retries_ = 3;  ///< If, while waiting for response, timeout was reached, re-send the request.
-
 };
 
 
@@ -0,0 +1,285 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <QThread>
+#include <algorithm>
+#include <utility>
+
+#include "simulator_transport.h"
+#include "cctalk_frame_assembler.h"
+
+
+namespace qtcc {
+
+
+
+SimulatorTransport::SimulatorTransport()
+{
+	delivery_timer_.setParent(this);  // follow us to other threads
+	delivery_timer_.setSingleShot(true);
+	delivery_timer_.setTimerType(Qt::PreciseTimer);
+	connect(&delivery_timer_, &QTimer::timeout, this, &SimulatorTransport::processDueEvents);
+}
+
+
+
+bool SimulatorTransport::open(const QString& port_name, qint32 baud_rate, QString& error_msg)
+{
+	close();
+
+	port_name_ = port_name;
+	port_ = CcSimulator::findPort(port_name);
+	if (!port_) {
+		error_string_ = tr("No simulated port is registered under this name");
+		error_msg = tr("Can't open port %1: %2").arg(port_name).arg(error_string_);
+		return false;
+	}
+	baud_rate_ = baud_rate;
+	clock_.start();
+	return true;
+}
+
+
+
+bool SimulatorTransport::setBaudRate(qint32 baud_rate, QString& error_msg)
+{
+	if (baud_rate <= 0) {
+		error_msg = tr("Can't set baud rate %1 on port %2").arg(baud_rate).arg(port_name_);
+		return false;
+	}
+	baud_rate_ = baud_rate;
+	return true;
+}
+
+
+
+void SimulatorTransport::close()
+{
+	delivery_timer_.stop();
+	port_.reset();
+	line_events_.clear();
+	line_free_nsec_ = 0;
+	bytes_to_write_ = 0;
+	input_.clear();
+	request_data_.clear();
+}
+
+
+
+bool SimulatorTransport::isOpen() const
+{
+	return bool(port_);
+}
+
+
+
+QString SimulatorTransport::getPortName() const
+{
+	return port_name_;
+}
+
+
+
+QString SimulatorTransport::getErrorString() const
+{
+	return error_string_;
+}
+
+
+
+QString SimulatorTransport::getSettingsDescription() const
+{
+	if (port_ && !port_->getOptions().emulate_line_speed) {
+		return tr("simulated, infinite baud");
+	}
+	return tr("simulated");
+}
+
+
+
+qint64 SimulatorTransport::write(const char* data, qint64 size)
+{
+	if (!port_) {
+		error_string_ = tr("The port is not open");
+		return -1;
+	}
+
+	// The bytes go out one after another; the local echo arrives as they are sent.
+	const qint64 start_nsec = std::max(clock_.nsecsElapsed(), line_free_nsec_);
+	line_free_nsec_ = start_nsec + getTransmitTime(size);
+	bytes_to_write_ += size;
+
+	LineEvent written_event;
+	written_event.due_nsec = line_free_nsec_;
+	written_event.written_size = size;
+	written_event.received = QByteArray(data, int(size));
+	addLineEvent(std::move(written_event));
+
+	// Pass the complete frames to the devices
+	request_data_.append(data, int(size));
+	while (request_data_.size() >= CcFrameAssembler::data_size_offset + 1) {
+		const int frame_size = cc_frame_overhead_size + int(quint8(request_data_.at(CcFrameAssembler::data_size_offset)));
+		if (request_data_.size() < frame_size) {
+			break;
+		}
+		CcFrame request_frame;
+		request_frame.assign(CcByteView(request_data_.constData(), frame_size));
+		request_data_.remove(0, frame_size);
+
+		CcFrame reply_frame;
+		int latency_usec = 0;
+		if (port_->handleRequest(request_frame, baud_rate_, reply_frame, latency_usec)) {
+			LineEvent reply_event;
+			reply_event.due_nsec = line_free_nsec_ + getTransmitTime(reply_frame.size());
+			if (port_->getOptions().emulate_line_speed) {
+				reply_event.due_nsec += qint64(latency_usec) * 1000;
+			}
+			reply_event.received = reply_frame.getBytes().toByteArray();
+			addLineEvent(std::move(reply_event));
+		}
+	}
+
+	scheduleDelivery();
+	return size;
+}
+
+
+
+qint64 SimulatorTransport::bytesToWrite() const
+{
+	return bytes_to_write_;
+}
+
+
+
+bool SimulatorTransport::waitForBytesWritten(int msecs)
+{
+	QElapsedTimer timer;
+	timer.start();
+	while (bytes_to_write_ > 0) {
+		if (!waitForEvent(std::max(0, int(msecs - timer.elapsed())))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+
+bool SimulatorTransport::waitForReadyRead(int msecs)
+{
+	QElapsedTimer timer;
+	timer.start();
+	while (true) {
+		const int available = input_.size();
+		if (!waitForEvent(std::max(0, int(msecs - timer.elapsed())))) {
+			return false;
+		}
+		if (input_.size() > available) {
+			return true;
+		}
+	}
+}
+
+
+
+qint64 SimulatorTransport::read(char* data, qint64 max_size)
+{
+	if (!port_) {
+		return -1;
+	}
+	const int size = int(std::min(qint64(input_.size()), max_size));
+	std::copy_n(input_.constData(), size, data);
+	input_.remove(0, size);
+	return size;
+}
+
+
+
+void SimulatorTransport::clearInput()
+{
+	input_.clear();
+}
+
+
+
+qint64 SimulatorTransport::getTransmitTime(qint64 size) const
+{
+	if (!port_ || !port_->getOptions().emulate_line_speed || baud_rate_ <= 0) {
+		return 0;
+	}
+	// 1 start bit, 8 data bits, 1 stop bit
+	return size * 10 * 1000000000LL / baud_rate_;
+}
+
+
+
+void SimulatorTransport::addLineEvent(LineEvent event)
+{
+	auto iter = std::upper_bound(line_events_.begin(), line_events_.end(), event,
+			[](const LineEvent& a, const LineEvent& b) { return a.due_nsec < b.due_nsec; });
+	line_events_.insert(iter, std::move(event));
+}
+
+
+
+void SimulatorTransport::processDueEvents()
+{
+	const qint64 now_nsec = clock_.nsecsElapsed();
+	qint64 written_size = 0;
+	bool received = false;
+	while (!line_events_.isEmpty() && line_events_.constFirst().due_nsec <= now_nsec) {
+		const LineEvent& event = line_events_.constFirst();
+		written_size += event.written_size;
+		if (!event.received.isEmpty()) {
+			input_.append(event.received);
+			received = true;
+		}
+		line_events_.removeFirst();
+	}
+	bytes_to_write_ -= written_size;
+	scheduleDelivery();
+
+	// The handlers may write the next request right away, so the state must be consistent here.
+	if (written_size > 0) {
+		emit bytesWritten(written_size);
+	}
+	if (received) {
+		emit readyRead();
+	}
+}
+
+
+
+void SimulatorTransport::scheduleDelivery()
+{
+	if (line_events_.isEmpty()) {
+		delivery_timer_.stop();
+		return;
+	}
+	const qint64 delay_nsec = line_events_.constFirst().due_nsec - clock_.nsecsElapsed();
+	delivery_timer_.start(int(std::max(qint64(0), (delay_nsec + 999999) / 1000000)));
+}
+
+
+
+bool SimulatorTransport::waitForEvent(int msecs)
+{
+	const qint64 now_nsec = clock_.nsecsElapsed();
+	if (line_events_.isEmpty() || line_events_.constFirst().due_nsec > now_nsec + qint64(msecs) * 1000000) {
+		QThread::msleep(ulong(msecs));
+		return false;
+	}
+	const qint64 delay_nsec = line_events_.constFirst().due_nsec - now_nsec;
+	if (delay_nsec > 0) {
+		QThread::usleep(ulong((delay_nsec + 999) / 1000));
+	}
+	processDueEvents();
+	return true;
+}
+
+
+
+}
@@ -0,0 +1,121 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef SIMULATOR_TRANSPORT_H
+#define SIMULATOR_TRANSPORT_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QVector>
+#include <memory>
+
+#include "serial_transport.h"
+#include "cctalk_simulator.h"
+
+
+namespace qtcc {
+
+
+
+/// Serial transport talking to the in-process simulated devices (see cctalk_simulator.h).
+/// The port name selects a port registered with CcSimulator::addPort().
+/// The written bytes are echoed back like on a real ccTalk line, followed by the device reply.
+/// Both the blocking and the signal-driven access are supported.
+class SimulatorTransport : public SerialTransport {
+	Q_OBJECT
+	public:
+
+		/// Constructor
+		SimulatorTransport();
+
+		// Reimplemented
+		bool open(const QString& port_name, qint32 baud_rate, QString& error_msg) override;
+
+		// Reimplemented
+		bool setBaudRate(qint32 baud_rate, QString& error_msg) override;
+
+		// Reimplemented
+		void close() override;
+
+		// Reimplemented
+		[[nodiscard]] bool isOpen() const override;
+
+		// Reimplemented
+		[[nodiscard]] QString getPortName() const override;
+
+		// Reimplemented
+		[[nodiscard]] QString getErrorString() const override;
+
+		// Reimplemented
+		[[nodiscard]] QString getSettingsDescription() const override;
+
+		// Reimplemented
+		qint64 write(const char* data, qint64 size) override;
+
+		// Reimplemented
+		[[nodiscard]] qint64 bytesToWrite() const override;
+
+		// Reimplemented
+		bool waitForBytesWritten(int msecs) override;
+
+		// Reimplemented
+		bool waitForReadyRead(int msecs) override;
+
+		// Reimplemented
+		qint64 read(char* data, qint64 max_size) override;
+
+		// Reimplemented
+		void clearInput() override;
+
+
+	private:
+
+		/// Something that happens on the line at a certain time
+		struct LineEvent {
+			qint64 due_nsec = 0;  ///< Time on clock_
+			qint64 written_size = 0;  ///< If non-zero, this many bytes have been written out
+			QByteArray received;  ///< Bytes arriving from the line (echo or reply)
+		};
+
+
+		/// Get the time it takes to transmit \c size bytes
+		[[nodiscard]] qint64 getTransmitTime(qint64 size) const;
+
+		/// Add an event, keeping the events sorted by time
+		void addLineEvent(LineEvent event);
+
+		/// Apply all the due events and emit the signals
+		void processDueEvents();
+
+		/// Start the delivery timer for the earliest event
+		void scheduleDelivery();
+
+		/// Sleep until the earliest event, if it's due within \c msecs.
+		/// \return false if there is no such event (after sleeping \c msecs).
+		bool waitForEvent(int msecs);
+
+
+		std::shared_ptr<CcSimulatedPort> port_;  ///< Simulated port, null if closed
+		QString port_name_;  ///< Port name
+		QString error_string_;  ///< Last error
+		qint32 baud_rate_ = cc_default_baud_rate;  ///< Line speed
+
+		QElapsedTimer clock_;  ///< Started on open()
+		QTimer delivery_timer_;  ///< Fires when the earliest event is due
+		QVector<LineEvent> line_events_;  ///< Pending events, sorted by time
+		qint64 line_free_nsec_ = 0;  ///< Time when the current transmission ends
+		qint64 bytes_to_write_ = 0;  ///< Bytes being transmitted
+		QByteArray input_;  ///< Received, unread data
+		QByteArray request_data_;  ///< Written bytes not forming a complete frame yet
+
+};
+
+
+
+}
+
+
+#endif
@@ -0,0 +1,348 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <iostream>  // cerr
+#include <csignal>
+#include <cerrno>
+
+#include <QtGlobal>
+#include <QDir>
+#include <QFile>
+#include <QTimer>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "daemon_application.h"
+#include "app_common/app_settings.h"
+#include "app_common/cctalk_tools.h"
+#include "cctalk/helpers/debug_qt_bridge.h"
+#include "cctalk/helpers/debug.h"
+
+
+
+namespace {
+
+	/// SIGTERM / SIGINT self-pipe. The handler only writes to it.
+	int s_signal_fds[2] = {-1, -1};
+
+
+	/// Signal handler
+	void handleStopSignal([[maybe_unused]] int signal_number)
+	{
+		const int saved_errno = errno;
+		const char byte = 1;
+		[[maybe_unused]] const ssize_t written = ::write(s_signal_fds[1], &byte, 1);
+		errno = saved_errno;
+	}
+
+}
+
+
+
+DaemonApplication::DaemonApplication(int& par_argc, char**& par_argv)
+		: QCoreApplication(par_argc, par_argv)
+{
+	// Needed for settings
+	QCoreApplication::setOrganizationName(QStringLiteral("Qt-ccTalk"));
+	QCoreApplication::setApplicationName(QStringLiteral("cctalkd"));
+
+	QObject::connect(this, &QCoreApplication::aboutToQuit, this, &DaemonApplication::quitCleanup);
+}
+
+
+
+DaemonApplication::~DaemonApplication() = default;
+
+
+
+int DaemonApplication::run(const QString& socket_path)
+{
+	// Set levels that will abort the program if printing to them.
+	debug_set_abort_on_levels(debug_level::fatal);
+
+	// Set default destinations for specified levels.
+	debug_set_default_dests(debug_level::all, DEBUG_CONSOLE);
+
+	// Output to cerr, to avoid buffering. This ends up in the journal under systemd.
+	debug_set_console_stream(&std::cerr);
+
+	// Set the default application name to send along the message.
+	debug_set_application_name("cctalkd");
+
+	// Use libdebug for Qt's messages.
+	qInstallMessageHandler(debug_qt5_message_handler);
+
+	debug_out_info(DBG_FUNC_MSG << "Daemon starting...");
+	debug_out_dump("Current directory is \"" << QDir::current().path() << "\".");
+
+	// Load application settings. The keys are the same as in the GUI test.
+	AppSettings::init();
+
+	// Optional log file and syslog output, written from a background thread so that
+	// logging doesn't delay the device polling.
+	debug_dest::type dests = DEBUG_CONSOLE;
+	const QString log_file = AppSettings::getValue<QString>(QStringLiteral("cctalkd/log_file"), QString());
+	if (!log_file.isEmpty()) {
+		debug_set_file(debug_level::all, QFile::encodeName(log_file).toStdString());
+		dests |= DEBUG_FILE;
+	}
+	if (AppSettings::getValue<bool>(QStringLiteral("cctalkd/syslog"), false)) {
+		dests |= DEBUG_SYSLOG;
+	}
+	if (dests != debug_dest::type(DEBUG_CONSOLE)) {
+		debug_set_default_dests(debug_level::all, dests);
+		debug_start_async_sink();
+	}
+
+	if (!installSignalHandlers()) {
+		return 1;
+	}
+
+	connect(&event_server_, &EventServer::logMessage, this, &DaemonApplication::logMessage);
+	QString listen_error;
+	const QString path = socket_path.isEmpty()
+			? AppSettings::getValue<QString>(QStringLiteral("cctalkd/socket_path"), QString::fromUtf8(default_socket_path))
+			: socket_path;
+	if (!event_server_.listen(path, listen_error)) {
+		logMessage(listen_error);
+		return 1;
+	}
+
+	accept_credits_ = AppSettings::getValue<bool>(QStringLiteral("cctalkd/accept_credits"), true);
+
+	// Credits are published from the channel in batches, not per device signal.
+	credit_channel_ = std::make_shared<qtcc::CcCreditEventChannel>(1024, qtcc::CcCreditEventChannel::Mode::SingleProducer);
+	credit_channel_->setDataAvailableCallback([this]() {
+		QMetaObject::invokeMethod(this, [this]() {
+			drainCredits();
+		}, Qt::QueuedConnection);
+	});
+
+	// Find the devices on all serial ports, instead of guessing the ports and addresses.
+	if (AppSettings::getValue<bool>(QStringLiteral("cctalk/discover_devices"), false)) {
+		connect(&bus_discovery_, &qtcc::CcBusDiscovery::logMessage, this, &DaemonApplication::logMessage);
+		bus_discovery_.setCacheFile(AppSettings::getUserSettingsDirectory() + QStringLiteral("/bus_discovery.ini"));
+		bus_discovery_.discover(QStringList(), [this](const qtcc::CcBusMap& bus_map) {
+			startDevices(bus_map);
+		});
+	} else {
+		startDevices(qtcc::CcBusMap());
+	}
+
+	// The Main Loop
+	debug_out_info("Entering main loop.");
+
+	int status = QCoreApplication::exec();
+
+	if (status == 0) {  // don't print if it's an error, because the application may be in unstable state
+		debug_out_info("Main loop exited.");
+	}
+
+	return status;
+}
+
+
+
+void DaemonApplication::quitCleanup()
+{
+	// Put all the post-main-loop stuff here.
+	// The devices are destroyed after the event server, don't publish from their destructors.
+	for (qtcc::CctalkDevice* device : qAsConst(devices_)) {
+		device->disconnect(this);
+	}
+	event_server_.close();
+	signal_notifier_.reset();
+
+	// Write the queued log messages
+	debug_stop_async_sink();
+}
+
+
+
+bool DaemonApplication::installSignalHandlers()
+{
+	if (::pipe2(s_signal_fds, O_CLOEXEC | O_NONBLOCK) == -1) {
+		logMessage(tr("! Cannot create the signal pipe."));
+		return false;
+	}
+
+	struct sigaction action = {};
+	action.sa_handler = handleStopSignal;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_RESTART;
+	::sigaction(SIGTERM, &action, nullptr);
+	::sigaction(SIGINT, &action, nullptr);
+
+	signal_notifier_ = std::make_unique<QSocketNotifier>(s_signal_fds[0], QSocketNotifier::Read);
+	connect(signal_notifier_.get(), &QSocketNotifier::activated, this, [this]() {
+		char buffer[16];
+		while (::read(s_signal_fds[0], buffer, sizeof(buffer)) > 0) {
+			// discard
+		}
+		requestStop();
+	});
+	return true;
+}
+
+
+
+void DaemonApplication::startDevices(const qtcc::CcBusMap& discovered_buses)
+{
+	if (stopping_) {
+		return;
+	}
+
+	qtcc::BillValidatorDevice* bill_validator = nullptr;
+	if (AppSettings::getValue<bool>(QStringLiteral("cctalkd/bill_validator"), true)) {
+		bill_validator = &bill_validator_;
+		devices_.append(bill_validator);
+	}
+	qtcc::CoinAcceptorDevice* coin_acceptor = nullptr;
+	if (AppSettings::getValue<bool>(QStringLiteral("cctalkd/coin_acceptor"), true)) {
+		coin_acceptor = &coin_acceptor_;
+		devices_.append(coin_acceptor);
+	}
+
+	// The devices may log from their own (worker) thread.
+	QString setup_error = setUpCctalkDevices(bill_validator, coin_acceptor, [this](QString message) {
+		QMetaObject::invokeMethod(this, [this, message]() {
+			logMessage(message);
+		});
+	}, discovered_buses);
+	if (!setup_error.isEmpty()) {
+		logMessage(setup_error);
+		exitLater(1);  // let systemd restart us
+		return;
+	}
+
+	for (qtcc::CctalkDevice* device : qAsConst(devices_)) {
+		const qtcc::CcCategory category = (device == &bill_validator_ ? qtcc::CcCategory::BillValidator : qtcc::CcCategory::CoinAcceptor);
+		device->setCreditEventChannel(credit_channel_);
+
+		connect(device, &qtcc::CctalkDevice::deviceStateChanged, this,
+				[this, device, category](qtcc::CcDeviceState old_state, qtcc::CcDeviceState new_state) {
+			event_server_.publishDeviceState(category, device->getLinkController().getDeviceAddress(), old_state, new_state);
+
+			// Start accepting once initialized, but don't override a later switch to rejecting.
+			if (accept_credits_ && !stopping_ && new_state == qtcc::CcDeviceState::NormalRejecting
+					&& old_state != qtcc::CcDeviceState::NormalAccepting) {
+				device->requestSwitchDeviceState(qtcc::CcDeviceState::NormalAccepting, []([[maybe_unused]] const QString& error_msg) {
+					// nothing
+				});
+			}
+		});
+
+		connect(device, &qtcc::CctalkDevice::creditsPossiblyLost, this, [this, device, category](const qtcc::CcLostCreditsRecord& record) {
+			event_server_.publishCreditsLost(category, device->getLinkController().getDeviceAddress(), record);
+		});
+
+		startDevice(device);
+	}
+}
+
+
+
+void DaemonApplication::startDevice(qtcc::CctalkDevice* device)
+{
+	device->getLinkController().openPort([this, device](const QString& error_msg) {
+		if (!error_msg.isEmpty()) {
+			logMessage(error_msg);
+			exitLater(1);  // let systemd restart us
+			return;
+		}
+		device->initialize([]([[maybe_unused]] const QString& init_error_msg) { });
+	});
+}
+
+
+
+void DaemonApplication::drainCredits()
+{
+	const QVector<qtcc::CcCreditEvent> events = credit_channel_->drain();
+	for (const auto& event : events) {
+		event_server_.publishCredit(event);
+	}
+
+	const quint64 dropped_count = credit_channel_->getDroppedCount();
+	if (dropped_count != dropped_credit_count_) {
+		logMessage(tr("! %1 credit events dropped by the full credit event channel.").arg(dropped_count - dropped_credit_count_));
+		dropped_credit_count_ = dropped_count;
+	}
+}
+
+
+
+void DaemonApplication::requestStop()
+{
+	if (stopping_) {
+		return;
+	}
+	stopping_ = true;
+	logMessage(tr("* Stopping..."));
+
+	// Publish what's already there
+	drainCredits();
+
+	QVector<qtcc::CctalkDevice*> running_devices;
+	for (qtcc::CctalkDevice* device : qAsConst(devices_)) {
+		if (device->getDeviceState() != qtcc::CcDeviceState::ShutDown) {
+			running_devices.append(device);
+		} else {
+			device->getLinkController().closePort();
+		}
+	}
+	if (running_devices.isEmpty()) {
+		QCoreApplication::exit(0);
+		return;
+	}
+
+	// Exit after all the devices have been shut down (inhibited), or after a timeout.
+	auto remaining = std::make_shared<int>(running_devices.size());
+	for (qtcc::CctalkDevice* device : qAsConst(running_devices)) {
+		const bool sent = device->shutdown([device, remaining]([[maybe_unused]] const QString& error_msg) {
+			device->getLinkController().closePort();
+			if (--(*remaining) == 0) {
+				QCoreApplication::exit(0);
+			}
+		});
+		if (!sent) {
+			device->getLinkController().closePort();
+			if (--(*remaining) == 0) {
+				QCoreApplication::exit(0);
+			}
+		}
+	}
+	QTimer::singleShot(shutdown_timeout_msec, this, [this]() {
+		logMessage(tr("! Timed out waiting for the devices to shut down."));
+		QCoreApplication::exit(0);
+	});
+}
+
+
+
+void DaemonApplication::exitLater(int status)
+{
+	// exit() does nothing if the main loop hasn't been entered yet
+	QMetaObject::invokeMethod(this, [status]() {
+		QCoreApplication::exit(status);
+	}, Qt::QueuedConnection);
+}
+
+
+
+void DaemonApplication::logMessage(QString msg)
+{
+	msg = ccProcessLoggingMessage(msg, false);
+	if (msg.isEmpty()) {
+		return;
+	}
+	// This is the daemon's log, don't let DEBUG_MIN_LEVEL compile it out.
+	debug_send_to_stream(msg.startsWith(QStringLiteral("!")) ? debug_level::warn : debug_level::info, msg.toStdString());
+}
+
+
+
+
@@ -0,0 +1,95 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef DAEMON_APPLICATION_H
+#define DAEMON_APPLICATION_H
+
+#include <QCoreApplication>
+#include <QSocketNotifier>
+#include <QVector>
+#include <memory>
+
+#include "cctalk/bill_validator_device.h"
+#include "cctalk/coin_acceptor_device.h"
+#include "cctalk/cctalk_bus_discovery.h"
+#include "cctalk/cctalk_credit_event_channel.h"
+#include "event_server.h"
+
+
+
+/// Headless application owning the ccTalk devices and publishing their events
+/// on a Unix domain socket (see event_server.h). Stops on SIGTERM / SIGINT.
+class DaemonApplication : public QCoreApplication {
+	Q_OBJECT
+	public:
+
+		/// Default event socket, in the systemd RuntimeDirectory
+		static constexpr const char* default_socket_path = "/run/cctalkd/cctalkd.sock";
+
+		/// Maximum time to wait for the devices to shut down before exiting
+		static constexpr int shutdown_timeout_msec = 3000;
+
+
+		/// Constructor. The arguments are the same as in QCoreApplication::QCoreApplication().
+		/// Construct only ONCE.
+		DaemonApplication(int& par_argc, char**& par_argv);
+
+		/// Destructor
+		~DaemonApplication() override;
+
+		/// Initialize everything and run the main loop. \c socket_path overrides the
+		/// cctalkd/socket_path setting if not empty.
+		/// \return exit status.
+		int run(const QString& socket_path);
+
+
+	protected slots:
+
+		/// Slot. This is called whenever the main loop exits.
+		void quitCleanup();
+
+
+	private:
+
+		/// Route SIGTERM and SIGINT to requestStop() through a self-pipe
+		bool installSignalHandlers();
+
+		/// Set up the devices (once the bus discovery, if any, has finished) and start them
+		void startDevices(const qtcc::CcBusMap& discovered_buses);
+
+		/// Open the port of the device and initialize it
+		void startDevice(qtcc::CctalkDevice* device);
+
+		/// Publish all the credits queued in the credit event channel
+		void drainCredits();
+
+		/// Shut down the devices, close their ports and exit the main loop
+		void requestStop();
+
+		/// Exit the main loop with \c status, once it's running
+		void exitLater(int status);
+
+		/// Log a message from the devices or the event server
+		void logMessage(QString msg);
+
+
+		qtcc::BillValidatorDevice bill_validator_;  ///< Bill validator
+		qtcc::CoinAcceptorDevice coin_acceptor_;  ///< Coin acceptor
+		qtcc::CcBusDiscovery bus_discovery_;  ///< Finds the devices if cctalk/discover_devices is set
+		QVector<qtcc::CctalkDevice*> devices_;  ///< Enabled devices
+
+		std::shared_ptr<qtcc::CcCreditEventChannel> credit_channel_;  ///< Credits of both devices
+		quint64 dropped_credit_count_ = 0;  ///< Dropped credits already reported
+
+		EventServer event_server_;  ///< Event socket
+		std::unique_ptr<QSocketNotifier> signal_notifier_;  ///< Self-pipe notifier
+		bool accept_credits_ = true;  ///< Switch the devices to accepting mode once initialized
+		bool stopping_ = false;  ///< True after requestStop()
+
+};
+
+
+
+#endif
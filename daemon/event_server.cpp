@@ -0,0 +1,333 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <QDateTime>
+#include <QFile>
+#include <QtEndian>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "event_server.h"
+#include "cctalk/helpers/debug.h"
+
+
+
+namespace {
+
+	/// Append a little-endian integer
+	template<typename T>
+	void appendLittleEndian(QByteArray& out, T value)
+	{
+		const T le_value = qToLittleEndian(value);
+		out.append(reinterpret_cast<const char*>(&le_value), int(sizeof(T)));
+	}
+
+
+	/// Get the current errno as a string
+	QString getErrnoString()
+	{
+		return QString::fromLocal8Bit(std::strerror(errno));
+	}
+
+}
+
+
+
+EventServer::EventServer() = default;
+
+
+
+EventServer::~EventServer()
+{
+	close();
+}
+
+
+
+bool EventServer::listen(const QString& socket_path, QString& error_msg)
+{
+	close();
+
+	const QByteArray path = QFile::encodeName(socket_path);
+	sockaddr_un address = {};
+	if (path.isEmpty() || std::size_t(path.size()) >= sizeof(address.sun_path)) {
+		error_msg = tr("! Invalid event socket path \"%1\".").arg(socket_path);
+		return false;
+	}
+	address.sun_family = AF_UNIX;
+	std::memcpy(address.sun_path, path.constData(), std::size_t(path.size()));
+
+	listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listen_fd_ == -1) {
+		error_msg = tr("! Cannot create the event socket: %1").arg(getErrnoString());
+		return false;
+	}
+
+	// A socket left by a previous instance would make bind() fail. Don't remove anything else.
+	struct stat file_info = {};
+	if (::lstat(path.constData(), &file_info) == 0 && S_ISSOCK(file_info.st_mode)) {
+		::unlink(path.constData());
+	}
+
+	if (::bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == -1
+			|| ::listen(listen_fd_, SOMAXCONN) == -1) {
+		error_msg = tr("! Cannot listen on event socket %1: %2").arg(socket_path).arg(getErrnoString());
+		::close(listen_fd_);
+		listen_fd_ = -1;
+		return false;
+	}
+	socket_path_ = socket_path;
+
+	accept_notifier_ = std::make_unique<QSocketNotifier>(listen_fd_, QSocketNotifier::Read);
+	connect(accept_notifier_.get(), &QSocketNotifier::activated, this, &EventServer::onAcceptActivated);
+
+	emit logMessage(tr("* Publishing events on %1").arg(socket_path));
+	return true;
+}
+
+
+
+void EventServer::close()
+{
+	// Not called from the client notifiers, so they can be deleted right away.
+	for (auto& client : clients_) {
+		client->read_notifier.reset();
+		client->write_notifier.reset();
+		::close(client->fd);
+	}
+	clients_.clear();
+
+	accept_notifier_.reset();
+	if (listen_fd_ != -1) {
+		::close(listen_fd_);
+		listen_fd_ = -1;
+		::unlink(QFile::encodeName(socket_path_).constData());
+	}
+	socket_path_.clear();
+}
+
+
+
+int EventServer::getClientCount() const
+{
+	return int(clients_.size());
+}
+
+
+
+void EventServer::publishCredit(const qtcc::CcCreditEvent& event)
+{
+	QByteArray payload;
+	payload.reserve(30);
+	appendLittleEndian(payload, event.host_sequence);
+	appendLittleEndian(payload, event.timestamp_msec);
+	appendLittleEndian(payload, event.value);
+	appendLittleEndian(payload, event.decimal_places);
+	appendLittleEndian(payload, quint8(event.category));
+	appendLittleEndian(payload, event.device_address);
+	appendLittleEndian(payload, event.device_event_counter);
+	appendLittleEndian(payload, event.position);
+	appendLittleEndian(payload, event.sorter_path);
+	queueMessage(EventMessageType::Credit, payload);
+
+	pending_sequence_ = std::max(pending_sequence_, event.host_sequence);
+}
+
+
+
+void EventServer::publishDeviceState(qtcc::CcCategory category, quint8 address,
+		qtcc::CcDeviceState old_state, qtcc::CcDeviceState new_state)
+{
+	QByteArray payload;
+	payload.reserve(12);
+	appendLittleEndian(payload, QDateTime::currentMSecsSinceEpoch());
+	appendLittleEndian(payload, quint8(category));
+	appendLittleEndian(payload, address);
+	appendLittleEndian(payload, quint8(old_state));
+	appendLittleEndian(payload, quint8(new_state));
+	queueMessage(EventMessageType::DeviceState, payload);
+
+	device_states_[quint16((quint16(category) << 8) | address)] = payload;
+}
+
+
+
+void EventServer::publishCreditsLost(qtcc::CcCategory category, quint8 address, const qtcc::CcLostCreditsRecord& record)
+{
+	QByteArray payload;
+	payload.reserve(12);
+	appendLittleEndian(payload, record.detection_time.toMSecsSinceEpoch());
+	appendLittleEndian(payload, quint8(category));
+	appendLittleEndian(payload, address);
+	appendLittleEndian(payload, quint16(std::clamp(record.lost_event_count, 0, 0xffff)));
+	queueMessage(EventMessageType::CreditsLost, payload);
+}
+
+
+
+void EventServer::onAcceptActivated()
+{
+	for (;;) {
+		const int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				emit logMessage(tr("! Cannot accept an event client: %1").arg(getErrnoString()));
+			}
+			break;
+		}
+
+		auto client = std::make_unique<Client>();
+		Client* client_ptr = client.get();
+		client->fd = fd;
+
+		// The clients don't send anything. Read and discard whatever arrives, and detect disconnects.
+		client->read_notifier = std::make_unique<QSocketNotifier>(fd, QSocketNotifier::Read);
+		connect(client->read_notifier.get(), &QSocketNotifier::activated, this, [this, client_ptr]() {
+			char buffer[256];
+			for (;;) {
+				const ssize_t count = ::recv(client_ptr->fd, buffer, sizeof(buffer), 0);
+				if (count > 0 || (count == -1 && errno == EINTR)) {
+					continue;
+				}
+				if (count == 0) {
+					disconnectClient(client_ptr, tr("closed by client"));
+				} else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+					disconnectClient(client_ptr, getErrnoString());
+				}
+				break;
+			}
+		});
+
+		client->write_notifier = std::make_unique<QSocketNotifier>(fd, QSocketNotifier::Write);
+		client->write_notifier->setEnabled(false);
+		connect(client->write_notifier.get(), &QSocketNotifier::activated, this, [this, client_ptr]() {
+			if (!writeOutput(*client_ptr)) {
+				disconnectClient(client_ptr, tr("write error or too much unread data"));
+			}
+		});
+
+		// Hello, then the current state of each device
+		QByteArray hello;
+		appendLittleEndian(hello, protocol_version);
+		appendLittleEndian(hello, last_sequence_);
+		encodeMessage(client->output, EventMessageType::Hello, hello);
+		for (const QByteArray& state : qAsConst(device_states_)) {
+			encodeMessage(client->output, EventMessageType::DeviceState, state);
+		}
+
+		clients_.push_back(std::move(client));
+		emit logMessage(tr("* Event client connected (%1 connected).").arg(clients_.size()));
+
+		if (!writeOutput(*client_ptr)) {
+			disconnectClient(client_ptr, tr("write error"));
+		}
+	}
+}
+
+
+
+void EventServer::queueMessage(EventMessageType type, const QByteArray& payload)
+{
+	encodeMessage(batch_, type, payload);
+
+	// Everything published until the control returns to the event loop is sent together.
+	if (!flush_scheduled_) {
+		flush_scheduled_ = true;
+		QMetaObject::invokeMethod(this, [this]() { flush(); }, Qt::QueuedConnection);
+	}
+}
+
+
+
+void EventServer::flush()
+{
+	flush_scheduled_ = false;
+	if (batch_.isEmpty()) {
+		return;
+	}
+	last_sequence_ = pending_sequence_;
+
+	std::vector<Client*> failed_clients;
+	for (auto& client : clients_) {
+		client->output.append(batch_);
+		if (!writeOutput(*client)) {
+			failed_clients.push_back(client.get());
+		}
+	}
+	batch_.clear();
+
+	for (Client* client : failed_clients) {
+		disconnectClient(client, tr("write error or too much unread data"));
+	}
+}
+
+
+
+bool EventServer::writeOutput(Client& client)
+{
+	while (!client.output.isEmpty()) {
+		const ssize_t written = ::send(client.fd, client.output.constData(), std::size_t(client.output.size()), MSG_NOSIGNAL);
+		if (written > 0) {
+			client.output.remove(0, int(written));
+			continue;
+		}
+		if (written == -1 && errno == EINTR) {
+			continue;
+		}
+		if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+		return false;
+	}
+
+	// Continue when the socket becomes writable
+	client.write_notifier->setEnabled(!client.output.isEmpty());
+	return client.output.size() <= max_client_backlog;
+}
+
+
+
+void EventServer::disconnectClient(Client* client, const QString& reason)
+{
+	auto iter = std::find_if(clients_.begin(), clients_.end(), [client](const std::unique_ptr<Client>& c) {
+		return c.get() == client;
+	});
+	if (iter == clients_.end()) {
+		return;  // already disconnected
+	}
+	std::unique_ptr<Client> removed = std::move(*iter);
+	clients_.erase(iter);
+
+	// We may be called from one of the client notifiers, delete them later.
+	removed->read_notifier->setEnabled(false);
+	removed->read_notifier.release()->deleteLater();
+	removed->write_notifier->setEnabled(false);
+	removed->write_notifier.release()->deleteLater();
+	::close(removed->fd);
+
+	emit logMessage(tr("* Event client disconnected: %1 (%2 connected).").arg(reason).arg(clients_.size()));
+}
+
+
+
+void EventServer::encodeMessage(QByteArray& out, EventMessageType type, const QByteArray& payload)
+{
+	DBG_ASSERT(payload.size() <= 255);
+	out.append(char(type));
+	out.append(char(quint8(payload.size())));
+	out.append(payload);
+}
+
+
+
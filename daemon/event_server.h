@@ -0,0 +1,153 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#ifndef EVENT_SERVER_H
+#define EVENT_SERVER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QMap>
+#include <QSocketNotifier>
+#include <memory>
+#include <vector>
+
+#include "cctalk/cctalk_enums.h"
+#include "cctalk/cctalk_credit_event_channel.h"
+#include "cctalk/cctalk_device.h"
+
+
+/**
+\file
+
+Unix domain socket publisher of credit and device state events.
+
+Consumers connect to the (stream) socket and only read from it. Each message is
+<tt>[type: 1 byte][payload size: 1 byte][payload]</tt>; multi-byte integers are little-endian,
+categories and states are the numeric values of qtcc::CcCategory and qtcc::CcDeviceState.
+Consumers must skip the messages of unknown types (using the payload size).
+
+- Hello (1): <tt>[protocol version: 1][last host sequence: 8]</tt>. Sent on connect, followed
+  by the current DeviceState of each device.
+- Credit (2): <tt>[host sequence: 8][timestamp msec: 8][value: 8][decimal places: 1][category: 1]
+  [address: 1][device event counter: 1][position: 1][sorter path: 1]</tt>. See qtcc::CcCreditEvent;
+  gaps in the host sequence are credits dropped by the credit event channel.
+- DeviceState (3): <tt>[timestamp msec: 8][category: 1][address: 1][old state: 1][new state: 1]</tt>
+- CreditsLost (4): <tt>[timestamp msec: 8][category: 1][address: 1][lost event count: 2]</tt>.
+  The device event buffer overflowed between two polls, see qtcc::CcLostCreditsRecord.
+
+The messages published during one event loop iteration are written to each client
+with a single send() call. A client that doesn't keep up (more than max_client_backlog
+bytes pending) is disconnected.
+*/
+
+
+
+/// Message type of the event socket protocol
+enum class EventMessageType : quint8 {
+	Hello = 1,
+	Credit = 2,
+	DeviceState = 3,
+	CreditsLost = 4,
+};
+
+
+
+/// Unix domain socket server, publishing the events to all the connected clients.
+class EventServer : public QObject {
+	Q_OBJECT
+	public:
+
+		/// Protocol version sent in the Hello message
+		static constexpr quint8 protocol_version = 1;
+
+		/// Maximum number of unsent bytes of a client before it's disconnected
+		static constexpr int max_client_backlog = 256 * 1024;
+
+
+		/// Constructor
+		EventServer();
+
+		/// Destructor. Closes the socket.
+		~EventServer() override;
+
+
+		/// Start listening on \c socket_path, replacing a stale socket file.
+		/// \return false on error, with \c error_msg set.
+		bool listen(const QString& socket_path, QString& error_msg);
+
+		/// Disconnect all clients, stop listening and remove the socket file
+		void close();
+
+		/// Get the number of connected clients
+		[[nodiscard]] int getClientCount() const;
+
+
+		/// Publish an accepted credit
+		void publishCredit(const qtcc::CcCreditEvent& event);
+
+		/// Publish a device state change. The last state of each device is also sent
+		/// to the clients connecting later.
+		void publishDeviceState(qtcc::CcCategory category, quint8 address,
+				qtcc::CcDeviceState old_state, qtcc::CcDeviceState new_state);
+
+		/// Publish an event buffer overflow
+		void publishCreditsLost(qtcc::CcCategory category, quint8 address, const qtcc::CcLostCreditsRecord& record);
+
+
+	signals:
+
+		/// Emitted on client connects and disconnects, and on errors
+		void logMessage(const QString& msg);
+
+
+	private:
+
+		/// Connected client
+		struct Client {
+			int fd = -1;  ///< Socket
+			QByteArray output;  ///< Data not written yet
+			std::unique_ptr<QSocketNotifier> read_notifier;  ///< Detects disconnects
+			std::unique_ptr<QSocketNotifier> write_notifier;  ///< Enabled while there is unsent output
+		};
+
+
+		/// Accept the pending connections
+		void onAcceptActivated();
+
+		/// Append a message to the current batch and schedule its sending
+		void queueMessage(EventMessageType type, const QByteArray& payload);
+
+		/// Send the current batch to all clients
+		void flush();
+
+		/// Write as much of the client output as possible.
+		/// \return false if the client has to be disconnected.
+		bool writeOutput(Client& client);
+
+		/// Disconnect a client (the object is deleted later)
+		void disconnectClient(Client* client, const QString& reason);
+
+		/// Append the encoded message to \c out
+		static void encodeMessage(QByteArray& out, EventMessageType type, const QByteArray& payload);
+
+
+		QString socket_path_;  ///< Socket file
+		int listen_fd_ = -1;  ///< Listening socket
+		std::unique_ptr<QSocketNotifier> accept_notifier_;  ///< Listening socket notifier
+		std::vector<std::unique_ptr<Client>> clients_;  ///< Connected clients
+
+		QByteArray batch_;  ///< Messages published since the last flush
+		bool flush_scheduled_ = false;  ///< True if flush() is queued
+
+		quint64 pending_sequence_ = 0;  ///< Highest host sequence in the batch or before it
+		quint64 last_sequence_ = 0;  ///< Highest flushed host sequence, sent in the Hello message
+		QMap<quint16, QByteArray> device_states_;  ///< (category, address) -> last DeviceState payload
+
+};
+
+
+
+#endif
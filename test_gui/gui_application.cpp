@@ -15,7 +15,7 @@ License: BSD-3-Clause
 
 #include "gui_application.h"
 #include "main_window.h"
-#include "app_settings.h"
+#include "app_common/app_settings.h"
 #include "cctalk/helpers/debug_qt_bridge.h"
 #include "cctalk/helpers/debug.h"
 
@@ -12,11 +12,11 @@ License: BSD-3-Clause
 #include <cmath>
 
 #include "cctalk/helpers/debug.h"
-#include "app_settings.h"
+#include "app_common/app_settings.h"
 #include "main_window.h"
 #include "ui_main_window.h"
 #include "gui_application.h"
-#include "cctalk_tools.h"
+#include "app_common/cctalk_tools.h"
 
 
 
@@ -66,6 +66,17 @@ MainWindow::MainWindow()
 MainWindow::~MainWindow()
 {
 	debug_out_dump("MainWindow deleting...");
+
+	// Bring the devices back before they are deleted with us.
+	if (device_thread_.isRunning()) {
+		QThread* gui_thread = thread();
+		QMetaObject::invokeMethod(&bill_validator_, [this, gui_thread]() {
+			bill_validator_.moveToDeviceThread(gui_thread);
+			coin_acceptor_.moveToDeviceThread(gui_thread);
+		}, Qt::BlockingQueuedConnection);
+		device_thread_.quit();
+		device_thread_.wait();
+	}
 }
 
 
@@ -105,19 +116,46 @@ void MainWindow::logMessage(QString msg)
 
 
 void MainWindow::runSerialThreads()
+{
+	// Find the devices on all serial ports, instead of guessing the ports and addresses.
+	if (AppSettings::getValue<bool>(QStringLiteral("cctalk/discover_devices"), false)) {
+		connect(&bus_discovery_, &qtcc::CcBusDiscovery::logMessage, this, &MainWindow::logMessage);
+		bus_discovery_.setCacheFile(AppSettings::getUserSettingsDirectory() + QStringLiteral("/bus_discovery.ini"));
+		bus_discovery_.discover(QStringList(), [this](const qtcc::CcBusMap& bus_map) {
+			startDevices(bus_map);
+		});
+		return;
+	}
+	startDevices(qtcc::CcBusMap());
+}
+
+
+
+void MainWindow::startDevices(const qtcc::CcBusMap& discovered_buses)
 {
 	// Set cctalk options
+	// The devices may log from their own thread.
 	QString setup_error = setUpCctalkDevices(&bill_validator_, &coin_acceptor_, [=](QString message) {
-		logMessage(message);
-	});
+		QMetaObject::invokeMethod(this, [=]() {
+			logMessage(message);
+		});
+	}, discovered_buses);
 	if (!setup_error.isEmpty()) {
 		logMessage(setup_error);
 		return;
 	}
 
+	// Run the device state machines in a dedicated thread, so that GUI stalls don't delay
+	// event polling and bill routing.
+	if (AppSettings::getValue<bool>(QStringLiteral("cctalk/device_thread"), false)) {
+		device_thread_.start(QThread::TimeCriticalPriority);
+		bill_validator_.moveToDeviceThread(&device_thread_);
+		coin_acceptor_.moveToDeviceThread(&device_thread_);
+	}
+
 	// Bill validator
 	{
-		connect(&bill_validator_, &qtcc::CctalkDevice::creditAccepted, [this]([[maybe_unused]] quint8 id, const qtcc::CcIdentifier& identifier) {
+		connect(&bill_validator_, &qtcc::CctalkDevice::creditAccepted, this, [this]([[maybe_unused]] quint8 id, const qtcc::CcIdentifier& identifier) {
 			const char* prop_name = "integral_value";
 
 			quint64 existing_value = ui->entered_bills_lineedit->property(prop_name).toULongLong();
@@ -132,7 +170,7 @@ void MainWindow::runSerialThreads()
 
 	// Coin acceptor
 	{
-		connect(&coin_acceptor_, &qtcc::CctalkDevice::creditAccepted, [this]([[maybe_unused]] quint8 id, const qtcc::CcIdentifier& identifier) {
+		connect(&coin_acceptor_, &qtcc::CctalkDevice::creditAccepted, this, [this]([[maybe_unused]] quint8 id, const qtcc::CcIdentifier& identifier) {
 			const char* prop_name = "integral_value";
 
 			quint64 existing_value = ui->entered_coins_lineedit->property(prop_name).toULongLong();
@@ -150,18 +188,21 @@ void MainWindow::runSerialThreads()
 
 void MainWindow::onStartStopBillValidatorClicked()
 {
-	if (bill_validator_.getDeviceState() == CcDeviceState::ShutDown) {
-		bill_validator_.getLinkController().openPort([this](const QString& error_msg) {
-			if (error_msg.isEmpty()) {
-				bill_validator_.initialize([]([[maybe_unused]] const QString& init_error_msg) { });
-			}
-		});
-	} else {
-		bill_validator_.shutdown([this]([[maybe_unused]] const QString& error_msg) {
-			// Close the port once the device is "shut down"
-			bill_validator_.getLinkController().closePort();
-		});
-	}
+	// The device may live in another thread
+	QMetaObject::invokeMethod(&bill_validator_, [this]() {
+		if (bill_validator_.getDeviceState() == CcDeviceState::ShutDown) {
+			bill_validator_.getLinkController().openPort([this](const QString& error_msg) {
+				if (error_msg.isEmpty()) {
+					bill_validator_.initialize([]([[maybe_unused]] const QString& init_error_msg) { });
+				}
+			});
+		} else {
+			bill_validator_.shutdown([this]([[maybe_unused]] const QString& error_msg) {
+				// Close the port once the device is "shut down"
+				bill_validator_.getLinkController().closePort();
+			});
+		}
+	});
 }
 
 
@@ -172,8 +213,10 @@ void MainWindow::onToggleBillAcceptClicked()
 	bool rejecting = bill_validator_.getDeviceState() == CcDeviceState::NormalRejecting;
 	if (accepting || rejecting) {
 		CcDeviceState new_state = accepting ? CcDeviceState::NormalRejecting : CcDeviceState::NormalAccepting;
-		bill_validator_.requestSwitchDeviceState(new_state, []([[maybe_unused]] const QString& error_msg) {
-			// nothing
+		QMetaObject::invokeMethod(&bill_validator_, [this, new_state]() {
+			bill_validator_.requestSwitchDeviceState(new_state, []([[maybe_unused]] const QString& error_msg) {
+				// nothing
+			});
 		});
 	} else {
 		logMessage(tr("! Cannot toggle bill accept mode, the device is in %1 state.")
@@ -185,18 +228,21 @@ void MainWindow::onToggleBillAcceptClicked()
 
 void MainWindow::onStartStopCoinAcceptorClicked()
 {
-	if (coin_acceptor_.getDeviceState() == CcDeviceState::ShutDown) {
-		coin_acceptor_.getLinkController().openPort([this](const QString& error_msg) {
-			if (error_msg.isEmpty()) {
-				coin_acceptor_.initialize([]([[maybe_unused]] const QString& init_error_msg) { });
-			}
-		});
-	} else {
-		coin_acceptor_.shutdown([this]([[maybe_unused]] const QString& error_msg) {
-			// Close the port once the device is "shut down"
-			coin_acceptor_.getLinkController().closePort();
-		});
-	}
+	// The device may live in another thread
+	QMetaObject::invokeMethod(&coin_acceptor_, [this]() {
+		if (coin_acceptor_.getDeviceState() == CcDeviceState::ShutDown) {
+			coin_acceptor_.getLinkController().openPort([this](const QString& error_msg) {
+				if (error_msg.isEmpty()) {
+					coin_acceptor_.initialize([]([[maybe_unused]] const QString& init_error_msg) { });
+				}
+			});
+		} else {
+			coin_acceptor_.shutdown([this]([[maybe_unused]] const QString& error_msg) {
+				// Close the port once the device is "shut down"
+				coin_acceptor_.getLinkController().closePort();
+			});
+		}
+	});
 }
 
 
@@ -207,8 +253,10 @@ void MainWindow::onToggleCoinAcceptClicked()
 	bool rejecting = coin_acceptor_.getDeviceState() == CcDeviceState::NormalRejecting;
 	if (accepting || rejecting) {
 		CcDeviceState new_state = accepting ? CcDeviceState::NormalRejecting : CcDeviceState::NormalAccepting;
-		coin_acceptor_.requestSwitchDeviceState(new_state, []([[maybe_unused]] const QString& error_msg) {
-			// nothing
+		QMetaObject::invokeMethod(&coin_acceptor_, [this, new_state]() {
+			coin_acceptor_.requestSwitchDeviceState(new_state, []([[maybe_unused]] const QString& error_msg) {
+				// nothing
+			});
 		});
 	} else {
 		logMessage(tr("! Cannot toggle coin accept mode, the device is in %1 state.")
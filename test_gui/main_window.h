@@ -9,9 +9,11 @@ License: BSD-3-Clause
 #include <QMainWindow>
 #include <QCloseEvent>
 #include <QScopedPointer>
+#include <QThread>
 
 #include "cctalk/bill_validator_device.h"
 #include "cctalk/coin_acceptor_device.h"
+#include "cctalk/cctalk_bus_discovery.h"
 
 
 
@@ -46,7 +48,7 @@ class MainWindow : public QMainWindow {
 
 	protected slots:
 
-		/// Launch device-handling threads
+		/// Launch device-handling threads, discovering the devices first if enabled
 		void runSerialThreads();
 
 
@@ -74,11 +76,19 @@ class MainWindow : public QMainWindow {
 
 	private:
 
+		/// Set up and connect the devices, using the devices found by bus discovery (if any)
+		void startDevices(const qtcc::CcBusMap& discovered_buses);
+
+
 		QScopedPointer<Ui::MainWindow> ui;  ///< Designer-created class instance
 
 		qtcc::BillValidatorDevice bill_validator_;  ///< Bill validator communicator (launches separate thread)
 		qtcc::CoinAcceptorDevice coin_acceptor_;  ///< Coin acceptor communicator (launches separate thread)
 
+		qtcc::CcBusDiscovery bus_discovery_;  ///< Startup bus discovery (cctalk/discover_devices setting)
+
+		QThread device_thread_;  ///< Optional thread for the device state machines (cctalk/device_thread setting)
+
 };
 
 
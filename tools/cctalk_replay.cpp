@@ -0,0 +1,271 @@
+/**************************************************************************
+Copyright: (C) 2021 Alexander Shaduri
+License: BSD-3-Clause
+***************************************************************************/
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <cstdio>
+#include <memory>
+
+#include "cctalk/cctalk_bus.h"
+#include "cctalk/cctalk_device.h"
+#include "cctalk/cctalk_link_controller.h"
+#include "cctalk/cctalk_wire_capture.h"
+
+
+/**
+\file
+Capture replay tool: feeds a wire capture (see cctalk_wire_capture.h) back through the
+ccTalk reply parser (CctalkLinkController::onResponseReceive()) and the device event
+processing (CctalkDevice::processCreditEventLog()) at full speed, without a serial port.
+
+The device category and the coin / bill identifiers are taken from the captured
+identification replies, so a capture that includes the device initialization replays
+the credits with their real values. The replies are verified with the checksum mode
+recorded in the capture.
+*/
+
+
+namespace {
+
+
+	/// Maximum time to wait for the device to finish processing an event poll
+	constexpr int max_callback_wait_msec = 5000;
+
+
+	/// Link controller with the reply parser exposed
+	class ReplayLinkController : public qtcc::CctalkLinkController {
+		public:
+			using CctalkLinkController::onResponseReceive;
+	};
+
+
+	/// Device with the event processing exposed
+	class ReplayDevice : public qtcc::CctalkDevice {
+		public:
+			using CctalkDevice::processCreditEventLog;
+			using CctalkDevice::setStoredIdentification;
+
+			qtcc::CcCategory category = qtcc::CcCategory::Unknown;  ///< From GetEquipmentCategory
+			QMap<quint8, qtcc::CcIdentifier> identifiers;  ///< From GetCoinId / GetBillId
+	};
+
+
+	/// A captured request waiting for its reply
+	struct PendingRequest {
+		quint16 port_id = 0;
+		quint8 address = 0;
+		qtcc::CcHeader header = qtcc::CcHeader::Reply;
+		quint8 first_data_byte = 0;
+	};
+
+
+	/// Replay counters
+	struct ReplayCounters {
+		quint64 record_count = 0;
+		quint64 request_count = 0;
+		quint64 response_count = 0;
+		quint64 timeout_count = 0;
+		quint64 structure_error_count = 0;
+		quint64 event_poll_count = 0;
+		quint64 credit_count = 0;
+		quint64 lost_credits_count = 0;
+	};
+
+
+	/// Replay the capture once
+	void replay(qtcc::CcCaptureReader& reader, ReplayCounters& counters)
+	{
+		QHash<int, std::shared_ptr<ReplayLinkController>> controllers;  // (port ID << 1) | checksum_16bit -> parser
+		QHash<int, std::shared_ptr<ReplayDevice>> devices;  // (port ID << 8) | address -> device
+		QHash<quint64, PendingRequest> pending;
+
+		auto get_device = [&](quint16 port_id, quint8 address) {
+			const int key = (int(port_id) << 8) | address;
+			auto device = devices.value(key);
+			if (!device) {
+				device = std::make_shared<ReplayDevice>();
+				// Without an open port, the async worker fails the requests right away.
+				device->getLinkController().setBus(std::make_shared<qtcc::CctalkBus>(qtcc::SerialWorkerMode::Async));
+				device->getLinkController().setLoggingOptions(false, false, false, false, false);
+				QObject::connect(device.get(), &qtcc::CctalkDevice::creditAccepted, [&counters]() {
+					++counters.credit_count;
+				});
+				QObject::connect(device.get(), &qtcc::CctalkDevice::creditsPossiblyLost, [&counters]() {
+					++counters.lost_credits_count;
+				});
+				devices.insert(key, device);
+			}
+			return device;
+		};
+
+		qtcc::CcCaptureRecord record;
+		while (reader.next(record)) {
+			++counters.record_count;
+
+			switch (record.direction) {
+				case qtcc::CcCaptureDirection::PortName:
+					break;
+
+				case qtcc::CcCaptureDirection::Request:
+				{
+					++counters.request_count;
+					qtcc::CcFrame frame;
+					frame.assign(record.data);
+					PendingRequest request;
+					request.port_id = record.port_id;
+					request.address = frame.getDestinationAddress();
+					request.header = qtcc::CcHeader(frame.getHeader());
+					request.first_data_byte = frame.getData().isEmpty() ? 0 : quint8(frame.getData().at(0));
+					pending.insert(record.request_id, request);
+					break;
+				}
+
+				case qtcc::CcCaptureDirection::RequestTimeout:
+				case qtcc::CcCaptureDirection::ResponseTimeout:
+					++counters.timeout_count;
+					pending.remove(record.request_id);
+					break;
+
+				case qtcc::CcCaptureDirection::Response:
+				{
+					++counters.response_count;
+					qtcc::CcFrame frame;
+					frame.assign(record.data);
+
+					// Devices with different checksum modes may share a port.
+					const bool checksum_16bit = (record.flags & quint8(qtcc::CcCaptureFlag::Checksum16)) != 0;
+					const int controller_key = (int(record.port_id) << 1) | int(checksum_16bit);
+					auto controller = controllers.value(controller_key);
+					if (!controller) {
+						controller = std::make_shared<ReplayLinkController>();
+						controller->setCcTalkOptions(QString(), 0, checksum_16bit, false);
+						controller->setLoggingOptions(false, false, false, false, false);
+						QObject::connect(controller.get(), &qtcc::CctalkLinkController::ccResponseMessageStructureError, [&counters]() {
+							++counters.structure_error_count;
+						});
+						controllers.insert(controller_key, controller);
+					}
+					const quint64 structure_errors = counters.structure_error_count;
+					controller->onResponseReceive(record.request_id, frame);
+					if (counters.structure_error_count != structure_errors || !pending.contains(record.request_id)) {
+						pending.remove(record.request_id);
+						break;
+					}
+
+					const PendingRequest request = pending.take(record.request_id);
+					const qtcc::CcByteView data = frame.getData();
+					auto device = get_device(request.port_id, request.address);
+
+					switch (request.header) {
+						case qtcc::CcHeader::GetEquipmentCategory:
+							device->category = qtcc::ccCategoryFromReportedName(QString::fromUtf8(data.data(), data.size()));
+							device->setStoredIdentification(device->category, device->identifiers);
+							break;
+
+						case qtcc::CcHeader::GetCoinId:
+						case qtcc::CcHeader::GetBillId:
+						{
+							const QByteArray id_string(data.data(), data.size());
+							if (!id_string.trimmed().isEmpty() && id_string != "......" && id_string.at(0) != 0) {
+								device->identifiers.insert(request.first_data_byte, qtcc::CcIdentifier(id_string));
+								device->setStoredIdentification(device->category, device->identifiers);
+							}
+							break;
+						}
+
+						case qtcc::CcHeader::ReadBufferedCredit:
+						case qtcc::CcHeader::ReadBufferedBillEvents:
+						{
+							if (data.isEmpty() || data.size() % 2 != 1) {
+								break;  // reported by the device in a real run
+							}
+							if (device->category == qtcc::CcCategory::Unknown) {
+								device->category = (request.header == qtcc::CcHeader::ReadBufferedCredit
+										? qtcc::CcCategory::CoinAcceptor : qtcc::CcCategory::BillValidator);
+								device->setStoredIdentification(device->category, device->identifiers);
+							}
+							QVector<qtcc::CcEventData> event_data;
+							for (int i = 1; (i+1) < data.size(); i += 2) {
+								event_data << qtcc::CcEventData(data.at(i), data.at(i+1), device->category);
+							}
+							++counters.event_poll_count;
+
+							bool finished = false;
+							device->processCreditEventLog(true, QString(), quint8(data.at(0)), event_data, [&finished]() {
+								finished = true;
+							});
+							// Bill routing and state switches send requests, which fail without a port.
+							QElapsedTimer wait_timer;
+							wait_timer.start();
+							while (!finished && !wait_timer.hasExpired(max_callback_wait_msec)) {
+								QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents, 100);
+							}
+							break;
+						}
+
+						default:
+							break;
+					}
+					break;
+				}
+			}
+		}
+	}
+
+
+}
+
+
+
+int main(int argc, char* argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription(QStringLiteral("Replay a ccTalk wire capture through the parser and the device state machine."));
+	parser.addHelpOption();
+	QCommandLineOption repeat_option(QStringLiteral("repeat"), QStringLiteral("Replay the capture <count> times."),
+			QStringLiteral("count"), QStringLiteral("1"));
+	parser.addOption(repeat_option);
+	parser.addPositionalArgument(QStringLiteral("capture"), QStringLiteral("Capture file."));
+	parser.process(app);
+
+	const QStringList args = parser.positionalArguments();
+	if (args.size() != 1) {
+		parser.showHelp(1);
+	}
+	const int repeat_count = std::max(parser.value(repeat_option).toInt(), 1);
+
+	qtcc::CcCaptureReader reader;
+	QString error_msg;
+	if (!reader.open(args.first(), error_msg)) {
+		std::fprintf(stderr, "%s\n", qPrintable(error_msg));
+		return 1;
+	}
+
+	ReplayCounters counters;
+	QElapsedTimer timer;
+	timer.start();
+	for (int i = 0; i < repeat_count; ++i) {
+		reader.rewind();
+		replay(reader, counters);
+	}
+	const double elapsed_sec = double(timer.nsecsElapsed()) / 1e9;
+
+	std::printf("records:          %llu\n", static_cast<unsigned long long>(counters.record_count));
+	std::printf("requests:         %llu\n", static_cast<unsigned long long>(counters.request_count));
+	std::printf("responses:        %llu\n", static_cast<unsigned long long>(counters.response_count));
+	std::printf("timeouts:         %llu\n", static_cast<unsigned long long>(counters.timeout_count));
+	std::printf("structure errors: %llu\n", static_cast<unsigned long long>(counters.structure_error_count));
+	std::printf("event polls:      %llu\n", static_cast<unsigned long long>(counters.event_poll_count));
+	std::printf("credits:          %llu\n", static_cast<unsigned long long>(counters.credit_count));
+	std::printf("lost credits:     %llu\n", static_cast<unsigned long long>(counters.lost_credits_count));
+	std::printf("elapsed:          %.3f s (%.0f records/s)\n", elapsed_sec,
+			elapsed_sec > 0 ? double(counters.record_count) / elapsed_sec : 0.0);
+	return 0;
+}